@@ -13,10 +13,18 @@ import logging
 import struct
 import pandas as pd
 
+# Native decoder from sensor-software/SbemTools, if it has been built and is on
+# PYTHONPATH. It writes the same CSV and releases the GIL while converting.
+try:
+    import sbem_native
+except ImportError:
+    sbem_native = None
+
 
 # --- Global Configuration ---
 VERBOSE_CHUNK_COUNT = 10      # How many chunks to print detailed info for.
 PROGRESS_INTERVAL = 1000      # Print progress message every N chunks.
+NATIVE_MEMORY_LIMIT_MB = 512  # Memory the native converter may use, whatever the log length.
 
 # --- Globals to hold parsed output for one file ---
 descriptor_definitions = []  # Stores descriptor chunk info.
@@ -248,17 +256,34 @@ def convert_sbem(file_path: str, output_dir: str):
     Convert an SBEM file to CSV.
     :param file_path: Path to the input SBEM file.
     :param output_dir: Folder where the converted CSV file will be saved.
+    :return: Path of the CSV file, or None if nothing was written.
     """
     logging.info(f"Converting {file_path} to CSV in {output_dir}")
+    if sbem_native is not None:
+        os.makedirs(output_dir, exist_ok=True)
+        try:
+            csv_filename = sbem_native.convert(file_path, output_dir, memory_limit_mb=NATIVE_MEMORY_LIMIT_MB)
+        except ValueError as e:
+            logging.error("Error converting SBEM file: " + str(e))
+            return None
+        except OSError as e:
+            logging.error("Error saving CSV: " + str(e))
+            return None
+        if csv_filename is None:
+            logging.warning("No data rows parsed from SBEM file.")
+        else:
+            logging.info(f"Saved CSV: {csv_filename}")
+        return csv_filename
+
     rows = processSBEM(file_path)
     if rows is None or len(rows) == 0:
         logging.warning("No data rows parsed from SBEM file.")
-        return
+        return None
     try:
         df = pd.json_normalize(rows)
     except Exception as e:
         logging.error("Error creating DataFrame: " + str(e))
-        return
+        return None
     base_name = os.path.splitext(os.path.basename(file_path))[0]
     os.makedirs(output_dir, exist_ok=True)
     csv_filename = os.path.join(output_dir, base_name + ".csv")
@@ -267,6 +292,8 @@ def convert_sbem(file_path: str, output_dir: str):
         logging.info(f"Saved CSV: {csv_filename}")
     except Exception as e:
         logging.error("Error saving CSV: " + str(e))
+        return None
+    return csv_filename
 
 if __name__ == "__main__":
     import argparse
@@ -0,0 +1,150 @@
+#!/usr/bin/env python3
+"""
+sbemcol.py
+
+Reader for the memory-mappable columnar files (.sbcol) written by the native
+SbemTools converters (`sbem2csv --columnar`). The layout is documented in
+sensor-software/SbemTools/sbem/ColumnarFormat.h.
+
+    rec = load_sbcol("DATA/Converted/PID71_040625_3.sbcol")
+    ecg = rec["ecg.samples"]            # numpy.memmap, float32, 200 Hz
+    rec.info("ecg.samples").sample_rate # 200.0
+
+Arrays are views of the mapped file, so opening a day long recording takes
+milliseconds and only the pages that are touched are read from disk.
+
+Compressed files (.sbcol.zst, `--zstd`) are read through the native module
+(sensor-software/SbemTools, sbem_native on PYTHONPATH): each column is
+decompressed the first time it is asked for, into a read-only array.
+"""
+
+import struct
+from collections import namedtuple
+
+import numpy as np
+
+try:
+    import sbem_native
+except ImportError:
+    sbem_native = None
+
+
+MAGIC = b"SBEMCOL\x00"
+VERSION = 1
+HEADER_FORMAT = "<8sIIQQII24x"        # FileHeader, 64 bytes
+ENTRY_FORMAT = "<48s48sB3xfIIQQ"      # ColumnEntry, 128 bytes
+ZSTD_MAGIC = b"\x28\xb5\x2f\xfd"     # start of every zstd frame
+DTYPES = ["<u1", "<i1", "<u2", "<i2", "<u4", "<i4", "<u8", "<i8", "<f4", "<f8"]
+
+ColumnInfo = namedtuple("ColumnInfo", "name path dtype sample_rate values_per_packet first_timestamp offset count")
+
+
+class SbemColumns:
+    """Columns of one .sbcol file, indexable by name ("ecg.samples", "imu.acc_x", ...)."""
+
+    def __init__(self, file_path):
+        with open(file_path, "rb") as f:
+            compressed = f.read(len(ZSTD_MAGIC)) == ZSTD_MAGIC
+        self._compressed = None
+        self._arrays = {}
+        if compressed:
+            if sbem_native is None or not hasattr(sbem_native, "SeekableFile"):
+                raise ValueError(f"{file_path}: compressed columnar files need the sbem_native module "
+                                 f"(sensor-software/SbemTools built with zstd, on PYTHONPATH)")
+            self._compressed = sbem_native.SeekableFile(file_path)
+
+        header = self._read(file_path, 0, struct.calcsize(HEADER_FORMAT))
+        if len(header) != struct.calcsize(HEADER_FORMAT):
+            raise ValueError(f"{file_path}: too short for a columnar file")
+        magic, version, column_count, _, source_size, chunk_count, flags = struct.unpack(HEADER_FORMAT, header)
+        if magic != MAGIC or version != VERSION:
+            raise ValueError(f"{file_path}: not a version {VERSION} columnar file")
+        directory = self._read(file_path, len(header), column_count * struct.calcsize(ENTRY_FORMAT))
+
+        self.path = file_path
+        self.source_size = source_size
+        self.chunk_count = chunk_count
+        self.truncated = bool(flags & 1)
+        self._columns = {}
+        for name, path, type_id, rate, per_packet, first_ts, offset, count in struct.iter_unpack(ENTRY_FORMAT, directory):
+            info = ColumnInfo(name.rstrip(b"\x00").decode(), path.rstrip(b"\x00").decode(),
+                              np.dtype(DTYPES[type_id]), rate, per_packet, first_ts, offset, count)
+            self._columns[info.name] = info
+
+    def _read(self, file_path, offset, length):
+        """Bytes of the (decompressed) file, fewer at its end."""
+        if self._compressed is not None:
+            length = max(min(length, self._compressed.size() - offset), 0)
+            return self._compressed.read(offset, length)
+        with open(file_path, "rb") as f:
+            f.seek(offset)
+            return f.read(length)
+
+    def names(self):
+        return list(self._columns)
+
+    def info(self, name):
+        return self._columns[name]
+
+    def __contains__(self, name):
+        return name in self._columns
+
+    def __getitem__(self, name):
+        info = self._columns[name]
+        if info.count == 0:
+            return np.empty(0, dtype=info.dtype)
+        if self._compressed is not None:
+            if name not in self._arrays:
+                data = self._compressed.read(info.offset, info.count * info.dtype.itemsize)
+                self._arrays[name] = np.frombuffer(data, dtype=info.dtype)
+            return self._arrays[name]
+        return np.memmap(self.path, dtype=info.dtype, mode="r", offset=info.offset, shape=(info.count,))
+
+    def sample_times(self, group):
+        """
+        Sensor time in ms of every sample of a packet group ("ecg" or "imu").
+        Samples between packet timestamps are spaced at the group's sample rate.
+        """
+        timestamps = self[group + ".timestamp"].astype(np.float64)
+        channel = next(c for c in self._columns.values() if c.name.startswith(group + ".") and c.sample_rate > 0)
+        offsets = np.arange(channel.values_per_packet) * (1000.0 / channel.sample_rate)
+        return (timestamps[:, None] + offsets[None, :]).ravel()
+
+
+def lod_window(lod: SbemColumns, channel: str, t0: float, t1: float, pixels: int):
+    """
+    Min/max/mean of a channel between two sensor times, from a pyramid written
+    by `sbem2csv --lod` (.lod.sbcol), at the coarsest level that still has a
+    bin per pixel. Reads about `pixels` bins whatever the length of the range.
+    :param lod: The opened .lod.sbcol file.
+    :param channel: "ecg.samples", "imu.acc_x", ...
+    :param t0: Start of the range in sensor ms.
+    :param t1: End of the range in sensor ms.
+    :param pixels: Width the range is drawn at.
+    :return: (time, min, max, mean) arrays, time being the ms of each bin's first packet.
+    """
+    prefix = channel + "."
+    sizes = sorted(int(name[len(prefix):-len(".time")]) for name in lod.names()
+                   if name.startswith(prefix) and name.endswith(".time"))
+    if not sizes:
+        raise KeyError(f"{lod.path}: no pyramid of {channel}")
+
+    # Coarsest first; the finest level is taken when none has enough bins
+    for size in reversed(sizes):
+        time = lod[f"{prefix}{size}.time"]
+        begin = max(int(np.searchsorted(time, t0, side="right")) - 1, 0)
+        end = int(np.searchsorted(time, t1, side="right"))
+        if end - begin >= pixels or size == sizes[0]:
+            break
+    level = f"{prefix}{size}."
+    return (time[begin:end], lod[level + "min"][begin:end], lod[level + "max"][begin:end],
+            lod[level + "mean"][begin:end])
+
+
+def load_sbcol(file_path: str) -> SbemColumns:
+    """
+    Open a columnar recording.
+    :param file_path: Path to a .sbcol file, or a .sbcol.zst with sbem_native available.
+    :return: SbemColumns giving numpy arrays by column name.
+    """
+    return SbemColumns(file_path)
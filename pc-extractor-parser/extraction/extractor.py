@@ -4,10 +4,10 @@
 Movesense log extraction client (multiple sensors).
 
 This client:
-  1. For each sensor (identified by the end of its name) in a provided list,
-     it discovers the sensor.
-  2. Connects and subscribes to notifications.
-  3. Sequentially fetches log files—one file per log ID.
+  1. Discovers the sensors (identified by the end of their names) in a provided list, once.
+  2. Connects to up to MAX_LINKS of them at a time, largest logbook first when the
+     volumes are known, and subscribes to notifications.
+  3. Sequentially fetches each sensor's log files—one file per log ID.
   
 The FETCH_LOG command is sent with a six‐byte payload:
   • Byte 0: 3 (FETCH_LOG)
@@ -21,21 +21,43 @@ Notifications from the sensor are expected in the format:
   • Bytes 6–end: data payload
 
 An “end‐of‐file” is signaled by a notification whose payload (bytes after the offset) is empty.
+With the native module the received ranges are tracked, and a log that arrives with holes
+is fetched once more to fill them. A log whose notifications stop before the EOF marker
+(it was lost) is fetched once more as well, and kept as received after that.
 
-If a log fetch times out (i.e. no notifications arrive) the client assumes there are no
+If a log fetch times out without any data arriving the client assumes there are no
 more logs to extract.
+
+When a conversion folder is given and the native decoder (sbem_native) is available,
+each log is also converted to CSV while it downloads, so the CSV is ready right after
+the EOF marker.
 """
 
 
 import os
 import asyncio
+import csv
 import logging
 import struct
 import sys
-from functools import reduce
+import time
 from datetime import datetime
 
-from bleak import BleakClient, discover
+# MOVESENSE_SIMULATOR=<folder> swaps Bluetooth for the simulated sensors of SbemTools' sbemsim
+if os.environ.get("MOVESENSE_SIMULATOR"):
+    try:
+        from .simulated_ble import BleakClient, discover
+    except ImportError:
+        from simulated_ble import BleakClient, discover
+else:
+    from bleak import BleakClient, discover
+
+# Native decoder from sensor-software/SbemTools, if it has been built and is on
+# PYTHONPATH. It converts a log to CSV from the notifications as they arrive.
+try:
+    import sbem_native
+except ImportError:
+    sbem_native = None
 
 from enum import IntEnum
 
@@ -65,33 +87,48 @@ async def send_stop_logging(client: BleakClient, reference: int = 101):
 WRITE_CHARACTERISTIC_UUID = "34800001-7185-4d5d-b431-630e7050e8f0"
 NOTIFY_CHARACTERISTIC_UUID = "34800002-7185-4d5d-b431-630e7050e8f0"
 
-# -----------------------------------------------------------------------------
-# Helper: DataView class for binary extraction
-# -----------------------------------------------------------------------------
-class DataView:
-    def __init__(self, array, bytes_per_element=1):
-        self.array = array
-        self.bytes_per_element = bytes_per_element
-
-    def __get_binary(self, start_index, byte_count, signed=False):
-        integers = [self.array[start_index + x] for x in range(byte_count)]
-        bytes_seq = [integer.to_bytes(self.bytes_per_element, byteorder='little', signed=signed)
-                     for integer in integers]
-        return reduce(lambda a, b: a + b, bytes_seq)
-
-    def get_uint_16(self, start_index):
-        return int.from_bytes(self.__get_binary(start_index, 2), byteorder='little')
+# Sensors extracted at once by extract_all_sensors; adapters keep about 7 links, fewer reliably
+MAX_LINKS = 4
 
-    def get_uint_8(self, start_index):
-        return int.from_bytes(self.__get_binary(start_index, 1), byteorder='little')
+# Times a log is fetched again when notifications were lost (needs sbem_native to notice)
+MAX_REFETCHES = 1
 
-    def get_uint_32(self, start_index):
-        binary = self.__get_binary(start_index, 4)
-        return struct.unpack('<I', binary)[0]
-
-    def get_float_32(self, start_index):
-        binary = self.__get_binary(start_index, 4)
-        return struct.unpack('<f', binary)[0]
+# -----------------------------------------------------------------------------
+# Log file writer used without the native module
+# -----------------------------------------------------------------------------
+class LogFile:
+    """
+    Writes each data notification's payload at its offset, like sbem_native.Reassembler
+    but without tracking what arrived, so missing() never reports holes and stats() counts
+    the bytes up to the furthest one received.
+    """
+    def __init__(self, path, reference=101):
+        self.file = open(path, 'wb')
+        self.reference = reference
+        self.furthest = 0
+
+    def frame(self, data):
+        if len(data) < 6:
+            return 'malformed'
+        if data[0] not in (2, 3, 4) or data[1] != self.reference:
+            return 'foreign'
+        if len(data) == 6:
+            return 'end'
+        offset = struct.unpack_from('<I', data, 2)[0]
+        self.file.seek(offset)
+        self.file.write(data[6:])
+        self.furthest = max(self.furthest, offset + len(data) - 6)
+        return 'data'
+
+    def missing(self):
+        return []
+
+    def stats(self):
+        return {'received': self.furthest}
+
+    def close(self):
+        self.file.close()
+        return True
 
 # -----------------------------------------------------------------------------
 # Notification handler
@@ -99,65 +136,125 @@ class DataView:
 async def notification_handler(sender, data, queue: asyncio.Queue):
     """
     Notification handler for data characteristic.
-    Strips off the first two bytes and puts the remaining bytes on the shared queue.
+    Puts the whole notification on the shared queue; fetch_log checks its type and reference.
     """
-    await queue.put(data[2:])
+    await queue.put(data)
 
 # -----------------------------------------------------------------------------
 # Fetch a single log file (modified to use raw_folder and new naming format)
 # -----------------------------------------------------------------------------
 async def fetch_log(client: BleakClient, queue: asyncio.Queue, sensor_id: str,
-                    log_id: int, disconnect_event: asyncio.Event, raw_folder: str) -> bool:
+                    log_id: int, disconnect_event: asyncio.Event, raw_folder: str,
+                    conv_folder: str = None):
+    """Fetch one log. Returns the bytes received, or None if nothing arrived (no such log)."""
     # Generate the current timestamp in the desired format: HHMMSSDDMMYYYY
     timestamp = datetime.now().strftime("%H%M%S%d%m%Y")
     filename = os.path.join(raw_folder, f"{timestamp}_{sensor_id}_{log_id}.sbem")
     logging.info(f"Fetching log {log_id} -> '{filename}'")
+
+    # Convert while downloading: the same CSV converter.py writes for the finished file
+    live = None
+    if conv_folder and sbem_native is not None:
+        os.makedirs(conv_folder, exist_ok=True)
+        live_csv = os.path.join(conv_folder, f"{timestamp}_{sensor_id}_{log_id}.csv")
+        live = sbem_native.PushConverter(live_csv)
+    log_file = None
+    complete = False
     try:
-        with open(filename, 'wb') as f:
-            command = bytearray([3, 101, log_id, 0, 0, 0])
-            logging.info(f"Sending FETCH_LOG command for log {log_id}: {command.hex()}")
+        # The native reassembler writes 64 KiB blocks and lists the holes lost notifications left
+        log_file = sbem_native.Reassembler(filename, 101) if sbem_native is not None else LogFile(filename, 101)
+        command = bytearray([Commands.FETCH_LOG, 101, log_id, 0, 0, 0])
+        logging.info(f"Sending FETCH_LOG command for log {log_id}: {command.hex()}")
+        await client.write_gatt_char(WRITE_CHARACTERISTIC_UUID, command, response=True)
+        refetches = 0
+
+        async def refetch():
+            # FETCH_LOG has no byte range: the sensor sends the whole log again and
+            # only the missing bytes are taken from it
+            nonlocal live, refetches
+            refetches += 1
+            if live is not None:
+                live.finish()  # decoded with the gaps zero filled; converted after the fetch instead
+                live = None
+                if os.path.exists(live_csv):
+                    os.remove(live_csv)
             await client.write_gatt_char(WRITE_CHARACTERISTIC_UUID, command, response=True)
-            
-            while not disconnect_event.is_set():
-                try:
-                    item = await asyncio.wait_for(queue.get(), timeout=10.0)
-                except asyncio.TimeoutError:
+
+        while not disconnect_event.is_set():
+            try:
+                item = await asyncio.wait_for(queue.get(), timeout=10.0)
+            except asyncio.TimeoutError:
+                received = log_file.stats()['received']
+                if not received:
                     logging.warning(f"Timeout waiting for data for log {log_id}.")
-                    return False
-
-                if isinstance(item, bytearray):
-                    dv = DataView(item)
-                    offset = dv.get_uint_32(0)
-                    payload = item[4:]
-                    if len(payload) > 0:
-                        f.seek(offset)
-                        f.write(payload)
-                        #logging.info(f"Log {log_id}: wrote {len(payload)} bytes at offset {offset}")
-                    else:
-                        logging.info(f"Log {log_id} complete (EOF marker received).")
-                        return True
-                else:
-                    logging.info(f"Received non-bytearray message: {item}")
+                    return None
+                # Data came but the EOF marker didn't: it was lost, not a missing log
+                if refetches < MAX_REFETCHES:
+                    logging.warning(f"Log {log_id}: no EOF marker after {received} bytes, fetching it again")
+                    await refetch()
+                    continue
+                logging.warning(f"Log {log_id}: still no EOF marker, kept the {received} bytes received")
+                return received
+
+            if not isinstance(item, (bytes, bytearray)):
+                logging.info(f"Received non-bytearray message: {item}")
+                continue
+
+            kind = log_file.frame(item)
+            if kind == 'data':
+                if live is not None:
+                    live.push(struct.unpack_from('<I', item, 2)[0], item[6:])
+            elif kind == 'end':
+                holes = log_file.missing()
+                if holes and refetches < MAX_REFETCHES:
+                    missing_bytes = sum(end - begin for begin, end in holes)
+                    logging.warning(f"Log {log_id}: {missing_bytes} bytes in {len(holes)} gaps lost, "
+                                    f"fetching it again")
+                    await refetch()
+                    continue
+                if holes:
+                    logging.warning(f"Log {log_id}: {len(holes)} gaps still missing, left zero filled")
+                logging.info(f"Log {log_id} complete (EOF marker received).")
+                complete = True
+                return log_file.stats()['received']
     except Exception as e:
         logging.error(f"Error fetching log {log_id}: {e}")
-        return False
+        return None
+    finally:
+        if log_file is not None and not log_file.close():
+            logging.error(f"Error writing '{filename}'")
+            complete = False
+        if live is not None:
+            csv_filename = live.finish()
+            if complete and csv_filename:
+                logging.info(f"Log {log_id} converted while downloading -> '{csv_filename}'")
+            elif os.path.exists(live_csv):
+                os.remove(live_csv)  # partial log, converted after a complete fetch instead
 
 # -----------------------------------------------------------------------------
 # Main BLE client routine for a single sensor (modified to use raw_folder)
 # -----------------------------------------------------------------------------
-async def run_ble_client(end_of_serial: str, queue: asyncio.Queue, raw_folder: str) -> bool:
-    devices = await discover()
+async def run_ble_client(end_of_serial: str, queue: asyncio.Queue, raw_folder: str,
+                         conv_folder: str = None, device=None):
+    """Fetch every log of one sensor. Returns the bytes received, or None if no log was fetched."""
     found = False
     address = None
     name = None
-    for d in devices:
-        logging.info(f"Found device: {d}")
-        if d.name and d.name.endswith(end_of_serial):
-            logging.info("Sensor found")
-            address = d.address
-            name = d.name
-            found = True
-            break
+    if device is not None:
+        # Discovered by the caller, once for all sensors
+        address = device.address
+        name = device.name
+        found = True
+    else:
+        devices = await discover()
+        for d in devices:
+            logging.info(f"Found device: {d}")
+            if d.name and d.name.endswith(end_of_serial):
+                logging.info("Sensor found")
+                address = d.address
+                name = d.name
+                found = True
+                break
 
     disconnected_event = asyncio.Event()
 
@@ -166,7 +263,7 @@ async def run_ble_client(end_of_serial: str, queue: asyncio.Queue, raw_folder: s
         disconnected_event.set()
 
     if found:
-        success_flag = False
+        total = None
         async with BleakClient(address, disconnected_callback=disconnect_callback) as client:
             logging.info("Enabling notifications")
             await client.start_notify(NOTIFY_CHARACTERISTIC_UUID,
@@ -178,11 +275,12 @@ async def run_ble_client(end_of_serial: str, queue: asyncio.Queue, raw_folder: s
             max_consecutive_misses = 1  # Adjust as needed
 
             while not disconnected_event.is_set() and consecutive_misses < max_consecutive_misses:
-                success = await fetch_log(client, queue, name, current_log_id, disconnected_event, raw_folder)
-                if success:
+                received = await fetch_log(client, queue, name, current_log_id, disconnected_event, raw_folder,
+                                           conv_folder)
+                if received is not None:
                     logging.info(f"Successfully fetched log {current_log_id}")
                     consecutive_misses = 0  # reset on success
-                    success_flag = True  # Mark that at least one log was successfully extracted
+                    total = (total or 0) + received  # at least one log was successfully extracted
           
                 else:
                     logging.info(f"No data received for log {current_log_id}.")
@@ -206,30 +304,75 @@ async def run_ble_client(end_of_serial: str, queue: asyncio.Queue, raw_folder: s
             
             await queue.put(None)
             await asyncio.sleep(1.0)
-        return success_flag
+        return total
     else:
         await queue.put(None)
         logging.error(f"Sensor with ending '{end_of_serial}' not found!")
-        return False
+        return None
 
 # -----------------------------------------------------------------------------
 # Extract logs for a single sensor (wrapper, now accepts raw_folder)
 # -----------------------------------------------------------------------------
-async def extract_sensor(sensor_id: str, raw_folder: str) -> bool:
+async def extract_sensor(sensor_id: str, raw_folder: str, conv_folder: str = None, device=None):
+    """Returns the bytes received from the sensor, or None if no log was fetched."""
     queue = asyncio.Queue()
     logging.info(f"Starting extraction for sensor with ending '{sensor_id}'")
-    result = await run_ble_client(sensor_id, queue, raw_folder)
+    result = await run_ble_client(sensor_id, queue, raw_folder, conv_folder, device)
     logging.info(f"Extraction finished for sensor with ending '{sensor_id}' with result: {result}")
     return result
 
 # -----------------------------------------------------------------------------
-# Extract logs for a list of sensors sequentially
+# Logbook volumes, to fetch the largest first
 # -----------------------------------------------------------------------------
-async def extract_all_sensors(sensor_list, raw_folder: str):
+def read_logbook(path: str) -> dict:
+    """Bytes per sensor from a serial,log_id,bytes CSV (sbemsim writes one for its sensors)."""
+    volumes = {}
+    with open(path, newline='') as f:
+        for row in csv.DictReader(f):
+            volumes[row['serial']] = volumes.get(row['serial'], 0) + int(row['bytes'])
+    return volumes
+
+# -----------------------------------------------------------------------------
+# Extract logs for a list of sensors, several at once
+# -----------------------------------------------------------------------------
+async def extract_all_sensors(sensor_list, raw_folder: str, conv_folder: str = None,
+                              max_links: int = MAX_LINKS, volumes: dict = None) -> dict:
+    """
+    Discover once, then extract up to max_links sensors at a time, largest logbook first
+    (volumes: bytes per sensor id, when known) so the longest transfer isn't started last.
+    Returns {sensor_id: success}.
+    """
+    start = time.monotonic()
+    devices = await discover()
+    found = {}
     for sensor_id in sensor_list:
-        logging.info(f"--- Processing sensor with ending '{sensor_id}' ---")
-        await extract_sensor(sensor_id, raw_folder)
-        await asyncio.sleep(1)
+        match = next((d for d in devices if d.name and d.name.endswith(sensor_id)), None)
+        if match is None:
+            logging.error(f"Sensor with ending '{sensor_id}' not found!")
+        else:
+            found[sensor_id] = match
+    volumes = volumes or {}
+    order = sorted(found, key=lambda sensor_id: volumes.get(sensor_id, 0), reverse=True)
+
+    # The semaphore hands out the links in the order the tasks start waiting
+    links = asyncio.Semaphore(max_links)
+    results = {sensor_id: False for sensor_id in sensor_list}
+    received = {}
+
+    async def extract(sensor_id):
+        async with links:
+            logging.info(f"--- Processing sensor with ending '{sensor_id}' ---")
+            received[sensor_id] = await extract_sensor(sensor_id, raw_folder, conv_folder, found[sensor_id])
+            results[sensor_id] = received[sensor_id] is not None
+
+    await asyncio.gather(*(extract(sensor_id) for sensor_id in order))
+
+    # Counted as received: files already in raw_folder, or written by another run, don't inflate it
+    seconds = time.monotonic() - start
+    total = sum(value for value in received.values() if value)
+    logging.info(f"{sum(results.values())}/{len(sensor_list)} sensors, {total / 1e6:.1f} MB "
+                 f"in {seconds:.1f} s: {total / 1e3 / max(seconds, 1e-9):.1f} kB/s over up to {max_links} links")
+    return results
 
 # -----------------------------------------------------------------------------
 # Main entry point (for command-line testing)
@@ -237,8 +380,11 @@ async def extract_all_sensors(sensor_list, raw_folder: str):
 if __name__ == "__main__":
     logging.basicConfig(level=logging.INFO)
     if len(sys.argv) < 3:
-        print("Usage: python extractor.py <end_of_sensor_name> <raw_folder>")
+        print("Usage: python extractor.py <end_of_sensor_name>[,<end_of_sensor_name>...] <raw_folder> "
+              "[max_links] [logbook.csv]")
         sys.exit(1)
-    end_of_serial = sys.argv[1]
+    sensor_ids = sys.argv[1].split(",")
     raw_folder = sys.argv[2]
-    asyncio.run(extract_all_sensors([end_of_serial], raw_folder))
\ No newline at end of file
+    max_links = int(sys.argv[3]) if len(sys.argv) > 3 else MAX_LINKS
+    volumes = read_logbook(sys.argv[4]) if len(sys.argv) > 4 else None
+    asyncio.run(extract_all_sensors(sensor_ids, raw_folder, max_links=max_links, volumes=volumes))
@@ -0,0 +1,115 @@
+# -*- coding: utf-8 -*-
+"""
+Stand-ins for bleak's discover() and BleakClient that talk to the simulated sensors of
+sensor-software/SbemTools/tools/sbemsim instead of Bluetooth, so the extractor can be run,
+timed and stress-tested on any Linux machine.
+
+The extractor uses them when MOVESENSE_SIMULATOR names sbemsim's folder:
+
+    sbemsim --sensors 4 /tmp/sim &
+    MOVESENSE_SIMULATOR=/tmp/sim python extractor.py 990000000001 Raw
+
+Each sensor is a SOCK_SEQPACKET socket <folder>/<serial>.sock carrying one message per ATT
+packet: [1][command] for a write, [2] for its write response, [3][value] for a notification.
+"""
+
+import asyncio
+import glob
+import os
+import socket
+
+SIMULATOR_DIR = os.environ.get("MOVESENSE_SIMULATOR")
+
+LINK_WRITE = 1
+LINK_WRITE_RESPONSE = 2
+LINK_NOTIFY = 3
+
+
+class SimulatedDevice:
+    """What discover() reports of a sensor: its advertised name and where to connect."""
+    def __init__(self, path):
+        self.address = path
+        self.name = "Movesense " + os.path.basename(path)[:-len(".sock")]
+
+    def __repr__(self):
+        return f"{self.address}: {self.name}"
+
+
+async def discover(timeout: float = 5.0):
+    """The sensors currently advertising: the sockets in the simulator's folder."""
+    return [SimulatedDevice(path) for path in sorted(glob.glob(os.path.join(SIMULATOR_DIR, "*.sock")))]
+
+
+class BleakClient:
+    """The part of bleak.BleakClient the extractor uses, over a simulated sensor's socket."""
+    def __init__(self, address, disconnected_callback=None):
+        self.address = address
+        self._disconnected_callback = disconnected_callback
+        self._socket = None
+        self._reader = None
+        self._notify = None
+        self._responses = asyncio.Queue()
+
+    @property
+    def is_connected(self):
+        return self._socket is not None
+
+    async def __aenter__(self):
+        await self.connect()
+        return self
+
+    async def __aexit__(self, *exc_info):
+        await self.disconnect()
+
+    async def connect(self):
+        sock = socket.socket(socket.AF_UNIX, socket.SOCK_SEQPACKET)
+        sock.setblocking(False)
+        await asyncio.get_running_loop().sock_connect(sock, self.address)
+        self._socket = sock
+        self._reader = asyncio.create_task(self._read())
+        return True
+
+    async def disconnect(self):
+        if self._reader is not None:
+            self._reader.cancel()
+            self._reader = None
+        if self._socket is not None:
+            self._socket.close()
+            self._socket = None
+        return True
+
+    async def start_notify(self, char_uuid, callback):
+        self._notify = callback
+
+    async def stop_notify(self, char_uuid):
+        self._notify = None
+
+    async def write_gatt_char(self, char_uuid, data, response=False):
+        if self._socket is None:
+            raise ConnectionError(f"{self.address} is not connected")
+        await asyncio.get_running_loop().sock_sendall(self._socket, bytes([LINK_WRITE]) + bytes(data))
+        if response:
+            if await self._responses.get() is None:
+                raise ConnectionError(f"{self.address} disconnected")
+
+    async def _read(self):
+        loop = asyncio.get_running_loop()
+        try:
+            while True:
+                message = await loop.sock_recv(self._socket, 1024)
+                if not message:
+                    break
+                if message[0] == LINK_WRITE_RESPONSE:
+                    self._responses.put_nowait(True)
+                elif message[0] == LINK_NOTIFY and self._notify is not None:
+                    self._notify(None, bytearray(message[1:]))
+        except (ConnectionError, OSError):
+            pass
+        # The link dropped: fail a pending write and tell the owner, as bleak does
+        self._responses.put_nowait(None)
+        if self._socket is not None:
+            self._socket.close()
+            self._socket = None
+        self._reader = None
+        if self._disconnected_callback is not None:
+            self._disconnected_callback(self)
@@ -116,6 +116,16 @@ class ExtractionThread(QtCore.QThread):
         # We'll use a thread pool executor for the synchronous conversion.
         loop = asyncio.get_running_loop()
         executor = ThreadPoolExecutor(max_workers=4)
+
+        # Discover once for all workers; a sensor missing from this scan is looked up again when extracted
+        devices = {}
+        try:
+            for d in await discover():
+                for sensor_id in self.sensor_list:
+                    if d.name and d.name.endswith(sensor_id):
+                        devices[sensor_id] = d
+        except Exception as e:
+            logging.error(f"Discovery failed: {e}")
         
         async def worker():
             # Each worker runs until no pending sensor remains.
@@ -169,8 +179,9 @@ class ExtractionThread(QtCore.QThread):
                     logger = logging.getLogger()
                     logger.addHandler(flag_handler)
                     try:
-                        result = await extract_sensor(sensor_id, self.raw_folder)
-                        extraction_success = result  # expecting Boolean result.
+                        result = await extract_sensor(sensor_id, self.raw_folder, self.conv_folder,
+                                                      devices.get(sensor_id))
+                        extraction_success = result is not None  # bytes received, None if no log
                     except Exception as e:
                         logging.error(f"Extraction failed for sensor {sensor_id}: {e}")
                         extraction_success = False
@@ -191,7 +202,11 @@ class ExtractionThread(QtCore.QThread):
                         for file_path in matching_files:
                             logging.info(f"Converting file {file_path} for sensor {sensor_id}...")
                             try:
-                                csv_path = await loop.run_in_executor(executor, conv.convert_sbem, file_path, self.conv_folder)
+                                # Logs fetched with sbem_native were converted while downloading
+                                base_name = os.path.splitext(os.path.basename(file_path))[0]
+                                csv_path = os.path.join(self.conv_folder, base_name + ".csv")
+                                if not os.path.exists(csv_path):
+                                    csv_path = await loop.run_in_executor(executor, conv.convert_sbem, file_path, self.conv_folder)
                                 if csv_path and os.path.exists(csv_path):
                                     target_name = self._build_target_name(sensor_id)
                                     if target_name:
@@ -0,0 +1,854 @@
+// sbem_native: the SBEM decoder as a CPython extension
+//
+//   import sbem_native
+//   cols = sbem_native.decode("Raw/x.sbem", threads=4)   # {"ecg.samples": ndarray, ...}
+//   csv = sbem_native.convert("Raw/x.sbem", "Converted")  # same CSV as converter.py
+//   live = sbem_native.PushConverter("Converted/x.csv")    # the same CSV while downloading:
+//   live.push(offset, payload) per notification, live.finish() at the EOF marker
+//   log = sbem_native.Reassembler("Raw/x.sbem", 101)     # the file from the notifications:
+//   log.frame(notification) per notification, log.missing() and log.close() at the EOF marker
+//   zst = sbem_native.SeekableFile("Converted/x.sbcol.zst")  # byte ranges of a --zstd output:
+//   zst.read(offset, length) decompresses only the frames it needs
+//
+// Arrays are views of the decoded recording's arena, kept alive by the arrays
+// themselves. Decoding and writing run with the GIL released, so conversions
+// started from several Python threads proceed in parallel.
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <cerrno>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "sbem/ColumnarWriter.h"
+#include "sbem/CsvWriter.h"
+#include "sbem/Decoder.h"
+#include "sbem/MappedFile.h"
+#include "sbem/Reassembler.h"
+#include "sbem/SeekableReader.h"
+#include "sbem/StreamConverter.h"
+
+#if SBEM_HAVE_NUMPY
+#define NPY_NO_DEPRECATED_API NPY_1_7_API_VERSION
+#include <numpy/arrayobject.h>
+#endif
+
+namespace
+{
+
+/** Python object owning a decoded recording; every array of it holds a reference. */
+struct RecordingObject
+{
+    PyObject_HEAD
+    sbem::Recording* pRecording;
+};
+
+void recordingDealloc(PyObject* pSelf)
+{
+    PyTypeObject* pType = Py_TYPE(pSelf);
+    delete reinterpret_cast<RecordingObject*>(pSelf)->pRecording;
+    pType->tp_free(pSelf);
+    Py_DECREF(pType);
+}
+
+PyType_Slot recordingSlots[] =
+{
+    { Py_tp_dealloc, reinterpret_cast<void*>(recordingDealloc) },
+    { Py_tp_doc, const_cast<char*>("Owner of a decoded recording's column storage") },
+    { 0, nullptr }
+};
+
+PyType_Spec recordingSpec =
+{
+    "sbem_native.Recording", sizeof(RecordingObject), 0, Py_TPFLAGS_DEFAULT, recordingSlots
+};
+
+PyTypeObject* pRecordingType = nullptr;
+
+/** Buffer exporter for one column when NumPy isn't available at build time. */
+struct ColumnObject
+{
+    PyObject_HEAD
+    PyObject* pOwner;
+    void* pData;
+    Py_ssize_t count;
+    Py_ssize_t itemSize;
+    const char* format;
+};
+
+int columnGetBuffer(PyObject* pSelf, Py_buffer* pView, int flags)
+{
+    ColumnObject* pColumn = reinterpret_cast<ColumnObject*>(pSelf);
+    if (PyBuffer_FillInfo(pView, pSelf, pColumn->pData, pColumn->count * pColumn->itemSize, 1, flags) < 0)
+        return -1;
+    if (flags & PyBUF_FORMAT)
+        pView->format = const_cast<char*>(pColumn->format);
+    pView->itemsize = pColumn->itemSize;
+    if (flags & PyBUF_ND)
+    {
+        pView->ndim = 1;
+        pView->shape = &pColumn->count;
+    }
+    if (flags & PyBUF_STRIDES)
+        pView->strides = &pView->itemsize;
+    return 0;
+}
+
+void columnDealloc(PyObject* pSelf)
+{
+    PyTypeObject* pType = Py_TYPE(pSelf);
+    Py_XDECREF(reinterpret_cast<ColumnObject*>(pSelf)->pOwner);
+    pType->tp_free(pSelf);
+    Py_DECREF(pType);
+}
+
+PyType_Slot columnSlots[] =
+{
+    { Py_tp_dealloc, reinterpret_cast<void*>(columnDealloc) },
+    { Py_bf_getbuffer, reinterpret_cast<void*>(columnGetBuffer) },
+    { Py_tp_doc, const_cast<char*>("Buffer export of one decoded column") },
+    { 0, nullptr }
+};
+
+PyType_Spec columnSpec =
+{
+    "sbem_native.Column", sizeof(ColumnObject), 0, Py_TPFLAGS_DEFAULT, columnSlots
+};
+
+PyTypeObject* pColumnType = nullptr;
+
+template <typename T> struct PyFormat;
+template <> struct PyFormat<uint16_t> { static constexpr const char* CODE = "H"; static constexpr int NPY = 4; };
+template <> struct PyFormat<uint32_t> { static constexpr const char* CODE = "I"; static constexpr int NPY = 6; };
+template <> struct PyFormat<float> { static constexpr const char* CODE = "f"; static constexpr int NPY = 11; };
+template <> struct PyFormat<double> { static constexpr const char* CODE = "d"; static constexpr int NPY = 12; };
+
+/** Read-only 1-d array viewing rColumn, keeping pOwner alive. */
+template <typename T>
+PyObject* columnArray(PyObject* pOwner, const sbem::Column<T>& rColumn)
+{
+    // Empty columns have no storage of their own; any non-null pointer will do
+    static T empty;
+    void* pData = rColumn.data ? static_cast<void*>(rColumn.data) : static_cast<void*>(&empty);
+
+#if SBEM_HAVE_NUMPY
+    static_assert(PyFormat<uint16_t>::NPY == NPY_UINT16 && PyFormat<uint32_t>::NPY == NPY_UINT32 &&
+                  PyFormat<float>::NPY == NPY_FLOAT32 && PyFormat<double>::NPY == NPY_FLOAT64,
+                  "NumPy type numbers");
+    npy_intp dims[1] = { static_cast<npy_intp>(rColumn.size) };
+    PyObject* pArray = PyArray_SimpleNewFromData(1, dims, PyFormat<T>::NPY, pData);
+    if (!pArray)
+        return nullptr;
+    PyArray_CLEARFLAGS(reinterpret_cast<PyArrayObject*>(pArray), NPY_ARRAY_WRITEABLE);
+    Py_INCREF(pOwner);
+    if (PyArray_SetBaseObject(reinterpret_cast<PyArrayObject*>(pArray), pOwner) < 0)
+    {
+        Py_DECREF(pArray);
+        return nullptr;
+    }
+    return pArray;
+#else
+    ColumnObject* pColumn = PyObject_New(ColumnObject, pColumnType);
+    if (!pColumn)
+        return nullptr;
+    Py_INCREF(pOwner);
+    pColumn->pOwner = pOwner;
+    pColumn->pData = pData;
+    pColumn->count = static_cast<Py_ssize_t>(rColumn.size);
+    pColumn->itemSize = sizeof(T);
+    pColumn->format = PyFormat<T>::CODE;
+    PyObject* pView = PyMemoryView_FromObject(reinterpret_cast<PyObject*>(pColumn));
+    Py_DECREF(pColumn);
+    return pView;
+#endif
+}
+
+template <typename T>
+bool putColumn(PyObject* pDict, PyObject* pOwner, const std::string& name, const sbem::Column<T>& rColumn)
+{
+    PyObject* pArray = columnArray(pOwner, rColumn);
+    if (!pArray)
+        return false;
+    const int result = PyDict_SetItemString(pDict, name.c_str(), pArray);
+    Py_DECREF(pArray);
+    return result == 0;
+}
+
+bool putValue(PyObject* pDict, const char* name, PyObject* pValue)
+{
+    if (!pValue)
+        return false;
+    const int result = PyDict_SetItemString(pDict, name, pValue);
+    Py_DECREF(pValue);
+    return result == 0;
+}
+
+/** Same column names as the .sbcol files (see sbem/ColumnarFormat.h). */
+PyObject* recordingDict(PyObject* pOwner, const sbem::Recording& rRec)
+{
+    PyObject* pDict = PyDict_New();
+    if (!pDict)
+        return nullptr;
+
+    bool ok = putColumn(pDict, pOwner, "ecg.chunk_index", rRec.ecg.chunkIndex) &&
+              putColumn(pDict, pOwner, "ecg.timestamp", rRec.ecg.timestamp) &&
+              putColumn(pDict, pOwner, "ecg.samples", rRec.ecg.samples) &&
+              putColumn(pDict, pOwner, "imu.chunk_index", rRec.imu.chunkIndex) &&
+              putColumn(pDict, pOwner, "imu.timestamp", rRec.imu.timestamp) &&
+              putColumn(pDict, pOwner, "imu.acc_x", rRec.imu.accelX) &&
+              putColumn(pDict, pOwner, "imu.acc_y", rRec.imu.accelY) &&
+              putColumn(pDict, pOwner, "imu.acc_z", rRec.imu.accelZ) &&
+              putColumn(pDict, pOwner, "imu.gyro_x", rRec.imu.gyroX) &&
+              putColumn(pDict, pOwner, "imu.gyro_y", rRec.imu.gyroY) &&
+              putColumn(pDict, pOwner, "imu.gyro_z", rRec.imu.gyroZ) &&
+              putColumn(pDict, pOwner, "other.chunk_index", rRec.other.chunkIndex) &&
+              putColumn(pDict, pOwner, "other.id", rRec.other.id) &&
+              putColumn(pDict, pOwner, "other.value", rRec.other.value) &&
+              putValue(pDict, "chunk_count", PyLong_FromUnsignedLong(rRec.chunkCount)) &&
+              putValue(pDict, "truncated", PyBool_FromLong(rRec.truncated));
+
+    PyObject* pGaps = ok ? PyList_New(static_cast<Py_ssize_t>(rRec.gaps.size())) : nullptr;
+    for (size_t g = 0; pGaps && g < rRec.gaps.size(); g++)
+    {
+        PyObject* pGap = Py_BuildValue("(KK)", static_cast<unsigned long long>(rRec.gaps[g].begin),
+                                       static_cast<unsigned long long>(rRec.gaps[g].end));
+        if (!pGap)
+        {
+            Py_CLEAR(pGaps);
+            break;
+        }
+        PyList_SET_ITEM(pGaps, static_cast<Py_ssize_t>(g), pGap);
+    }
+    ok = ok && putValue(pDict, "gaps", pGaps);
+
+    for (size_t s = 0; ok && s < rRec.streams.size(); s++)
+    {
+        const sbem::GenericStream& rStream = rRec.streams[s];
+        const std::string prefix = "stream." + std::to_string(rStream.id) + ".";
+        ok = putColumn(pDict, pOwner, prefix + "chunk_index", rStream.chunkIndex) &&
+             putColumn(pDict, pOwner, prefix + "value_offsets", rStream.valueOffsets) &&
+             putColumn(pDict, pOwner, prefix + "values", rStream.values);
+    }
+
+    if (!ok)
+    {
+        Py_DECREF(pDict);
+        return nullptr;
+    }
+    return pDict;
+}
+
+PyObject* decode(PyObject*, PyObject* pArgs, PyObject* pKwargs)
+{
+    static const char* KEYWORDS[] = { "path", "threads", nullptr };
+    PyObject* pPath = nullptr;
+    unsigned threads = 1;
+    if (!PyArg_ParseTupleAndKeywords(pArgs, pKwargs, "O&|I", const_cast<char**>(KEYWORDS),
+                                     PyUnicode_FSConverter, &pPath, &threads))
+    {
+        return nullptr;
+    }
+    const std::string path = PyBytes_AS_STRING(pPath);
+    Py_DECREF(pPath);
+
+    RecordingObject* pOwner = PyObject_New(RecordingObject, pRecordingType);
+    if (!pOwner)
+        return nullptr;
+    pOwner->pRecording = new sbem::Recording();
+
+    sbem::DecodeOptions options;
+    options.threads = threads;
+    bool ok;
+    Py_BEGIN_ALLOW_THREADS
+    ok = sbem::Decoder::decodeFile(path.c_str(), *pOwner->pRecording, options);
+    Py_END_ALLOW_THREADS
+
+    if (!ok)
+    {
+        Py_DECREF(pOwner);
+        PyErr_Format(PyExc_ValueError, "%s: not a readable SBEM file", path.c_str());
+        return nullptr;
+    }
+
+    PyObject* pDict = recordingDict(reinterpret_cast<PyObject*>(pOwner), *pOwner->pRecording);
+    Py_DECREF(pOwner);
+    return pDict;
+}
+
+PyObject* convert(PyObject*, PyObject* pArgs, PyObject* pKwargs)
+{
+    static const char* KEYWORDS[] = { "path", "output_dir", "threads", "columnar", "memory_limit_mb", nullptr };
+    PyObject* pPath = nullptr;
+    PyObject* pOutputDir = nullptr;
+    unsigned threads = 1;
+    int columnar = 0;
+    unsigned memoryLimitMb = 0;
+    if (!PyArg_ParseTupleAndKeywords(pArgs, pKwargs, "O&O&|IpI", const_cast<char**>(KEYWORDS),
+                                     PyUnicode_FSConverter, &pPath, PyUnicode_FSConverter, &pOutputDir,
+                                     &threads, &columnar, &memoryLimitMb))
+    {
+        Py_XDECREF(pPath);
+        Py_XDECREF(pOutputDir);
+        return nullptr;
+    }
+    const std::string path = PyBytes_AS_STRING(pPath);
+    const std::string outputDir = PyBytes_AS_STRING(pOutputDir);
+    Py_DECREF(pPath);
+    Py_DECREF(pOutputDir);
+    if (memoryLimitMb && columnar)
+    {
+        PyErr_SetString(PyExc_ValueError, "memory_limit_mb writes CSV only");
+        return nullptr;
+    }
+
+    // Output named like converter.py: input base name without extension
+    const size_t slash = path.find_last_of('/');
+    std::string base = slash == std::string::npos ? path : path.substr(slash + 1);
+    const size_t dot = base.find_last_of('.');
+    if (dot != std::string::npos && dot > 0)
+        base.resize(dot);
+    const std::string outPath = outputDir + "/" + base + (columnar ? ".sbcol" : ".csv");
+
+    enum { OK, DECODE_FAILED, NO_ROWS, WRITE_FAILED } result = OK;
+    int error = 0;
+    Py_BEGIN_ALLOW_THREADS
+    sbem::Recording recording;
+    sbem::DecodeOptions options;
+    options.threads = threads;
+    sbem::CsvOptions csvOptions;
+    csvOptions.threads = threads;
+    sbem::MappedFile file;
+    sbem::StreamStats stats;
+    if (memoryLimitMb)
+    {
+        if (!file.open(path.c_str()) || file.size() < sbem::HEADER_SIZE)
+            result = DECODE_FAILED;
+        else if (!sbem::StreamConverter::toCsv(file, outPath.c_str(), static_cast<size_t>(memoryLimitMb) << 20,
+                                               options, csvOptions, stats))
+            result = stats.shape.empty() ? NO_ROWS : WRITE_FAILED;
+    }
+    else if (!sbem::Decoder::decodeFile(path.c_str(), recording, options))
+        result = DECODE_FAILED;
+    else if (!columnar && sbem::RecordingShape::of(recording).empty())
+        result = NO_ROWS;
+    else if (columnar ? !sbem::ColumnarWriter::write(recording, outPath.c_str())
+                      : !sbem::CsvWriter::write(recording, outPath.c_str(), csvOptions))
+        result = WRITE_FAILED;
+    // The failed call's errno, before anything else can change it
+    if (result == WRITE_FAILED)
+        error = errno ? errno : EIO;
+    Py_END_ALLOW_THREADS
+
+    if (result == DECODE_FAILED)
+    {
+        PyErr_Format(PyExc_ValueError, "%s: not a readable SBEM file", path.c_str());
+        return nullptr;
+    }
+    if (result == WRITE_FAILED)
+    {
+        errno = error;
+        return PyErr_SetFromErrnoWithFilename(PyExc_OSError, outPath.c_str());
+    }
+    if (result == NO_ROWS)
+        Py_RETURN_NONE;
+    return PyUnicode_DecodeFSDefault(outPath.c_str());
+}
+
+/** sbem_native.PushConverter: a PushConverter fed from the extractor's notification handler. */
+struct PushConverterObject
+{
+    PyObject_HEAD
+    sbem::PushConverter* pConverter;
+    PyObject* pPath;
+};
+
+PyObject* pushConverterNew(PyTypeObject* pType, PyObject* pArgs, PyObject* pKwargs)
+{
+    static const char* KEYWORDS[] = { "csv_path", "threads", "loss_window", nullptr };
+    PyObject* pPath = nullptr;
+    unsigned threads = 1;
+    Py_ssize_t lossWindow = static_cast<Py_ssize_t>(sbem::PushDecoder::LOSS_WINDOW);
+    if (!PyArg_ParseTupleAndKeywords(pArgs, pKwargs, "O&|In", const_cast<char**>(KEYWORDS),
+                                     PyUnicode_FSConverter, &pPath, &threads, &lossWindow))
+    {
+        return nullptr;
+    }
+    if (lossWindow < 0)
+    {
+        Py_DECREF(pPath);
+        PyErr_SetString(PyExc_ValueError, "loss_window must be 0 or more");
+        return nullptr;
+    }
+
+    PushConverterObject* pSelf = reinterpret_cast<PushConverterObject*>(pType->tp_alloc(pType, 0));
+    if (!pSelf)
+    {
+        Py_DECREF(pPath);
+        return nullptr;
+    }
+    sbem::DecodeOptions options;
+    options.threads = threads;
+    sbem::CsvOptions csvOptions;
+    csvOptions.threads = threads;
+    pSelf->pConverter = new sbem::PushConverter(PyBytes_AS_STRING(pPath), options, csvOptions,
+                                                static_cast<size_t>(lossWindow));
+    pSelf->pPath = pPath;
+    return reinterpret_cast<PyObject*>(pSelf);
+}
+
+void pushConverterDealloc(PyObject* pSelf)
+{
+    PyTypeObject* pType = Py_TYPE(pSelf);
+    PushConverterObject* pConverter = reinterpret_cast<PushConverterObject*>(pSelf);
+    delete pConverter->pConverter;
+    Py_XDECREF(pConverter->pPath);
+    pType->tp_free(pSelf);
+    Py_DECREF(pType);
+}
+
+PyObject* pushConverterPush(PyObject* pSelf, PyObject* pArgs)
+{
+    unsigned long long offset;
+    Py_buffer data;
+    if (!PyArg_ParseTuple(pArgs, "Ky*", &offset, &data))
+        return nullptr;
+
+    sbem::PushConverter& rConverter = *reinterpret_cast<PushConverterObject*>(pSelf)->pConverter;
+    bool ok;
+    Py_BEGIN_ALLOW_THREADS
+    ok = rConverter.push(offset, static_cast<const uint8_t*>(data.buf), static_cast<size_t>(data.len));
+    Py_END_ALLOW_THREADS
+    PyBuffer_Release(&data);
+    return PyBool_FromLong(ok);
+}
+
+PyObject* pushConverterFinish(PyObject* pSelf, PyObject*)
+{
+    PushConverterObject* pConverter = reinterpret_cast<PushConverterObject*>(pSelf);
+    sbem::StreamStats stats;
+    bool ok;
+    Py_BEGIN_ALLOW_THREADS
+    ok = pConverter->pConverter->finish(stats);
+    Py_END_ALLOW_THREADS
+    if (!ok)
+        Py_RETURN_NONE;
+    return PyUnicode_DecodeFSDefault(PyBytes_AS_STRING(pConverter->pPath));
+}
+
+PyObject* pushConverterProgress(PyObject* pSelf, PyObject*)
+{
+    const sbem::PushDecoder& rDecoder = reinterpret_cast<PushConverterObject*>(pSelf)->pConverter->decoder();
+    return Py_BuildValue("{sKsKsKsn}", "contiguous", static_cast<unsigned long long>(rDecoder.contiguous()),
+                         "decoded", static_cast<unsigned long long>(rDecoder.position()),
+                         "lost", static_cast<unsigned long long>(rDecoder.lost()),
+                         "pending", static_cast<Py_ssize_t>(rDecoder.pending()));
+}
+
+PyMethodDef pushConverterMethods[] =
+{
+    {
+        "push", pushConverterPush, METH_VARARGS,
+        "push(offset, data) -> bool\n\n"
+        "Add a notification's payload at its file offset, in any order. Decodes\n"
+        "and writes every 64 KiB of contiguous log. False once the CSV can't be\n"
+        "written or after finish()."
+    },
+    {
+        "finish", pushConverterFinish, METH_NOARGS,
+        "finish() -> str or None\n\n"
+        "The log is complete (EOF marker): zero fill lost notifications, write\n"
+        "the rest and close the CSV. Returns its path, None if nothing was\n"
+        "written (no data rows, or the CSV not writable)."
+    },
+    {
+        "progress", pushConverterProgress, METH_NOARGS,
+        "progress() -> dict\n\n"
+        "Bytes received without a hole (contiguous), decoded so far, zero filled\n"
+        "for lost notifications (lost) and waiting behind a hole (pending)."
+    },
+    { nullptr, nullptr, 0, nullptr }
+};
+
+PyType_Slot pushConverterSlots[] =
+{
+    { Py_tp_new, reinterpret_cast<void*>(pushConverterNew) },
+    { Py_tp_dealloc, reinterpret_cast<void*>(pushConverterDealloc) },
+    { Py_tp_methods, pushConverterMethods },
+    { Py_tp_doc, const_cast<char*>(
+        "PushConverter(csv_path, threads=1, loss_window=65536)\n\n"
+        "Converts an SBEM log to CSV while it downloads. The CSV is byte identical\n"
+        "to convert() of the file the pushed fragments make; a hole with\n"
+        "loss_window bytes past it is taken as a lost notification (0: only at\n"
+        "finish()). The GIL is released while decoding and writing.") },
+    { 0, nullptr }
+};
+
+PyType_Spec pushConverterSpec =
+{
+    "sbem_native.PushConverter", sizeof(PushConverterObject), 0, Py_TPFLAGS_DEFAULT, pushConverterSlots
+};
+
+/** sbem_native.Reassembler: the file of a log from its data notifications. */
+struct ReassemblerObject
+{
+    PyObject_HEAD
+    sbem::Reassembler* pReassembler;
+    bool errorRaised;   // the write error has been raised, it isn't raised again
+};
+
+PyObject* reassemblerNew(PyTypeObject* pType, PyObject* pArgs, PyObject* pKwargs)
+{
+    static const char* KEYWORDS[] = { "path", "reference", nullptr };
+    PyObject* pPath = nullptr;
+    unsigned char reference = 101;
+    if (!PyArg_ParseTupleAndKeywords(pArgs, pKwargs, "O&|b", const_cast<char**>(KEYWORDS), PyUnicode_FSConverter,
+                                     &pPath, &reference))
+    {
+        return nullptr;
+    }
+
+    std::unique_ptr<sbem::Reassembler> pReassembler(new sbem::Reassembler());
+    if (!pReassembler->open(PyBytes_AS_STRING(pPath), reference))
+    {
+        errno = pReassembler->error();
+        PyErr_SetFromErrnoWithFilenameObject(PyExc_OSError, pPath);
+        Py_DECREF(pPath);
+        return nullptr;
+    }
+    Py_DECREF(pPath);
+
+    ReassemblerObject* pSelf = reinterpret_cast<ReassemblerObject*>(pType->tp_alloc(pType, 0));
+    if (!pSelf)
+        return nullptr;
+    pSelf->pReassembler = pReassembler.release();
+    pSelf->errorRaised = false;
+    return reinterpret_cast<PyObject*>(pSelf);
+}
+
+void reassemblerDealloc(PyObject* pSelf)
+{
+    PyTypeObject* pType = Py_TYPE(pSelf);
+    delete reinterpret_cast<ReassemblerObject*>(pSelf)->pReassembler;
+    pType->tp_free(pSelf);
+    Py_DECREF(pType);
+}
+
+PyObject* reassemblerFrame(PyObject* pSelf, PyObject* pArgs)
+{
+    Py_buffer data;
+    if (!PyArg_ParseTuple(pArgs, "y*", &data))
+        return nullptr;
+
+    ReassemblerObject* pObject = reinterpret_cast<ReassemblerObject*>(pSelf);
+    sbem::Reassembler& rReassembler = *pObject->pReassembler;
+    sbem::FrameKind kind;
+    Py_BEGIN_ALLOW_THREADS
+    kind = rReassembler.frame(static_cast<const uint8_t*>(data.buf), static_cast<size_t>(data.len));
+    Py_END_ALLOW_THREADS
+    PyBuffer_Release(&data);
+    if (!rReassembler.ok() && !pObject->errorRaised)
+    {
+        // errno itself may be stale by now, the Reassembler kept the one of the failed write
+        pObject->errorRaised = true;
+        errno = rReassembler.error();
+        return PyErr_SetFromErrno(PyExc_OSError);
+    }
+    switch (kind)
+    {
+    case sbem::FrameKind::DATA:
+        return PyUnicode_FromString("data");
+    case sbem::FrameKind::END:
+        return PyUnicode_FromString("end");
+    case sbem::FrameKind::FOREIGN:
+        return PyUnicode_FromString("foreign");
+    case sbem::FrameKind::MALFORMED:
+        break;
+    }
+    return PyUnicode_FromString("malformed");
+}
+
+PyObject* reassemblerMissing(PyObject* pSelf, PyObject*)
+{
+    std::vector<sbem::ByteRange> holes;
+    reinterpret_cast<ReassemblerObject*>(pSelf)->pReassembler->missing(holes);
+    PyObject* pList = PyList_New(static_cast<Py_ssize_t>(holes.size()));
+    if (!pList)
+        return nullptr;
+    for (size_t i = 0; i < holes.size(); i++)
+    {
+        PyObject* pRange = Py_BuildValue("(KK)", static_cast<unsigned long long>(holes[i].begin),
+                                         static_cast<unsigned long long>(holes[i].end));
+        if (!pRange)
+        {
+            Py_DECREF(pList);
+            return nullptr;
+        }
+        PyList_SET_ITEM(pList, static_cast<Py_ssize_t>(i), pRange);
+    }
+    return pList;
+}
+
+PyObject* reassemblerClose(PyObject* pSelf, PyObject*)
+{
+    sbem::Reassembler& rReassembler = *reinterpret_cast<ReassemblerObject*>(pSelf)->pReassembler;
+    bool ok;
+    Py_BEGIN_ALLOW_THREADS
+    ok = rReassembler.close();
+    Py_END_ALLOW_THREADS
+    return PyBool_FromLong(ok);
+}
+
+PyObject* reassemblerStats(PyObject* pSelf, PyObject*)
+{
+    const sbem::Reassembler& rReassembler = *reinterpret_cast<ReassemblerObject*>(pSelf)->pReassembler;
+    const sbem::ReassemblyStats& rStats = rReassembler.stats();
+    return Py_BuildValue("{sKsKsKsKsKsKsKsKsO}", "size", static_cast<unsigned long long>(rReassembler.size()),
+                         "received", static_cast<unsigned long long>(rReassembler.received()),
+                         "frames", static_cast<unsigned long long>(rStats.frames),
+                         "duplicates", static_cast<unsigned long long>(rStats.duplicates),
+                         "foreign", static_cast<unsigned long long>(rStats.foreign),
+                         "malformed", static_cast<unsigned long long>(rStats.malformed),
+                         "block_writes", static_cast<unsigned long long>(rStats.blockWrites),
+                         "range_writes", static_cast<unsigned long long>(rStats.rangeWrites),
+                         "complete", rReassembler.complete() ? Py_True : Py_False);
+}
+
+PyMethodDef reassemblerMethods[] =
+{
+    {
+        "frame", reassemblerFrame, METH_VARARGS,
+        "frame(notification) -> str\n\n"
+        "Take a notification as received, header included. Returns 'data', 'end'\n"
+        "(the EOF marker), 'foreign' (another reference or type) or 'malformed'.\n"
+        "Raises OSError, once, when a write to the file fails; close() then returns False."
+    },
+    {
+        "missing", reassemblerMissing, METH_NOARGS,
+        "missing() -> list\n\n"
+        "(begin, end) byte ranges not received, below the size from the EOF\n"
+        "marker (before it: below the furthest byte received)."
+    },
+    {
+        "close", reassemblerClose, METH_NOARGS,
+        "close() -> bool\n\n"
+        "Write what is buffered and close the file; holes read as zeros. False\n"
+        "if any write failed."
+    },
+    {
+        "stats", reassemblerStats, METH_NOARGS,
+        "stats() -> dict\n\n"
+        "Log size and bytes received, frames taken, duplicate payload bytes,\n"
+        "foreign and malformed notifications, whole block and partial writes,\n"
+        "and whether the log is complete."
+    },
+    { nullptr, nullptr, 0, nullptr }
+};
+
+PyType_Slot reassemblerSlots[] =
+{
+    { Py_tp_new, reinterpret_cast<void*>(reassemblerNew) },
+    { Py_tp_dealloc, reinterpret_cast<void*>(reassemblerDealloc) },
+    { Py_tp_methods, reassemblerMethods },
+    { Py_tp_doc, const_cast<char*>(
+        "Reassembler(path, reference=101)\n\n"
+        "Writes the log of a FETCH_LOG with this reference to path from its data\n"
+        "notifications, in any order, repeated or lost: new bytes are gathered in\n"
+        "64 KiB blocks and written a block at a time, and the received ranges are\n"
+        "kept so missing() can list the holes after the EOF marker.") },
+    { 0, nullptr }
+};
+
+PyType_Spec reassemblerSpec =
+{
+    "sbem_native.Reassembler", sizeof(ReassemblerObject), 0, Py_TPFLAGS_DEFAULT, reassemblerSlots
+};
+
+/** sbem_native.SeekableFile: byte ranges of a seekable zstd file (--zstd output). */
+struct SeekableFileObject
+{
+    PyObject_HEAD
+    sbem::SeekableReader* pReader;
+};
+
+PyObject* seekableFileNew(PyTypeObject* pType, PyObject* pArgs, PyObject* pKwargs)
+{
+    static const char* KEYWORDS[] = { "path", nullptr };
+    PyObject* pPath = nullptr;
+    if (!PyArg_ParseTupleAndKeywords(pArgs, pKwargs, "O&", const_cast<char**>(KEYWORDS), PyUnicode_FSConverter,
+                                     &pPath))
+    {
+        return nullptr;
+    }
+
+    std::unique_ptr<sbem::SeekableReader> pReader(new sbem::SeekableReader());
+    bool opened;
+    Py_BEGIN_ALLOW_THREADS
+    opened = pReader->open(PyBytes_AS_STRING(pPath));
+    Py_END_ALLOW_THREADS
+    if (!opened)
+    {
+#if SBEM_HAVE_ZSTD
+        PyErr_Format(PyExc_ValueError, "%s: not a seekable zstd file", PyBytes_AS_STRING(pPath));
+#else
+        PyErr_Format(PyExc_ValueError, "%s: sbem_native was built without zstd", PyBytes_AS_STRING(pPath));
+#endif
+        Py_DECREF(pPath);
+        return nullptr;
+    }
+    Py_DECREF(pPath);
+
+    SeekableFileObject* pSelf = reinterpret_cast<SeekableFileObject*>(pType->tp_alloc(pType, 0));
+    if (!pSelf)
+        return nullptr;
+    pSelf->pReader = pReader.release();
+    return reinterpret_cast<PyObject*>(pSelf);
+}
+
+void seekableFileDealloc(PyObject* pSelf)
+{
+    PyTypeObject* pType = Py_TYPE(pSelf);
+    delete reinterpret_cast<SeekableFileObject*>(pSelf)->pReader;
+    pType->tp_free(pSelf);
+    Py_DECREF(pType);
+}
+
+PyObject* seekableFileRead(PyObject* pSelf, PyObject* pArgs)
+{
+    unsigned long long offset = 0;
+    Py_ssize_t length = 0;
+    if (!PyArg_ParseTuple(pArgs, "Kn", &offset, &length))
+        return nullptr;
+
+    sbem::SeekableReader& rReader = *reinterpret_cast<SeekableFileObject*>(pSelf)->pReader;
+    if (length < 0 || offset > rReader.size() || static_cast<uint64_t>(length) > rReader.size() - offset)
+    {
+        PyErr_SetString(PyExc_ValueError, "range runs past the end of the file");
+        return nullptr;
+    }
+    PyObject* pBytes = PyBytes_FromStringAndSize(nullptr, length);
+    if (!pBytes)
+        return nullptr;
+    bool ok;
+    Py_BEGIN_ALLOW_THREADS
+    ok = rReader.read(offset, static_cast<size_t>(length), PyBytes_AS_STRING(pBytes));
+    Py_END_ALLOW_THREADS
+    if (!ok)
+    {
+        Py_DECREF(pBytes);
+        PyErr_SetString(PyExc_ValueError, "corrupt zstd frame");
+        return nullptr;
+    }
+    return pBytes;
+}
+
+PyObject* seekableFileSize(PyObject* pSelf, PyObject*)
+{
+    return PyLong_FromUnsignedLongLong(reinterpret_cast<SeekableFileObject*>(pSelf)->pReader->size());
+}
+
+PyMethodDef seekableFileMethods[] =
+{
+    {
+        "read", seekableFileRead, METH_VARARGS,
+        "read(offset, length) -> bytes\n\n"
+        "length bytes of the decompressed data from offset. Only the frames the\n"
+        "range overlaps are decompressed. Raises ValueError past size() or on a\n"
+        "corrupt frame."
+    },
+    {
+        "size", seekableFileSize, METH_NOARGS,
+        "size() -> int\n\n"
+        "Size of the decompressed data."
+    },
+    { nullptr, nullptr, 0, nullptr }
+};
+
+PyType_Slot seekableFileSlots[] =
+{
+    { Py_tp_new, reinterpret_cast<void*>(seekableFileNew) },
+    { Py_tp_dealloc, reinterpret_cast<void*>(seekableFileDealloc) },
+    { Py_tp_methods, seekableFileMethods },
+    { Py_tp_doc, const_cast<char*>(
+        "SeekableFile(path)\n\n"
+        "Random access to a .csv.zst or .sbcol.zst written with --zstd, through\n"
+        "its seek table. Raises ValueError if path isn't a seekable zstd file or\n"
+        "the module was built without zstd. The GIL is released while reading.") },
+    { 0, nullptr }
+};
+
+PyType_Spec seekableFileSpec =
+{
+    "sbem_native.SeekableFile", sizeof(SeekableFileObject), 0, Py_TPFLAGS_DEFAULT, seekableFileSlots
+};
+
+PyMethodDef METHODS[] =
+{
+    {
+        "decode", reinterpret_cast<PyCFunction>(reinterpret_cast<void (*)(void)>(decode)),
+        METH_VARARGS | METH_KEYWORDS,
+        "decode(path, threads=1) -> dict\n\n"
+        "Decode an SBEM file. Returns read-only arrays viewing the decoded columns,\n"
+        "keyed like the .sbcol files (ecg.samples, imu.acc_x, ...), plus chunk_count,\n"
+        "truncated and gaps, the (begin, end) byte ranges skipped as corrupt.\n"
+        "The GIL is released while decoding."
+    },
+    {
+        "convert", reinterpret_cast<PyCFunction>(reinterpret_cast<void (*)(void)>(convert)),
+        METH_VARARGS | METH_KEYWORDS,
+        "convert(path, output_dir, threads=1, columnar=False, memory_limit_mb=0) -> str or None\n\n"
+        "Decode an SBEM file and write <output_dir>/<name>.csv byte identical to\n"
+        "converter.py (or <name>.sbcol). Returns the output path, or None if the\n"
+        "log has no data rows. Raises OSError if the output can't be written. With\n"
+        "memory_limit_mb the CSV is converted in batches within that much memory,\n"
+        "however long the log. Runs entirely without the GIL."
+    },
+    { nullptr, nullptr, 0, nullptr }
+};
+
+PyModuleDef MODULE =
+{
+    PyModuleDef_HEAD_INIT, "sbem_native", "Native SBEM decoder (sensor-software/SbemTools).", -1, METHODS,
+    nullptr, nullptr, nullptr, nullptr
+};
+
+} // namespace
+
+PyMODINIT_FUNC PyInit_sbem_native()
+{
+#if SBEM_HAVE_NUMPY
+    import_array();
+#endif
+
+    pRecordingType = reinterpret_cast<PyTypeObject*>(PyType_FromSpec(&recordingSpec));
+    pColumnType = reinterpret_cast<PyTypeObject*>(PyType_FromSpec(&columnSpec));
+    PyObject* pPushConverterType = PyType_FromSpec(&pushConverterSpec);
+    PyObject* pReassemblerType = PyType_FromSpec(&reassemblerSpec);
+    PyObject* pSeekableFileType = PyType_FromSpec(&seekableFileSpec);
+    if (!pRecordingType || !pColumnType || !pPushConverterType || !pReassemblerType || !pSeekableFileType)
+        return nullptr;
+
+    PyObject* pModule = PyModule_Create(&MODULE);
+    if (!pModule || PyModule_AddObject(pModule, "PushConverter", pPushConverterType) < 0)
+    {
+        Py_XDECREF(pModule);
+        Py_DECREF(pPushConverterType);
+        Py_DECREF(pReassemblerType);
+        Py_DECREF(pSeekableFileType);
+        return nullptr;
+    }
+    if (PyModule_AddObject(pModule, "Reassembler", pReassemblerType) < 0)
+    {
+        Py_DECREF(pModule);
+        Py_DECREF(pReassemblerType);
+        Py_DECREF(pSeekableFileType);
+        return nullptr;
+    }
+    if (PyModule_AddObject(pModule, "SeekableFile", pSeekableFileType) < 0)
+    {
+        Py_DECREF(pModule);
+        Py_DECREF(pSeekableFileType);
+        return nullptr;
+    }
+    return pModule;
+}
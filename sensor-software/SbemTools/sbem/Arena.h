@@ -0,0 +1,158 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <utility>
+
+#include <sys/mman.h>
+
+namespace sbem
+{
+
+/**
+*   One contiguous block carved into typed arrays by bumping a pointer.
+*
+*   The decoder sizes the block from the chunk counts of the scan pass, so a
+*   whole recording lives in a single allocation and decoding itself never
+*   allocates. Memory is not initialised; every slot is written by the decoder.
+*/
+class Arena
+{
+public:
+    /** Arrays start on cache line boundaries (also keeps SIMD loads aligned). */
+    static constexpr size_t ALIGNMENT = 64;
+
+    /** Blocks from this size on are mapped straight from the kernel. */
+    static constexpr size_t MAP_THRESHOLD = 1 << 20;
+
+    static constexpr size_t footprint(size_t bytes)
+    {
+        return (bytes + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+    }
+
+    template <typename T>
+    static constexpr size_t footprint(size_t count)
+    {
+        return footprint(count * sizeof(T));
+    }
+
+    Arena():
+        mBase(nullptr),
+        mCapacity(0),
+        mUsed(0)
+    {
+    }
+
+    ~Arena()
+    {
+        release();
+    }
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    Arena(Arena&& rOther) noexcept:
+        mBase(rOther.mBase),
+        mCapacity(rOther.mCapacity),
+        mUsed(rOther.mUsed)
+    {
+        rOther.mBase = nullptr;
+        rOther.mCapacity = 0;
+        rOther.mUsed = 0;
+    }
+
+    Arena& operator=(Arena&& rOther) noexcept
+    {
+        if (this != &rOther)
+        {
+            release();
+            std::swap(mBase, rOther.mBase);
+            std::swap(mCapacity, rOther.mCapacity);
+            std::swap(mUsed, rOther.mUsed);
+        }
+        return *this;
+    }
+
+    /**
+    *   Drop the current block and allocate a new one.
+    *
+    *   @param bytes Capacity, normally a sum of footprint() values
+    *   @return false if the allocation failed
+    */
+    bool reset(size_t bytes)
+    {
+        release();
+        if (bytes == 0)
+            return true;
+
+        // malloc raises its own mapping threshold to the largest block freed, after which a recording
+        // freed for the next file stays in the heap under whatever was allocated above it
+        void* p = nullptr;
+        if (footprint(bytes) >= MAP_THRESHOLD)
+        {
+            p = mmap(nullptr, footprint(bytes), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (p == MAP_FAILED)
+                return false;
+        }
+        else if (posix_memalign(&p, ALIGNMENT, footprint(bytes)) != 0)
+        {
+            return false;
+        }
+        mBase = static_cast<uint8_t*>(p);
+        mCapacity = footprint(bytes);
+        return true;
+    }
+
+    /**
+    *   Empty the arena for reuse, keeping the current block if it holds bytes.
+    *
+    *   @param bytes Capacity needed
+    *   @return false if a new block was needed and the allocation failed
+    */
+    bool reuse(size_t bytes)
+    {
+        if (mBase && footprint(bytes) <= mCapacity)
+        {
+            mUsed = 0;
+            return true;
+        }
+        return reset(bytes);
+    }
+
+    void release()
+    {
+        if (mCapacity >= MAP_THRESHOLD)
+            munmap(mBase, mCapacity);
+        else
+            free(mBase);
+        mBase = nullptr;
+        mCapacity = 0;
+        mUsed = 0;
+    }
+
+    /**
+    *   @param count Elements
+    *   @return Uninitialised array, or nullptr if the block is too small
+    */
+    template <typename T>
+    T* alloc(size_t count)
+    {
+        const size_t bytes = footprint<T>(count);
+        if (mUsed + bytes > mCapacity)
+            return count ? nullptr : reinterpret_cast<T*>(mBase + mUsed);
+        T* p = reinterpret_cast<T*>(mBase + mUsed);
+        mUsed += bytes;
+        return p;
+    }
+
+    size_t capacity() const { return mCapacity; }
+    size_t used() const { return mUsed; }
+
+private:
+    uint8_t* mBase;
+    size_t mCapacity;
+    size_t mUsed;
+};
+
+} // namespace sbem
@@ -0,0 +1,268 @@
+#include "ChunkIndex.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "DecodePlan.h"
+#include "FileIo.h"
+#include "Scanner.h"
+
+namespace sbem
+{
+
+namespace
+{
+
+const char MAGIC[8] = { 'S', 'B', 'E', 'M', 'I', 'D', 'X', '\0' };
+constexpr uint32_t VERSION = 4;
+constexpr uint16_t FLAG_TRUNCATED = 1;
+constexpr size_t STAMP_BLOCK = 64 * 1024;
+
+/** Sidecar header, followed by entryCount IndexEntry records and gapCount Gap records. */
+struct FileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint16_t entrySize;
+    uint16_t flags;
+    uint64_t sourceSize;
+    int64_t sourceMtimeNs;
+    uint64_t sourceHash;
+    uint64_t entryCount;
+    uint64_t ecgSamples;
+    uint64_t imuSamples;
+    uint64_t descriptorEnd;
+    uint64_t gapCount;
+    uint8_t reserved[48];
+};
+
+static_assert(sizeof(FileHeader) == 128, "FileHeader is a file record");
+
+bool isPacket(const IndexEntry& rEntry)
+{
+    return rEntry.kind == ChunkKind::ECG || rEntry.kind == ChunkKind::IMU;
+}
+
+uint64_t fnv1a(uint64_t hash, const uint8_t* p, size_t size)
+{
+    for (size_t i = 0; i < size; i++)
+        hash = (hash ^ p[i]) * 0x100000001b3ull;
+    return hash;
+}
+
+} // namespace
+
+bool SourceStamp::of(const char* path, const uint8_t* pData, size_t size, SourceStamp& rStamp)
+{
+    struct stat st;
+    if (stat(path, &st) != 0)
+        return false;
+
+    rStamp.size = size;
+    rStamp.mtimeNs = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+
+    const size_t head = size < STAMP_BLOCK ? size : STAMP_BLOCK;
+    const size_t tail = size - head < STAMP_BLOCK ? size - head : STAMP_BLOCK;
+    rStamp.hash = fnv1a(fnv1a(0xcbf29ce484222325ull, pData, head), pData + size - tail, tail);
+    return true;
+}
+
+void ChunkIndex::build(const uint8_t* pData, size_t size)
+{
+    clear();
+    mBuilt.reserve(size / (ECG_MV_PACKET_SIZE + 2) + 16);
+
+    PlanTable plans;
+    Scanner scanner(pData, size);
+    Chunk chunk;
+    while (scanner.next(chunk))
+    {
+        const uint8_t* p = pData + chunk.offset;
+
+        IndexEntry entry = {};
+        entry.offset = chunk.offset;
+        entry.length = chunk.length;
+        entry.firstTimestamp = chunk.length >= 4 ? loadU32(p) : 0;
+        entry.id = chunk.id;
+
+        if (chunk.id == DESCRIPTOR_ID)
+        {
+            plans.addDescriptor(p, chunk.length);
+            entry.kind = ChunkKind::DESCRIPTOR;
+            mBuilt.push_back(entry);
+            mDescriptorEnd = mBuilt.size();
+            continue;
+        }
+
+        const DecodePlan* pPlan;
+        switch (plans.route(chunk.id, chunk.length, pPlan))
+        {
+        case PacketKind::ECG_MV:
+            entry.kind = ChunkKind::ECG;
+            entry.samples = ECG_SAMPLES_PER_PACKET;
+            break;
+        case PacketKind::IMU6:
+            entry.kind = ChunkKind::IMU;
+            entry.samples = IMU_SAMPLES_PER_PACKET;
+            break;
+        case PacketKind::GENERIC:
+            entry.kind = ChunkKind::OTHER;
+            entry.samples = pPlan ? pPlan->valueCount(chunk.length) : 0;
+            break;
+        }
+        mBuilt.push_back(entry);
+    }
+
+    mBuiltGaps = scanner.gaps();
+    mpEntries = mBuilt.data();
+    mCount = mBuilt.size();
+    mpGaps = mBuiltGaps.data();
+    mGapCount = mBuiltGaps.size();
+    mTruncated = scanner.truncated();
+    for (const IndexEntry& e : mBuilt)
+    {
+        if (e.kind == ChunkKind::ECG)
+            mEcgSamples += e.samples;
+        else if (e.kind == ChunkKind::IMU)
+            mImuSamples += e.samples;
+    }
+}
+
+bool ChunkIndex::load(const char* indexPath, const SourceStamp& rSource)
+{
+    clear();
+    if (!mFile.open(indexPath, MappedFile::Access::RANDOM))
+        return false;
+
+    FileHeader header;
+    if (mFile.size() < sizeof(header))
+    {
+        clear();
+        return false;
+    }
+    memcpy(&header, mFile.data(), sizeof(header));
+
+    const SourceStamp stamp = { header.sourceSize, header.sourceMtimeNs, header.sourceHash };
+    const uint64_t records = mFile.size() - sizeof(header);
+    const bool valid = memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0 && header.version == VERSION &&
+                       header.entrySize == sizeof(IndexEntry) && stamp == rSource &&
+                       header.entryCount <= records / sizeof(IndexEntry) &&
+                       header.gapCount <= records / sizeof(Gap) &&
+                       header.entryCount * sizeof(IndexEntry) + header.gapCount * sizeof(Gap) == records;
+    if (!valid)
+    {
+        clear();
+        return false;
+    }
+
+    mpEntries = reinterpret_cast<const IndexEntry*>(mFile.data() + sizeof(header));
+    mCount = static_cast<size_t>(header.entryCount);
+    mpGaps = reinterpret_cast<const Gap*>(mFile.data() + sizeof(header) + mCount * sizeof(IndexEntry));
+    mGapCount = static_cast<size_t>(header.gapCount);
+    mTruncated = (header.flags & FLAG_TRUNCATED) != 0;
+    mEcgSamples = header.ecgSamples;
+    mImuSamples = header.imuSamples;
+    mDescriptorEnd = static_cast<size_t>(std::min<uint64_t>(header.descriptorEnd, header.entryCount));
+    return true;
+}
+
+bool ChunkIndex::save(const char* indexPath, const SourceStamp& rSource) const
+{
+    FileHeader header = {};
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.entrySize = sizeof(IndexEntry);
+    header.sourceSize = rSource.size;
+    header.sourceMtimeNs = rSource.mtimeNs;
+    header.sourceHash = rSource.hash;
+    header.entryCount = mCount;
+    header.flags = mTruncated ? FLAG_TRUNCATED : 0;
+    header.ecgSamples = mEcgSamples;
+    header.imuSamples = mImuSamples;
+    header.descriptorEnd = mDescriptorEnd;
+    header.gapCount = mGapCount;
+
+    const std::string tmpPath = std::string(indexPath) + ".tmp" + std::to_string(getpid());
+    const int fd = ::open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return false;
+
+    bool ok = writeAll(fd, &header, sizeof(header)) && writeAll(fd, mpEntries, mCount * sizeof(IndexEntry)) &&
+              writeAll(fd, mpGaps, mGapCount * sizeof(Gap));
+    if (::close(fd) != 0)
+        ok = false;
+    if (ok && rename(tmpPath.c_str(), indexPath) != 0)
+        ok = false;
+    if (!ok)
+        unlink(tmpPath.c_str());
+    return ok;
+}
+
+bool ChunkIndex::useSidecar(const char* path, const uint8_t* pData, size_t size)
+{
+    const std::string indexPath = sidecarPath(path);
+    SourceStamp stamp;
+    const bool stamped = SourceStamp::of(path, pData, size, stamp);
+    if (stamped && load(indexPath.c_str(), stamp))
+        return true;
+
+    build(pData, size);
+    if (stamped)
+        save(indexPath.c_str(), stamp);
+    return false;
+}
+
+void ChunkIndex::clear()
+{
+    mBuilt.clear();
+    mBuiltGaps.clear();
+    mFile.close();
+    mpEntries = nullptr;
+    mCount = 0;
+    mpGaps = nullptr;
+    mGapCount = 0;
+    mTruncated = false;
+    mEcgSamples = 0;
+    mImuSamples = 0;
+    mDescriptorEnd = 0;
+}
+
+size_t ChunkIndex::lowerBound(uint32_t timestamp) const
+{
+    // Packet timestamps ascend; the few other chunks in between are stepped over
+    size_t lo = 0;
+    size_t hi = mCount;
+    while (lo < hi)
+    {
+        const size_t mid = lo + (hi - lo) / 2;
+        size_t packet = mid;
+        while (packet < hi && !isPacket(mpEntries[packet]))
+            packet++;
+
+        if (packet == hi || mpEntries[packet].firstTimestamp >= timestamp)
+            hi = mid;
+        else
+            lo = packet + 1;
+    }
+    return lo;
+}
+
+bool ChunkIndex::firstTimestamp(uint32_t& rTimestamp) const
+{
+    for (const IndexEntry& e : *this)
+    {
+        if (isPacket(e))
+        {
+            rTimestamp = e.firstTimestamp;
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace sbem
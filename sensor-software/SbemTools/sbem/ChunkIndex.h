@@ -0,0 +1,164 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "MappedFile.h"
+#include "SbemFormat.h"
+
+namespace sbem
+{
+
+/** What a chunk decodes into. */
+enum class ChunkKind : uint8_t
+{
+    DESCRIPTOR,
+    ECG,
+    IMU,
+    OTHER
+};
+
+/** One chunk of the indexed file, 24 bytes on disk. */
+struct IndexEntry
+{
+    uint64_t offset;            // payload offset in the file
+    uint32_t length;            // payload length
+    uint32_t firstTimestamp;    // first 4 payload bytes: the packet timestamp of ECG and IMU chunks
+    uint32_t samples;           // values the chunk adds to its channel, per axis for IMU
+    uint16_t id;
+    ChunkKind kind;
+    uint8_t reserved;
+};
+
+static_assert(sizeof(IndexEntry) == 24, "IndexEntry is a file record");
+
+/**
+*   Identity of the file an index was built from. Logs only ever grow, so the
+*   size, modification time and a hash of the first and last 64 KiB catch
+*   every rewrite without reading the whole file.
+*/
+struct SourceStamp
+{
+    uint64_t size = 0;
+    int64_t mtimeNs = 0;
+    uint64_t hash = 0;
+
+    /**
+    *   @param path The SBEM file
+    *   @param pData Its mapped image
+    *   @param size Image size
+    *   @param rStamp Receives the stamp
+    *   @return false if the file can't be stat'ed
+    */
+    static bool of(const char* path, const uint8_t* pData, size_t size, SourceStamp& rStamp);
+
+    bool operator==(const SourceStamp& rOther) const
+    {
+        return size == rOther.size && mtimeNs == rOther.mtimeNs && hash == rOther.hash;
+    }
+};
+
+/**
+*   Chunk boundaries of an SBEM file: where every chunk is, what it decodes
+*   into and the timestamp it starts at, and the corrupt ranges in between. Built by one scan and kept in a
+*   sidecar file next to the log (<file>.sbem.sbidx), so later readers seek
+*   straight to a chunk instead of walking the file from byte 0.
+*
+*   A loaded index points into the mapped sidecar; nothing is copied.
+*/
+class ChunkIndex
+{
+public:
+    /**
+    *   Scan an SBEM image. Descriptors are compiled on the way so chunks are
+    *   classified exactly the way Decoder routes them.
+    *
+    *   @param pData Start of the file image
+    *   @param size Image size
+    */
+    void build(const uint8_t* pData, size_t size);
+
+    /**
+    *   Map a sidecar written by save().
+    *
+    *   @param indexPath Sidecar file
+    *   @param rSource Stamp of the SBEM file as it is now
+    *   @return false if the sidecar is missing, malformed or was built from another file
+    */
+    bool load(const char* indexPath, const SourceStamp& rSource);
+
+    /**
+    *   Write the index. The file is written under a temporary name and renamed
+    *   into place, so concurrent readers never see half an index.
+    *
+    *   @param indexPath Sidecar file
+    *   @param rSource Stamp of the file the index was built from
+    *   @return false if the sidecar can't be written
+    */
+    bool save(const char* indexPath, const SourceStamp& rSource) const;
+
+    /**
+    *   Load the sidecar of an SBEM file, or build it and try to save it when
+    *   it is missing or stale. A folder that can't be written to just means
+    *   the index is rebuilt next time.
+    *
+    *   @param path The SBEM file
+    *   @param pData Its mapped image
+    *   @param size Image size
+    *   @return true if a valid sidecar was reused, false if the index was built
+    */
+    bool useSidecar(const char* path, const uint8_t* pData, size_t size);
+
+    /** Sidecar name of an SBEM file. */
+    static std::string sidecarPath(const char* path) { return std::string(path) + ".sbidx"; }
+
+    void clear();
+
+    size_t size() const { return mCount; }
+    bool empty() const { return mCount == 0; }
+    const IndexEntry& operator[](size_t i) const { return mpEntries[i]; }
+    const IndexEntry* begin() const { return mpEntries; }
+    const IndexEntry* end() const { return mpEntries + mCount; }
+
+    /** True if the file ends in corrupt bytes, e.g. a chunk running past its end. */
+    bool truncated() const { return mTruncated; }
+
+    /** Corrupt byte ranges the scan skipped, in file order. */
+    const Gap* gapsBegin() const { return mpGaps; }
+    const Gap* gapsEnd() const { return mpGaps + mGapCount; }
+    size_t gapCount() const { return mGapCount; }
+    uint64_t ecgSamples() const { return mEcgSamples; }
+    uint64_t imuSamples() const { return mImuSamples; }
+
+    /** One past the last descriptor chunk; a decode starting later only needs to read these first. */
+    size_t descriptorEnd() const { return mDescriptorEnd; }
+
+    /**
+    *   Binary search over the ECG and IMU packet timestamps.
+    *
+    *   @param timestamp Sensor time in ms
+    *   @return First chunk that isn't a packet earlier than timestamp, size() if there is none
+    */
+    size_t lowerBound(uint32_t timestamp) const;
+
+    /**
+    *   @param rTimestamp Receives the timestamp of the first ECG or IMU packet
+    *   @return false if the file has no packets
+    */
+    bool firstTimestamp(uint32_t& rTimestamp) const;
+
+private:
+    std::vector<IndexEntry> mBuilt;
+    std::vector<Gap> mBuiltGaps;
+    MappedFile mFile;
+    const IndexEntry* mpEntries = nullptr;
+    size_t mCount = 0;
+    const Gap* mpGaps = nullptr;
+    size_t mGapCount = 0;
+    bool mTruncated = false;
+    uint64_t mEcgSamples = 0;
+    uint64_t mImuSamples = 0;
+    size_t mDescriptorEnd = 0;
+};
+
+} // namespace sbem
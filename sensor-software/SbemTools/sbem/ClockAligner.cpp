@@ -0,0 +1,350 @@
+#include "ClockAligner.h"
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <vector>
+
+namespace sbem
+{
+
+namespace
+{
+
+constexpr double STEP_MS = 20.0;            // activity signal at 50 Hz
+constexpr size_t COARSE = 10;               // samples averaged for the 5 Hz whole-recording search
+constexpr size_t HIGH_PASS = 25;            // half width of the moving average taken off the magnitude, 0.5 s
+constexpr double MAX_DRIFT = 1e-4;          // 100 ppm, beyond any crystal; bounds the window search
+constexpr size_t MIN_SAMPLES = 30000 / 20;  // 30 s of activity
+
+/** Activity samples every STEP_MS from start on a sensor's clock; 0 where the IMU has no data. */
+struct Activity
+{
+    double start = 0.0;
+    std::vector<float> values;
+    std::vector<uint8_t> valid;
+};
+
+/** Median step between consecutive packet timestamps, 0 with fewer than two packets. */
+double packetPeriod(const Column<uint32_t>& rTimestamps)
+{
+    std::vector<uint32_t> steps;
+    for (size_t i = 1; i < rTimestamps.size; i++)
+    {
+        if (rTimestamps[i] > rTimestamps[i - 1])
+            steps.push_back(rTimestamps[i] - rTimestamps[i - 1]);
+    }
+    if (steps.empty())
+        return 0.0;
+    std::nth_element(steps.begin(), steps.begin() + steps.size() / 2, steps.end());
+    return steps[steps.size() / 2];
+}
+
+/**
+*   Accelerometer magnitude resampled to STEP_MS, less its 1 s moving
+*   average, rectified and normalised to zero mean and unit variance over
+*   the samples that have data.
+*/
+bool buildActivity(const ImuColumns& rImu, Activity& rOut)
+{
+    const double dt = packetPeriod(rImu.timestamp) / IMU_SAMPLES_PER_PACKET;
+    if (dt <= 0.0)
+        return false;
+
+    const size_t samples = rImu.packets() * IMU_SAMPLES_PER_PACKET;
+    auto timeOf = [&](size_t j)
+    {
+        return rImu.timestamp[j / IMU_SAMPLES_PER_PACKET] + (j % IMU_SAMPLES_PER_PACKET) * dt;
+    };
+    auto magnitude = [&](size_t j)
+    {
+        return std::sqrt(double(rImu.accelX[j]) * rImu.accelX[j] + double(rImu.accelY[j]) * rImu.accelY[j] +
+                         double(rImu.accelZ[j]) * rImu.accelZ[j]);
+    };
+
+    rOut.start = timeOf(0);
+    const double span = timeOf(samples - 1) - rOut.start;
+    if (span <= 0.0 || span / STEP_MS < MIN_SAMPLES)
+        return false;
+    const size_t n = static_cast<size_t>(span / STEP_MS) + 1;
+    std::vector<double> level(n, 0.0);
+    rOut.valid.assign(n, 0);
+
+    size_t j = 0;
+    for (size_t k = 0; k < n; k++)
+    {
+        const double t = rOut.start + k * STEP_MS;
+        while (j + 1 < samples && timeOf(j + 1) <= t)
+            j++;
+        if (j + 1 >= samples)
+            break;
+        const double t0 = timeOf(j);
+        const double t1 = timeOf(j + 1);
+        if (t1 > t0 && t1 - t0 <= 3 * dt)
+        {
+            const double w = (t - t0) / (t1 - t0);
+            level[k] = magnitude(j) * (1.0 - w) + magnitude(j + 1) * w;
+            rOut.valid[k] = 1;
+        }
+    }
+
+    // Moving average of the samples with data, from prefix sums
+    std::vector<double> sum(n + 1, 0.0);
+    std::vector<uint32_t> count(n + 1, 0);
+    for (size_t k = 0; k < n; k++)
+    {
+        sum[k + 1] = sum[k] + (rOut.valid[k] ? level[k] : 0.0);
+        count[k + 1] = count[k] + rOut.valid[k];
+    }
+    double total = 0.0;
+    double squares = 0.0;
+    size_t valid = 0;
+    for (size_t k = 0; k < n; k++)
+    {
+        if (!rOut.valid[k])
+            continue;
+        const size_t lo = k > HIGH_PASS ? k - HIGH_PASS : 0;
+        const size_t hi = std::min(n, k + HIGH_PASS + 1);
+        level[k] = std::fabs(level[k] - (sum[hi] - sum[lo]) / (count[hi] - count[lo]));
+        total += level[k];
+        squares += level[k] * level[k];
+        valid++;
+    }
+    if (valid < MIN_SAMPLES)
+        return false;
+    const double mean = total / valid;
+    const double deviation = std::sqrt(std::max(0.0, squares / valid - mean * mean));
+    if (deviation <= 0.0)
+        return false;
+
+    rOut.values.assign(n, 0.0f);
+    for (size_t k = 0; k < n; k++)
+    {
+        if (rOut.valid[k])
+            rOut.values[k] = static_cast<float>((level[k] - mean) / deviation);
+    }
+    return true;
+}
+
+/** In place radix-2 FFT; the size is a power of two. */
+void fft(std::vector<std::complex<double>>& rData, bool inverse)
+{
+    const size_t n = rData.size();
+    for (size_t i = 1, j = 0; i < n; i++)
+    {
+        size_t bit = n >> 1;
+        for (; j & bit; bit >>= 1)
+            j ^= bit;
+        j ^= bit;
+        if (i < j)
+            std::swap(rData[i], rData[j]);
+    }
+    for (size_t len = 2; len <= n; len <<= 1)
+    {
+        const double angle = 2 * M_PI / len * (inverse ? 1 : -1);
+        const std::complex<double> root(std::cos(angle), std::sin(angle));
+        for (size_t i = 0; i < n; i += len)
+        {
+            std::complex<double> w(1.0);
+            for (size_t k = 0; k < len / 2; k++)
+            {
+                const std::complex<double> u = rData[i + k];
+                const std::complex<double> v = rData[i + k + len / 2] * w;
+                rData[i + k] = u + v;
+                rData[i + k + len / 2] = u - v;
+                w *= root;
+            }
+        }
+    }
+}
+
+std::vector<double> decimate(const std::vector<float>& rValues)
+{
+    std::vector<double> out(rValues.size() / COARSE, 0.0);
+    for (size_t b = 0; b < out.size(); b++)
+    {
+        for (size_t k = 0; k < COARSE; k++)
+            out[b] += rValues[b * COARSE + k];
+        out[b] /= COARSE;
+    }
+    return out;
+}
+
+/**
+*   Lag L in coarse samples maximising sum r[k + L] * s[k], over lags where
+*   the signals overlap by at least a tenth of the shorter one.
+*/
+bool coarseLag(const std::vector<double>& rRef, const std::vector<double>& rSensor, long& rLag)
+{
+    const size_t nr = rRef.size();
+    const size_t ns = rSensor.size();
+    if (!nr || !ns)
+        return false;
+    size_t n = 1;
+    while (n < nr + ns)
+        n <<= 1;
+
+    std::vector<std::complex<double>> a(n);
+    std::vector<std::complex<double>> b(n);
+    for (size_t k = 0; k < nr; k++)
+        a[k] = rRef[k];
+    for (size_t k = 0; k < ns; k++)
+        b[k] = rSensor[k];
+    fft(a, false);
+    fft(b, false);
+    for (size_t k = 0; k < n; k++)
+        a[k] *= std::conj(b[k]);
+    fft(a, true);
+
+    const long minOverlap = static_cast<long>(std::max<size_t>(1, std::min(nr, ns) / 10));
+    double best = -INFINITY;
+    for (long lag = 1 - static_cast<long>(ns); lag < static_cast<long>(nr); lag++)
+    {
+        const long overlap = std::min<long>(nr, lag + static_cast<long>(ns)) - std::max<long>(0, lag);
+        if (overlap < minOverlap)
+            continue;
+        const double c = a[lag < 0 ? n + lag : lag].real();
+        if (c > best)
+        {
+            best = c;
+            rLag = lag;
+        }
+    }
+    return best > -INFINITY;
+}
+
+/** Pearson correlation of s[begin, begin + length) with r shifted by lag, over samples both have. */
+double correlate(const Activity& rRef, const Activity& rSensor, size_t begin, size_t length, long lag)
+{
+    double sx = 0, sy = 0, sxx = 0, syy = 0, sxy = 0;
+    size_t n = 0;
+    for (size_t k = begin; k < begin + length; k++)
+    {
+        const size_t r = k + lag;
+        if (!rSensor.valid[k] || !rRef.valid[r])
+            continue;
+        const double x = rSensor.values[k];
+        const double y = rRef.values[r];
+        sx += x;
+        sy += y;
+        sxx += x * x;
+        syy += y * y;
+        sxy += x * y;
+        n++;
+    }
+    if (n < length / 2)
+        return 0.0;
+    const double cov = sxy - sx * sy / n;
+    const double vx = sxx - sx * sx / n;
+    const double vy = syy - sy * sy / n;
+    return vx > 0 && vy > 0 ? cov / std::sqrt(vx * vy) : 0.0;
+}
+
+struct WindowLag
+{
+    double time;        // sensor ms, middle of the window
+    double offset;      // reference ms - sensor ms
+    double weight;
+};
+
+/** Weighted least squares offset + drift * (time - anchor); drift stays 0 unless wanted and possible. */
+void fitLine(const std::vector<WindowLag>& rLags, double anchor, bool drift, double& rOffset, double& rDrift)
+{
+    double w = 0, wx = 0, wy = 0, wxx = 0, wxy = 0;
+    for (const WindowLag& rLag : rLags)
+    {
+        const double x = rLag.time - anchor;
+        w += rLag.weight;
+        wx += rLag.weight * x;
+        wy += rLag.weight * rLag.offset;
+        wxx += rLag.weight * x * x;
+        wxy += rLag.weight * x * rLag.offset;
+    }
+    const double det = w * wxx - wx * wx;
+    if (drift && rLags.size() >= 3 && det > 0)
+    {
+        rDrift = (w * wxy - wx * wy) / det;
+        rOffset = (wy - rDrift * wx) / w;
+    }
+    else
+    {
+        rDrift = 0.0;
+        rOffset = wy / w;
+    }
+}
+
+} // namespace
+
+bool ClockAligner::fit(const Recording& rReference, const Recording& rSensor, const AlignOptions& rOptions,
+                       ClockFit& rFit)
+{
+    rFit = ClockFit();
+    Activity ref;
+    Activity sensor;
+    if (!buildActivity(rReference.imu, ref) || !buildActivity(rSensor.imu, sensor))
+        return false;
+    rFit.anchor = sensor.start;
+
+    long lag = 0;
+    if (!coarseLag(decimate(ref.values), decimate(sensor.values), lag))
+        return false;
+
+    // Window lags around the coarse one; the search covers its error and the worst drift
+    const long nr = static_cast<long>(ref.values.size());
+    const long ns = static_cast<long>(sensor.values.size());
+    const long center = lag * static_cast<long>(COARSE);
+    const long radius = 2 * static_cast<long>(COARSE) + static_cast<long>(std::ceil(MAX_DRIFT * ns));
+    const size_t window = std::min<size_t>(ns, std::max<size_t>(MIN_SAMPLES, rOptions.windowMs / STEP_MS));
+
+    std::vector<WindowLag> lags;
+    for (size_t begin = 0; begin + window <= static_cast<size_t>(ns); begin += window)
+    {
+        const long first = std::max(center - radius, -static_cast<long>(begin));
+        const long last = std::min(center + radius, nr - static_cast<long>(begin + window));
+        if (first + 2 > last)
+            continue;
+
+        std::vector<double> scores(last - first + 1);
+        for (long l = first; l <= last; l++)
+            scores[l - first] = correlate(ref, sensor, begin, window, l);
+        const size_t peak = std::max_element(scores.begin(), scores.end()) - scores.begin();
+        if (scores[peak] < rOptions.minScore || peak == 0 || peak + 1 == scores.size())
+            continue;
+
+        // Parabola through the peak and its neighbours for the sub-sample lag
+        const double below = scores[peak - 1];
+        const double above = scores[peak + 1];
+        const double curve = below - 2 * scores[peak] + above;
+        const double shift = curve < 0 ? 0.5 * (below - above) / curve : 0.0;
+        const double samples = first + static_cast<double>(peak) + shift;
+        lags.push_back({ sensor.start + (begin + window / 2.0) * STEP_MS, ref.start - sensor.start + samples * STEP_MS,
+                         scores[peak] * scores[peak] });
+    }
+    if (lags.empty())
+        return false;
+
+    fitLine(lags, rFit.anchor, rOptions.drift, rFit.offset, rFit.drift);
+
+    // Drop windows far off the line (a repeated movement matched one period off) and fit again
+    std::vector<double> residuals;
+    for (const WindowLag& rLag : lags)
+        residuals.push_back(std::fabs(rLag.offset - rFit.toReference(rLag.time) + rLag.time));
+    std::vector<double> sorted = residuals;
+    std::nth_element(sorted.begin(), sorted.begin() + sorted.size() / 2, sorted.end());
+    const double limit = std::max(STEP_MS, 3 * 1.4826 * sorted[sorted.size() / 2]);
+    std::vector<WindowLag> kept;
+    for (size_t i = 0; i < lags.size(); i++)
+    {
+        if (residuals[i] <= limit)
+            kept.push_back(lags[i]);
+    }
+    fitLine(kept, rFit.anchor, rOptions.drift, rFit.offset, rFit.drift);
+
+    for (const WindowLag& rLag : kept)
+        rFit.score += std::sqrt(rLag.weight);
+    rFit.score /= kept.size();
+    rFit.windows = kept.size();
+    return true;
+}
+
+} // namespace sbem
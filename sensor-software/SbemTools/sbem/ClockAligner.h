@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "Recording.h"
+
+namespace sbem
+{
+
+/**
+*   Maps a sensor's clock onto the reference sensor's:
+*   reference ms = t + offset + drift * (t - anchor), t in sensor ms.
+*/
+struct ClockFit
+{
+    double offset = 0.0;        // ms, at the anchor
+    double drift = 0.0;         // reference ms gained per sensor ms, e.g. 20e-6 for 20 ppm
+    double anchor = 0.0;        // sensor ms, the first IMU packet
+    double score = 0.0;         // mean correlation of the windows used, 0 to 1
+    size_t windows = 0;         // windows the fit is based on
+
+    double toReference(double t) const { return t + offset + drift * (t - anchor); }
+    double toSensor(double reference) const { return (reference - offset + drift * anchor) / (1.0 + drift); }
+};
+
+struct AlignOptions
+{
+    /** Length of the windows whose lags the drift is fitted to [ms]. */
+    uint32_t windowMs = 10 * 60 * 1000;
+
+    /** Fit a drift; false fits the offset only. */
+    bool drift = true;
+
+    /** Windows correlating less than this are left out of the fit. */
+    double minScore = 0.2;
+};
+
+/**
+*   Estimates the clock relation of two sensors on one participant from the
+*   movement both IMUs record.
+*
+*   Both accelerometers are reduced to an orientation free activity signal,
+*   the magnitude with gravity and slow posture changes filtered out, sampled
+*   at 50 Hz on each sensor's own clock. The lag of the whole recordings is
+*   the peak of their FFT cross-correlation at 5 Hz, which finds the offset
+*   whatever the sensors' boot times. The lag is then measured again in
+*   windows of windowMs at 50 Hz around that estimate, sub-sample by fitting
+*   a parabola to the peak, and a weighted line through the window lags,
+*   outliers rejected once, gives the offset and the drift of the crystals.
+*/
+class ClockAligner
+{
+public:
+    /**
+    *   @param rReference Recording whose clock is the time base
+    *   @param rSensor Recording to map onto it
+    *   @param rOptions Window length and fit options
+    *   @param rFit Receives the mapping
+    *   @return false if either recording has too little IMU data or the
+    *           signals don't correlate anywhere
+    */
+    static bool fit(const Recording& rReference, const Recording& rSensor, const AlignOptions& rOptions,
+                    ClockFit& rFit);
+};
+
+} // namespace sbem
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "DecodePlan.h"
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "columnar files are written and mapped as little-endian"
+#endif
+
+/**
+*   On-disk layout of SBEM columnar files (.sbcol).
+*
+*   A decoded recording stored so it can be memory mapped and used in place:
+*
+*     FileHeader                      64 bytes
+*     ColumnEntry[columnCount]        128 bytes each
+*     padding to dataOffset
+*     array of column 0               at entry.offset, 64 byte aligned
+*     array of column 1 ...
+*
+*   Arrays are little-endian and tightly packed, entry.count elements of
+*   entry.type. Column names follow "<group>.<channel>": ecg.timestamp,
+*   ecg.samples, imu.acc_x ... imu.gyro_z, other.id, stream.<id>.values.
+*   Every group also has a <group>.chunk_index column with the chunk number
+*   of each packet in the source SBEM file. Stitched recordings add the gap
+*   table as gap.kind, gap.channel, gap.begin and gap.end (TimelineGapColumns).
+*/
+namespace sbem
+{
+namespace columnar
+{
+
+constexpr char MAGIC[8] = { 'S', 'B', 'E', 'M', 'C', 'O', 'L', '\0' };
+constexpr uint32_t VERSION = 1;
+constexpr size_t ALIGNMENT = 64;
+constexpr size_t NAME_SIZE = 48;
+constexpr size_t PATH_SIZE = 48;
+
+constexpr uint32_t FLAG_TRUNCATED = 1;  // the source's last chunk was cut short
+
+struct FileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t columnCount;
+    uint64_t dataOffset;        // first array, a multiple of ALIGNMENT
+    uint64_t sourceSize;        // bytes of the SBEM file this was decoded from
+    uint32_t chunkCount;        // chunks in the source, including descriptors
+    uint32_t flags;
+    uint8_t reserved[24];
+};
+
+/**
+*   type holds a FieldType value: uint8 0, int8 1, uint16 2, int16 3,
+*   uint32 4, int32 5, uint64 6, int64 7, float32 8, float64 9.
+*/
+struct ColumnEntry
+{
+    char name[NAME_SIZE];       // NUL padded
+    char path[PATH_SIZE];       // SBEM resource path of the group, e.g. /Meas/ECG/200/mV
+    uint8_t type;
+    uint8_t reserved[3];
+    float sampleRate;           // Hz of consecutive values; 0 for per-packet and unsampled columns
+    uint32_t valuesPerPacket;   // values each packet of the group contributes to this column
+    uint32_t firstTimestamp;    // time anchor: sensor timestamp [ms] of the group's first packet
+    uint64_t offset;            // from the start of the file
+    uint64_t count;             // elements
+};
+
+static_assert(sizeof(FileHeader) == 64, "FileHeader is part of the file format");
+static_assert(sizeof(ColumnEntry) == 128, "ColumnEntry is part of the file format");
+static_assert(static_cast<int>(FieldType::UINT32) == 4 && static_cast<int>(FieldType::FLOAT32) == 8 &&
+              static_cast<int>(FieldType::FLOAT64) == 9, "ColumnEntry::type stores FieldType values");
+
+template <typename T> struct TypeOf;
+template <> struct TypeOf<uint8_t> { static constexpr FieldType VALUE = FieldType::UINT8; };
+template <> struct TypeOf<int8_t> { static constexpr FieldType VALUE = FieldType::INT8; };
+template <> struct TypeOf<uint16_t> { static constexpr FieldType VALUE = FieldType::UINT16; };
+template <> struct TypeOf<int16_t> { static constexpr FieldType VALUE = FieldType::INT16; };
+template <> struct TypeOf<uint32_t> { static constexpr FieldType VALUE = FieldType::UINT32; };
+template <> struct TypeOf<int32_t> { static constexpr FieldType VALUE = FieldType::INT32; };
+template <> struct TypeOf<uint64_t> { static constexpr FieldType VALUE = FieldType::UINT64; };
+template <> struct TypeOf<int64_t> { static constexpr FieldType VALUE = FieldType::INT64; };
+template <> struct TypeOf<float> { static constexpr FieldType VALUE = FieldType::FLOAT32; };
+template <> struct TypeOf<double> { static constexpr FieldType VALUE = FieldType::FLOAT64; };
+
+} // namespace columnar
+
+/** One array of a mapped columnar file. */
+struct ColumnView
+{
+    std::string name;
+    std::string path;
+    FieldType type;
+    float sampleRate;
+    uint32_t valuesPerPacket;
+    uint32_t firstTimestamp;
+    const void* pData;
+    uint64_t count;
+
+    /** @return The array as T, or nullptr if the column holds another type */
+    template <typename T>
+    const T* as() const
+    {
+        return type == columnar::TypeOf<T>::VALUE ? static_cast<const T*>(pData) : nullptr;
+    }
+};
+
+} // namespace sbem
@@ -0,0 +1,131 @@
+#include "ColumnarReader.h"
+
+#include <cstring>
+
+namespace sbem
+{
+
+bool ColumnarReader::open(const char* path)
+{
+    close();
+    if (!mFile.open(path, MappedFile::Access::RANDOM))
+        return false;
+
+    // The header and directory, in place or decompressed
+    const uint8_t* pBase = mFile.data();
+    uint64_t size = mFile.size();
+    std::vector<uint8_t> directory;
+    if (SeekableReader::isCompressed(pBase, size))
+    {
+        mFile.close();
+        if (!mCompressed.open(path) || !mCompressed.read(0, sizeof(mHeader), &mHeader))
+        {
+            close();
+            return false;
+        }
+        size = mCompressed.size();
+        const uint64_t directorySize = uint64_t(mHeader.columnCount) * sizeof(columnar::ColumnEntry);
+        if (directorySize > size - sizeof(mHeader))
+        {
+            close();
+            return false;
+        }
+        directory.resize(sizeof(mHeader) + directorySize);
+        if (!mCompressed.read(0, directory.size(), directory.data()))
+        {
+            close();
+            return false;
+        }
+        pBase = directory.data();
+    }
+    else if (size >= sizeof(columnar::FileHeader))
+    {
+        memcpy(&mHeader, pBase, sizeof(mHeader));
+    }
+    else
+    {
+        close();
+        return false;
+    }
+
+    const uint64_t directoryEnd = sizeof(mHeader) + uint64_t(mHeader.columnCount) * sizeof(columnar::ColumnEntry);
+    if (memcmp(mHeader.magic, columnar::MAGIC, sizeof(mHeader.magic)) != 0 ||
+        mHeader.version != columnar::VERSION || directoryEnd > size)
+    {
+        close();
+        return false;
+    }
+
+    mColumns.reserve(mHeader.columnCount);
+    for (uint32_t i = 0; i < mHeader.columnCount; i++)
+    {
+        columnar::ColumnEntry entry;
+        memcpy(&entry, pBase + sizeof(mHeader) + i * sizeof(entry), sizeof(entry));
+
+        const FieldType type = static_cast<FieldType>(entry.type);
+        const uint64_t elementSize = entry.type <= static_cast<uint8_t>(FieldType::FLOAT64) ? fieldTypeSize(type) : 0;
+        const bool fits = elementSize && entry.offset % columnar::ALIGNMENT == 0 && entry.offset <= size &&
+                          entry.count <= (size - entry.offset) / elementSize;
+        if (!fits)
+        {
+            close();
+            return false;
+        }
+
+        ColumnView view;
+        view.name.assign(entry.name, strnlen(entry.name, sizeof(entry.name)));
+        view.path.assign(entry.path, strnlen(entry.path, sizeof(entry.path)));
+        view.type = type;
+        view.sampleRate = entry.sampleRate;
+        view.valuesPerPacket = entry.valuesPerPacket;
+        view.firstTimestamp = entry.firstTimestamp;
+        view.pData = mCompressed.isOpen() ? nullptr : pBase + entry.offset;
+        view.count = entry.count;
+        mColumns.push_back(std::move(view));
+        mOffsets.push_back(entry.offset);
+    }
+    mArrays.resize(mColumns.size());
+    return true;
+}
+
+void ColumnarReader::close()
+{
+    mFile.close();
+    mCompressed.close();
+    mHeader = columnar::FileHeader();
+    mColumns.clear();
+    mArrays.clear();
+    mOffsets.clear();
+}
+
+const ColumnView& ColumnarReader::loaded(size_t i) const
+{
+    ColumnView& rColumn = mColumns[i];
+    if (rColumn.pData || !mCompressed.isOpen() || !rColumn.count)
+        return rColumn;
+
+    const size_t bytes = rColumn.count * fieldTypeSize(rColumn.type);
+    mArrays[i].reset(new uint64_t[(bytes + sizeof(uint64_t) - 1) / sizeof(uint64_t)]);
+    if (mCompressed.read(mOffsets[i], bytes, mArrays[i].get()))
+    {
+        rColumn.pData = mArrays[i].get();
+    }
+    else
+    {
+        mArrays[i].reset();
+        rColumn.count = 0;
+    }
+    return rColumn;
+}
+
+const ColumnView* ColumnarReader::find(const char* name) const
+{
+    for (size_t i = 0; i < mColumns.size(); i++)
+    {
+        if (mColumns[i].name == name)
+            return &loaded(i);
+    }
+    return nullptr;
+}
+
+} // namespace sbem
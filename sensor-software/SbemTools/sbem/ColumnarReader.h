@@ -0,0 +1,75 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ColumnarFormat.h"
+#include "MappedFile.h"
+#include "SeekableReader.h"
+
+namespace sbem
+{
+
+/**
+*   Maps a columnar file written by ColumnarWriter and exposes its arrays in
+*   place. Opening validates the header and that every array lies inside the
+*   file; nothing is copied, so a day of ECG is available in milliseconds.
+*
+*   A compressed file (.sbcol.zst) opens the same way: only the header and
+*   directory are decompressed, and each array the first time it is asked for.
+*/
+class ColumnarReader
+{
+public:
+    /**
+    *   @param path File to map
+    *   @return false if the file can't be mapped or isn't a valid columnar file
+    */
+    bool open(const char* path);
+    void close();
+
+    bool isOpen() const { return mFile.isOpen() || mCompressed.isOpen(); }
+
+    size_t columnCount() const { return mColumns.size(); }
+
+    /** A column whose array can't be decompressed comes back with no data and count 0. */
+    const ColumnView& column(size_t i) const { return loaded(i); }
+
+    /** @return The column called name, or nullptr */
+    const ColumnView* find(const char* name) const;
+
+    /**
+    *   Typed access by name.
+    *
+    *   @param name Column name, e.g. "ecg.samples"
+    *   @param rCount Receives the element count (0 if missing)
+    *   @return The array, or nullptr if missing, of another type or unreadable
+    */
+    template <typename T>
+    const T* array(const char* name, uint64_t& rCount) const
+    {
+        const ColumnView* pColumn = find(name);
+        const T* pData = pColumn ? pColumn->as<T>() : nullptr;
+        rCount = pData ? pColumn->count : 0;
+        return pData;
+    }
+
+    uint32_t chunkCount() const { return mHeader.chunkCount; }
+    uint64_t sourceSize() const { return mHeader.sourceSize; }
+    bool truncated() const { return (mHeader.flags & columnar::FLAG_TRUNCATED) != 0; }
+
+private:
+    const ColumnView& loaded(size_t i) const;
+
+    MappedFile mFile;
+    columnar::FileHeader mHeader = {};
+
+    // Arrays of a compressed file are decompressed on first access
+    mutable SeekableReader mCompressed;
+    mutable std::vector<ColumnView> mColumns;
+    mutable std::vector<std::unique_ptr<uint64_t[]>> mArrays;
+    std::vector<uint64_t> mOffsets;
+};
+
+} // namespace sbem
@@ -0,0 +1,248 @@
+#include "ColumnarWriter.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "ColumnarFormat.h"
+
+namespace sbem
+{
+
+namespace
+{
+
+// Resources winlogger subscribes to (see startLogging()), used when a log carries no descriptors
+const char* const ECG_PATH = "/Meas/ECG/200/mV";
+const char* const IMU_PATH = "/Meas/IMU6/26";
+
+void copyName(char* pDst, size_t size, const std::string& text)
+{
+    memset(pDst, 0, size);
+    memcpy(pDst, text.data(), std::min(text.size(), size - 1));
+}
+
+constexpr uint64_t alignUp(uint64_t v)
+{
+    return (v + columnar::ALIGNMENT - 1) & ~static_cast<uint64_t>(columnar::ALIGNMENT - 1);
+}
+
+/** Directory under construction; arrays stay in the recording until written. */
+class Directory
+{
+public:
+    /** Per-group metadata shared by the group's columns. */
+    struct Group
+    {
+        std::string prefix;
+        std::string path;
+        float rate;
+        uint32_t firstTimestamp;
+    };
+
+    /**
+    *   @param rGroup Group the column belongs to
+    *   @param channel Column name inside the group
+    *   @param rColumn Data
+    *   @param valuesPerPacket Values each packet adds, 0 if it varies
+    *   @param sampled Whether the values are samples at the group's rate
+    */
+    template <typename T>
+    void add(const Group& rGroup, const char* channel, const Column<T>& rColumn, uint32_t valuesPerPacket,
+             bool sampled)
+    {
+        columnar::ColumnEntry entry = {};
+        copyName(entry.name, sizeof(entry.name), rGroup.prefix + "." + channel);
+        copyName(entry.path, sizeof(entry.path), rGroup.path);
+        entry.type = static_cast<uint8_t>(columnar::TypeOf<T>::VALUE);
+        entry.sampleRate = sampled ? rGroup.rate : 0.0f;
+        entry.valuesPerPacket = valuesPerPacket;
+        entry.firstTimestamp = rGroup.firstTimestamp;
+        entry.count = rColumn.size;
+        mEntries.push_back(entry);
+        mArrays.push_back({ rColumn.data, rColumn.size * sizeof(T) });
+    }
+
+    /** A column that isn't part of a recording group. */
+    void add(const ColumnView& rColumn)
+    {
+        columnar::ColumnEntry entry = {};
+        copyName(entry.name, sizeof(entry.name), rColumn.name);
+        copyName(entry.path, sizeof(entry.path), rColumn.path);
+        entry.type = static_cast<uint8_t>(rColumn.type);
+        entry.sampleRate = rColumn.sampleRate;
+        entry.valuesPerPacket = rColumn.valuesPerPacket;
+        entry.firstTimestamp = rColumn.firstTimestamp;
+        entry.count = rColumn.count;
+        mEntries.push_back(entry);
+        mArrays.push_back({ rColumn.pData, rColumn.count * fieldTypeSize(rColumn.type) });
+    }
+
+    /** Assign array offsets behind the directory. */
+    uint64_t layout()
+    {
+        uint64_t offset = alignUp(sizeof(columnar::FileHeader) + mEntries.size() * sizeof(columnar::ColumnEntry));
+        const uint64_t dataOffset = offset;
+        for (size_t i = 0; i < mEntries.size(); i++)
+        {
+            mEntries[i].offset = offset;
+            offset = alignUp(offset + mArrays[i].bytes);
+        }
+        return dataOffset;
+    }
+
+    bool writeTo(OutputFile& rFile, const columnar::FileHeader& rHeader) const
+    {
+        static const uint8_t ZEROS[columnar::ALIGNMENT] = {};
+
+        uint64_t pos = sizeof(rHeader) + mEntries.size() * sizeof(columnar::ColumnEntry);
+        if (!rFile.write(&rHeader, sizeof(rHeader)) ||
+            !rFile.write(mEntries.data(), mEntries.size() * sizeof(columnar::ColumnEntry)))
+        {
+            return false;
+        }
+
+        for (size_t i = 0; i < mEntries.size(); i++)
+        {
+            if (!rFile.write(ZEROS, mEntries[i].offset - pos) || !rFile.write(mArrays[i].pData, mArrays[i].bytes))
+                return false;
+            pos = mEntries[i].offset + mArrays[i].bytes;
+        }
+        return rFile.write(ZEROS, alignUp(pos) - pos);
+    }
+
+    size_t size() const { return mEntries.size(); }
+
+private:
+    struct Array
+    {
+        const void* pData;
+        size_t bytes;
+    };
+
+    std::vector<columnar::ColumnEntry> mEntries;
+    std::vector<Array> mArrays;
+};
+
+/** Header, directory and arrays, to a plain or compressed file. */
+bool writeFile(Directory& rDirectory, uint64_t sourceSize, uint32_t chunkCount, uint32_t flags, const char* path,
+               const OutputOptions& rOutput)
+{
+    columnar::FileHeader header = {};
+    memcpy(header.magic, columnar::MAGIC, sizeof(header.magic));
+    header.version = columnar::VERSION;
+    header.columnCount = static_cast<uint32_t>(rDirectory.size());
+    header.dataOffset = rDirectory.layout();
+    header.sourceSize = sourceSize;
+    header.chunkCount = chunkCount;
+    header.flags = flags;
+
+    OutputFile file;
+    if (!file.open(path, rOutput))
+        return false;
+
+    const bool ok = rDirectory.writeTo(file, header);
+    return file.close() && ok;
+}
+
+} // namespace
+
+std::string ColumnarWriter::channelPath(const std::vector<std::string>& rDescriptors, PacketKind kind)
+{
+    PlanTable plans;
+    for (const std::string& d : rDescriptors)
+        plans.addDescriptor(reinterpret_cast<const uint8_t*>(d.data()), d.size());
+    for (const DecodePlan& plan : plans.plans())
+    {
+        if (plan.kind == kind && !plan.path.empty())
+            return plan.path;
+    }
+    return kind == PacketKind::ECG_MV ? ECG_PATH : kind == PacketKind::IMU6 ? IMU_PATH : "";
+}
+
+float ColumnarWriter::rateFromPath(const std::string& path)
+{
+    size_t begin = 0;
+    while (begin < path.size())
+    {
+        size_t end = path.find('/', begin);
+        if (end == std::string::npos)
+            end = path.size();
+        if (end > begin && path.find_first_not_of("0123456789", begin) >= end)
+            return static_cast<float>(atof(path.c_str() + begin));
+        begin = end + 1;
+    }
+    return 0.0f;
+}
+
+bool ColumnarWriter::write(const Recording& rRecording, const char* path, const OutputOptions& rOutput)
+{
+    const EcgColumns& rEcg = rRecording.ecg;
+    const ImuColumns& rImu = rRecording.imu;
+
+    Directory::Group ecg;
+    ecg.prefix = "ecg";
+    ecg.path = channelPath(rRecording.descriptors, PacketKind::ECG_MV);
+    ecg.rate = rateFromPath(ecg.path);
+    ecg.firstTimestamp = rEcg.packets() ? rEcg.timestamp[0] : 0;
+
+    Directory::Group imu;
+    imu.prefix = "imu";
+    imu.path = channelPath(rRecording.descriptors, PacketKind::IMU6);
+    imu.rate = rateFromPath(imu.path);
+    imu.firstTimestamp = rImu.packets() ? rImu.timestamp[0] : 0;
+
+    const Directory::Group other = { "other", "", 0.0f, 0 };
+
+    Directory directory;
+    directory.add(ecg, "chunk_index", rEcg.chunkIndex, 1, false);
+    directory.add(ecg, "timestamp", rEcg.timestamp, 1, false);
+    directory.add(ecg, "samples", rEcg.samples, ECG_SAMPLES_PER_PACKET, true);
+
+    directory.add(imu, "chunk_index", rImu.chunkIndex, 1, false);
+    directory.add(imu, "timestamp", rImu.timestamp, 1, false);
+    directory.add(imu, "acc_x", rImu.accelX, IMU_SAMPLES_PER_PACKET, true);
+    directory.add(imu, "acc_y", rImu.accelY, IMU_SAMPLES_PER_PACKET, true);
+    directory.add(imu, "acc_z", rImu.accelZ, IMU_SAMPLES_PER_PACKET, true);
+    directory.add(imu, "gyro_x", rImu.gyroX, IMU_SAMPLES_PER_PACKET, true);
+    directory.add(imu, "gyro_y", rImu.gyroY, IMU_SAMPLES_PER_PACKET, true);
+    directory.add(imu, "gyro_z", rImu.gyroZ, IMU_SAMPLES_PER_PACKET, true);
+
+    directory.add(other, "chunk_index", rRecording.other.chunkIndex, 1, false);
+    directory.add(other, "id", rRecording.other.id, 1, false);
+    directory.add(other, "value", rRecording.other.value, 1, false);
+
+    for (const GenericStream& rStream : rRecording.streams)
+    {
+        const Directory::Group group = { "stream." + std::to_string(rStream.id), rStream.path, 0.0f, 0 };
+        directory.add(group, "chunk_index", rStream.chunkIndex, 1, false);
+        directory.add(group, "value_offsets", rStream.valueOffsets, 1, false);
+        directory.add(group, "values", rStream.values, 0, false);
+    }
+
+    const TimelineGapColumns& rGaps = rRecording.timelineGaps;
+    if (rGaps.size())
+    {
+        const Directory::Group gap = { "gap", "", 0.0f, 0 };
+        directory.add(gap, "kind", rGaps.kind, 1, false);
+        directory.add(gap, "channel", rGaps.channel, 1, false);
+        directory.add(gap, "begin", rGaps.begin, 1, false);
+        directory.add(gap, "end", rGaps.end, 1, false);
+    }
+
+    return writeFile(directory, rRecording.bytesScanned, rRecording.chunkCount,
+                     rRecording.truncated ? columnar::FLAG_TRUNCATED : 0, path, rOutput);
+}
+
+bool ColumnarWriter::writeColumns(const std::vector<ColumnView>& rColumns, uint64_t sourceSize, uint32_t chunkCount,
+                                  const char* path, const OutputOptions& rOutput)
+{
+    Directory directory;
+    for (const ColumnView& rColumn : rColumns)
+        directory.add(rColumn);
+    return writeFile(directory, sourceSize, chunkCount, 0, path, rOutput);
+}
+
+} // namespace sbem
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "ColumnarFormat.h"
+#include "OutputFile.h"
+#include "Recording.h"
+
+namespace sbem
+{
+
+/**
+*   Writes a Recording as a memory-mappable columnar file (see ColumnarFormat.h).
+*
+*   Every column of the recording becomes one aligned array, so a reader maps
+*   the file and hands the arrays to analysis code without parsing. Sample
+*   rates come from the resource paths of the descriptors (/Meas/ECG/200/mV is
+*   200 Hz), falling back to the rates winlogger logs at.
+*/
+class ColumnarWriter
+{
+public:
+    /**
+    *   @param rRecording Decoded data
+    *   @param path Output path, .sbcol by convention (.sbcol.zst compressed)
+    *   @param rOutput Compression; a compressed file is read with ColumnarReader too
+    *   @return false if the file can't be written
+    */
+    static bool write(const Recording& rRecording, const char* path, const OutputOptions& rOutput = OutputOptions());
+
+    /**
+    *   Resource path of a packet kind, as the first descriptor describing it
+    *   names it, or the path winlogger logs it at if no descriptor does.
+    */
+    static std::string channelPath(const std::vector<std::string>& rDescriptors, PacketKind kind);
+
+    /** Rate encoded in a resource path: its first all-digit segment, e.g. 200 in /Meas/ECG/200/mV; 0 if none. */
+    static float rateFromPath(const std::string& path);
+
+    /**
+    *   Write arrays that aren't a Recording, e.g. a LodPyramid, in the same format.
+    *
+    *   @param rColumns Arrays with their names and metadata; offset-free, pData and count are written
+    *   @param sourceSize Size of the SBEM file the arrays were derived from
+    *   @param chunkCount Chunks of that file
+    *   @param path Output path
+    *   @param rOutput Compression
+    *   @return false if the file can't be written
+    */
+    static bool writeColumns(const std::vector<ColumnView>& rColumns, uint64_t sourceSize, uint32_t chunkCount,
+                             const char* path, const OutputOptions& rOutput = OutputOptions());
+};
+
+} // namespace sbem
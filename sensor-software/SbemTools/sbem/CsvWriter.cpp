@@ -0,0 +1,574 @@
+#include "CsvWriter.h"
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "FloatFormat.h"
+#include "TextBuffer.h"
+#include "ThreadPool.h"
+
+namespace sbem
+{
+
+namespace
+{
+
+enum CsvColumn
+{
+    COL_CHUNK_INDEX,
+    COL_GROUP,
+    COL_TIMESTAMP,
+    COL_ACCEL,
+    COL_GYRO,
+    COL_SAMPLES,
+    COL_CHUNK_ID,
+    COL_VALUE,
+    // SAMPLES layout
+    COL_SAMPLE,
+    COL_ECG_MV,
+    COL_ACC_X,
+    COL_ACC_Y,
+    COL_ACC_Z,
+    COL_GYRO_X,
+    COL_GYRO_Y,
+    COL_GYRO_Z,
+    COL_COUNT
+};
+
+const char* const COLUMN_NAMES[COL_COUNT] =
+{
+    "chunk_index", "group", "TIMESTAMP", "ACCEL", "GYRO", "SAMPLES", "chunk_id", "value",
+    "sample", "ecg_mv", "acc_x", "acc_y", "acc_z", "gyro_x", "gyro_y", "gyro_z"
+};
+
+enum RowKind
+{
+    ROW_IMU,
+    ROW_ECG,
+    ROW_OTHER,
+    ROW_KIND_COUNT
+};
+
+// Keys of the dicts converter.py builds for each chunk kind, in insertion order
+const CsvColumn IMU_KEYS[] = { COL_CHUNK_INDEX, COL_GROUP, COL_TIMESTAMP, COL_ACCEL, COL_GYRO };
+const CsvColumn ECG_KEYS[] = { COL_CHUNK_INDEX, COL_GROUP, COL_TIMESTAMP, COL_SAMPLES };
+const CsvColumn OTHER_KEYS[] = { COL_CHUNK_INDEX, COL_CHUNK_ID, COL_VALUE };
+
+// Chunks formatted per block; about 1.5 MB of ECG rows in the converter layout
+constexpr uint32_t BLOCK_CHUNKS = 4096;
+
+// Sequential writes are batched up to this size
+constexpr size_t FLUSH_THRESHOLD = 1 << 20;
+
+size_t lowerBound(const Column<uint32_t>& rColumn, uint32_t chunkIndex)
+{
+    return std::lower_bound(rColumn.begin(), rColumn.end(), chunkIndex) - rColumn.begin();
+}
+
+/**
+*   Formats the rows of any chunk range of a recording. Holds no mutable
+*   state, so several threads can format different ranges at once.
+*/
+class RowFormatter
+{
+public:
+    /**
+    *   @param rRecording Rows to format, the whole recording or one batch of it
+    *   @param rShape Shape of the whole recording, which fixes the columns
+    *   @param rOptions Layout and float format
+    */
+    RowFormatter(const Recording& rRecording, const RecordingShape& rShape, const CsvOptions& rOptions):
+        mRec(rRecording),
+        mShape(rShape),
+        mOptions(rOptions),
+        mColumnCount(0),
+        mTimestampAsFloat(false),
+        mOtherAsFloat(false)
+    {
+        mHasKind[ROW_IMU] = rOptions.imu && rShape.firstImu != UINT32_MAX;
+        mHasKind[ROW_ECG] = rOptions.ecg && rShape.firstEcg != UINT32_MAX;
+        mHasKind[ROW_OTHER] = rOptions.other && rShape.firstOther != UINT32_MAX;
+
+        if (rOptions.layout == CsvLayout::CONVERTER)
+            chooseConverterColumns();
+        else
+            chooseSampleColumns();
+
+        mHasRows[ROW_IMU] = mHasKind[ROW_IMU] && rRecording.imu.packets() > 0;
+        mHasRows[ROW_ECG] = mHasKind[ROW_ECG] && rRecording.ecg.packets() > 0;
+        mHasRows[ROW_OTHER] = mHasKind[ROW_OTHER] && rRecording.other.size() > 0;
+
+        mChunkBegin = UINT32_MAX;
+        mChunkEnd = 0;
+        if (mHasRows[ROW_IMU])
+        {
+            mChunkBegin = std::min(mChunkBegin, mRec.imu.chunkIndex[0]);
+            mChunkEnd = std::max(mChunkEnd, mRec.imu.chunkIndex[mRec.imu.packets() - 1] + 1);
+        }
+        if (mHasRows[ROW_ECG])
+        {
+            mChunkBegin = std::min(mChunkBegin, mRec.ecg.chunkIndex[0]);
+            mChunkEnd = std::max(mChunkEnd, mRec.ecg.chunkIndex[mRec.ecg.packets() - 1] + 1);
+        }
+        if (mHasRows[ROW_OTHER])
+        {
+            mChunkBegin = std::min(mChunkBegin, mRec.other.chunkIndex[0]);
+            mChunkEnd = std::max(mChunkEnd, mRec.other.chunkIndex[mRec.other.size() - 1] + 1);
+        }
+        mChunkBegin = std::min(mChunkBegin, mChunkEnd);
+    }
+
+    /** True if the whole recording has rows to write. */
+    bool hasRows() const { return mHasKind[ROW_IMU] || mHasKind[ROW_ECG] || mHasKind[ROW_OTHER]; }
+
+    /** Lowest chunk index that has a row. */
+    uint32_t chunkBegin() const { return mChunkBegin; }
+
+    /** One past the highest chunk index that has a row. */
+    uint32_t chunkEnd() const { return mChunkEnd; }
+
+    void header(TextBuffer& rOut) const
+    {
+        for (size_t c = 0; c < mColumnCount; c++)
+        {
+            if (c)
+                rOut.put(',');
+            rOut.put(COLUMN_NAMES[mColumns[c]], strlen(COLUMN_NAMES[mColumns[c]]));
+        }
+        rOut.put('\n');
+    }
+
+    /** Append the rows of chunks [chunkBegin, chunkEnd) in file order. */
+    void rows(uint32_t chunkBegin, uint32_t chunkEnd, TextBuffer& rOut) const
+    {
+        size_t imu = mHasRows[ROW_IMU] ? lowerBound(mRec.imu.chunkIndex, chunkBegin) : 0;
+        size_t ecg = mHasRows[ROW_ECG] ? lowerBound(mRec.ecg.chunkIndex, chunkBegin) : 0;
+        size_t other = mHasRows[ROW_OTHER] ? lowerBound(mRec.other.chunkIndex, chunkBegin) : 0;
+        const size_t imuEnd = mHasRows[ROW_IMU] ? lowerBound(mRec.imu.chunkIndex, chunkEnd) : 0;
+        const size_t ecgEnd = mHasRows[ROW_ECG] ? lowerBound(mRec.ecg.chunkIndex, chunkEnd) : 0;
+        const size_t otherEnd = mHasRows[ROW_OTHER] ? lowerBound(mRec.other.chunkIndex, chunkEnd) : 0;
+
+        for (;;)
+        {
+            const uint32_t imuIndex = imu < imuEnd ? mRec.imu.chunkIndex[imu] : UINT32_MAX;
+            const uint32_t ecgIndex = ecg < ecgEnd ? mRec.ecg.chunkIndex[ecg] : UINT32_MAX;
+            const uint32_t otherIndex = other < otherEnd ? mRec.other.chunkIndex[other] : UINT32_MAX;
+
+            if (ecg < ecgEnd && ecgIndex < imuIndex && ecgIndex < otherIndex)
+                putRows(ROW_ECG, ecg++, rOut);
+            else if (imu < imuEnd && imuIndex < otherIndex)
+                putRows(ROW_IMU, imu++, rOut);
+            else if (other < otherEnd)
+                putRows(ROW_OTHER, other++, rOut);
+            else
+                break;
+        }
+    }
+
+private:
+    /** Column order of pandas: the union of dict keys in order of first appearance. */
+    void chooseConverterColumns()
+    {
+        const uint32_t firstIndex[ROW_KIND_COUNT] =
+        {
+            mHasKind[ROW_IMU] ? mShape.firstImu : UINT32_MAX,
+            mHasKind[ROW_ECG] ? mShape.firstEcg : UINT32_MAX,
+            mHasKind[ROW_OTHER] ? mShape.firstOther : UINT32_MAX,
+        };
+        int kindOrder[ROW_KIND_COUNT] = { ROW_IMU, ROW_ECG, ROW_OTHER };
+        for (int i = 1; i < ROW_KIND_COUNT; i++)
+        {
+            for (int j = i; j > 0 && firstIndex[kindOrder[j]] < firstIndex[kindOrder[j - 1]]; j--)
+                std::swap(kindOrder[j], kindOrder[j - 1]);
+        }
+
+        bool used[COL_COUNT] = {};
+        for (int kind : kindOrder)
+        {
+            if (!mHasKind[kind])
+                continue;
+
+            const CsvColumn* keys = kind == ROW_IMU ? IMU_KEYS : kind == ROW_ECG ? ECG_KEYS : OTHER_KEYS;
+            const size_t keyCount = kind == ROW_IMU ? 5 : kind == ROW_ECG ? 4 : 3;
+            for (size_t k = 0; k < keyCount; k++)
+            {
+                if (!used[keys[k]])
+                {
+                    used[keys[k]] = true;
+                    mColumns[mColumnCount++] = keys[k];
+                }
+            }
+        }
+
+        // Integer columns missing from some rows are float64 in pandas
+        mTimestampAsFloat = mHasKind[ROW_OTHER];
+        mOtherAsFloat = mHasKind[ROW_IMU] || mHasKind[ROW_ECG];
+    }
+
+    void chooseSampleColumns()
+    {
+        static const CsvColumn COMMON[] = { COL_CHUNK_INDEX, COL_GROUP, COL_TIMESTAMP, COL_SAMPLE };
+        static const CsvColumn IMU[] = { COL_ACC_X, COL_ACC_Y, COL_ACC_Z, COL_GYRO_X, COL_GYRO_Y, COL_GYRO_Z };
+
+        for (CsvColumn c : COMMON)
+            mColumns[mColumnCount++] = c;
+        if (mHasKind[ROW_ECG])
+            mColumns[mColumnCount++] = COL_ECG_MV;
+        if (mHasKind[ROW_IMU])
+        {
+            for (CsvColumn c : IMU)
+                mColumns[mColumnCount++] = c;
+        }
+        if (mHasKind[ROW_OTHER])
+        {
+            mColumns[mColumnCount++] = COL_CHUNK_ID;
+            mColumns[mColumnCount++] = COL_VALUE;
+        }
+    }
+
+    void putFloat(TextBuffer& rOut, float v) const
+    {
+        switch (mOptions.floats)
+        {
+        case CsvFloats::PYTHON_REPR:
+            rOut.commit(formatPyFloat(rOut.room(PY_FLOAT_MAX_CHARS), v));
+            break;
+        case CsvFloats::SHORTEST:
+            rOut.commit(formatShortestFloat(rOut.room(PY_FLOAT_MAX_CHARS), v));
+            break;
+        case CsvFloats::FIXED:
+            rOut.commit(formatFixedFloat(rOut.room(fixedFloatMaxChars(mOptions.decimals)), v, mOptions.decimals));
+            break;
+        }
+    }
+
+    /** Samples [first, first + count) of three axis columns as a list of {'x', 'y', 'z'} dicts. */
+    void putXyzList(TextBuffer& rOut, const Column<float>& rX, const Column<float>& rY, const Column<float>& rZ,
+                    size_t first, size_t count) const
+    {
+        rOut.put("\"[");
+        for (size_t i = first; i < first + count; i++)
+        {
+            if (i != first)
+                rOut.put(", ");
+            rOut.put("{'x': ");
+            putFloat(rOut, rX[i]);
+            rOut.put(", 'y': ");
+            putFloat(rOut, rY[i]);
+            rOut.put(", 'z': ");
+            putFloat(rOut, rZ[i]);
+            rOut.put('}');
+        }
+        rOut.put("]\"");
+    }
+
+    void putFloatList(TextBuffer& rOut, const float* pValues, size_t count) const
+    {
+        rOut.put("\"[");
+        for (size_t i = 0; i < count; i++)
+        {
+            if (i)
+                rOut.put(", ");
+            putFloat(rOut, pValues[i]);
+        }
+        rOut.put("]\"");
+    }
+
+    void putRows(RowKind kind, size_t pos, TextBuffer& rOut) const
+    {
+        if (mOptions.layout == CsvLayout::CONVERTER)
+        {
+            putConverterRow(kind, pos, rOut);
+        }
+        else if (kind == ROW_OTHER)
+        {
+            putSampleRow(kind, pos, 0, rOut);
+        }
+        else
+        {
+            const size_t samples = kind == ROW_ECG ? ECG_SAMPLES_PER_PACKET : IMU_SAMPLES_PER_PACKET;
+            for (size_t s = 0; s < samples; s++)
+                putSampleRow(kind, pos, s, rOut);
+        }
+    }
+
+    void putConverterRow(RowKind kind, size_t pos, TextBuffer& rOut) const
+    {
+        const ImuColumns& rImu = mRec.imu;
+        const EcgColumns& rEcg = mRec.ecg;
+        const OtherColumns& rOther = mRec.other;
+
+        for (size_t c = 0; c < mColumnCount; c++)
+        {
+            if (c)
+                rOut.put(',');
+
+            switch (mColumns[c])
+            {
+            case COL_CHUNK_INDEX:
+                rOut.putUInt(kind == ROW_ECG ? rEcg.chunkIndex[pos] : kind == ROW_IMU ? rImu.chunkIndex[pos]
+                                                                                       : rOther.chunkIndex[pos]);
+                break;
+            case COL_GROUP:
+                if (kind == ROW_ECG)
+                    rOut.put("ECGmV");
+                else if (kind == ROW_IMU)
+                    rOut.put("IMU");
+                break;
+            case COL_TIMESTAMP:
+                if (kind != ROW_OTHER)
+                {
+                    const uint32_t ts = kind == ROW_ECG ? rEcg.timestamp[pos] : rImu.timestamp[pos];
+                    if (mTimestampAsFloat)
+                        rOut.putUIntAsFloat(ts);
+                    else
+                        rOut.putUInt(ts);
+                }
+                break;
+            case COL_ACCEL:
+                if (kind == ROW_IMU)
+                    putXyzList(rOut, rImu.accelX, rImu.accelY, rImu.accelZ, pos * IMU_SAMPLES_PER_PACKET,
+                               IMU_SAMPLES_PER_PACKET);
+                break;
+            case COL_GYRO:
+                if (kind == ROW_IMU)
+                    putXyzList(rOut, rImu.gyroX, rImu.gyroY, rImu.gyroZ, pos * IMU_SAMPLES_PER_PACKET,
+                               IMU_SAMPLES_PER_PACKET);
+                break;
+            case COL_SAMPLES:
+                if (kind == ROW_ECG)
+                    putFloatList(rOut, &rEcg.samples[pos * ECG_SAMPLES_PER_PACKET], ECG_SAMPLES_PER_PACKET);
+                break;
+            case COL_CHUNK_ID:
+            case COL_VALUE:
+                if (kind == ROW_OTHER)
+                {
+                    const uint32_t v = mColumns[c] == COL_CHUNK_ID ? rOther.id[pos] : rOther.value[pos];
+                    if (mOtherAsFloat)
+                        rOut.putUIntAsFloat(v);
+                    else
+                        rOut.putUInt(v);
+                }
+                break;
+            default:
+                break;
+            }
+        }
+        rOut.put('\n');
+    }
+
+    void putSampleRow(RowKind kind, size_t pos, size_t sample, TextBuffer& rOut) const
+    {
+        const ImuColumns& rImu = mRec.imu;
+        const size_t i = pos * IMU_SAMPLES_PER_PACKET + sample;
+
+        for (size_t c = 0; c < mColumnCount; c++)
+        {
+            if (c)
+                rOut.put(',');
+
+            const CsvColumn column = mColumns[c];
+            switch (column)
+            {
+            case COL_CHUNK_INDEX:
+                rOut.putUInt(kind == ROW_ECG ? mRec.ecg.chunkIndex[pos] : kind == ROW_IMU ? rImu.chunkIndex[pos]
+                                                                                           : mRec.other.chunkIndex[pos]);
+                break;
+            case COL_GROUP:
+                if (kind == ROW_ECG)
+                    rOut.put("ECGmV");
+                else if (kind == ROW_IMU)
+                    rOut.put("IMU");
+                break;
+            case COL_TIMESTAMP:
+                if (kind != ROW_OTHER)
+                    rOut.putUInt(kind == ROW_ECG ? mRec.ecg.timestamp[pos] : rImu.timestamp[pos]);
+                break;
+            case COL_SAMPLE:
+                if (kind != ROW_OTHER)
+                    rOut.putUInt(sample);
+                break;
+            case COL_ECG_MV:
+                if (kind == ROW_ECG)
+                    putFloat(rOut, mRec.ecg.samples[pos * ECG_SAMPLES_PER_PACKET + sample]);
+                break;
+            case COL_ACC_X:
+            case COL_ACC_Y:
+            case COL_ACC_Z:
+            case COL_GYRO_X:
+            case COL_GYRO_Y:
+            case COL_GYRO_Z:
+                if (kind == ROW_IMU)
+                {
+                    const Column<float>* axes[] =
+                    {
+                        &rImu.accelX, &rImu.accelY, &rImu.accelZ, &rImu.gyroX, &rImu.gyroY, &rImu.gyroZ
+                    };
+                    putFloat(rOut, (*axes[column - COL_ACC_X])[i]);
+                }
+                break;
+            case COL_CHUNK_ID:
+                if (kind == ROW_OTHER)
+                    rOut.putUInt(mRec.other.id[pos]);
+                break;
+            case COL_VALUE:
+                if (kind == ROW_OTHER)
+                    rOut.putUInt(mRec.other.value[pos]);
+                break;
+            default:
+                break;
+            }
+        }
+        rOut.put('\n');
+    }
+
+    const Recording& mRec;
+    const RecordingShape mShape;
+    const CsvOptions& mOptions;
+    bool mHasKind[ROW_KIND_COUNT];  // has columns
+    bool mHasRows[ROW_KIND_COUNT];  // has rows in mRec
+    CsvColumn mColumns[COL_COUNT];
+    size_t mColumnCount;
+    bool mTimestampAsFloat;
+    bool mOtherAsFloat;
+    uint32_t mChunkBegin;
+    uint32_t mChunkEnd;
+};
+
+/**
+*   Format blocks a wave at a time on the pool, each into its own buffer, and
+*   write them in order. The buffers outlive the call so a CsvStream reuses
+*   them batch after batch instead of leaving freed blocks in the workers'
+*   malloc arenas.
+*/
+bool writeParallel(OutputFile& rFile, const RowFormatter& rFormatter, ThreadPool& rPool, std::vector<TextBuffer>& rBuffers)
+{
+    const uint32_t base = rFormatter.chunkBegin();
+    const uint32_t end = rFormatter.chunkEnd();
+    const uint32_t blocks = (end - base + BLOCK_CHUNKS - 1) / BLOCK_CHUNKS;
+    const uint32_t wave = rPool.concurrency() * 2;
+    if (rBuffers.size() < std::min(wave, blocks))
+        rBuffers.resize(std::min(wave, blocks));
+
+    for (uint32_t first = 0; first < blocks; first += wave)
+    {
+        const uint32_t count = std::min(wave, blocks - first);
+        TaskGroup group;
+        for (uint32_t k = 0; k < count; k++)
+        {
+            const uint32_t begin = base + (first + k) * BLOCK_CHUNKS;
+            TextBuffer* pBuffer = &rBuffers[k];
+            rPool.submit(group, [&rFormatter, pBuffer, begin, end]()
+            {
+                pBuffer->clear();
+                rFormatter.rows(begin, std::min(end, begin + BLOCK_CHUNKS), *pBuffer);
+            });
+        }
+        rPool.wait(group);
+
+        for (uint32_t k = 0; k < count; k++)
+        {
+            if (!rFile.write(rBuffers[k].data(), rBuffers[k].size()))
+                return false;
+        }
+    }
+    return true;
+}
+
+bool writeSequential(OutputFile& rFile, const RowFormatter& rFormatter, TextBuffer& rBuffer)
+{
+    const uint32_t end = rFormatter.chunkEnd();
+    for (uint32_t begin = rFormatter.chunkBegin(); begin < end; begin += BLOCK_CHUNKS)
+    {
+        rFormatter.rows(begin, std::min(end, begin + BLOCK_CHUNKS), rBuffer);
+        if (rBuffer.size() >= FLUSH_THRESHOLD)
+        {
+            if (!rFile.write(rBuffer.data(), rBuffer.size()))
+                return false;
+            rBuffer.clear();
+        }
+    }
+    return rFile.write(rBuffer.data(), rBuffer.size());
+}
+
+} // namespace
+
+CsvStream::CsvStream() = default;
+
+CsvStream::~CsvStream()
+{
+    close();
+}
+
+bool CsvStream::open(const char* path, const RecordingShape& rShape, const CsvOptions& rOptions)
+{
+    close();
+    mShape = rShape;
+    mOptions = rOptions;
+
+    const Recording empty;
+    const RowFormatter formatter(empty, mShape, mOptions);
+    if (!formatter.hasRows())
+        return false;
+
+    const unsigned threads = rOptions.threads ? rOptions.threads : defaultThreadCount();
+    if (!mOptions.pPool && threads > 1)
+    {
+        mpPool.reset(new ThreadPool(threads - 1));
+        mOptions.pPool = mpPool.get();
+    }
+
+    OutputOptions output = mOptions.output;
+    if (mOptions.pPool)
+        output.pPool = mOptions.pPool;
+    if (!mFile.open(path, output))
+        return false;
+
+    mBuffers.resize(1);
+    mBuffers[0].clear();
+    formatter.header(mBuffers[0]);
+    mOk = mFile.write(mBuffers[0].data(), mBuffers[0].size());
+    return mOk;
+}
+
+bool CsvStream::append(const Recording& rBatch)
+{
+    if (!mFile.isOpen() || !mOk)
+        return false;
+
+    const RowFormatter formatter(rBatch, mShape, mOptions);
+    if (mOptions.pPool)
+    {
+        mOk = writeParallel(mFile, formatter, *mOptions.pPool, mBuffers);
+    }
+    else
+    {
+        mBuffers[0].clear();
+        mOk = writeSequential(mFile, formatter, mBuffers[0]);
+    }
+    return mOk;
+}
+
+bool CsvStream::close()
+{
+    if (!mFile.isOpen())
+        return false;
+    if (!mFile.close())
+        mOk = false;
+    mpPool.reset();
+    mBuffers.clear();
+    return mOk;
+}
+
+bool CsvWriter::write(const Recording& rRecording, const char* path, const CsvOptions& rOptions)
+{
+    CsvStream stream;
+    if (!stream.open(path, RecordingShape::of(rRecording), rOptions))
+        return false;
+    stream.append(rRecording);
+    return stream.close();
+}
+
+} // namespace sbem
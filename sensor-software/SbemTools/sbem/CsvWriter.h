@@ -0,0 +1,120 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "OutputFile.h"
+#include "Recording.h"
+#include "TextBuffer.h"
+
+namespace sbem
+{
+
+class ThreadPool;
+
+enum class CsvLayout : uint8_t
+{
+    CONVERTER,  // one row per chunk with list cells, as converter.py writes it
+    SAMPLES     // one row per sample, a plain numeric column per channel
+};
+
+enum class CsvFloats : uint8_t
+{
+    PYTHON_REPR,    // repr() of the float32 widened to double, what converter.py writes
+    SHORTEST,       // shortest digits that still parse back to the same float32
+    FIXED           // CsvOptions::decimals digits after the point
+};
+
+struct CsvOptions
+{
+    /** The defaults give output byte identical to converter.py. */
+    CsvLayout layout = CsvLayout::CONVERTER;
+    CsvFloats floats = CsvFloats::PYTHON_REPR;
+    int decimals = 6;
+
+    /** Row kinds to write. */
+    bool ecg = true;
+    bool imu = true;
+    bool other = true;
+
+    /**
+    *   Rows are formatted in blocks of chunks; with more than one thread the
+    *   blocks are formatted in parallel into their own buffers and written in
+    *   order. 0 uses every core.
+    */
+    unsigned threads = 1;
+
+    /** Format on this pool instead of a private one; threads is ignored when set. */
+    ThreadPool* pPool = nullptr;
+
+    /** Compression of the file. Frames are compressed on the formatting pool if there is one. */
+    OutputOptions output;
+};
+
+/**
+*   Writes a Recording as CSV.
+*
+*   By default in the layout produced by converter.py: one row per data chunk
+*   in file order. Columns appear in the order pandas discovers them
+*   (chunk_index, group, TIMESTAMP, ACCEL, GYRO, SAMPLES, chunk_id, value
+*   depending on which chunk kinds come first) and list cells use Python's
+*   repr, so existing analysis scripts read the output unchanged.
+*/
+class CsvWriter
+{
+public:
+    /**
+    *   @param rRecording Decoded data
+    *   @param path Output CSV path, with OutputFile::suffix() when compressed
+    *   @param rOptions Layout, float format, threading and compression
+    *   @return false if the recording has no rows to write or the file can't be written
+    */
+    static bool write(const Recording& rRecording, const char* path, const CsvOptions& rOptions = CsvOptions());
+};
+
+/**
+*   Writes a CSV a batch at a time, for recordings decoded by a StreamDecoder.
+*   The columns are fixed when the file is opened from the shape of the whole
+*   recording, so the batches together give the same file as CsvWriter::write
+*   of the recording in one piece.
+*/
+class CsvStream
+{
+public:
+    CsvStream();
+    ~CsvStream();
+
+    CsvStream(const CsvStream&) = delete;
+    CsvStream& operator=(const CsvStream&) = delete;
+
+    /**
+    *   Create the file and write the header.
+    *
+    *   @param path Output CSV path, with OutputFile::suffix() when compressed
+    *   @param rShape Shape of the whole recording
+    *   @param rOptions Layout, float format, threading and compression
+    *   @return false if the recording has no rows to write or the file can't be written
+    */
+    bool open(const char* path, const RecordingShape& rShape, const CsvOptions& rOptions = CsvOptions());
+
+    /**
+    *   Write the rows of the next batch; batches must come in file order.
+    *
+    *   @param rBatch Decoded batch
+    *   @return false once a write has failed
+    */
+    bool append(const Recording& rBatch);
+
+    /** @return false if the file wasn't open or any write failed */
+    bool close();
+
+private:
+    OutputFile mFile;
+    bool mOk = false;
+    RecordingShape mShape;
+    CsvOptions mOptions;
+    std::unique_ptr<ThreadPool> mpPool;
+    std::vector<TextBuffer> mBuffers;   // reused by every batch
+};
+
+} // namespace sbem
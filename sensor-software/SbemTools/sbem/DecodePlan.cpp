@@ -0,0 +1,445 @@
+#include "DecodePlan.h"
+
+#include <cstdlib>
+#include <initializer_list>
+#include <cstring>
+
+#include "PacketLayout.h"
+#include "SbemFormat.h"
+
+namespace sbem
+{
+
+namespace
+{
+
+constexpr int MAX_GROUP_DEPTH = 8;
+
+struct TypeName
+{
+    const char* name;
+    FieldType type;
+};
+
+const TypeName TYPE_NAMES[] =
+{
+    { "uint8", FieldType::UINT8 },
+    { "int8", FieldType::INT8 },
+    { "uint16", FieldType::UINT16 },
+    { "int16", FieldType::INT16 },
+    { "uint32", FieldType::UINT32 },
+    { "int32", FieldType::INT32 },
+    { "uint64", FieldType::UINT64 },
+    { "int64", FieldType::INT64 },
+    { "float32", FieldType::FLOAT32 },
+    { "float64", FieldType::FLOAT64 },
+    { "float", FieldType::FLOAT32 },
+    { "double", FieldType::FLOAT64 },
+};
+
+/**
+*   Parse "<FRM>" text such as "float32", "float32[3]", "float32[3][2]" or "float32[]".
+*   count is 0 for an open array.
+*/
+bool parseFormat(const std::string& text, FieldType& rType, uint32_t& rCount)
+{
+    const size_t bracket = text.find('[');
+    const std::string typeName = text.substr(0, bracket);
+
+    bool known = false;
+    for (const TypeName& t : TYPE_NAMES)
+    {
+        if (typeName == t.name)
+        {
+            rType = t.type;
+            known = true;
+            break;
+        }
+    }
+    if (!known)
+        return false;
+
+    rCount = 1;
+    for (size_t pos = bracket; pos != std::string::npos; pos = text.find('[', pos + 1))
+    {
+        const size_t close = text.find(']', pos);
+        if (close == std::string::npos)
+            return false;
+        if (close == pos + 1)
+        {
+            rCount = 0;
+            return true;
+        }
+        rCount *= static_cast<uint32_t>(strtoul(text.c_str() + pos + 1, nullptr, 10));
+    }
+    return rCount > 0;
+}
+
+/** Same token rule as converter.py parseGroupLine(): keep the digits of each comma separated token. */
+std::vector<uint16_t> parseMembers(const std::string& text)
+{
+    std::vector<uint16_t> members;
+    uint32_t value = 0;
+    bool haveDigits = false;
+    for (size_t i = 0; i <= text.size(); i++)
+    {
+        const char c = i < text.size() ? text[i] : ',';
+        if (c == ',')
+        {
+            if (haveDigits && value <= UINT16_MAX)
+                members.push_back(static_cast<uint16_t>(value));
+            value = 0;
+            haveDigits = false;
+        }
+        else if (c >= '0' && c <= '9')
+        {
+            value = value * 10 + (c - '0');
+            haveDigits = true;
+        }
+    }
+    return members;
+}
+
+double loadValue(FieldType type, const uint8_t* p)
+{
+    switch (type)
+    {
+    case FieldType::UINT8:
+        return *p;
+    case FieldType::INT8:
+        return static_cast<int8_t>(*p);
+    case FieldType::UINT16:
+        return loadU16(p);
+    case FieldType::INT16:
+        return static_cast<int16_t>(loadU16(p));
+    case FieldType::UINT32:
+        return loadU32(p);
+    case FieldType::INT32:
+        return static_cast<int32_t>(loadU32(p));
+    case FieldType::FLOAT32:
+        return loadF32(p);
+    case FieldType::UINT64:
+    case FieldType::INT64:
+    case FieldType::FLOAT64:
+    {
+        uint64_t v;
+        memcpy(&v, p, sizeof(v));
+        if (type == FieldType::UINT64)
+            return static_cast<double>(v);
+        if (type == FieldType::INT64)
+            return static_cast<double>(static_cast<int64_t>(v));
+        double d;
+        memcpy(&d, &v, sizeof(d));
+        return d;
+    }
+    }
+    return 0.0;
+}
+
+/** Build a plan from a compile-time packet layout. */
+DecodePlan layoutPlan(PacketKind kind, const char* path, std::initializer_list<Field> fields)
+{
+    DecodePlan plan;
+    plan.id = 0;
+    plan.kind = kind;
+    plan.path = path;
+    plan.fields = fields;
+    plan.fixedSize = 0;
+    for (const Field& f : plan.fields)
+        plan.fixedSize += static_cast<uint32_t>(fieldTypeSize(f.type) * f.count);
+    plan.tailElementSize = 0;
+    return plan;
+}
+
+} // namespace
+
+size_t fieldTypeSize(FieldType type)
+{
+    switch (type)
+    {
+    case FieldType::UINT8:
+    case FieldType::INT8:
+        return 1;
+    case FieldType::UINT16:
+    case FieldType::INT16:
+        return 2;
+    case FieldType::UINT32:
+    case FieldType::INT32:
+    case FieldType::FLOAT32:
+        return 4;
+    case FieldType::UINT64:
+    case FieldType::INT64:
+    case FieldType::FLOAT64:
+        return 8;
+    }
+    return 0;
+}
+
+uint32_t DecodePlan::valueCount(uint32_t length) const
+{
+    const uint32_t tail = tailCount(length);
+    uint32_t n = 0;
+    for (const Field& f : fields)
+    {
+        const uint32_t count = f.count ? f.count : tail;
+        if (f.offset + fieldTypeSize(f.type) * count > length)
+            break;
+        n += count;
+    }
+    return n;
+}
+
+void DecodePlan::decode(const uint8_t* pData, uint32_t length, double* pOut) const
+{
+    const uint32_t tail = tailCount(length);
+    for (const Field& f : fields)
+    {
+        const uint32_t count = f.count ? f.count : tail;
+        const size_t size = fieldTypeSize(f.type);
+        if (f.offset + size * count > length)
+            break;
+        for (uint32_t i = 0; i < count; i++)
+            *pOut++ = loadValue(f.type, pData + f.offset + i * size);
+    }
+}
+
+PlanTable::PlanTable():
+    mDirty(false)
+{
+}
+
+void PlanTable::clear()
+{
+    mDescriptors.clear();
+    mPlans.clear();
+    mSlots.clear();
+    mDirty = false;
+}
+
+bool PlanTable::parseDescriptor(const uint8_t* pData, size_t length, Descriptor& rDescriptor)
+{
+    const uint8_t* p = pData;
+    const uint8_t* end = pData + length;
+    uint16_t id;
+    if (!readId(p, end, id) || id == DESCRIPTOR_ID)
+        return false;
+
+    Descriptor& d = rDescriptor;
+    d.id = id;
+    d.isGroup = false;
+    d.type = FieldType::UINT8;
+    d.count = 0;
+    bool haveFormat = false;
+
+    // Walk "<TAG>value" pairs; a value ends at the next tag or line break
+    while (p < end)
+    {
+        const uint8_t* open = static_cast<const uint8_t*>(memchr(p, '<', end - p));
+        if (!open || end - open < 5 || open[4] != '>')
+            break;
+
+        const std::string tag(reinterpret_cast<const char*>(open + 1), 3);
+        const uint8_t* valueBegin = open + 5;
+        const uint8_t* valueEnd = valueBegin;
+        while (valueEnd < end && *valueEnd != '<' && *valueEnd != '\n' && *valueEnd != '\r' && *valueEnd != '\0')
+            valueEnd++;
+
+        std::string value;
+        for (const uint8_t* c = valueBegin; c < valueEnd; c++)
+        {
+            if (*c > ' ' && *c < 0x7F)
+                value.push_back(static_cast<char>(*c));
+        }
+
+        if (tag == "FRM")
+            haveFormat = parseFormat(value, d.type, d.count);
+        else if (tag == "GRP")
+        {
+            d.isGroup = true;
+            d.members = parseMembers(value);
+        }
+        else if (tag == "NME")
+            d.name = value;
+        else if (tag == "PTH")
+            d.path = value;
+
+        p = valueEnd;
+        while (p < end && *p != '<')
+            p++;
+    }
+
+    return haveFormat || d.isGroup;
+}
+
+bool PlanTable::validDescriptor(const uint8_t* pData, size_t length)
+{
+    Descriptor d;
+    return parseDescriptor(pData, length, d);
+}
+
+bool PlanTable::addDescriptor(const uint8_t* pData, size_t length)
+{
+    Descriptor d;
+    if (!parseDescriptor(pData, length, d))
+        return false;
+
+    // A later descriptor for the same id (new log session) replaces the old one
+    for (Descriptor& existing : mDescriptors)
+    {
+        if (existing.id == d.id)
+        {
+            existing = d;
+            mDirty = true;
+            return true;
+        }
+    }
+    mDescriptors.push_back(d);
+    mDirty = true;
+    return true;
+}
+
+const PlanTable::Descriptor* PlanTable::findDescriptor(uint16_t id) const
+{
+    for (const Descriptor& d : mDescriptors)
+    {
+        if (d.id == id)
+            return &d;
+    }
+    return nullptr;
+}
+
+bool PlanTable::flatten(uint16_t id, DecodePlan& rPlan, int depth) const
+{
+    const Descriptor* d = findDescriptor(id);
+    if (!d || depth > MAX_GROUP_DEPTH)
+        return false;
+
+    if (d->isGroup)
+    {
+        if (rPlan.path.empty())
+            rPlan.path = d->path;
+        for (uint16_t member : d->members)
+        {
+            if (!flatten(member, rPlan, depth + 1))
+                return false;
+        }
+        return !rPlan.fields.empty();
+    }
+
+    // Nothing can follow an open array, its length is only known per chunk
+    if (rPlan.tailElementSize)
+        return false;
+
+    const uint32_t elementSize = static_cast<uint32_t>(fieldTypeSize(d->type));
+    rPlan.fields.push_back({ d->type, rPlan.fixedSize, d->count, d->name });
+    if (d->count == 0)
+        rPlan.tailElementSize = elementSize;
+    else
+        rPlan.fixedSize += elementSize * d->count;
+
+    if (rPlan.path.empty())
+        rPlan.path = d->path;
+    return true;
+}
+
+void PlanTable::classify(DecodePlan& rPlan)
+{
+    rPlan.kind = PacketKind::GENERIC;
+
+    const std::vector<Field>& f = rPlan.fields;
+    if (f.empty() || f[0].type != FieldType::UINT32 || f[0].count != 1)
+        return;
+
+    uint32_t floats = 0;
+    bool openArray = false;
+    for (size_t i = 1; i < f.size(); i++)
+    {
+        if (f[i].type != FieldType::FLOAT32)
+            return;
+        floats += f[i].count;
+        openArray |= (f[i].count == 0);
+    }
+
+    if (rPlan.path.find("ECG") != std::string::npos &&
+        (openArray || floats == ECG_SAMPLES_PER_PACKET))
+    {
+        rPlan.kind = PacketKind::ECG_MV;
+    }
+    else if (rPlan.path.find("IMU6") != std::string::npos && !openArray &&
+             floats == 2 * IMU_SAMPLES_PER_PACKET * 3)
+    {
+        rPlan.kind = PacketKind::IMU6;
+    }
+}
+
+void PlanTable::compile()
+{
+    mPlans.clear();
+    mSlots.clear();
+    mDirty = false;
+
+    for (const Descriptor& d : mDescriptors)
+    {
+        DecodePlan plan;
+        plan.id = d.id;
+        plan.kind = PacketKind::GENERIC;
+        plan.fixedSize = 0;
+        plan.tailElementSize = 0;
+        if (!flatten(d.id, plan, 0))
+            continue;
+
+        classify(plan);
+        if (mSlots.size() <= d.id)
+            mSlots.resize(d.id + 1, -1);
+        mSlots[d.id] = static_cast<int32_t>(mPlans.size());
+        mPlans.push_back(std::move(plan));
+    }
+}
+
+const DecodePlan* PlanTable::builtinPlan(PacketKind kind)
+{
+    static const DecodePlan ECG_PLAN = layoutPlan(PacketKind::ECG_MV, "/Meas/ECG/200/mV",
+    {
+        { FieldType::UINT32, EcgMvLayout::TIMESTAMP, 1, "Timestamp" },
+        { FieldType::FLOAT32, EcgMvLayout::SAMPLES, EcgMvLayout::SAMPLE_COUNT, "Samples" },
+    });
+    static const DecodePlan IMU_PLAN = layoutPlan(PacketKind::IMU6, "/Meas/IMU6/26",
+    {
+        { FieldType::UINT32, Imu6Layout::TIMESTAMP, 1, "Timestamp" },
+        { FieldType::FLOAT32, Imu6Layout::ACCEL, Imu6Layout::SAMPLE_COUNT * Imu6Layout::AXES, "ArrayAcc" },
+        { FieldType::FLOAT32, Imu6Layout::GYRO, Imu6Layout::SAMPLE_COUNT * Imu6Layout::AXES, "ArrayGyro" },
+    });
+
+    switch (kind)
+    {
+    case PacketKind::ECG_MV:
+        return &ECG_PLAN;
+    case PacketKind::IMU6:
+        return &IMU_PLAN;
+    case PacketKind::GENERIC:
+        break;
+    }
+    return nullptr;
+}
+
+PacketKind PlanTable::route(uint16_t id, uint32_t length, const DecodePlan*& rpPlan)
+{
+    rpPlan = find(id);
+    const PacketKind kind = rpPlan ? rpPlan->kind : guessKind(length);
+    if (kind == PacketKind::IMU6 && length == IMU6_PACKET_SIZE)
+        return PacketKind::IMU6;
+    if (kind == PacketKind::ECG_MV && length == ECG_MV_PACKET_SIZE)
+        return PacketKind::ECG_MV;
+    return PacketKind::GENERIC;
+}
+
+PacketKind PlanTable::guessKind(uint32_t length)
+{
+    if (length == IMU6_PACKET_SIZE)
+        return PacketKind::IMU6;
+    if (length == ECG_MV_PACKET_SIZE)
+        return PacketKind::ECG_MV;
+    return PacketKind::GENERIC;
+}
+
+} // namespace sbem
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace sbem
+{
+
+enum class FieldType : uint8_t
+{
+    UINT8,
+    INT8,
+    UINT16,
+    INT16,
+    UINT32,
+    INT32,
+    UINT64,
+    INT64,
+    FLOAT32,
+    FLOAT64
+};
+
+size_t fieldTypeSize(FieldType type);
+
+/** Scalar or array member of a packet. */
+struct Field
+{
+    FieldType type;
+    uint32_t offset;    // byte offset inside the chunk payload
+    uint32_t count;     // elements; 0 = repeats to the end of the chunk
+    std::string name;
+};
+
+/** Packet layouts with a dedicated decoder; everything else is GENERIC. */
+enum class PacketKind : uint8_t
+{
+    GENERIC,
+    ECG_MV,
+    IMU6
+};
+
+/**
+*   How to decode every data chunk carrying one chunk id.
+*/
+struct DecodePlan
+{
+    uint16_t id;
+    PacketKind kind;
+    std::string path;
+    std::vector<Field> fields;
+    uint32_t fixedSize;         // bytes taken by fixed-count fields
+    uint32_t tailElementSize;   // element size of a trailing open array, 0 if none
+
+    /** Number of elements in the open array for a chunk of this length. */
+    uint32_t tailCount(uint32_t length) const
+    {
+        return (tailElementSize && length > fixedSize) ? (length - fixedSize) / tailElementSize : 0;
+    }
+
+    /** Values decode() produces for a chunk of this length; fields running past the payload are dropped. */
+    uint32_t valueCount(uint32_t length) const;
+
+    /**
+    *   Interpret one chunk field by field, every element widened to double.
+    *
+    *   @param pData Chunk payload
+    *   @param length Payload length
+    *   @param pOut Receives valueCount(length) values
+    */
+    void decode(const uint8_t* pData, uint32_t length, double* pOut) const;
+};
+
+/**
+*   Compiles SBEM descriptor chunks into per-chunk-id decode plans.
+*
+*   A descriptor chunk (id 0) holds the escape-encoded id it describes followed
+*   by tagged text:
+*     item:  <FRM>float32[3]<NME>ArrayAcc     (count may be [n], [] or absent)
+*     group: <GRP>10,13,14<PTH>/Meas/IMU6/26  (member ids, items or groups)
+*   Groups are flattened into field offsets once; lookups are a table index.
+*/
+class PlanTable
+{
+public:
+    PlanTable();
+
+    void clear();
+
+    /**
+    *   Register a descriptor chunk. Plans are rebuilt on the next find().
+    *
+    *   @param pData Descriptor chunk payload
+    *   @param length Payload length
+    *   @return false if the payload doesn't start with a valid id
+    */
+    bool addDescriptor(const uint8_t* pData, size_t length);
+
+    /** True if addDescriptor() would accept the payload, without registering it. */
+    static bool validDescriptor(const uint8_t* pData, size_t length);
+
+    /**
+    *   @param id Chunk id
+    *   @return Plan for the id, or nullptr if no descriptor describes it
+    */
+    const DecodePlan* find(uint16_t id)
+    {
+        if (mDirty)
+            compile();
+        return (id < mSlots.size() && mSlots[id] >= 0) ? &mPlans[mSlots[id]] : nullptr;
+    }
+
+    const std::vector<DecodePlan>& plans()
+    {
+        if (mDirty)
+            compile();
+        return mPlans;
+    }
+
+    /**
+    *   Packet decoder a data chunk goes to. Described ids go by their plan, the
+    *   others by guessKind(); a payload that doesn't fit the packet is GENERIC.
+    *
+    *   @param id Chunk id (not DESCRIPTOR_ID)
+    *   @param length Payload length
+    *   @param rpPlan Receives the id's plan, nullptr if undescribed
+    */
+    PacketKind route(uint16_t id, uint32_t length, const DecodePlan*& rpPlan);
+
+    /** The length-only classification converter.py uses when nothing is described. */
+    static PacketKind guessKind(uint32_t length);
+
+    /**
+    *   Plan equivalent to the fixed layout of a packet kind (see PacketLayout.h),
+    *   used to interpret undescribed ECG and IMU6 chunks on the generic path.
+    *
+    *   @param kind ECG_MV or IMU6
+    *   @return nullptr for GENERIC
+    */
+    static const DecodePlan* builtinPlan(PacketKind kind);
+
+private:
+    struct Descriptor
+    {
+        uint16_t id;
+        bool isGroup;
+        FieldType type;
+        uint32_t count;
+        std::string name;
+        std::string path;
+        std::vector<uint16_t> members;
+    };
+
+    static bool parseDescriptor(const uint8_t* pData, size_t length, Descriptor& rDescriptor);
+    void compile();
+    bool flatten(uint16_t id, DecodePlan& rPlan, int depth) const;
+    const Descriptor* findDescriptor(uint16_t id) const;
+    static void classify(DecodePlan& rPlan);
+
+    std::vector<Descriptor> mDescriptors;
+    std::vector<DecodePlan> mPlans;
+    std::vector<int32_t> mSlots;
+    bool mDirty;
+};
+
+} // namespace sbem
@@ -0,0 +1,958 @@
+#include "Decoder.h"
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <map>
+
+#include "ChunkIndex.h"
+#include "DecodePlan.h"
+#include "MappedFile.h"
+#include "Scanner.h"
+#include "ThreadPool.h"
+
+namespace sbem
+{
+
+namespace
+{
+
+/** Packet decoders selected by DecodeOptions::packets. pPlan is the chunk's plan, only read when interpreting. */
+template <PacketPath PATH>
+struct PacketSink
+{
+    static void ecg(const DecodePlan*, const uint8_t* p, uint32_t chunkIndex, EcgColumns& rEcg, size_t slot)
+    {
+        PacketDecoder<EcgMvLayout, PATH>::decode(p, chunkIndex, rEcg, slot);
+    }
+
+    static void imu(const DecodePlan*, const uint8_t* p, uint32_t chunkIndex, ImuColumns& rImu, size_t slot)
+    {
+        PacketDecoder<Imu6Layout, PATH>::decode(p, chunkIndex, rImu, slot);
+    }
+};
+
+/** The converter.py way: unpack every field through the plan, then scatter into the columns. */
+template <>
+struct PacketSink<PacketPath::INTERPRETED>
+{
+    static void ecg(const DecodePlan* pPlan, const uint8_t* p, uint32_t chunkIndex, EcgColumns& rEcg, size_t slot)
+    {
+        double values[EcgMvLayout::SIZE];
+        pPlan->decode(p, EcgMvLayout::SIZE, values);
+
+        rEcg.chunkIndex[slot] = chunkIndex;
+        rEcg.timestamp[slot] = static_cast<uint32_t>(values[0]);
+        for (size_t s = 0; s < EcgMvLayout::SAMPLE_COUNT; s++)
+            rEcg.samples[slot * EcgMvLayout::SAMPLE_COUNT + s] = static_cast<float>(values[1 + s]);
+    }
+
+    static void imu(const DecodePlan* pPlan, const uint8_t* p, uint32_t chunkIndex, ImuColumns& rImu, size_t slot)
+    {
+        double values[Imu6Layout::SIZE];
+        pPlan->decode(p, Imu6Layout::SIZE, values);
+
+        rImu.chunkIndex[slot] = chunkIndex;
+        rImu.timestamp[slot] = static_cast<uint32_t>(values[0]);
+        for (size_t s = 0; s < Imu6Layout::SAMPLE_COUNT; s++)
+        {
+            const double* pAccel = values + 1 + s * Imu6Layout::AXES;
+            const double* pGyro = pAccel + Imu6Layout::SAMPLE_COUNT * Imu6Layout::AXES;
+            const size_t i = slot * Imu6Layout::SAMPLE_COUNT + s;
+            rImu.accelX[i] = static_cast<float>(pAccel[0]);
+            rImu.accelY[i] = static_cast<float>(pAccel[1]);
+            rImu.accelZ[i] = static_cast<float>(pAccel[2]);
+            rImu.gyroX[i] = static_cast<float>(pGyro[0]);
+            rImu.gyroY[i] = static_cast<float>(pGyro[1]);
+            rImu.gyroZ[i] = static_cast<float>(pGyro[2]);
+        }
+    }
+};
+
+/** Plan to interpret an ECG or IMU6 chunk by; undescribed ids use the built-in layout. */
+const DecodePlan* packetPlan(const DecodePlan* pPlan, PacketKind kind)
+{
+    return pPlan ? pPlan : PlanTable::builtinPlan(kind);
+}
+
+enum class Route : uint8_t
+{
+    DESCRIPTOR,
+    ECG,
+    IMU,
+    OTHER
+};
+
+/**
+*   Classifies chunks in file order. Each pass gets its own Router, and since
+*   descriptors are met at the same positions every pass classifies the same
+*   chunk the same way and numbers generic streams in the same order.
+*
+*   The plans it hands out are copies that live as long as the Router, so a
+*   chunk table can keep the plan in force at each chunk and decode by it
+*   later, whatever descriptors come after.
+*/
+class Router
+{
+public:
+    /**
+    *   @param rChunk Chunk to classify; descriptors are compiled on the way
+    *   @param p Chunk payload
+    *   @param rpPlan Receives the plan of a described id, nullptr otherwise
+    */
+    Route route(const Chunk& rChunk, const uint8_t* p, const DecodePlan*& rpPlan)
+    {
+        if (rChunk.id == DESCRIPTOR_ID)
+        {
+            // A descriptor may change any plan, copy them again when next used
+            if (mPlans.addDescriptor(p, rChunk.length))
+                std::fill(mPinned.begin(), mPinned.end(), nullptr);
+            rpPlan = nullptr;
+            return Route::DESCRIPTOR;
+        }
+
+        const DecodePlan* pCurrent;
+        const PacketKind kind = mPlans.route(rChunk.id, rChunk.length, pCurrent);
+        rpPlan = pCurrent ? pin(*pCurrent) : nullptr;
+        switch (kind)
+        {
+        case PacketKind::IMU6:
+            return Route::IMU;
+        case PacketKind::ECG_MV:
+            return Route::ECG;
+        default:
+            return Route::OTHER;
+        }
+    }
+
+    /**
+    *   @param rPlan Plan of a generic chunk
+    *   @param rCreated Set when this is the first chunk of the id
+    *   @return Index of the id's stream in Recording::streams
+    */
+    int32_t stream(const DecodePlan& rPlan, bool& rCreated)
+    {
+        if (mStreams.size() <= rPlan.id)
+            mStreams.resize(rPlan.id + 1, -1);
+        rCreated = mStreams[rPlan.id] < 0;
+        if (rCreated)
+            mStreams[rPlan.id] = mStreamCount++;
+        return mStreams[rPlan.id];
+    }
+
+private:
+    const DecodePlan* pin(const DecodePlan& rPlan)
+    {
+        if (mPinned.size() <= rPlan.id)
+            mPinned.resize(rPlan.id + 1, nullptr);
+        if (!mPinned[rPlan.id])
+        {
+            mCopies.push_back(rPlan);
+            mPinned[rPlan.id] = &mCopies.back();
+        }
+        return mPinned[rPlan.id];
+    }
+
+    PlanTable mPlans;
+    std::deque<DecodePlan> mCopies;             // stable addresses
+    std::vector<const DecodePlan*> mPinned;     // copy of each id's current plan, nullptr until used
+    std::vector<int32_t> mStreams;
+    int32_t mStreamCount = 0;
+};
+
+/**
+*   Chunks in file order, from a ChunkIndex when there is one, otherwise
+*   scanned. Index entries are checked against the image like scanned ones,
+*   a sidecar is a file too.
+*/
+class ChunkWalk
+{
+public:
+    ChunkWalk(const uint8_t* pData, size_t size, const DecodeOptions& rOptions):
+        mScanner(pData, rOptions.pIndex ? 0 : size),
+        mpIndex(rOptions.pIndex),
+        mSize(size),
+        mNext(0),
+        mFirst(0),
+        mEnd(0),
+        mBroken(false)
+    {
+        if (mpIndex)
+        {
+            mFirst = std::min(rOptions.firstChunk, mpIndex->size());
+            mEnd = std::max(mFirst, std::min(rOptions.endChunk, mpIndex->size()));
+        }
+    }
+
+    bool next(Chunk& rChunk)
+    {
+        if (!mpIndex)
+            return mScanner.next(rChunk);
+        // In front of the range only the descriptors are visited
+        while (mNext < mFirst)
+        {
+            if (mNext >= mpIndex->descriptorEnd())
+                mNext = mFirst;
+            else if ((*mpIndex)[mNext].kind == ChunkKind::DESCRIPTOR)
+                break;
+            else
+                mNext++;
+        }
+        if (mNext >= mEnd || mBroken)
+            return false;
+
+        const IndexEntry& e = (*mpIndex)[mNext];
+        if (e.offset > mSize || e.length > mSize - e.offset)
+        {
+            mBroken = true;
+            return false;
+        }
+        rChunk.index = static_cast<uint32_t>(mNext++);
+        rChunk.id = e.id;
+        rChunk.length = e.length;
+        rChunk.offset = e.offset;
+        return true;
+    }
+
+    bool truncated() const { return mpIndex ? mpIndex->truncated() || mBroken : mScanner.truncated(); }
+
+    /** Scanning walks only, see Scanner::extend(). */
+    void extend(const uint8_t* pData, size_t size, size_t dropped, bool complete)
+    {
+        mScanner.extend(pData, size, dropped, complete);
+    }
+    size_t position() const { return mScanner.position(); }
+
+    /** Gaps found by the scanner so far (none when walking an index). */
+    const std::vector<Gap>& scannedGaps() const { return mScanner.gaps(); }
+
+    /** Gaps inside the walked range. */
+    void gaps(std::vector<Gap>& rGaps) const
+    {
+        if (!mpIndex)
+        {
+            rGaps = mScanner.gaps();
+            return;
+        }
+
+        const uint64_t begin = mFirst < mpIndex->size() ? (*mpIndex)[mFirst].offset : UINT64_MAX;
+        const uint64_t end = mEnd > mFirst ? (*mpIndex)[mEnd - 1].offset : 0;
+        const bool whole = mFirst == 0 && mEnd == mpIndex->size();
+        for (const Gap* p = mpIndex->gapsBegin(); p != mpIndex->gapsEnd(); p++)
+        {
+            if (whole || (p->end > begin && p->begin < end))
+                rGaps.push_back(*p);
+        }
+    }
+    uint32_t chunkCount() const { return mpIndex ? static_cast<uint32_t>(mNext) : mScanner.chunkCount(); }
+
+private:
+    Scanner mScanner;
+    const ChunkIndex* mpIndex;
+    size_t mSize;
+    size_t mNext;
+    size_t mFirst;
+    size_t mEnd;
+    bool mBroken;
+};
+
+/** Column sizes found by the counting pass. */
+struct Layout
+{
+    size_t ecg = 0;
+    size_t imu = 0;
+    size_t other = 0;
+    std::vector<size_t> streamChunks;
+    std::vector<size_t> streamValues;
+};
+
+/** Chunk table entry of the parallel decode: the chunk plus its pre-assigned output slots. */
+struct SlottedChunk
+{
+    Chunk chunk;
+    Route route;
+    const DecodePlan* pPlan;    // plan in force at the chunk, nullptr if undescribed
+    int32_t stream;         // index into Recording::streams, -1 if none
+    uint32_t slot;          // index into ecg/imu packets, or into the stream's chunks
+    uint32_t otherSlot;     // index into Recording::other, UINT32_MAX if none
+};
+
+/**
+*   Pass 1: walk the chunk boundaries and count, until the walk ends or the
+*   chunks walked reach rEnd. Fills the descriptors and stream metadata of
+*   rRecording, and the chunk table when one is given.
+*
+*   @param rEnd Offset to stop at, receives the end of the last chunk walked
+*   @return false if the walk ended
+*/
+bool countChunks(const uint8_t* pData, ChunkWalk& rWalk, Router& rRouter, Recording& rRecording, Layout& rLayout,
+                 std::vector<SlottedChunk>* pTable, uint64_t& rEnd)
+{
+    const uint64_t stop = rEnd;
+    SlottedChunk entry;
+    const DecodePlan* pPlan;
+    while (rWalk.next(entry.chunk))
+    {
+        const Chunk& chunk = entry.chunk;
+        const uint8_t* p = pData + chunk.offset;
+        rEnd = chunk.offset + chunk.length;
+        entry.route = rRouter.route(chunk, p, pPlan);
+        entry.pPlan = pPlan;
+        entry.stream = -1;
+        entry.slot = 0;
+        entry.otherSlot = UINT32_MAX;
+
+        switch (entry.route)
+        {
+        case Route::DESCRIPTOR:
+            rRecording.descriptors.emplace_back(reinterpret_cast<const char*>(p), chunk.length);
+            if (rEnd >= stop)
+                return true;
+            continue;
+        case Route::IMU:
+            entry.slot = static_cast<uint32_t>(rLayout.imu++);
+            break;
+        case Route::ECG:
+            entry.slot = static_cast<uint32_t>(rLayout.ecg++);
+            break;
+        case Route::OTHER:
+            if (pPlan)
+            {
+                bool created;
+                entry.stream = rRouter.stream(*pPlan, created);
+                if (created)
+                {
+                    rRecording.streams.emplace_back();
+                    rRecording.streams.back().id = pPlan->id;
+                    rRecording.streams.back().path = pPlan->path;
+                    rLayout.streamChunks.push_back(0);
+                    rLayout.streamValues.push_back(0);
+                }
+                entry.slot = static_cast<uint32_t>(rLayout.streamChunks[entry.stream]++);
+                rLayout.streamValues[entry.stream] += pPlan->valueCount(chunk.length);
+            }
+            if (chunk.length >= 4)
+                entry.otherSlot = static_cast<uint32_t>(rLayout.other++);
+            break;
+        }
+
+        if (pTable)
+            pTable->push_back(entry);
+        if (rEnd >= stop)
+            return true;
+    }
+    return false;
+}
+
+/** Pass 1 over the whole walk of rOptions. rRouter holds the plans of the table, keep it for pass 2. */
+void countChunks(const uint8_t* pData, size_t size, const DecodeOptions& rOptions, Router& rRouter,
+                 Recording& rRecording, Layout& rLayout, std::vector<SlottedChunk>* pTable)
+{
+    ChunkWalk walk(pData, size, rOptions);
+    uint64_t end = UINT64_MAX;
+    countChunks(pData, walk, rRouter, rRecording, rLayout, pTable, end);
+
+    rRecording.chunkCount = walk.chunkCount();
+    rRecording.truncated = walk.truncated();
+    walk.gaps(rRecording.gaps);
+}
+
+template <typename T>
+void place(Arena& rArena, Column<T>& rColumn, size_t count)
+{
+    rColumn.data = rArena.alloc<T>(count);
+    rColumn.size = count;
+}
+
+/** Size the arena exactly for the layout and point every column into it. */
+bool allocateColumns(Recording& rRecording, const Layout& rLayout)
+{
+    const size_t ecgSamples = rLayout.ecg * ECG_SAMPLES_PER_PACKET;
+    const size_t imuSamples = rLayout.imu * IMU_SAMPLES_PER_PACKET;
+
+    size_t bytes = 2 * Arena::footprint<uint32_t>(rLayout.ecg) + Arena::footprint<float>(ecgSamples) +
+                   2 * Arena::footprint<uint32_t>(rLayout.imu) + 6 * Arena::footprint<float>(imuSamples) +
+                   2 * Arena::footprint<uint32_t>(rLayout.other) + Arena::footprint<uint16_t>(rLayout.other);
+    for (size_t s = 0; s < rRecording.streams.size(); s++)
+    {
+        bytes += Arena::footprint<uint32_t>(rLayout.streamChunks[s]) +
+                 Arena::footprint<uint32_t>(rLayout.streamChunks[s] + 1) +
+                 Arena::footprint<double>(rLayout.streamValues[s]);
+    }
+
+    Arena& rArena = rRecording.arena;
+    if (!rArena.reuse(bytes))
+        return false;
+
+    place(rArena, rRecording.ecg.chunkIndex, rLayout.ecg);
+    place(rArena, rRecording.ecg.timestamp, rLayout.ecg);
+    place(rArena, rRecording.ecg.samples, ecgSamples);
+
+    place(rArena, rRecording.imu.chunkIndex, rLayout.imu);
+    place(rArena, rRecording.imu.timestamp, rLayout.imu);
+    place(rArena, rRecording.imu.accelX, imuSamples);
+    place(rArena, rRecording.imu.accelY, imuSamples);
+    place(rArena, rRecording.imu.accelZ, imuSamples);
+    place(rArena, rRecording.imu.gyroX, imuSamples);
+    place(rArena, rRecording.imu.gyroY, imuSamples);
+    place(rArena, rRecording.imu.gyroZ, imuSamples);
+
+    place(rArena, rRecording.other.chunkIndex, rLayout.other);
+    place(rArena, rRecording.other.id, rLayout.other);
+    place(rArena, rRecording.other.value, rLayout.other);
+
+    for (size_t s = 0; s < rRecording.streams.size(); s++)
+    {
+        GenericStream& rStream = rRecording.streams[s];
+        place(rArena, rStream.chunkIndex, rLayout.streamChunks[s]);
+        place(rArena, rStream.valueOffsets, rLayout.streamChunks[s] + 1);
+        place(rArena, rStream.values, rLayout.streamValues[s]);
+        rStream.valueOffsets[0] = 0;
+    }
+    return true;
+}
+
+void putOther(OtherColumns& rOther, size_t slot, const Chunk& rChunk, const uint8_t* p)
+{
+    rOther.chunkIndex[slot] = rChunk.index;
+    rOther.id[slot] = rChunk.id;
+    rOther.value[slot] = loadU32(p);
+}
+
+/** Pass 2 on the calling thread: re-walk the file and fill the columns in order. */
+template <PacketPath PATH>
+void decodeSequential(const uint8_t* pData, size_t size, const DecodeOptions& rOptions, Recording& rRecording)
+{
+    size_t ecgPos = 0;
+    size_t imuPos = 0;
+    size_t otherPos = 0;
+    std::vector<size_t> streamPos(rRecording.streams.size(), 0);
+
+    Router router;
+    ChunkWalk walk(pData, size, rOptions);
+    Chunk chunk;
+    const DecodePlan* pPlan;
+    while (walk.next(chunk))
+    {
+        const uint8_t* p = pData + chunk.offset;
+
+        switch (router.route(chunk, p, pPlan))
+        {
+        case Route::DESCRIPTOR:
+            break;
+        case Route::IMU:
+            PacketSink<PATH>::imu(packetPlan(pPlan, PacketKind::IMU6), p, chunk.index, rRecording.imu, imuPos++);
+            break;
+        case Route::ECG:
+            PacketSink<PATH>::ecg(packetPlan(pPlan, PacketKind::ECG_MV), p, chunk.index, rRecording.ecg, ecgPos++);
+            break;
+        case Route::OTHER:
+            if (pPlan)
+            {
+                bool created;
+                const int32_t s = router.stream(*pPlan, created);
+                GenericStream& rStream = rRecording.streams[s];
+                const size_t i = streamPos[s]++;
+                rStream.chunkIndex[i] = chunk.index;
+                pPlan->decode(p, chunk.length, rStream.values.data + rStream.valueOffsets[i]);
+                rStream.valueOffsets[i + 1] = rStream.valueOffsets[i] + pPlan->valueCount(chunk.length);
+            }
+            if (chunk.length >= 4)
+                putOther(rRecording.other, otherPos++, chunk, p);
+            break;
+        }
+    }
+}
+
+/** Pass 2 on the pool: every chunk of the table owns its output slots, so workers never contend. */
+template <PacketPath PATH>
+void decodeParallel(const uint8_t* pData, const std::vector<SlottedChunk>& rTable, Recording& rRecording,
+                    ThreadPool& rPool)
+{
+    // Generic value offsets are a prefix sum, do them up front (generic chunks are rare)
+    for (const SlottedChunk& e : rTable)
+    {
+        if (e.stream >= 0)
+        {
+            GenericStream& rStream = rRecording.streams[e.stream];
+            rStream.chunkIndex[e.slot] = e.chunk.index;
+            rStream.valueOffsets[e.slot + 1] = rStream.valueOffsets[e.slot] + e.pPlan->valueCount(e.chunk.length);
+        }
+    }
+
+    parallelFor(rPool, rTable.size(), [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; i++)
+        {
+            const SlottedChunk& e = rTable[i];
+            const uint8_t* p = pData + e.chunk.offset;
+            switch (e.route)
+            {
+            case Route::IMU:
+                PacketSink<PATH>::imu(packetPlan(e.pPlan, PacketKind::IMU6), p, e.chunk.index, rRecording.imu, e.slot);
+                break;
+            case Route::ECG:
+                PacketSink<PATH>::ecg(packetPlan(e.pPlan, PacketKind::ECG_MV), p, e.chunk.index, rRecording.ecg,
+                                      e.slot);
+                break;
+            case Route::OTHER:
+                if (e.stream >= 0)
+                {
+                    GenericStream& rStream = rRecording.streams[e.stream];
+                    e.pPlan->decode(p, e.chunk.length, rStream.values.data + rStream.valueOffsets[e.slot]);
+                }
+                if (e.otherSlot != UINT32_MAX)
+                    putOther(rRecording.other, e.otherSlot, e.chunk, p);
+                break;
+            case Route::DESCRIPTOR:
+                break;
+            }
+        }
+    });
+}
+
+template <PacketPath PATH>
+void decodeColumns(const uint8_t* pData, size_t size, const std::vector<SlottedChunk>& rTable, Recording& rRecording,
+                   const DecodeOptions& rOptions, unsigned threads)
+{
+    if (rOptions.pPool)
+    {
+        decodeParallel<PATH>(pData, rTable, rRecording, *rOptions.pPool);
+    }
+    else if (threads > 1)
+    {
+        ThreadPool pool(threads - 1);
+        decodeParallel<PATH>(pData, rTable, rRecording, pool);
+    }
+    else
+    {
+        decodeSequential<PATH>(pData, size, rOptions, rRecording);
+    }
+}
+
+/** Options of a StreamDecoder or PushDecoder walk: always scanned. */
+DecodeOptions scanned(const DecodeOptions& rOptions)
+{
+    DecodeOptions options = rOptions;
+    options.pIndex = nullptr;
+    return options;
+}
+
+/**
+*   Pass 2 of a batch whose chunk table has been counted into rBatch and
+*   rLayout. Streams met for the first time are added to rStreams, so later
+*   batches number them the same.
+*
+*   @return false if the batch can't be allocated
+*/
+bool decodeBatch(const uint8_t* pData, const std::vector<SlottedChunk>& rTable, const Layout& rLayout,
+                 std::vector<GenericStream>& rStreams, const DecodeOptions& rOptions, Recording& rBatch)
+{
+    for (size_t i = rStreams.size(); i < rBatch.streams.size(); i++)
+    {
+        rStreams.push_back(GenericStream());
+        rStreams.back().id = rBatch.streams[i].id;
+        rStreams.back().path = rBatch.streams[i].path;
+    }
+
+    if (!allocateColumns(rBatch, rLayout))
+    {
+        rBatch.clear();
+        return false;
+    }
+
+    switch (rOptions.packets)
+    {
+    case PacketPath::SIMD:
+        decodeParallel<PacketPath::SIMD>(pData, rTable, rBatch, *rOptions.pPool);
+        break;
+    case PacketPath::UNROLLED:
+        decodeParallel<PacketPath::UNROLLED>(pData, rTable, rBatch, *rOptions.pPool);
+        break;
+    case PacketPath::INTERPRETED:
+        decodeParallel<PacketPath::INTERPRETED>(pData, rTable, rBatch, *rOptions.pPool);
+        break;
+    }
+    return true;
+}
+
+/** The pool of a batch decoder: rOptions' own, or else a private one kept in rpPool. */
+void batchPool(DecodeOptions& rOptions, std::unique_ptr<ThreadPool>& rpPool)
+{
+    if (!rOptions.pPool)
+    {
+        const unsigned threads = rOptions.threads ? rOptions.threads : defaultThreadCount();
+        rpPool.reset(new ThreadPool(threads - 1));
+        rOptions.pPool = rpPool.get();
+    }
+}
+
+} // namespace
+
+bool Decoder::decode(const uint8_t* pData, size_t size, Recording& rRecording, const DecodeOptions& rOptions)
+{
+    rRecording.clear();
+    if (size < HEADER_SIZE)
+        return false;
+
+    const unsigned threads = rOptions.threads ? rOptions.threads : defaultThreadCount();
+    const bool parallel = rOptions.pPool || threads > 1;
+
+    Layout layout;
+    std::vector<SlottedChunk> table;
+    if (parallel)
+    {
+        const ChunkIndex* pIndex = rOptions.pIndex;
+        const size_t end = pIndex ? std::min(rOptions.endChunk, pIndex->size()) : 0;
+        table.reserve(pIndex ? end - std::min(rOptions.firstChunk, end) + pIndex->descriptorEnd()
+                             : size / (ECG_MV_PACKET_SIZE + 2) + 16);
+    }
+    Router router;
+    countChunks(pData, size, rOptions, router, rRecording, layout, parallel ? &table : nullptr);
+
+    if (!allocateColumns(rRecording, layout))
+    {
+        rRecording.clear();
+        return false;
+    }
+
+    switch (rOptions.packets)
+    {
+    case PacketPath::SIMD:
+        decodeColumns<PacketPath::SIMD>(pData, size, table, rRecording, rOptions, parallel ? threads : 1);
+        break;
+    case PacketPath::UNROLLED:
+        decodeColumns<PacketPath::UNROLLED>(pData, size, table, rRecording, rOptions, parallel ? threads : 1);
+        break;
+    case PacketPath::INTERPRETED:
+        decodeColumns<PacketPath::INTERPRETED>(pData, size, table, rRecording, rOptions, parallel ? threads : 1);
+        break;
+    }
+
+    rRecording.bytesScanned = size;
+    return true;
+}
+
+struct StreamDecoder::State
+{
+    State(const uint8_t* pData, size_t size, const DecodeOptions& rOptions):
+        pData(pData),
+        size(size),
+        options(scanned(rOptions)),
+        walk(pData, size, options),
+        position(size < HEADER_SIZE ? size : HEADER_SIZE),
+        reportedGaps(0),
+        done(size < HEADER_SIZE)
+    {
+        batchPool(options, pPool);
+    }
+
+    const uint8_t* pData;
+    size_t size;
+    DecodeOptions options;
+    ChunkWalk walk;
+    Router router;
+    std::unique_ptr<ThreadPool> pPool;
+    std::vector<SlottedChunk> table;
+    std::vector<GenericStream> streams;     // metadata only
+    uint64_t position;
+    size_t reportedGaps;
+    bool done;
+};
+
+StreamDecoder::StreamDecoder(const uint8_t* pData, size_t size, const DecodeOptions& rOptions):
+    mpState(new State(pData, size, rOptions))
+{
+}
+
+StreamDecoder::~StreamDecoder()
+{
+}
+
+bool StreamDecoder::next(Recording& rBatch, size_t maxBytes)
+{
+    State& s = *mpState;
+    rBatch.recycle();
+    if (s.done)
+        return false;
+
+    // Streams met in earlier batches keep their numbers
+    Layout layout;
+    rBatch.streams = s.streams;
+    layout.streamChunks.assign(s.streams.size(), 0);
+    layout.streamValues.assign(s.streams.size(), 0);
+
+    const uint64_t begin = s.position;
+    const uint32_t chunksBefore = s.walk.chunkCount();
+    uint64_t end = begin + std::max<size_t>(maxBytes, 1);
+    s.table.clear();
+    s.done = !countChunks(s.pData, s.walk, s.router, rBatch, layout, &s.table, end);
+    if (s.done && s.walk.chunkCount() == chunksBefore && s.walk.scannedGaps().size() == s.reportedGaps)
+        return false;
+    s.position = s.done ? s.size : end;
+
+    if (!decodeBatch(s.pData, s.table, layout, s.streams, s.options, rBatch))
+    {
+        s.done = true;
+        return false;
+    }
+
+    const std::vector<Gap>& rGaps = s.walk.scannedGaps();
+    rBatch.gaps.assign(rGaps.begin() + s.reportedGaps, rGaps.end());
+    s.reportedGaps = rGaps.size();
+    rBatch.chunkCount = s.walk.chunkCount();
+    rBatch.truncated = s.done && s.walk.truncated();
+    rBatch.bytesScanned = s.position - (begin > HEADER_SIZE ? begin : 0);
+    return true;
+}
+
+bool StreamDecoder::survey(RecordingShape& rShape, size_t maxBytes)
+{
+    State& s = *mpState;
+    if (s.done || rShape.complete())
+        return false;
+
+    const uint64_t stop = s.position + std::max<size_t>(maxBytes, 1);
+    Chunk chunk;
+    const DecodePlan* pPlan;
+    while (s.walk.next(chunk))
+    {
+        s.position = chunk.offset + chunk.length;
+        switch (s.router.route(chunk, s.pData + chunk.offset, pPlan))
+        {
+        case Route::ECG:
+            rShape.firstEcg = std::min(rShape.firstEcg, chunk.index);
+            break;
+        case Route::IMU:
+            rShape.firstImu = std::min(rShape.firstImu, chunk.index);
+            break;
+        case Route::OTHER:
+            if (chunk.length >= 4)
+                rShape.firstOther = std::min(rShape.firstOther, chunk.index);
+            break;
+        case Route::DESCRIPTOR:
+            break;
+        }
+        if (rShape.complete())
+            return false;
+        if (s.position >= stop)
+            return true;
+    }
+    s.done = true;
+    s.position = s.size;
+    return false;
+}
+
+uint64_t StreamDecoder::position() const
+{
+    return mpState->position;
+}
+
+struct PushDecoder::State
+{
+    State(const DecodeOptions& rOptions, size_t lossWindow):
+        options(scanned(rOptions)),
+        lossWindow(lossWindow)
+    {
+        batchPool(options, pPool);
+    }
+
+    /** End of the contiguous bytes received. */
+    uint64_t end() const { return origin + buffer.size(); }
+
+    /** Copy a fragment that starts inside or right after the buffer, except what was decoded already. */
+    void place(uint64_t offset, const uint8_t* pData, size_t size)
+    {
+        if (offset + size <= origin)
+            return;
+        if (offset < origin)
+        {
+            pData += origin - offset;
+            size -= static_cast<size_t>(origin - offset);
+            offset = origin;
+        }
+        const size_t at = static_cast<size_t>(offset - origin);
+        const size_t overlap = std::min(size, buffer.size() - at);
+        std::copy(pData, pData + overlap, buffer.begin() + at);
+        buffer.insert(buffer.end(), pData + overlap, pData + size);
+    }
+
+    /** Move waiting fragments into the buffer once it reaches them or limit bytes past it are in; holes read as zeros. */
+    void drain(uint64_t limit)
+    {
+        while (!waiting.empty() && (waiting.begin()->first <= end() || furthest - end() >= limit))
+        {
+            const auto it = waiting.begin();
+            if (it->first > end())
+            {
+                lost += it->first - end();
+                buffer.resize(static_cast<size_t>(it->first - origin), 0);
+            }
+            place(it->first, it->second.data(), it->second.size());
+            waitingBytes -= it->second.size();
+            waiting.erase(it);
+        }
+    }
+
+    DecodeOptions options;
+    uint64_t lossWindow;
+    std::unique_ptr<ThreadPool> pPool;
+    std::vector<uint8_t> buffer;        // file bytes [origin, end()), from the first undecoded chunk on
+    uint64_t origin = 0;
+    std::map<uint64_t, std::vector<uint8_t>> waiting;   // fragments behind a hole, by offset
+    size_t waitingBytes = 0;
+    uint64_t furthest = 0;              // end of the furthest fragment
+    uint64_t lost = 0;
+    std::unique_ptr<ChunkWalk> pWalk;   // from when the file header is in
+    Router router;
+    std::vector<SlottedChunk> table;
+    std::vector<GenericStream> streams; // metadata only
+    uint64_t position = 0;
+    size_t reportedGaps = 0;
+    bool finished = false;
+    bool done = false;
+};
+
+PushDecoder::PushDecoder(const DecodeOptions& rOptions, size_t lossWindow):
+    mpState(new State(rOptions, lossWindow))
+{
+}
+
+PushDecoder::~PushDecoder()
+{
+}
+
+bool PushDecoder::push(uint64_t offset, const uint8_t* pData, size_t size)
+{
+    State& s = *mpState;
+    if (s.finished)
+        return false;
+    if (size == 0)
+        return true;
+
+    s.furthest = std::max(s.furthest, offset + size);
+    if (offset > s.end())
+    {
+        std::vector<uint8_t>& rFragment = s.waiting[offset];
+        s.waitingBytes = s.waitingBytes - rFragment.size() + size;
+        rFragment.assign(pData, pData + size);
+    }
+    else
+    {
+        s.place(offset, pData, size);
+    }
+    s.drain(s.lossWindow ? s.lossWindow : UINT64_MAX);
+    return true;
+}
+
+void PushDecoder::finish()
+{
+    State& s = *mpState;
+    if (s.finished)
+        return;
+    s.finished = true;
+    s.drain(0);
+}
+
+bool PushDecoder::next(Recording& rBatch)
+{
+    State& s = *mpState;
+    rBatch.recycle();
+    if (s.done)
+        return false;
+
+    if (!s.pWalk)
+    {
+        if (s.buffer.size() < HEADER_SIZE)
+        {
+            s.done = s.finished;
+            return false;
+        }
+        s.pWalk.reset(new ChunkWalk(s.buffer.data(), s.buffer.size(), s.options));
+    }
+    // The buffer may have moved since the last batch
+    ChunkWalk& rWalk = *s.pWalk;
+    rWalk.extend(s.buffer.data(), s.buffer.size(), 0, s.finished);
+
+    Layout layout;
+    rBatch.streams = s.streams;
+    layout.streamChunks.assign(s.streams.size(), 0);
+    layout.streamValues.assign(s.streams.size(), 0);
+
+    const uint64_t begin = s.position;
+    const uint32_t chunksBefore = rWalk.chunkCount();
+    uint64_t end = UINT64_MAX;
+    s.table.clear();
+    countChunks(s.buffer.data(), rWalk, s.router, rBatch, layout, &s.table, end);
+    s.done = s.finished;
+    if (rWalk.chunkCount() == chunksBefore && rWalk.scannedGaps().size() == s.reportedGaps)
+        return false;
+    s.position = s.done ? s.end() : s.origin + rWalk.position();
+
+    if (!decodeBatch(s.buffer.data(), s.table, layout, s.streams, s.options, rBatch))
+    {
+        s.done = true;
+        return false;
+    }
+
+    // Gaps are found at offsets into the buffer
+    const std::vector<Gap>& rGaps = rWalk.scannedGaps();
+    for (size_t g = s.reportedGaps; g < rGaps.size(); g++)
+        rBatch.gaps.push_back({ s.origin + rGaps[g].begin, s.origin + rGaps[g].end });
+    s.reportedGaps = rGaps.size();
+    rBatch.chunkCount = rWalk.chunkCount();
+    rBatch.truncated = s.done && rWalk.truncated();
+    rBatch.bytesScanned = s.position - begin;
+
+    // Drop what has been decoded; the rest is at most a chunk still arriving
+    const size_t decoded = rWalk.position();
+    s.buffer.erase(s.buffer.begin(), s.buffer.begin() + static_cast<ptrdiff_t>(decoded));
+    s.origin += decoded;
+    rWalk.extend(s.buffer.data(), s.buffer.size(), decoded, s.finished);
+    return true;
+}
+
+uint64_t PushDecoder::contiguous() const
+{
+    return mpState->end();
+}
+
+uint64_t PushDecoder::position() const
+{
+    return mpState->position;
+}
+
+size_t PushDecoder::pending() const
+{
+    return mpState->waitingBytes;
+}
+
+uint64_t PushDecoder::lost() const
+{
+    return mpState->lost;
+}
+
+bool PushDecoder::done() const
+{
+    return mpState->done;
+}
+
+bool Decoder::decodeFile(const char* path, Recording& rRecording, const DecodeOptions& rOptions)
+{
+    MappedFile file;
+    if (!file.open(path))
+    {
+        rRecording.clear();
+        return false;
+    }
+    if (!rOptions.sidecarIndex || rOptions.pIndex)
+        return decode(file.data(), file.size(), rRecording, rOptions);
+
+    ChunkIndex index;
+    index.useSidecar(path, file.data(), file.size());
+    DecodeOptions options = rOptions;
+    options.pIndex = &index;
+    return decode(file.data(), file.size(), rRecording, options);
+}
+
+} // namespace sbem
@@ -0,0 +1,237 @@
+#pragma once
+
+#include <memory>
+
+#include "PacketDecoder.h"
+#include "Recording.h"
+
+namespace sbem
+{
+
+class ChunkIndex;
+class ThreadPool;
+
+struct DecodeOptions
+{
+    /**
+    *   1 decodes on the calling thread. More threads keep a chunk table from
+    *   the counting pass and decode it in parallel, every chunk straight into
+    *   its pre-assigned slot. 0 uses every core.
+    */
+    unsigned threads = 1;
+
+    /**
+    *   Run the parallel phase on this pool instead of a private one. Lets a
+    *   batch of files share one pool so idle threads steal chunk ranges from
+    *   whichever file is still decoding. threads is ignored when set.
+    */
+    ThreadPool* pPool = nullptr;
+
+    /**
+    *   Packet decoder for ECG and IMU6 chunks. The layout-specialised paths are
+    *   the default; INTERPRETED exists to benchmark and cross-check them.
+    */
+    PacketPath packets = PacketPath::SIMD;
+
+    /**
+    *   Chunk boundaries of the image from a ChunkIndex built over it; both
+    *   passes then walk the index instead of scanning the file.
+    */
+    const ChunkIndex* pIndex = nullptr;
+
+    /**
+    *   With pIndex, decode only chunks [firstChunk, endChunk). Descriptors in
+    *   front of the range are still read so ids route the same way.
+    */
+    size_t firstChunk = 0;
+    size_t endChunk = SIZE_MAX;
+
+    /**
+    *   decodeFile() only: decode through the file's <file>.sbem.sbidx sidecar,
+    *   writing it first if it is missing or stale. Ignored when pIndex is set.
+    */
+    bool sidecarIndex = false;
+};
+
+/**
+*   Decodes SBEM chunks into a Recording.
+*
+*   A first pass over the chunk boundaries counts what every column will hold,
+*   the recording's arena is allocated once from those counts and a second
+*   pass decodes straight into the columns, so no memory is allocated per chunk.
+*
+*   Descriptor chunks (id 0) are compiled into a PlanTable and every data
+*   chunk is dispatched on its id. Ids without a descriptor are classified the
+*   way conversion/converter.py does it: a 68 byte payload is an ECG mV packet,
+*   52 bytes an IMU6 packet. Chunks without a packet decoder are decoded field
+*   by field into Recording::streams when described, and always keep their
+*   first 4 bytes in Recording::other for the CSV layout.
+*/
+class Decoder
+{
+public:
+    /**
+    *   Decode an in-memory SBEM image.
+    *
+    *   @param pData Start of the file image (including the 8 byte header)
+    *   @param size Size of the image in bytes
+    *   @param rRecording Receives the decoded data (cleared first)
+    *   @param rOptions Decode options
+    *   @return false if the image is shorter than the SBEM header
+    */
+    static bool decode(const uint8_t* pData, size_t size, Recording& rRecording,
+                       const DecodeOptions& rOptions = DecodeOptions());
+
+    /**
+    *   Map and decode an SBEM file.
+    *
+    *   @param path File to decode
+    *   @param rRecording Receives the decoded data
+    *   @param rOptions Decode options
+    *   @return false if the file can't be mapped or has no header
+    */
+    static bool decodeFile(const char* path, Recording& rRecording,
+                           const DecodeOptions& rOptions = DecodeOptions());
+};
+
+/**
+*   Decodes an SBEM image a batch of chunks at a time, for logs whose whole
+*   Recording would not fit in memory.
+*
+*   Every batch is counted and decoded like Decoder::decode does a whole
+*   image, into a Recording whose arena is reused from batch to batch, so
+*   memory follows the batch size and not the length of the log. Chunk
+*   indices keep counting across batches and descriptors keep routing the
+*   chunks after them. Batches are always scanned: DecodeOptions::pIndex and
+*   the chunk range are ignored, as building an index would hold an entry
+*   per chunk.
+*/
+class StreamDecoder
+{
+public:
+    /**
+    *   @param pData Start of the file image (including the 8 byte header)
+    *   @param size Size of the image in bytes
+    *   @param rOptions Decode options; threads and pPool decode each batch in parallel
+    */
+    StreamDecoder(const uint8_t* pData, size_t size, const DecodeOptions& rOptions = DecodeOptions());
+    ~StreamDecoder();
+
+    StreamDecoder(const StreamDecoder&) = delete;
+    StreamDecoder& operator=(const StreamDecoder&) = delete;
+
+    /**
+    *   Decode the next chunks, about maxBytes of the image (at least one chunk).
+    *
+    *   rBatch gets the batch's columns, descriptors and gaps, and the
+    *   metadata of every generic stream met so far (Recording::streams is
+    *   numbered the same in every batch). chunkCount counts all chunks so
+    *   far and bytesScanned the bytes of this batch, the file header
+    *   counted with the first, so the batches add up to the file size.
+    *
+    *   @param rBatch Receives the batch, recycled first
+    *   @param maxBytes Image bytes per batch
+    *   @return false when the image is exhausted or the batch can't be allocated
+    */
+    bool next(Recording& rBatch, size_t maxBytes);
+
+    /**
+    *   Classify the next chunks, about maxBytes of the image, without
+    *   decoding them. Stops early once every row kind has been found. Use a
+    *   StreamDecoder of its own for this, next() continues after the survey.
+    *
+    *   @param rShape Updated with the kinds found
+    *   @param maxBytes Image bytes per call
+    *   @return false when the shape is known: complete, or the image exhausted
+    */
+    bool survey(RecordingShape& rShape, size_t maxBytes);
+
+    /** Image bytes walked so far; everything before it can be dropped from memory. */
+    uint64_t position() const;
+
+private:
+    struct State;
+    std::unique_ptr<State> mpState;
+};
+
+/**
+*   Decodes an SBEM log while it is being downloaded, from the notification
+*   fragments the sensor sends: every fragment is pushed with its file
+*   offset, in whatever order they arrive, and next() decodes the chunks
+*   whose bytes have become contiguous since the last batch. Conversion so
+*   keeps up with the transfer instead of starting after it.
+*
+*   Batches are like those of StreamDecoder::next(), and together they hold
+*   exactly what Decoder::decode() gives for the finished file. Chunks at
+*   the edge of the received data whose verdict depends on bytes still to
+*   come (a resync, a chunk of a new id) wait for them.
+*
+*   The sensor sends a log in order, so a notification missing while the
+*   ones after it keep arriving has been lost. Once lossWindow bytes past a
+*   hole are in, the hole is filled with zeros, as writing the fragments to
+*   a file leaves it, and decoding goes on; finish() does the same for the
+*   holes left at the end. A fragment for a hole that arrives after that is
+*   still taken if its bytes haven't been decoded yet.
+*
+*   Only the bytes from the last undecoded chunk on are kept, so memory
+*   follows the fragments in flight and not the log.
+*/
+class PushDecoder
+{
+public:
+    /** Default bytes past a hole after which it is taken as lost, some 270 notifications. */
+    static constexpr size_t LOSS_WINDOW = 64 << 10;
+
+    /**
+    *   @param rOptions Decode options; pIndex is ignored, threads and pPool decode each batch
+    *   @param lossWindow Bytes past a hole after which it is zero filled; 0 waits for finish()
+    */
+    explicit PushDecoder(const DecodeOptions& rOptions = DecodeOptions(), size_t lossWindow = LOSS_WINDOW);
+    ~PushDecoder();
+
+    PushDecoder(const PushDecoder&) = delete;
+    PushDecoder& operator=(const PushDecoder&) = delete;
+
+    /**
+    *   Add a fragment of the file. Bytes that arrive twice are taken from
+    *   the later fragment, unless they have been decoded already.
+    *
+    *   @param offset File offset of the first byte
+    *   @param pData Fragment bytes
+    *   @param size Fragment length; 0 is ignored
+    *   @return false after finish()
+    */
+    bool push(uint64_t offset, const uint8_t* pData, size_t size);
+
+    /** The file is complete: zero fill the holes and let next() decode the rest. */
+    void finish();
+
+    /**
+    *   Decode the chunks whose bytes have arrived, see StreamDecoder::next().
+    *
+    *   @param rBatch Receives the batch, recycled first
+    *   @return false if there is nothing new to decode or the batch can't be allocated
+    */
+    bool next(Recording& rBatch);
+
+    /** Bytes from the start of the file received without a hole. */
+    uint64_t contiguous() const;
+
+    /** File bytes decoded so far. */
+    uint64_t position() const;
+
+    /** Bytes received out of order and waiting for the hole in front of them. */
+    size_t pending() const;
+
+    /** Bytes of holes zero filled so far. */
+    uint64_t lost() const;
+
+    /** True once finish() was called and next() has decoded everything. */
+    bool done() const;
+
+private:
+    struct State;
+    std::unique_ptr<State> mpState;
+};
+
+} // namespace sbem
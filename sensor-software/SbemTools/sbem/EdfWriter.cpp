@@ -0,0 +1,393 @@
+#include "EdfWriter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "ColumnarWriter.h"
+#include "OutputFile.h"
+#include "PacketSlots.h"
+
+namespace sbem
+{
+
+namespace
+{
+
+constexpr int DIGITAL_MIN = -32768;
+constexpr int DIGITAL_MAX = 32767;
+constexpr uint32_t RECORD_MS = 1000;
+constexpr size_t FLUSH_BYTES = 1 << 20;
+
+const char* const MONTHS[] = { "JAN", "FEB", "MAR", "APR", "MAY", "JUN", "JUL", "AUG", "SEP", "OCT", "NOV", "DEC" };
+
+/** One signal of the file. */
+struct Signal
+{
+    const char* label;
+    const char* dimension;
+    const Column<uint32_t>* pTimestamps;
+    const float* pSamples;
+    size_t perPacket;
+    double rate;
+    size_t perRecord;
+
+    std::string minText;
+    std::string maxText;
+    double physicalMin;
+    double scale;
+    int16_t fill;
+
+    int16_t digital(float value) const
+    {
+        if (!std::isfinite(value))
+            return fill;
+        const double d = std::round((value - physicalMin) * scale + DIGITAL_MIN);
+        return static_cast<int16_t>(std::min<double>(std::max<double>(d, DIGITAL_MIN), DIGITAL_MAX));
+    }
+};
+
+struct Annotation
+{
+    size_t record;
+    std::string tal;
+};
+
+/** Text padded with spaces or cut to width, printable ASCII only as EDF asks. */
+void putField(std::string& rHeader, const std::string& text, size_t width)
+{
+    for (size_t i = 0; i < width; i++)
+    {
+        const char c = i < text.size() ? text[i] : ' ';
+        rHeader += c >= 32 && c < 127 ? c : '_';
+    }
+}
+
+/** Spaces separate EDF+ subfields, so they become underscores inside one. */
+std::string subfield(const std::string& text)
+{
+    std::string out = text.empty() ? "X" : text;
+    std::replace(out.begin(), out.end(), ' ', '_');
+    return out;
+}
+
+/** A physical limit in at most 8 characters, rounded outwards so every sample stays in range. */
+std::string limitText(double value, bool upper)
+{
+    char text[64];
+    for (int decimals = 6; decimals >= 0; decimals--)
+    {
+        const double scale = std::pow(10.0, decimals);
+        const double rounded = (upper ? std::ceil(value * scale) : std::floor(value * scale)) / scale;
+        snprintf(text, sizeof(text), "%.*f", decimals, rounded);
+        if (strlen(text) <= 8)
+            return text;
+    }
+    return upper ? "99999999" : "-9999999";
+}
+
+/** Seconds as an EDF+ onset or duration: sign for onsets, ms resolution, no trailing zeros. */
+std::string seconds(double value, bool sign)
+{
+    char text[32];
+    snprintf(text, sizeof(text), sign ? "%+.3f" : "%.3f", value);
+    std::string out = text;
+    out.erase(out.find_last_not_of('0') + 1);
+    if (out.back() == '.')
+        out.pop_back();
+    return out;
+}
+
+void addSignal(std::vector<Signal>& rSignals, const char* label, const char* dimension,
+               const Column<uint32_t>& rTimestamps, const Column<float>& rSamples, size_t perPacket, double rate)
+{
+    Signal signal = {};
+    signal.label = label;
+    signal.dimension = dimension;
+    signal.pTimestamps = &rTimestamps;
+    signal.pSamples = rSamples.data;
+    signal.perPacket = perPacket;
+    signal.rate = rate;
+    signal.perRecord = static_cast<size_t>(std::llround(rate * RECORD_MS / 1000.0));
+
+    // Physical range of the samples; a constant signal still needs max > min
+    double lo = INFINITY;
+    double hi = -INFINITY;
+    for (size_t i = 0; i < rSamples.size; i++)
+    {
+        if (std::isfinite(rSamples[i]))
+        {
+            lo = std::min<double>(lo, rSamples[i]);
+            hi = std::max<double>(hi, rSamples[i]);
+        }
+    }
+    if (lo > hi)
+    {
+        lo = 0.0;
+        hi = 0.0;
+    }
+    signal.minText = limitText(lo, false);
+    signal.maxText = limitText(hi, true);
+    signal.physicalMin = atof(signal.minText.c_str());
+    double physicalMax = atof(signal.maxText.c_str());
+    if (physicalMax <= signal.physicalMin)
+    {
+        signal.maxText = limitText(signal.physicalMin + 1.0, true);
+        physicalMax = atof(signal.maxText.c_str());
+    }
+    signal.scale = (DIGITAL_MAX - DIGITAL_MIN) / (physicalMax - signal.physicalMin);
+    signal.fill = 0;
+    signal.fill = signal.digital(0.0f);
+    rSignals.push_back(signal);
+}
+
+const char* gapText(GapKind kind, PacketKind channel)
+{
+    switch (kind)
+    {
+    case GapKind::LEAD_OFF:
+        return "Lead off";
+    case GapKind::RESET:
+        return "Sensor restart";
+    case GapKind::DROPOUT:
+        break;
+    }
+    return channel == PacketKind::ECG_MV ? "ECG dropout" : "IMU dropout";
+}
+
+} // namespace
+
+bool EdfWriter::write(const Recording& rRecording, const char* path, const EdfOptions& rOptions, EdfStats& rStats)
+{
+    rStats = EdfStats();
+
+    std::vector<Signal> signals;
+    const EcgColumns& rEcg = rRecording.ecg;
+    const ImuColumns& rImu = rRecording.imu;
+    const bool ecg = rOptions.ecg && rEcg.packets();
+    const bool imu = rOptions.imu && rImu.packets();
+    if (ecg)
+    {
+        const double rate =
+            ColumnarWriter::rateFromPath(ColumnarWriter::channelPath(rRecording.descriptors, PacketKind::ECG_MV));
+        addSignal(signals, "ECG", "mV", rEcg.timestamp, rEcg.samples, ECG_SAMPLES_PER_PACKET, rate);
+    }
+    if (imu)
+    {
+        const double rate =
+            ColumnarWriter::rateFromPath(ColumnarWriter::channelPath(rRecording.descriptors, PacketKind::IMU6));
+        addSignal(signals, "Accel X", "m/s^2", rImu.timestamp, rImu.accelX, IMU_SAMPLES_PER_PACKET, rate);
+        addSignal(signals, "Accel Y", "m/s^2", rImu.timestamp, rImu.accelY, IMU_SAMPLES_PER_PACKET, rate);
+        addSignal(signals, "Accel Z", "m/s^2", rImu.timestamp, rImu.accelZ, IMU_SAMPLES_PER_PACKET, rate);
+        addSignal(signals, "Gyro X", "deg/s", rImu.timestamp, rImu.gyroX, IMU_SAMPLES_PER_PACKET, rate);
+        addSignal(signals, "Gyro Y", "deg/s", rImu.timestamp, rImu.gyroY, IMU_SAMPLES_PER_PACKET, rate);
+        addSignal(signals, "Gyro Z", "deg/s", rImu.timestamp, rImu.gyroZ, IMU_SAMPLES_PER_PACKET, rate);
+    }
+    if (signals.empty())
+        return false;
+
+    uint32_t origin = UINT32_MAX;
+    for (const Signal& rSignal : signals)
+    {
+        if (!rSignal.perRecord)
+            return false;
+        origin = std::min(origin, (*rSignal.pTimestamps)[0]);
+    }
+
+    // Records any packet reaches into, with the packets placed as below
+    std::vector<uint8_t> hasData;
+    for (const Signal& rSignal : signals)
+    {
+        PacketSlots slots(*rSignal.pTimestamps, rSignal.perPacket, rSignal.rate, origin);
+        for (; slots.valid(); slots.advance())
+        {
+            const int64_t first = slots.slot();
+            const int64_t last = first + static_cast<int64_t>(rSignal.perPacket) - 1;
+            if (last < 0)
+                continue;
+            const size_t begin = static_cast<size_t>(std::max<int64_t>(first, 0)) / rSignal.perRecord;
+            const size_t end = static_cast<size_t>(last) / rSignal.perRecord + 1;
+            if (hasData.size() < end)
+                hasData.resize(end, 0);
+            std::fill(hasData.begin() + begin, hasData.begin() + end, 1);
+        }
+    }
+
+    // Onsets count from the whole second of the start time
+    const double startOffset = rOptions.haveStart ? (rOptions.clockMs % 1000) / 1000.0 : 0.0;
+    std::vector<size_t> written;
+    for (size_t r = 0; r < hasData.size(); r++)
+    {
+        if (hasData[r])
+            written.push_back(r);
+    }
+    rStats.records = written.size();
+    rStats.skipped = hasData.size() - written.size();
+
+    // Gap annotations go into the first record written from the record of their onset on
+    const PacketKind mainChannel = ecg ? PacketKind::ECG_MV : PacketKind::IMU6;
+    std::vector<Annotation> annotations;
+    const TimelineGapColumns& rGaps = rRecording.timelineGaps;
+    for (size_t i = 0; i < rGaps.size(); i++)
+    {
+        const GapKind kind = static_cast<GapKind>(rGaps.kind[i]);
+        const PacketKind channel = static_cast<PacketKind>(rGaps.channel[i]);
+        const bool shown = channel == PacketKind::ECG_MV ? ecg : imu;
+        if (!shown || (kind != GapKind::DROPOUT && channel != mainChannel) || rGaps.begin[i] < origin)
+            continue;
+
+        const double onset = (rGaps.begin[i] - origin) / 1000.0;
+        const size_t target = static_cast<size_t>(onset * 1000 / RECORD_MS);
+        auto it = std::lower_bound(written.begin(), written.end(), target);
+        Annotation annotation;
+        annotation.record = it == written.end() ? written.back() : *it;
+        annotation.tal = seconds(onset + startOffset, true);
+        if (kind != GapKind::RESET)
+            annotation.tal += '\x15' + seconds((rGaps.end[i] - rGaps.begin[i]) / 1000.0, false);
+        annotation.tal += '\x14';
+        annotation.tal += gapText(kind, channel);
+        annotation.tal += std::string("\x14\0", 2);
+        annotations.push_back(annotation);
+    }
+    std::stable_sort(annotations.begin(), annotations.end(),
+                     [](const Annotation& rA, const Annotation& rB) { return rA.record < rB.record; });
+    rStats.annotations = annotations.size();
+
+    // The annotation signal is as wide as the fullest record needs
+    std::vector<size_t> talBytes(hasData.size(), 0);
+    for (const Annotation& rAnnotation : annotations)
+        talBytes[rAnnotation.record] += rAnnotation.tal.size();
+    size_t annotationBytes = 0;
+    for (size_t r : written)
+    {
+        const size_t timekeeping = seconds(r * RECORD_MS / 1000.0 + startOffset, true).size() + 3;
+        annotationBytes = std::max(annotationBytes, timekeeping + talBytes[r]);
+    }
+    const size_t annotationSamples = (annotationBytes + 1) / 2;
+
+    // Header
+    const size_t signalCount = signals.size() + 1;
+    char number[32];
+    std::string header;
+    header.reserve(256 * (signalCount + 1));
+    putField(header, "0", 8);
+    putField(header, rOptions.patient.empty() ? "X X X X" : rOptions.patient, 80);
+    if (rOptions.haveStart)
+    {
+        snprintf(number, sizeof(number), "%02d-%s-%04d", rOptions.day, MONTHS[(rOptions.month + 11) % 12],
+                 rOptions.year);
+        putField(header, std::string("Startdate ") + number + " X X " + subfield(rOptions.equipment), 80);
+        snprintf(number, sizeof(number), "%02d.%02d.%02d", rOptions.day, rOptions.month, rOptions.year % 100);
+        putField(header, number, 8);
+        const uint64_t s = rOptions.clockMs / 1000;
+        snprintf(number, sizeof(number), "%02u.%02u.%02u", static_cast<unsigned>(s / 3600 % 24),
+                 static_cast<unsigned>(s / 60 % 60), static_cast<unsigned>(s % 60));
+        putField(header, number, 8);
+    }
+    else
+    {
+        putField(header, "Startdate X X X " + subfield(rOptions.equipment), 80);
+        putField(header, "01.01.85", 8);
+        putField(header, "00.00.00", 8);
+    }
+    putField(header, std::to_string(256 * (signalCount + 1)), 8);
+    putField(header, rStats.skipped ? "EDF+D" : "EDF+C", 44);
+    putField(header, std::to_string(written.size()), 8);
+    putField(header, seconds(RECORD_MS / 1000.0, false), 8);
+    putField(header, std::to_string(signalCount), 4);
+
+    for (const Signal& rSignal : signals)
+        putField(header, rSignal.label, 16);
+    putField(header, "EDF Annotations", 16);
+    for (const Signal& rSignal : signals)
+        putField(header, rSignal.perPacket == ECG_SAMPLES_PER_PACKET ? "Movesense ECG electrodes"
+                                                                     : "Movesense IMU", 80);
+    putField(header, "", 80);
+    for (const Signal& rSignal : signals)
+        putField(header, rSignal.dimension, 8);
+    putField(header, "", 8);
+    for (const Signal& rSignal : signals)
+        putField(header, rSignal.minText, 8);
+    putField(header, "-1", 8);
+    for (const Signal& rSignal : signals)
+        putField(header, rSignal.maxText, 8);
+    putField(header, "1", 8);
+    for (size_t i = 0; i < signalCount; i++)
+        putField(header, std::to_string(DIGITAL_MIN), 8);
+    for (size_t i = 0; i < signalCount; i++)
+        putField(header, std::to_string(DIGITAL_MAX), 8);
+    for (size_t i = 0; i < signalCount; i++)
+        putField(header, "", 80);
+    for (const Signal& rSignal : signals)
+        putField(header, std::to_string(rSignal.perRecord), 8);
+    putField(header, std::to_string(annotationSamples), 8);
+    for (size_t i = 0; i < signalCount; i++)
+        putField(header, "", 32);
+
+    OutputFile file;
+    if (!file.open(path))
+        return false;
+    bool ok = file.write(header.data(), header.size());
+
+    // Data records, little endian int16 samples then the annotation bytes
+    std::vector<uint8_t> out;
+    std::vector<int16_t> block;
+    std::vector<PacketSlots> cursors;
+    cursors.reserve(signals.size());
+    for (const Signal& rSignal : signals)
+        cursors.emplace_back(*rSignal.pTimestamps, rSignal.perPacket, rSignal.rate, origin);
+    size_t nextAnnotation = 0;
+    for (size_t r : written)
+    {
+        for (size_t s = 0; s < signals.size(); s++)
+        {
+            const Signal& rSignal = signals[s];
+            PacketSlots& rSlots = cursors[s];
+            block.assign(rSignal.perRecord, rSignal.fill);
+            const int64_t begin = static_cast<int64_t>(r * rSignal.perRecord);
+            const int64_t end = begin + static_cast<int64_t>(rSignal.perRecord);
+            while (rSlots.valid())
+            {
+                const size_t p = rSlots.packet();
+                const int64_t first = rSlots.slot();
+                if (first >= end)
+                    break;
+                const float* pValues = rSignal.pSamples + p * rSignal.perPacket;
+                for (size_t k = 0; k < rSignal.perPacket; k++)
+                {
+                    const int64_t slot = first + static_cast<int64_t>(k);
+                    if (slot >= begin && slot < end)
+                        block[static_cast<size_t>(slot - begin)] = rSignal.digital(pValues[k]);
+                }
+                if (first + static_cast<int64_t>(rSignal.perPacket) > end)
+                    break;      // the rest of the packet belongs to the next record
+                rSlots.advance();
+            }
+            for (int16_t v : block)
+            {
+                out.push_back(static_cast<uint8_t>(v & 0xFF));
+                out.push_back(static_cast<uint8_t>((v >> 8) & 0xFF));
+            }
+        }
+
+        std::string tal = seconds(r * RECORD_MS / 1000.0 + startOffset, true) + std::string("\x14\x14\0", 3);
+        for (; nextAnnotation < annotations.size() && annotations[nextAnnotation].record == r; nextAnnotation++)
+            tal += annotations[nextAnnotation].tal;
+        tal.resize(annotationSamples * 2, '\0');
+        out.insert(out.end(), tal.begin(), tal.end());
+
+        if (out.size() >= FLUSH_BYTES)
+        {
+            ok = ok && file.write(out.data(), out.size());
+            out.clear();
+        }
+    }
+    ok = ok && file.write(out.data(), out.size());
+    rStats.signals = signals.size();
+    return file.close() && ok;
+}
+
+} // namespace sbem
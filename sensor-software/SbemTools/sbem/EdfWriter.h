@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "Recording.h"
+
+namespace sbem
+{
+
+struct EdfOptions
+{
+    /** EDF+ patient field: code, sex, birthdate, name; X for each unknown. */
+    std::string patient = "X X X X";
+
+    /** Equipment subfield of the recording field, e.g. the sensor serial. */
+    std::string equipment = "Movesense";
+
+    /**
+    *   Wall clock of the first packet. Unknown by default, which EDF+ writes
+    *   as start 01.01.85 00.00.00 and startdate X.
+    */
+    bool haveStart = false;
+    int year = 1985;
+    int month = 1;
+    int day = 1;
+    uint64_t clockMs = 0;       // ms after midnight
+
+    /** Signals to write; a kind the recording has no packets of is left out. */
+    bool ecg = true;
+    bool imu = true;
+};
+
+struct EdfStats
+{
+    size_t signals = 0;         // without the annotation signal
+    size_t records = 0;         // data records written
+    size_t skipped = 0;         // one second records without any sample, left out of an EDF+D file
+    size_t annotations = 0;     // gap annotations
+};
+
+/**
+*   Writes a Recording as an EDF+ file.
+*
+*   Data records are one second long. Every packet's samples are placed at
+*   the signal's rate from the first packet of the recording on, right after
+*   the packet before unless the timestamps show a gap (see PacketSlots), and
+*   scaled to int16 over the physical range of the signal's samples. Slots
+*   no packet fills (dropouts, lead-off) hold the value nearest to physical 0. Records without any sample are left out,
+*   which makes the file EDF+D; a recording without such holes is EDF+C.
+*
+*   The gaps of Recording::timelineGaps become annotations: "Lead off",
+*   "Sensor restart" and "ECG dropout" or "IMU dropout", with the length of
+*   the gap as duration except for restarts, whose length isn't known. Logs
+*   whose clock restarts inside them should be stitched first (Stitcher),
+*   as packets that go back in time are dropped here.
+*
+*   The samples are converted a record at a time straight from the columns,
+*   so a day takes one pass over the recording and no extra memory.
+*/
+class EdfWriter
+{
+public:
+    /**
+    *   @param rRecording Decoded data, possibly stitched
+    *   @param path Output path, .edf by convention
+    *   @param rOptions Header fields and signals
+    *   @param rStats Receives the records and annotations written
+    *   @return false if there are no samples to write or the file can't be written
+    */
+    static bool write(const Recording& rRecording, const char* path, const EdfOptions& rOptions, EdfStats& rStats);
+};
+
+} // namespace sbem
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+
+#include <unistd.h>
+
+namespace sbem
+{
+
+/**
+*   write(2) until everything is written or an error other than EINTR occurs.
+*
+*   @param fd Open file descriptor
+*   @param pData Bytes to write
+*   @param length Byte count
+*   @return false on a write error
+*/
+inline bool writeAll(int fd, const void* pData, size_t length)
+{
+    const char* p = static_cast<const char*>(pData);
+    while (length)
+    {
+        const ssize_t n = ::write(fd, p, length);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        p += n;
+        length -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+/**
+*   pwrite(2) until everything is written or an error other than EINTR occurs.
+*
+*   @param fd Open file descriptor
+*   @param pData Bytes to write
+*   @param length Byte count
+*   @param offset File offset of the first byte
+*   @return false on a write error
+*/
+inline bool writeAllAt(int fd, const void* pData, size_t length, uint64_t offset)
+{
+    const char* p = static_cast<const char*>(pData);
+    while (length)
+    {
+        const ssize_t n = ::pwrite(fd, p, length, static_cast<off_t>(offset));
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        p += n;
+        offset += static_cast<uint64_t>(n);
+        length -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+} // namespace sbem
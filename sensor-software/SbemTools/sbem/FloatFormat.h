@@ -0,0 +1,173 @@
+#pragma once
+
+#include <charconv>
+#include <cmath>
+#include <cstring>
+
+namespace sbem
+{
+
+/** Worst case output of formatPyFloat(): "-d.dddddddddddddddde-308" */
+constexpr size_t PY_FLOAT_MAX_CHARS = 32;
+
+/** Worst case output of formatFixedFloat(): sign, 309 integer digits, point and decimals. */
+constexpr size_t fixedFloatMaxChars(int decimals)
+{
+    return 311 + static_cast<size_t>(decimals);
+}
+
+namespace detail
+{
+
+/**
+*   Lay out std::to_chars scientific output ([-]d[.ddd]e(+|-)xx) the way
+*   Python's repr(float) does.
+*/
+inline char* reprFromScientific(char* out, const char* p, const char* end)
+{
+    if (*p == '-')
+    {
+        *out++ = '-';
+        ++p;
+    }
+
+    char digits[20];
+    int nd = 0;
+    for (; *p != 'e'; ++p)
+    {
+        if (*p != '.')
+            digits[nd++] = *p;
+    }
+    ++p;
+
+    const bool negExp = (*p == '-');
+    ++p;
+    int exp = 0;
+    for (; p < end; ++p)
+        exp = exp * 10 + (*p - '0');
+    if (negExp)
+        exp = -exp;
+
+    const int decpt = exp + 1;
+    if (decpt <= -4 || decpt > 16)
+    {
+        *out++ = digits[0];
+        if (nd > 1)
+        {
+            *out++ = '.';
+            memcpy(out, digits + 1, nd - 1);
+            out += nd - 1;
+        }
+        *out++ = 'e';
+        *out++ = negExp ? '-' : '+';
+        int absExp = negExp ? -exp : exp;
+        if (absExp < 10)
+            *out++ = '0';
+        out = std::to_chars(out, out + 4, absExp).ptr;
+    }
+    else if (decpt <= 0)
+    {
+        *out++ = '0';
+        *out++ = '.';
+        memset(out, '0', -decpt);
+        out += -decpt;
+        memcpy(out, digits, nd);
+        out += nd;
+    }
+    else if (decpt >= nd)
+    {
+        memcpy(out, digits, nd);
+        out += nd;
+        memset(out, '0', decpt - nd);
+        out += decpt - nd;
+        *out++ = '.';
+        *out++ = '0';
+    }
+    else
+    {
+        memcpy(out, digits, decpt);
+        out += decpt;
+        *out++ = '.';
+        memcpy(out, digits + decpt, nd - decpt);
+        out += nd - decpt;
+    }
+    return out;
+}
+
+/** nan/inf spelled like Python; returns nullptr for finite values. */
+inline char* formatNonFinite(char* out, double v)
+{
+    if (std::isnan(v))
+    {
+        memcpy(out, "nan", 3);
+        return out + 3;
+    }
+    if (std::isinf(v))
+    {
+        if (v < 0)
+            *out++ = '-';
+        memcpy(out, "inf", 3);
+        return out + 3;
+    }
+    return nullptr;
+}
+
+} // namespace detail
+
+/**
+*   Format a double exactly like Python's repr(float).
+*
+*   Shortest round-trip digits; fixed notation when the decimal exponent is in
+*   (-4, 16], scientific with a two digit minimum exponent otherwise, and a
+*   trailing ".0" for integral values. This keeps native CSV output byte
+*   identical to what pandas writes for the same values.
+*
+*   @param out Destination, at least PY_FLOAT_MAX_CHARS bytes
+*   @param v Value to format
+*   @return One past the last character written
+*/
+inline char* formatPyFloat(char* out, double v)
+{
+    if (char* pEnd = detail::formatNonFinite(out, v))
+        return pEnd;
+
+    char buf[PY_FLOAT_MAX_CHARS];
+    const char* end = std::to_chars(buf, buf + sizeof(buf), v, std::chars_format::scientific).ptr;
+    return detail::reprFromScientific(out, buf, end);
+}
+
+/**
+*   Python repr layout with the shortest digits that round-trip the float32
+*   itself, e.g. 0.1 instead of the 0.10000000149011612 formatPyFloat() gives
+*   for the same sample. Parses back to the identical float32.
+*
+*   @param out Destination, at least PY_FLOAT_MAX_CHARS bytes
+*   @param v Value to format
+*   @return One past the last character written
+*/
+inline char* formatShortestFloat(char* out, float v)
+{
+    if (char* pEnd = detail::formatNonFinite(out, v))
+        return pEnd;
+
+    char buf[PY_FLOAT_MAX_CHARS];
+    const char* end = std::to_chars(buf, buf + sizeof(buf), v, std::chars_format::scientific).ptr;
+    return detail::reprFromScientific(out, buf, end);
+}
+
+/**
+*   Fixed notation with a set number of decimals ("%.*f" without locale).
+*
+*   @param out Destination, at least fixedFloatMaxChars(decimals) bytes
+*   @param v Value to format
+*   @param decimals Digits after the decimal point
+*   @return One past the last character written
+*/
+inline char* formatFixedFloat(char* out, double v, int decimals)
+{
+    if (char* pEnd = detail::formatNonFinite(out, v))
+        return pEnd;
+    return std::to_chars(out, out + fixedFloatMaxChars(decimals), v, std::chars_format::fixed, decimals).ptr;
+}
+
+} // namespace sbem
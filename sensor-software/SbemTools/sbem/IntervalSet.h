@@ -0,0 +1,120 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <map>
+#include <vector>
+
+namespace sbem
+{
+
+/** Bytes [begin, end) of a file. */
+struct ByteRange
+{
+    uint64_t begin;
+    uint64_t end;
+};
+
+/**
+*   Disjoint byte ranges, merged with their neighbours as they are added, so
+*   a download that arrives in order is one range however many fragments it
+*   took. Lookups cost a map search, O(log ranges).
+*/
+class IntervalSet
+{
+public:
+    /**
+    *   Add [begin, end).
+    *
+    *   @return Bytes that weren't in the set yet
+    */
+    uint64_t add(uint64_t begin, uint64_t end)
+    {
+        if (begin >= end)
+            return 0;
+
+        // Absorb every range that overlaps or touches [begin, end)
+        uint64_t added = end - begin;
+        auto it = mRanges.upper_bound(begin);
+        if (it != mRanges.begin() && std::prev(it)->second >= begin)
+            --it;
+        while (it != mRanges.end() && it->first <= end)
+        {
+            added -= overlap(it->first, it->second, begin, end);
+            begin = std::min(begin, it->first);
+            end = std::max(end, it->second);
+            it = mRanges.erase(it);
+        }
+        mRanges.emplace(begin, end);
+        mBytes += added;
+        return added;
+    }
+
+    /** True if every byte of [begin, end) is in the set. */
+    bool covers(uint64_t begin, uint64_t end) const
+    {
+        if (begin >= end)
+            return true;
+        auto it = mRanges.upper_bound(begin);
+        return it != mRanges.begin() && std::prev(it)->second >= end;
+    }
+
+    /**
+    *   The parts of [begin, end) in the set, or with present false those
+    *   that aren't, in order.
+    *
+    *   @param rOut Receives the ranges (cleared first)
+    */
+    void within(uint64_t begin, uint64_t end, bool present, std::vector<ByteRange>& rOut) const
+    {
+        rOut.clear();
+        auto it = mRanges.upper_bound(begin);
+        if (it != mRanges.begin() && std::prev(it)->second > begin)
+            --it;
+        uint64_t at = begin;
+        for (; it != mRanges.end() && it->first < end && at < end; ++it)
+        {
+            const uint64_t from = std::max(it->first, begin);
+            const uint64_t to = std::min(it->second, end);
+            if (!present && from > at)
+                rOut.push_back({ at, from });
+            if (present)
+                rOut.push_back({ from, to });
+            at = to;
+        }
+        if (!present && at < end)
+            rOut.push_back({ at, end });
+    }
+
+    /** Bytes in the set. */
+    uint64_t bytes() const { return mBytes; }
+
+    /** Number of disjoint ranges. */
+    size_t size() const { return mRanges.size(); }
+
+    bool empty() const { return mRanges.empty(); }
+
+    /** End of the last range, 0 when empty. */
+    uint64_t end() const { return mRanges.empty() ? 0 : mRanges.rbegin()->second; }
+
+    void clear()
+    {
+        mRanges.clear();
+        mBytes = 0;
+    }
+
+private:
+    static uint64_t overlap(uint64_t aBegin, uint64_t aEnd, uint64_t bBegin, uint64_t bEnd)
+    {
+        const uint64_t from = std::max(aBegin, bBegin);
+        const uint64_t to = std::min(aEnd, bEnd);
+        return to > from ? to - from : 0;
+    }
+
+    std::map<uint64_t, uint64_t> mRanges;   // begin -> end; never overlapping or touching
+    uint64_t mBytes = 0;
+};
+
+} // namespace sbem
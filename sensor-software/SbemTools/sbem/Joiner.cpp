@@ -0,0 +1,212 @@
+#include "Joiner.h"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+
+#include "FloatFormat.h"
+#include "TextBuffer.h"
+
+namespace sbem
+{
+
+namespace
+{
+
+constexpr size_t FLUSH_BYTES = 1 << 20;
+
+/**
+*   Samples of one packet group with a forward-only cursor. Sample j is at
+*   timestamp[j / perPacket] + (j % perPacket) * dt on the sensor's clock.
+*/
+class Track
+{
+public:
+    Track(const Column<uint32_t>& rTimestamps, size_t perPacket, std::vector<const float*> columns):
+        mTimestamps(rTimestamps),
+        mPerPacket(perPacket),
+        mColumns(std::move(columns)),
+        mSamples(rTimestamps.size * perPacket)
+    {
+        std::vector<uint32_t> steps;
+        for (size_t i = 1; i < rTimestamps.size; i++)
+        {
+            if (rTimestamps[i] > rTimestamps[i - 1])
+                steps.push_back(rTimestamps[i] - rTimestamps[i - 1]);
+        }
+        if (!steps.empty())
+        {
+            std::nth_element(steps.begin(), steps.begin() + steps.size() / 2, steps.end());
+            mDt = static_cast<double>(steps[steps.size() / 2]) / perPacket;
+        }
+    }
+
+    bool empty() const { return mSamples < 2 || mDt <= 0.0; }
+    size_t width() const { return mColumns.size(); }
+    double first() const { return timeOf(0); }
+    double last() const { return timeOf(mSamples - 1); }
+
+    /**
+    *   Interpolate every column at sensor time t, which never decreases
+    *   from call to call.
+    *
+    *   @return false in a gap or outside the samples
+    */
+    bool at(double t, float* pOut)
+    {
+        if (empty())
+            return false;
+        while (mCursor + 1 < mSamples && timeOf(mCursor + 1) <= t)
+            mCursor++;
+        if (mCursor + 1 >= mSamples)
+            return false;
+        const double t0 = timeOf(mCursor);
+        const double t1 = timeOf(mCursor + 1);
+        if (t < t0 || t1 <= t0 || t1 - t0 > 2 * mDt)
+            return false;
+        const double w = (t - t0) / (t1 - t0);
+        for (size_t c = 0; c < mColumns.size(); c++)
+            pOut[c] = static_cast<float>(mColumns[c][mCursor] * (1.0 - w) + mColumns[c][mCursor + 1] * w);
+        return true;
+    }
+
+private:
+    double timeOf(size_t j) const { return mTimestamps[j / mPerPacket] + (j % mPerPacket) * mDt; }
+
+    const Column<uint32_t>& mTimestamps;
+    size_t mPerPacket;
+    std::vector<const float*> mColumns;
+    size_t mSamples;
+    double mDt = 0.0;
+    size_t mCursor = 0;
+};
+
+/** A track and the clock of its sensor. */
+struct Channel
+{
+    std::unique_ptr<Track> pTrack;
+    const ClockFit* pClock;
+    std::vector<std::string> names;
+};
+
+} // namespace
+
+bool Joiner::write(const std::vector<JoinSource>& rSources, const char* path, const JoinOptions& rOptions,
+                   JoinStats& rStats)
+{
+    rStats = JoinStats();
+    if (rOptions.rate <= 0.0)
+        return false;
+
+    std::vector<Channel> channels;
+    for (const JoinSource& rSource : rSources)
+    {
+        const Recording& rRec = *rSource.pRecording;
+        if (rOptions.ecg)
+        {
+            Channel channel;
+            channel.pTrack.reset(new Track(rRec.ecg.timestamp, ECG_SAMPLES_PER_PACKET, { rRec.ecg.samples.data }));
+            channel.pClock = &rSource.clock;
+            channel.names = { rSource.label + ".ecg" };
+            channels.push_back(std::move(channel));
+        }
+        if (rOptions.imu)
+        {
+            const ImuColumns& rImu = rRec.imu;
+            Channel channel;
+            channel.pTrack.reset(new Track(rImu.timestamp, IMU_SAMPLES_PER_PACKET,
+                                           { rImu.accelX.data, rImu.accelY.data, rImu.accelZ.data, rImu.gyroX.data,
+                                             rImu.gyroY.data, rImu.gyroZ.data }));
+            channel.pClock = &rSource.clock;
+            for (const char* axis : { "acc_x", "acc_y", "acc_z", "gyro_x", "gyro_y", "gyro_z" })
+                channel.names.push_back(rSource.label + "." + axis);
+            channels.push_back(std::move(channel));
+        }
+    }
+
+    // Reference time covered by any sensor, or by all of them
+    double begin = rOptions.overlap ? -INFINITY : INFINITY;
+    double end = rOptions.overlap ? INFINITY : -INFINITY;
+    size_t width = 0;
+    for (const Channel& rChannel : channels)
+    {
+        width += rChannel.pTrack->width();
+        if (rChannel.pTrack->empty())
+            continue;
+        const double first = rChannel.pClock->toReference(rChannel.pTrack->first());
+        const double last = rChannel.pClock->toReference(rChannel.pTrack->last());
+        begin = rOptions.overlap ? std::max(begin, first) : std::min(begin, first);
+        end = rOptions.overlap ? std::min(end, last) : std::max(end, last);
+    }
+    if (!std::isfinite(begin) || !std::isfinite(end) || begin > end)
+        return false;
+
+    OutputFile file;
+    if (!file.open(path, rOptions.output))
+        return false;
+
+    TextBuffer out;
+    out.put("time_ms");
+    for (const Channel& rChannel : channels)
+    {
+        for (const std::string& rName : rChannel.names)
+        {
+            out.put(',');
+            out.put(rName.data(), rName.size());
+        }
+    }
+    out.put('\n');
+
+    const double step = 1000.0 / rOptions.rate;
+    const double first = std::ceil(begin / step) * step;
+    const uint64_t rows = static_cast<uint64_t>(std::floor((end - first) / step)) + 1;
+    std::vector<float> values(width);
+    std::vector<uint8_t> have(channels.size());
+    bool ok = true;
+    for (uint64_t row = 0; row < rows && ok; row++)
+    {
+        const double t = first + row * step;
+        bool any = false;
+        size_t column = 0;
+        for (size_t c = 0; c < channels.size(); c++)
+        {
+            Channel& rChannel = channels[c];
+            have[c] = rChannel.pTrack->at(rChannel.pClock->toSensor(t), values.data() + column);
+            any = any || have[c];
+            column += rChannel.pTrack->width();
+        }
+        if (!any)
+            continue;
+
+        out.commit(formatPyFloat(out.room(PY_FLOAT_MAX_CHARS), t));
+        column = 0;
+        for (size_t c = 0; c < channels.size(); c++)
+        {
+            const size_t n = channels[c].pTrack->width();
+            char* p = out.room(n * (PY_FLOAT_MAX_CHARS + 1));
+            for (size_t k = 0; k < n; k++)
+            {
+                *p++ = ',';
+                if (have[c])
+                    p = formatShortestFloat(p, values[column + k]);
+            }
+            out.commit(p);
+            column += n;
+        }
+        out.put('\n');
+
+        if (!rStats.rows)
+            rStats.begin = t;
+        rStats.end = t;
+        rStats.rows++;
+        if (out.size() >= FLUSH_BYTES)
+        {
+            ok = file.write(out.data(), out.size());
+            out.clear();
+        }
+    }
+    ok = ok && file.write(out.data(), out.size());
+    return file.close() && ok;
+}
+
+} // namespace sbem
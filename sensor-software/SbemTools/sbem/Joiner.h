@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "ClockAligner.h"
+#include "OutputFile.h"
+#include "Recording.h"
+
+namespace sbem
+{
+
+/** One sensor of a join: its recording, how its clock maps to the reference and its column prefix. */
+struct JoinSource
+{
+    const Recording* pRecording = nullptr;
+    ClockFit clock;             // identity for the reference sensor
+    std::string label;
+};
+
+struct JoinOptions
+{
+    /** Rows per second; the default keeps every ECG sample. */
+    double rate = 200.0;
+
+    /** Channels written for every sensor. */
+    bool ecg = true;
+    bool imu = true;
+
+    /** Only the time every sensor covers, instead of the time any sensor covers. */
+    bool overlap = false;
+
+    OutputOptions output;
+};
+
+struct JoinStats
+{
+    uint64_t rows = 0;
+    double begin = 0.0;         // reference ms of the first and last row
+    double end = 0.0;
+};
+
+/**
+*   Writes several sensors as one CSV on the reference clock.
+*
+*   Rows are 1 / rate apart in reference time. Each row maps its time onto
+*   every sensor's clock and interpolates each channel linearly between the
+*   two samples around it, leaving the cell empty where the sensor has a gap
+*   (neighbouring samples more than two sample periods apart) or no data.
+*   Rows without any value are skipped. Every channel keeps a cursor that only
+*   moves forward, so the file is written in one pass over the recordings.
+*
+*   Columns: time_ms, then per sensor <label>.ecg and <label>.acc_x ..
+*   <label>.gyro_z.
+*/
+class Joiner
+{
+public:
+    /**
+    *   @param rSources Sensors, the reference first
+    *   @param path Output file, suffix() of the compression included
+    *   @param rOptions Rate, channels and compression
+    *   @param rStats Receives the rows written
+    *   @return false if no sensor has data of the chosen channels or the file can't be written
+    */
+    static bool write(const std::vector<JoinSource>& rSources, const char* path, const JoinOptions& rOptions,
+                      JoinStats& rStats);
+};
+
+} // namespace sbem
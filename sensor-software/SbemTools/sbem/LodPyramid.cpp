@@ -0,0 +1,179 @@
+#include "LodPyramid.h"
+
+#include <algorithm>
+
+#include "ColumnarWriter.h"
+
+namespace sbem
+{
+
+void LodPyramid::Pending::merge(const Pending& rBin)
+{
+    if (!count)
+    {
+        min = rBin.min;
+        max = rBin.max;
+        sum = 0.0;
+        time = rBin.time;
+    }
+    min = std::min(min, rBin.min);
+    max = std::max(max, rBin.max);
+    sum += rBin.sum;
+    count += rBin.count;
+}
+
+LodPyramid::LodPyramid()
+{
+    const char* const names[] = { "ecg.samples", "imu.acc_x", "imu.acc_y", "imu.acc_z",
+                                  "imu.gyro_x", "imu.gyro_y", "imu.gyro_z" };
+    for (const char* name : names)
+    {
+        Channel channel;
+        channel.name = name;
+        channel.kind = mChannels.empty() ? PacketKind::ECG_MV : PacketKind::IMU6;
+        mChannels.push_back(channel);
+    }
+}
+
+void LodPyramid::add(const Recording& rBatch)
+{
+    for (const std::string& rDescriptor : rBatch.descriptors)
+    {
+        if (std::find(mDescriptors.begin(), mDescriptors.end(), rDescriptor) == mDescriptors.end())
+            mDescriptors.push_back(rDescriptor);
+    }
+    mSourceSize += rBatch.bytesScanned;
+    mChunkCount = std::max(mChunkCount, rBatch.chunkCount);
+
+    const ImuColumns& rImu = rBatch.imu;
+    addSamples(mChannels[0], rBatch.ecg.timestamp, rBatch.ecg.samples, ECG_SAMPLES_PER_PACKET);
+    addSamples(mChannels[1], rImu.timestamp, rImu.accelX, IMU_SAMPLES_PER_PACKET);
+    addSamples(mChannels[2], rImu.timestamp, rImu.accelY, IMU_SAMPLES_PER_PACKET);
+    addSamples(mChannels[3], rImu.timestamp, rImu.accelZ, IMU_SAMPLES_PER_PACKET);
+    addSamples(mChannels[4], rImu.timestamp, rImu.gyroX, IMU_SAMPLES_PER_PACKET);
+    addSamples(mChannels[5], rImu.timestamp, rImu.gyroY, IMU_SAMPLES_PER_PACKET);
+    addSamples(mChannels[6], rImu.timestamp, rImu.gyroZ, IMU_SAMPLES_PER_PACKET);
+}
+
+void LodPyramid::addSamples(Channel& rChannel, const Column<uint32_t>& rTimestamps, const Column<float>& rSamples,
+                            size_t perPacket)
+{
+    const size_t packets = std::min(rTimestamps.size, rSamples.size / perPacket);
+    if (!packets)
+        return;
+    if (rChannel.levels.empty())
+    {
+        rChannel.firstTimestamp = rTimestamps[0];
+        rChannel.levels.emplace_back();
+    }
+
+    // Level 0 is folded a sample at a time, the levels above a bin at a time
+    Pending bin = rChannel.levels[0].pending;
+    const float* pSample = rSamples.data;
+    for (size_t p = 0; p < packets; p++)
+    {
+        for (size_t k = 0; k < perPacket; k++, pSample++)
+        {
+            const float v = *pSample;
+            if (!bin.count)
+            {
+                bin.min = v;
+                bin.max = v;
+                bin.sum = 0.0;
+                bin.time = rTimestamps[p];
+            }
+            bin.min = std::min(bin.min, v);
+            bin.max = std::max(bin.max, v);
+            bin.sum += v;
+            if (++bin.count == BASE_BIN)
+            {
+                emit(rChannel, 0, bin);
+                carry(rChannel, 0, bin);
+                bin.count = 0;
+            }
+        }
+    }
+    rChannel.levels[0].pending = bin;
+}
+
+void LodPyramid::emit(Channel& rChannel, size_t level, const Pending& rBin)
+{
+    Level& rLevel = rChannel.levels[level];
+    rLevel.min.push_back(rBin.min);
+    rLevel.max.push_back(rBin.max);
+    rLevel.mean.push_back(static_cast<float>(rBin.sum / rBin.count));
+    rLevel.time.push_back(rBin.time);
+}
+
+void LodPyramid::carry(Channel& rChannel, size_t level, const Pending& rBin)
+{
+    if (level + 1 == rChannel.levels.size())
+    {
+        rChannel.levels.emplace_back();
+        rChannel.levels.back().binSamples = rChannel.levels[level].binSamples * FACTOR;
+    }
+    Level& rAbove = rChannel.levels[level + 1];
+    rAbove.pending.merge(rBin);
+    if (rAbove.pending.count == rAbove.binSamples)
+    {
+        const Pending complete = rAbove.pending;
+        rAbove.pending.count = 0;
+        emit(rChannel, level + 1, complete);
+        carry(rChannel, level + 1, complete);
+    }
+}
+
+void LodPyramid::finish()
+{
+    if (mFinished)
+        return;
+    mFinished = true;
+    for (Channel& rChannel : mChannels)
+    {
+        // Complete the partial bins bottom up, up to the first level of a single bin
+        for (size_t level = 0; level < rChannel.levels.size(); level++)
+        {
+            const Pending partial = rChannel.levels[level].pending;
+            if (partial.count)
+                emit(rChannel, level, partial);
+            if (rChannel.levels[level].time.size() <= 1)
+            {
+                rChannel.levels.resize(level + 1);
+                break;
+            }
+            // Less than a bin of the level above, so this never completes one
+            if (partial.count)
+                carry(rChannel, level, partial);
+        }
+    }
+}
+
+bool LodPyramid::write(const char* path, const OutputOptions& rOutput)
+{
+    finish();
+
+    std::vector<ColumnView> columns;
+    for (const Channel& rChannel : mChannels)
+    {
+        const std::string resource = ColumnarWriter::channelPath(mDescriptors, rChannel.kind);
+        const float rate = ColumnarWriter::rateFromPath(resource);
+        for (const Level& rLevel : rChannel.levels)
+        {
+            const std::string prefix = rChannel.name + "." + std::to_string(rLevel.binSamples);
+            const float binRate = rate / rLevel.binSamples;
+            const uint64_t bins = rLevel.time.size();
+            const uint32_t first = rChannel.firstTimestamp;
+            columns.push_back({ prefix + ".min", resource, FieldType::FLOAT32, binRate, 1, first, rLevel.min.data(),
+                                bins });
+            columns.push_back({ prefix + ".max", resource, FieldType::FLOAT32, binRate, 1, first, rLevel.max.data(),
+                                bins });
+            columns.push_back({ prefix + ".mean", resource, FieldType::FLOAT32, binRate, 1, first, rLevel.mean.data(),
+                                bins });
+            columns.push_back({ prefix + ".time", resource, FieldType::UINT32, 0.0f, 1, first, rLevel.time.data(),
+                                bins });
+        }
+    }
+    return ColumnarWriter::writeColumns(columns, mSourceSize, mChunkCount, path, rOutput);
+}
+
+} // namespace sbem
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "DecodePlan.h"
+#include "OutputFile.h"
+#include "Recording.h"
+
+namespace sbem
+{
+
+/**
+*   Min/max/mean level-of-detail pyramid of the sampled channels of a log,
+*   so a viewer can draw any time range at screen resolution without
+*   touching the samples.
+*
+*   Level 0 summarises every BASE_BIN samples of a channel in one bin, each
+*   level above it FACTOR bins of the level below, up to a level of one bin.
+*   A bin holds the min, max and mean of its samples and the timestamp of
+*   the packet its first sample is in. The last bin of a level may cover
+*   fewer samples; its mean is still the mean of the samples it covers. To
+*   draw a time range p pixels wide, a viewer picks the coarsest level
+*   with at least p bins in the range, finds the first bin by binary search
+*   on the time column and reads about p bins. A day of 200 Hz ECG, 17
+*   million samples, makes eleven levels of 1.4 million bins in all, 16
+*   bytes each.
+*
+*   Batches are added in order, as a StreamDecoder yields them or as one
+*   whole recording, and the pyramid is written as a columnar file (see
+*   ColumnarFormat.h) with four columns per level and channel, named
+*   <channel>.<samples per bin>.min/.max/.mean (float32) and .time (uint32),
+*   e.g. ecg.samples.16.min or imu.acc_x.1024.mean.
+*/
+class LodPyramid
+{
+public:
+    /** Samples per bin of level 0; one ECG packet. */
+    static constexpr uint32_t BASE_BIN = 16;
+
+    /** Bins of a level per bin of the level above. */
+    static constexpr uint32_t FACTOR = 4;
+
+    LodPyramid();
+
+    /**
+    *   Fold the ECG and IMU samples of the next batch of a log in.
+    *
+    *   @param rBatch Batch of the log, after those added before
+    */
+    void add(const Recording& rBatch);
+
+    /**
+    *   Complete the partial bins and write the pyramid.
+    *
+    *   @param path Output path, .lod.sbcol by convention
+    *   @param rOutput Compression; keep the file uncompressed for viewers that map it
+    *   @return false if the file can't be written
+    */
+    bool write(const char* path, const OutputOptions& rOutput = OutputOptions());
+
+private:
+    /** Samples folded into a bin that isn't complete yet. */
+    struct Pending
+    {
+        float min;
+        float max;
+        double sum;
+        uint64_t count;
+        uint32_t time;
+
+        void merge(const Pending& rBin);
+    };
+
+    struct Level
+    {
+        uint64_t binSamples = BASE_BIN;
+        std::vector<float> min;
+        std::vector<float> max;
+        std::vector<float> mean;
+        std::vector<uint32_t> time;
+        Pending pending = {};
+    };
+
+    struct Channel
+    {
+        std::string name;
+        PacketKind kind;
+        uint32_t firstTimestamp = 0;
+        std::vector<Level> levels;
+    };
+
+    void addSamples(Channel& rChannel, const Column<uint32_t>& rTimestamps, const Column<float>& rSamples,
+                    size_t perPacket);
+    void emit(Channel& rChannel, size_t level, const Pending& rBin);
+    void carry(Channel& rChannel, size_t level, const Pending& rBin);
+    void finish();
+
+    std::vector<Channel> mChannels;
+    std::vector<std::string> mDescriptors;
+    uint64_t mSourceSize = 0;
+    uint32_t mChunkCount = 0;
+    bool mFinished = false;
+};
+
+} // namespace sbem
@@ -0,0 +1,81 @@
+#include "MappedFile.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace sbem
+{
+
+MappedFile::MappedFile():
+    mFd(-1),
+    mData(nullptr),
+    mSize(0)
+{
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+bool MappedFile::open(const char* path, Access access)
+{
+    close();
+
+    mFd = ::open(path, O_RDONLY);
+    if (mFd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(mFd, &st) != 0)
+    {
+        close();
+        return false;
+    }
+
+    mSize = static_cast<size_t>(st.st_size);
+    if (mSize == 0)
+        return true;
+
+    void* p = mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE, mFd, 0);
+    if (p == MAP_FAILED)
+    {
+        close();
+        return false;
+    }
+
+    // Chunks are walked front to back, let the kernel read ahead aggressively
+    if (access == Access::SEQUENTIAL)
+        madvise(p, mSize, MADV_SEQUENTIAL);
+    mData = static_cast<const uint8_t*>(p);
+    return true;
+}
+
+void MappedFile::release(uint64_t offset, uint64_t length)
+{
+    if (!mData || offset >= mSize)
+        return;
+
+    const uint64_t page = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+    const uint64_t end = length < mSize - offset ? offset + length : mSize;
+    const uint64_t first = offset / page * page;
+    const uint64_t last = end == mSize ? end : end / page * page;
+    if (first < last)
+        madvise(const_cast<uint8_t*>(mData) + first, last - first, MADV_DONTNEED);
+}
+
+void MappedFile::close()
+{
+    if (mData)
+        munmap(const_cast<uint8_t*>(mData), mSize);
+    if (mFd >= 0)
+        ::close(mFd);
+
+    mFd = -1;
+    mData = nullptr;
+    mSize = 0;
+}
+
+} // namespace sbem
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace sbem
+{
+
+/**
+*   Read-only memory mapping of a whole file.
+*/
+class MappedFile
+{
+public:
+    MappedFile();
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    enum class Access : uint8_t
+    {
+        SEQUENTIAL,     // read front to back once, read ahead aggressively
+        RANDOM          // arrays picked out of the file, default kernel behaviour
+    };
+
+    /**
+    *   Map a file for reading. An empty file maps successfully with size 0.
+    *
+    *   @param path File to map
+    *   @param access Expected access pattern
+    *   @return true on success
+    */
+    bool open(const char* path, Access access = Access::SEQUENTIAL);
+    void close();
+
+    /**
+    *   Drop the pages of [offset, offset + length) from memory. They stay
+    *   mapped and are read from the file again if touched. The page holding
+    *   offset goes too, the one holding the end of the range stays unless it
+    *   is the end of the file.
+    */
+    void release(uint64_t offset, uint64_t length);
+
+    bool isOpen() const { return mFd >= 0; }
+    const uint8_t* data() const { return mData; }
+    size_t size() const { return mSize; }
+
+private:
+    int mFd;
+    const uint8_t* mData;
+    size_t mSize;
+};
+
+} // namespace sbem
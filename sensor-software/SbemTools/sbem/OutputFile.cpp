@@ -0,0 +1,212 @@
+#include "OutputFile.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#if SBEM_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "FileIo.h"
+#include "ThreadPool.h"
+
+namespace sbem
+{
+
+namespace
+{
+
+constexpr size_t MIN_FRAME_SIZE = 4 << 10;
+constexpr size_t MAX_FRAME_SIZE = 1 << 30;
+
+void putU32(std::vector<uint8_t>& rOut, uint32_t v)
+{
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(&v);
+    rOut.insert(rOut.end(), p, p + sizeof(v));
+}
+
+} // namespace
+
+/** One frame of a wave: its plain bytes, compressed bytes and compression context. */
+struct OutputFile::Frame
+{
+    std::unique_ptr<uint8_t[]> pInput;
+    size_t inputSize = 0;
+    std::unique_ptr<uint8_t[]> pOutput;
+    size_t outputCapacity = 0;
+    size_t outputSize = 0;
+#if SBEM_HAVE_ZSTD
+    ZSTD_CCtx* pContext = nullptr;
+
+    ~Frame() { ZSTD_freeCCtx(pContext); }
+
+    /** Compress the input; outputSize stays 0 on failure. */
+    void compress()
+    {
+        const size_t size = ZSTD_compress2(pContext, pOutput.get(), outputCapacity, pInput.get(), inputSize);
+        outputSize = ZSTD_isError(size) ? 0 : size;
+    }
+#else
+    void compress() {}
+#endif
+};
+
+OutputFile::OutputFile():
+    mFd(-1)
+{
+}
+
+OutputFile::~OutputFile()
+{
+    close();
+}
+
+bool OutputFile::supports(Compression compression)
+{
+    return compression == Compression::NONE || SBEM_HAVE_ZSTD;
+}
+
+const char* OutputFile::suffix(Compression compression)
+{
+    return compression == Compression::ZSTD ? ".zst" : "";
+}
+
+bool OutputFile::open(const char* path, const OutputOptions& rOptions)
+{
+    close();
+    if (!supports(rOptions.compression))
+        return false;
+
+    mOptions = rOptions;
+    mOptions.frameSize = std::min(std::max(mOptions.frameSize, MIN_FRAME_SIZE), MAX_FRAME_SIZE);
+    mFd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (mFd < 0)
+        return false;
+    mOk = true;
+
+#if SBEM_HAVE_ZSTD
+    if (mOptions.compression == Compression::ZSTD)
+    {
+        const unsigned threads = mOptions.threads ? mOptions.threads : defaultThreadCount();
+        if (!mOptions.pPool && threads > 1)
+        {
+            mpPool.reset(new ThreadPool(threads - 1));
+            mOptions.pPool = mpPool.get();
+        }
+
+        const size_t wave = mOptions.pPool ? mOptions.pPool->concurrency() : 1;
+        for (size_t i = 0; i < wave; i++)
+        {
+            std::unique_ptr<Frame> pFrame(new Frame);
+            pFrame->pInput.reset(new uint8_t[mOptions.frameSize]);
+            pFrame->outputCapacity = ZSTD_compressBound(mOptions.frameSize);
+            pFrame->pOutput.reset(new uint8_t[pFrame->outputCapacity]);
+            pFrame->pContext = ZSTD_createCCtx();
+            if (!pFrame->pContext)
+            {
+                mOk = false;
+            }
+            else
+            {
+                ZSTD_CCtx_setParameter(pFrame->pContext, ZSTD_c_compressionLevel, mOptions.level);
+                ZSTD_CCtx_setParameter(pFrame->pContext, ZSTD_c_checksumFlag, 1);
+            }
+            mFrames.push_back(std::move(pFrame));
+        }
+    }
+#endif
+    return mOk;
+}
+
+bool OutputFile::write(const void* pData, size_t length)
+{
+    if (mFd < 0 || !mOk)
+        return false;
+    if (mOptions.compression == Compression::NONE)
+        return mOk = writeAll(mFd, pData, length);
+
+    const uint8_t* p = static_cast<const uint8_t*>(pData);
+    while (length && mOk)
+    {
+        Frame& rFrame = *mFrames[mFilled];
+        const size_t n = std::min(length, mOptions.frameSize - rFrame.inputSize);
+        memcpy(rFrame.pInput.get() + rFrame.inputSize, p, n);
+        rFrame.inputSize += n;
+        p += n;
+        length -= n;
+        if (rFrame.inputSize == mOptions.frameSize && ++mFilled == mFrames.size())
+            mOk = flush(mFilled);
+    }
+    return mOk;
+}
+
+/** Compress the first count frames of the wave in parallel and write them in order. */
+bool OutputFile::flush(size_t count)
+{
+    if (mOptions.pPool && count > 1)
+    {
+        TaskGroup group;
+        for (size_t k = 0; k < count; k++)
+        {
+            Frame* pFrame = mFrames[k].get();
+            mOptions.pPool->submit(group, [pFrame]() { pFrame->compress(); });
+        }
+        mOptions.pPool->wait(group);
+    }
+    else
+    {
+        for (size_t k = 0; k < count; k++)
+            mFrames[k]->compress();
+    }
+
+    for (size_t k = 0; k < count; k++)
+    {
+        Frame& rFrame = *mFrames[k];
+        if (!rFrame.outputSize || mSeekTable.size() == seekable::MAX_FRAMES ||
+            !writeAll(mFd, rFrame.pOutput.get(), rFrame.outputSize))
+        {
+            return false;
+        }
+        mSeekTable.push_back({ static_cast<uint32_t>(rFrame.outputSize), static_cast<uint32_t>(rFrame.inputSize) });
+        rFrame.inputSize = 0;
+    }
+    mFilled = 0;
+    return true;
+}
+
+bool OutputFile::writeSeekTable()
+{
+    const size_t entryBytes = mSeekTable.size() * sizeof(seekable::Entry);
+    std::vector<uint8_t> table;
+    table.reserve(seekable::SKIPPABLE_HEADER_SIZE + entryBytes + seekable::FOOTER_SIZE);
+    putU32(table, seekable::SKIPPABLE_MAGIC);
+    putU32(table, static_cast<uint32_t>(entryBytes + seekable::FOOTER_SIZE));
+    const uint8_t* pEntries = reinterpret_cast<const uint8_t*>(mSeekTable.data());
+    table.insert(table.end(), pEntries, pEntries + entryBytes);
+    putU32(table, static_cast<uint32_t>(mSeekTable.size()));
+    table.push_back(0);     // no checksums in the table, the frames carry their own
+    putU32(table, seekable::SEEKABLE_MAGIC);
+    return writeAll(mFd, table.data(), table.size());
+}
+
+bool OutputFile::close()
+{
+    if (mFd < 0)
+        return false;
+
+    if (mOk && mOptions.compression == Compression::ZSTD)
+        mOk = flush(mFilled + (mFrames[mFilled]->inputSize ? 1 : 0)) && writeSeekTable();
+    if (::close(mFd) != 0)
+        mOk = false;
+    mFd = -1;
+    mFrames.clear();
+    mFilled = 0;
+    mSeekTable.clear();
+    mpPool.reset();
+    return mOk;
+}
+
+} // namespace sbem
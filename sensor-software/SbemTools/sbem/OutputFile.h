@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "SeekableFormat.h"
+
+#ifndef SBEM_HAVE_ZSTD
+#define SBEM_HAVE_ZSTD 0
+#endif
+
+namespace sbem
+{
+
+class ThreadPool;
+
+enum class Compression : uint8_t
+{
+    NONE,
+    ZSTD    // seekable zstd (SeekableFormat.h), in builds with SBEM_HAVE_ZSTD
+};
+
+struct OutputOptions
+{
+    Compression compression = Compression::NONE;
+    int level = 3;                  // zstd level, 1 (fastest) to 19
+
+    /** Uncompressed bytes per zstd frame: the most a reader decompresses to get at one byte. */
+    size_t frameSize = 1 << 20;
+
+    /** Frames compressed in parallel. 0 uses every core. */
+    unsigned threads = 1;
+
+    /** Compress on this pool instead of a private one; threads is ignored when set. */
+    ThreadPool* pPool = nullptr;
+};
+
+/**
+*   Sequential writer of an output file, plain or compressed.
+*
+*   Compressed output is cut into frameSize blocks that are compressed as
+*   independent zstd frames, a wave of one frame per thread at a time, and
+*   written in order followed by the seek table. Memory stays at two frames
+*   per thread whatever the output size.
+*/
+class OutputFile
+{
+public:
+    OutputFile();
+    ~OutputFile();
+
+    OutputFile(const OutputFile&) = delete;
+    OutputFile& operator=(const OutputFile&) = delete;
+
+    /** False for ZSTD in a build without zstd. */
+    static bool supports(Compression compression);
+
+    /** Conventional file name suffix: ".zst" or "". */
+    static const char* suffix(Compression compression);
+
+    /**
+    *   Create or truncate a file.
+    *
+    *   @param path Output path, suffix() included
+    *   @param rOptions Compression and threading
+    *   @return false if the file can't be created or the compression isn't supported
+    */
+    bool open(const char* path, const OutputOptions& rOptions = OutputOptions());
+
+    /** @return false once a write has failed */
+    bool write(const void* pData, size_t length);
+
+    /**
+    *   Write what is buffered and the seek table, and close.
+    *
+    *   @return false if the file wasn't open or any write failed
+    */
+    bool close();
+
+    bool isOpen() const { return mFd >= 0; }
+
+private:
+    struct Frame;
+
+    bool flush(size_t count);
+    bool writeSeekTable();
+
+    int mFd;
+    bool mOk = false;
+    OutputOptions mOptions;
+    std::unique_ptr<ThreadPool> mpPool;
+    std::vector<std::unique_ptr<Frame>> mFrames;   // the wave being filled
+    size_t mFilled = 0;                             // full frames in the wave
+    std::vector<seekable::Entry> mSeekTable;
+};
+
+} // namespace sbem
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <utility>
+
+#include "PacketLayout.h"
+#include "Recording.h"
+
+namespace sbem
+{
+
+/** How ECG and IMU6 packets are unpacked. Every path produces identical columns. */
+enum class PacketPath : uint8_t
+{
+    SIMD,           // layout-specialised with SSE2 loads and shuffles (UNROLLED without SSE2)
+    UNROLLED,       // layout-specialised, scalar loads unrolled at compile time
+    INTERPRETED     // field by field through the chunk's DecodePlan, like converter.py
+};
+
+namespace detail
+{
+
+/** pDst[i] = float32 at p + OFFSET + i * STRIDE for every i, as straight-line code. */
+template <size_t OFFSET, size_t STRIDE, size_t... I>
+inline void gatherF32(const uint8_t* p, float* pDst, std::index_sequence<I...>)
+{
+    ((pDst[I] = loadF32(p + OFFSET + I * STRIDE)), ...);
+}
+
+/** One axis of every sample, e.g. x of ArrayAcc[0..COUNT). */
+template <size_t OFFSET, size_t STRIDE, size_t COUNT>
+inline void gatherAxis(const uint8_t* p, float* pDst)
+{
+    gatherF32<OFFSET, STRIDE>(p, pDst, std::make_index_sequence<COUNT>());
+}
+
+#if SBEM_HAVE_SSE2
+template <size_t OFFSET, size_t... I>
+inline void copyF32x4(const uint8_t* p, float* pDst, std::index_sequence<I...>)
+{
+    (_mm_storeu_ps(pDst + 4 * I, _mm_loadu_ps(reinterpret_cast<const float*>(p + OFFSET + 16 * I))), ...);
+}
+
+/** Store lanes 0 and 3 of v, the two samples of one axis after the shuffles below. */
+inline void storePair(float* pDst, __m128 v)
+{
+    _mm_storel_pi(reinterpret_cast<__m64*>(pDst), _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 0, 3, 0)));
+}
+#endif
+
+} // namespace detail
+
+/**
+*   Decoder generated from a compile-time packet layout. decode() writes packet
+*   number slot of the layout's columns.
+*/
+template <typename Layout, PacketPath PATH>
+struct PacketDecoder;
+
+template <>
+struct PacketDecoder<EcgMvLayout, PacketPath::UNROLLED>
+{
+    using L = EcgMvLayout;
+
+    static void decode(const uint8_t* p, uint32_t chunkIndex, EcgColumns& rEcg, size_t slot)
+    {
+        rEcg.chunkIndex[slot] = chunkIndex;
+        rEcg.timestamp[slot] = loadU32(p + L::TIMESTAMP);
+        detail::gatherAxis<L::SAMPLES, 4, L::SAMPLE_COUNT>(p, &rEcg.samples[slot * L::SAMPLE_COUNT]);
+    }
+};
+
+template <>
+struct PacketDecoder<Imu6Layout, PacketPath::UNROLLED>
+{
+    using L = Imu6Layout;
+
+    static void decode(const uint8_t* p, uint32_t chunkIndex, ImuColumns& rImu, size_t slot)
+    {
+        rImu.chunkIndex[slot] = chunkIndex;
+        rImu.timestamp[slot] = loadU32(p + L::TIMESTAMP);
+
+        const size_t i = slot * L::SAMPLE_COUNT;
+        detail::gatherAxis<L::ACCEL, L::SAMPLE_STRIDE, L::SAMPLE_COUNT>(p, &rImu.accelX[i]);
+        detail::gatherAxis<L::ACCEL + 4, L::SAMPLE_STRIDE, L::SAMPLE_COUNT>(p, &rImu.accelY[i]);
+        detail::gatherAxis<L::ACCEL + 8, L::SAMPLE_STRIDE, L::SAMPLE_COUNT>(p, &rImu.accelZ[i]);
+        detail::gatherAxis<L::GYRO, L::SAMPLE_STRIDE, L::SAMPLE_COUNT>(p, &rImu.gyroX[i]);
+        detail::gatherAxis<L::GYRO + 4, L::SAMPLE_STRIDE, L::SAMPLE_COUNT>(p, &rImu.gyroY[i]);
+        detail::gatherAxis<L::GYRO + 8, L::SAMPLE_STRIDE, L::SAMPLE_COUNT>(p, &rImu.gyroZ[i]);
+    }
+};
+
+#if SBEM_HAVE_SSE2
+
+template <>
+struct PacketDecoder<EcgMvLayout, PacketPath::SIMD>
+{
+    using L = EcgMvLayout;
+    static_assert(L::SAMPLE_COUNT % 4 == 0, "ECG samples are copied 4 at a time");
+
+    static void decode(const uint8_t* p, uint32_t chunkIndex, EcgColumns& rEcg, size_t slot)
+    {
+        rEcg.chunkIndex[slot] = chunkIndex;
+        rEcg.timestamp[slot] = loadU32(p + L::TIMESTAMP);
+        detail::copyF32x4<L::SAMPLES>(p, &rEcg.samples[slot * L::SAMPLE_COUNT],
+                                      std::make_index_sequence<L::SAMPLE_COUNT / 4>());
+    }
+};
+
+template <>
+struct PacketDecoder<Imu6Layout, PacketPath::SIMD>
+{
+    using L = Imu6Layout;
+    static_assert(L::SAMPLE_COUNT == 2 && L::AXES == 3 && L::GYRO == L::ACCEL + 24,
+                  "the shuffles below assume two xyz samples of accel followed by gyro");
+
+    static void decode(const uint8_t* p, uint32_t chunkIndex, ImuColumns& rImu, size_t slot)
+    {
+        rImu.chunkIndex[slot] = chunkIndex;
+        rImu.timestamp[slot] = loadU32(p + L::TIMESTAMP);
+
+        // Twelve floats in three loads:
+        //   v0 = ax0 ay0 az0 ax1   v1 = ay1 az1 gx0 gy0   v2 = gz0 gx1 gy1 gz1
+        const float* pIn = reinterpret_cast<const float*>(p + L::ACCEL);
+        const __m128 v0 = _mm_loadu_ps(pIn);
+        const __m128 v1 = _mm_loadu_ps(pIn + 4);
+        const __m128 v2 = _mm_loadu_ps(pIn + 8);
+
+        // Gather axes split across two vectors into lanes 0 and 3
+        const __m128 ay = _mm_shuffle_ps(v0, v1, _MM_SHUFFLE(0, 0, 0, 1));
+        const __m128 az = _mm_shuffle_ps(v0, v1, _MM_SHUFFLE(1, 1, 0, 2));
+        const __m128 gx = _mm_shuffle_ps(v1, v2, _MM_SHUFFLE(1, 1, 0, 2));
+        const __m128 gy = _mm_shuffle_ps(v1, v2, _MM_SHUFFLE(2, 2, 0, 3));
+
+        const size_t i = slot * L::SAMPLE_COUNT;
+        detail::storePair(&rImu.accelX[i], v0);
+        detail::storePair(&rImu.accelY[i], ay);
+        detail::storePair(&rImu.accelZ[i], az);
+        detail::storePair(&rImu.gyroX[i], gx);
+        detail::storePair(&rImu.gyroY[i], gy);
+        detail::storePair(&rImu.gyroZ[i], v2);
+    }
+};
+
+#else
+
+template <typename Layout>
+struct PacketDecoder<Layout, PacketPath::SIMD>: PacketDecoder<Layout, PacketPath::UNROLLED>
+{
+};
+
+#endif
+
+} // namespace sbem
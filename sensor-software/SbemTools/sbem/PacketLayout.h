@@ -0,0 +1,43 @@
+#pragma once
+
+#include "SbemFormat.h"
+
+namespace sbem
+{
+
+/**
+*   Compile-time byte layouts of the packets winlogger logs (see startLogging()).
+*
+*   Offsets are relative to the chunk payload. PacketDecoder.h generates the
+*   specialised decoders from these, PlanTable::builtinPlan() the equivalent
+*   DecodePlan for the interpreted path.
+*/
+
+/** /Meas/ECG/200/mV: uint32 Timestamp, float32 Samples[16]. */
+struct EcgMvLayout
+{
+    static constexpr size_t SIZE = ECG_MV_PACKET_SIZE;
+    static constexpr size_t TIMESTAMP = 0;
+    static constexpr size_t SAMPLES = 4;
+    static constexpr size_t SAMPLE_COUNT = ECG_SAMPLES_PER_PACKET;
+};
+
+static_assert(EcgMvLayout::SAMPLES + EcgMvLayout::SAMPLE_COUNT * 4 == EcgMvLayout::SIZE,
+              "ECG mV layout doesn't fill the packet");
+
+/** /Meas/IMU6/26: uint32 Timestamp, {x,y,z} ArrayAcc[2], {x,y,z} ArrayGyro[2], all float32. */
+struct Imu6Layout
+{
+    static constexpr size_t SIZE = IMU6_PACKET_SIZE;
+    static constexpr size_t TIMESTAMP = 0;
+    static constexpr size_t SAMPLE_COUNT = IMU_SAMPLES_PER_PACKET;
+    static constexpr size_t AXES = 3;
+    static constexpr size_t SAMPLE_STRIDE = AXES * 4;
+    static constexpr size_t ACCEL = 4;
+    static constexpr size_t GYRO = ACCEL + SAMPLE_COUNT * SAMPLE_STRIDE;
+};
+
+static_assert(Imu6Layout::GYRO + Imu6Layout::SAMPLE_COUNT * Imu6Layout::SAMPLE_STRIDE == Imu6Layout::SIZE,
+              "IMU6 layout doesn't fill the packet");
+
+} // namespace sbem
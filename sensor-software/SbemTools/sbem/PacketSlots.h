@@ -0,0 +1,106 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Recording.h"
+
+namespace sbem
+{
+
+/**
+*   Walks the packets of one channel and gives each the sample slot its
+*   first sample goes to, for writers that lay samples out on a fixed rate
+*   grid (EdfWriter, WfdbWriter).
+*
+*   Sensor timestamps jitter by a few ms and drift against the sample clock,
+*   so rounding every timestamp to a slot would now and then leave a slot
+*   empty or put two samples in one. A packet therefore goes right after the
+*   one before it unless its timestamp steps more than half a packet past
+*   the channel's usual step (the median, as Stitcher measures it); only
+*   then is a gap opened, as long as the step says. Packets that go back in
+*   time are skipped.
+*/
+class PacketSlots
+{
+public:
+    /**
+    *   @param rTimestamps Packet timestamps of the channel [ms]
+    *   @param perPacket Samples in a packet
+    *   @param rate Samples per second
+    *   @param origin Timestamp of slot 0; the first packet goes to its rounded slot
+    */
+    PacketSlots(const Column<uint32_t>& rTimestamps, size_t perPacket, double rate, uint32_t origin):
+        mTs(rTimestamps),
+        mPerPacket(static_cast<int64_t>(perPacket)),
+        mRate(rate),
+        mPacket(0),
+        mSlot(0),
+        mLatest(0)
+    {
+        const uint32_t nominal = static_cast<uint32_t>(std::lround(perPacket * 1000.0 / rate));
+        const uint32_t period = medianStep(rTimestamps, nominal);
+        mMaxStep = period + period / 2;
+        if (mTs.size)
+        {
+            mLatest = mTs[0];
+            mSlot = std::llround((static_cast<double>(mTs[0]) - origin) * rate / 1000.0);
+        }
+    }
+
+    bool valid() const { return mPacket < mTs.size; }
+
+    /** Index of the current packet in the channel's columns. */
+    size_t packet() const { return mPacket; }
+
+    /** Slot of the current packet's first sample. */
+    int64_t slot() const { return mSlot; }
+
+    /** Move to the next packet that doesn't go back in time. */
+    void advance()
+    {
+        size_t p = mPacket + 1;
+        while (p < mTs.size && mTs[p] < mLatest)
+            p++;
+        mPacket = p;
+        if (p >= mTs.size)
+            return;
+
+        const uint32_t step = mTs[p] - mLatest;
+        int64_t slots = mPerPacket;
+        if (step > mMaxStep)
+            slots = std::max<int64_t>(mPerPacket, std::llround(step * mRate / 1000.0));
+        mSlot += slots;
+        mLatest = mTs[p];
+    }
+
+    /** Median step between increasing timestamps, or fallback with fewer than two. */
+    static uint32_t medianStep(const Column<uint32_t>& rTimestamps, uint32_t fallback)
+    {
+        std::vector<uint32_t> steps;
+        steps.reserve(rTimestamps.size);
+        for (size_t i = 1; i < rTimestamps.size; i++)
+        {
+            if (rTimestamps[i] > rTimestamps[i - 1])
+                steps.push_back(rTimestamps[i] - rTimestamps[i - 1]);
+        }
+        if (steps.empty())
+            return fallback;
+        std::nth_element(steps.begin(), steps.begin() + steps.size() / 2, steps.end());
+        return steps[steps.size() / 2];
+    }
+
+private:
+    const Column<uint32_t>& mTs;
+    int64_t mPerPacket;
+    double mRate;
+    uint32_t mMaxStep;
+    size_t mPacket;
+    int64_t mSlot;
+    uint32_t mLatest;
+};
+
+} // namespace sbem
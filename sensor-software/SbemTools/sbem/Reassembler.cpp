@@ -0,0 +1,189 @@
+#include "Reassembler.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "FileIo.h"
+#include "SbemFormat.h"
+
+namespace sbem
+{
+
+Reassembler::Reassembler():
+    mFd(-1)
+{
+}
+
+Reassembler::~Reassembler()
+{
+    if (mFd >= 0)
+        close();
+}
+
+bool Reassembler::open(const char* path, uint8_t reference)
+{
+    if (mFd >= 0)
+        close();
+    mFd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    mReference = reference;
+    mOk = mFd >= 0;
+    mError = mOk ? 0 : errno;
+    mEnded = false;
+    mSize = 0;
+    mBlocks.clear();
+    mWindowBegin = 0;
+    mReceived.clear();
+    mStats = ReassemblyStats();
+    return mOk;
+}
+
+FrameKind Reassembler::frame(const uint8_t* pData, size_t size)
+{
+    using namespace winlogger;
+    if (size < FRAME_HEADER)
+    {
+        mStats.malformed++;
+        return FrameKind::MALFORMED;
+    }
+    const uint8_t type = pData[0];
+    if ((type != DATA && type != DATA_PART2 && type != DATA_PART3) || pData[1] != mReference)
+    {
+        mStats.foreign++;
+        return FrameKind::FOREIGN;
+    }
+
+    const uint32_t offset = loadU32(pData + 2);
+    if (size == FRAME_HEADER)
+    {
+        mEnded = true;
+        mSize = offset;
+        return FrameKind::END;
+    }
+    mStats.frames++;
+    add(offset, pData + FRAME_HEADER, size - FRAME_HEADER);
+    return FrameKind::DATA;
+}
+
+bool Reassembler::add(uint64_t offset, const uint8_t* pData, size_t size)
+{
+    if (mFd < 0 || !size)
+        return mOk;
+
+    // Only the parts not received before; a repeat costs one lookup
+    mReceived.within(offset, offset + size, false, mScratch);
+    uint64_t fresh = 0;
+    for (const ByteRange& rRange : mScratch)
+    {
+        fresh += rRange.end - rRange.begin;
+        store(rRange.begin, pData + (rRange.begin - offset), static_cast<size_t>(rRange.end - rRange.begin));
+    }
+    mStats.bytes += fresh;
+    mStats.duplicates += size - fresh;
+
+    const uint64_t furthest = mReceived.end() / BLOCK_SIZE;
+    if (furthest >= WINDOW_BLOCKS && furthest - WINDOW_BLOCKS + 1 > mWindowBegin)
+        evict(furthest - WINDOW_BLOCKS + 1);
+    return mOk;
+}
+
+bool Reassembler::store(uint64_t offset, const uint8_t* pData, size_t size)
+{
+    const uint64_t end = offset + size;
+    while (offset < end)
+    {
+        const uint64_t index = offset / BLOCK_SIZE;
+        const uint64_t blockEnd = (index + 1) * BLOCK_SIZE;
+        const size_t n = static_cast<size_t>(std::min(end, blockEnd) - offset);
+        if (index < mWindowBegin)
+        {
+            // The window has moved past this block: straight to the file
+            writeAt(pData, n, offset);
+            mStats.rangeWrites++;
+            mReceived.add(offset, offset + n);
+        }
+        else
+        {
+            Block& rBlock = mBlocks[index];
+            if (!rBlock.pData)
+                rBlock.pData.reset(new uint8_t[BLOCK_SIZE]);
+            memcpy(rBlock.pData.get() + (offset - index * BLOCK_SIZE), pData, n);
+            rBlock.filled += n;
+            mReceived.add(offset, offset + n);
+            if (rBlock.filled == BLOCK_SIZE)
+            {
+                writeAt(rBlock.pData.get(), BLOCK_SIZE, index * BLOCK_SIZE);
+                mStats.blockWrites++;
+                mBlocks.erase(index);
+            }
+        }
+        pData += n;
+        offset += n;
+    }
+    return mOk;
+}
+
+void Reassembler::writeAt(const uint8_t* pData, size_t size, uint64_t offset)
+{
+    if (!writeAllAt(mFd, pData, size, offset))
+        fail();
+}
+
+void Reassembler::fail()
+{
+    // Keep the errno of the first failure, later calls may have changed it
+    if (mOk)
+        mError = errno ? errno : EIO;
+    mOk = false;
+}
+
+bool Reassembler::flush(uint64_t index, const Block& rBlock)
+{
+    const uint64_t begin = index * BLOCK_SIZE;
+    mReceived.within(begin, begin + BLOCK_SIZE, true, mScratch);
+    for (const ByteRange& rRange : mScratch)
+    {
+        const size_t n = static_cast<size_t>(rRange.end - rRange.begin);
+        writeAt(rBlock.pData.get() + (rRange.begin - begin), n, rRange.begin);
+        mStats.rangeWrites++;
+    }
+    return mOk;
+}
+
+bool Reassembler::evict(uint64_t below)
+{
+    // flush() reuses mScratch, which add() is done with by now
+    auto it = mBlocks.begin();
+    while (it != mBlocks.end() && it->first < below)
+    {
+        flush(it->first, it->second);
+        it = mBlocks.erase(it);
+    }
+    mWindowBegin = below;
+    return mOk;
+}
+
+void Reassembler::missing(std::vector<ByteRange>& rOut) const
+{
+    mReceived.within(0, size(), false, rOut);
+}
+
+bool Reassembler::close()
+{
+    if (mFd < 0)
+        return false;
+    for (const auto& rEntry : mBlocks)
+        flush(rEntry.first, rEntry.second);
+    mBlocks.clear();
+    if (::ftruncate(mFd, static_cast<off_t>(std::max(size(), mReceived.end()))) != 0)
+        fail();
+    if (::close(mFd) != 0)
+        fail();
+    mFd = -1;
+    return mOk;
+}
+
+} // namespace sbem
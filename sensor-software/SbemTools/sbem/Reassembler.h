@@ -0,0 +1,148 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "IntervalSet.h"
+#include "WinloggerProtocol.h"
+
+namespace sbem
+{
+
+/** What Reassembler::frame() made of a notification. */
+enum class FrameKind : uint8_t
+{
+    DATA,       // payload at an offset of the log
+    END,        // EOF marker: the offset is the log size
+    FOREIGN,    // another reference, or not a data notification
+    MALFORMED   // shorter than the frame header
+};
+
+struct ReassemblyStats
+{
+    uint64_t frames = 0;        // data frames of the fetch
+    uint64_t bytes = 0;         // payload bytes new to the file
+    uint64_t duplicates = 0;    // payload bytes received before
+    uint64_t foreign = 0;       // notifications of other references or types
+    uint64_t malformed = 0;
+    uint64_t blockWrites = 0;   // whole aligned blocks
+    uint64_t rangeWrites = 0;   // parts of blocks, flushed before they filled up
+};
+
+/**
+*   Writes a log fetched as winlogger data notifications to a file, in
+*   whatever order and with whatever repeats and holes they arrive.
+*
+*   A notification is [type][reference][u32 offset][payload] of type DATA,
+*   DATA_PART2 or DATA_PART3 (WinloggerProtocol.h), and a DATA frame
+*   without payload at offset = log size marks the end. Only the
+*   bytes of each payload not received before are kept, in BLOCK_SIZE
+*   blocks at aligned offsets; a block is written with one pwrite once it is
+*   full. Blocks more than WINDOW_BLOCKS behind the furthest offset are
+*   written range by range, and fragments that arrive for them later go
+*   straight to the file, so memory stays at the window however the
+*   notifications are shuffled.
+*
+*   The received ranges are kept in an IntervalSet: after the end marker,
+*   missing() lists the holes to fetch again.
+*/
+class Reassembler
+{
+public:
+    static constexpr size_t BLOCK_SIZE = 64 << 10;
+    static constexpr size_t WINDOW_BLOCKS = 16;
+
+    Reassembler();
+    ~Reassembler();
+
+    Reassembler(const Reassembler&) = delete;
+    Reassembler& operator=(const Reassembler&) = delete;
+
+    /**
+    *   Create or truncate the output file.
+    *
+    *   @param path Output path
+    *   @param reference Reference byte of the FETCH_LOG command whose notifications to take
+    *   @return false if the file can't be created
+    */
+    bool open(const char* path, uint8_t reference);
+
+    /**
+    *   Take one notification as received.
+    *
+    *   @param pData Notification bytes, header included
+    *   @param size Byte count
+    */
+    FrameKind frame(const uint8_t* pData, size_t size);
+
+    /**
+    *   Add a payload at its offset in the log.
+    *
+    *   @return false once a write has failed
+    */
+    bool add(uint64_t offset, const uint8_t* pData, size_t size);
+
+    /**
+    *   Write what is buffered, size the file to the log (holes read as zero)
+    *   and close it.
+    *
+    *   @return false if the file wasn't open or any write failed
+    */
+    bool close();
+
+    /** True once an end marker was received. */
+    bool ended() const { return mEnded; }
+
+    /** Log size from the end marker, else the furthest byte received. */
+    uint64_t size() const { return mEnded ? mSize : mReceived.end(); }
+
+    /** Bytes received so far. */
+    uint64_t received() const { return mReceived.bytes(); }
+
+    /**
+    *   The byte ranges below size() not received.
+    *
+    *   @param rOut Receives the holes in order (cleared first)
+    */
+    void missing(std::vector<ByteRange>& rOut) const;
+
+    /** True once the end marker and every byte before it were received. */
+    bool complete() const { return mEnded && mReceived.covers(0, mSize); }
+
+    bool ok() const { return mOk; }
+
+    /** errno of the failed open or first failed write, 0 while ok(). */
+    int error() const { return mError; }
+
+    const ReassemblyStats& stats() const { return mStats; }
+
+private:
+    struct Block
+    {
+        std::unique_ptr<uint8_t[]> pData;
+        size_t filled = 0;
+    };
+
+    bool store(uint64_t offset, const uint8_t* pData, size_t size);
+    void writeAt(const uint8_t* pData, size_t size, uint64_t offset);
+    void fail();
+    bool flush(uint64_t index, const Block& rBlock);
+    bool evict(uint64_t below);
+
+    int mFd;
+    uint8_t mReference = 0;
+    bool mOk = false;
+    int mError = 0;
+    bool mEnded = false;
+    uint64_t mSize = 0;
+    std::map<uint64_t, Block> mBlocks;     // block index -> buffer, all within the window
+    uint64_t mWindowBegin = 0;              // first block index still buffered
+    IntervalSet mReceived;
+    std::vector<ByteRange> mScratch;
+    ReassemblyStats mStats;
+};
+
+} // namespace sbem
@@ -0,0 +1,174 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Arena.h"
+#include "SbemFormat.h"
+
+namespace sbem
+{
+
+/** Non-owning view of one column in the recording's arena. */
+template <typename T>
+struct Column
+{
+    T* data = nullptr;
+    size_t size = 0;
+
+    T& operator[](size_t i) { return data[i]; }
+    const T& operator[](size_t i) const { return data[i]; }
+    bool empty() const { return size == 0; }
+    T* begin() { return data; }
+    T* end() { return data + size; }
+    const T* begin() const { return data; }
+    const T* end() const { return data + size; }
+};
+
+/**
+*   /Meas/ECG/200/mV packets. Packet p has timestamp[p] and
+*   samples[p * ECG_SAMPLES_PER_PACKET .. + ECG_SAMPLES_PER_PACKET).
+*/
+struct EcgColumns
+{
+    Column<uint32_t> chunkIndex;    // running chunk number in the file, per packet
+    Column<uint32_t> timestamp;     // per packet
+    Column<float> samples;          // per sample, mV
+
+    size_t packets() const { return timestamp.size; }
+};
+
+/**
+*   /Meas/IMU6/26 packets. Packet p has timestamp[p] and samples
+*   [p * IMU_SAMPLES_PER_PACKET .. + IMU_SAMPLES_PER_PACKET) of every axis.
+*/
+struct ImuColumns
+{
+    Column<uint32_t> chunkIndex;
+    Column<uint32_t> timestamp;
+    Column<float> accelX;
+    Column<float> accelY;
+    Column<float> accelZ;
+    Column<float> gyroX;
+    Column<float> gyroY;
+    Column<float> gyroZ;
+
+    size_t packets() const { return timestamp.size; }
+};
+
+/** Data chunks of unknown layout; keep their first 4 bytes like converter.py does. */
+struct OtherColumns
+{
+    Column<uint32_t> chunkIndex;
+    Column<uint16_t> id;
+    Column<uint32_t> value;
+
+    size_t size() const { return chunkIndex.size; }
+};
+
+/**
+*   Chunks of one id decoded through a descriptor plan that has no dedicated
+*   packet decoder. Values of chunk i are values[valueOffsets[i] .. valueOffsets[i + 1]).
+*/
+struct GenericStream
+{
+    uint16_t id = 0;
+    std::string path;
+    Column<uint32_t> chunkIndex;
+    Column<uint32_t> valueOffsets;  // chunkIndex.size + 1 entries
+    Column<double> values;
+};
+
+/** Why a stitched timeline has no packets for a while, see Stitcher. */
+enum class GapKind : uint8_t
+{
+    DROPOUT,    // packets missing inside a log: lost notifications, corrupt chunks
+    LEAD_OFF,   // between two logs, while the sensor wasn't logging
+    RESET       // between two logs across a sensor restart; the length is unknown
+};
+
+/**
+*   Gaps in the timeline of a stitched recording, one row per gap and
+*   channel: the channel has no packets from begin up to end [ms].
+*/
+struct TimelineGapColumns
+{
+    Column<uint8_t> kind;           // GapKind
+    Column<uint8_t> channel;        // PacketKind, ECG_MV or IMU6
+    Column<uint32_t> begin;         // where the next packet was due
+    Column<uint32_t> end;           // timestamp of the packet after the gap
+
+    size_t size() const { return begin.size; }
+};
+
+/**
+*   Everything decoded from one SBEM file, as struct-of-arrays columns that
+*   all live in one arena.
+*/
+struct Recording
+{
+    Arena arena;
+    EcgColumns ecg;
+    ImuColumns imu;
+    OtherColumns other;
+    std::vector<GenericStream> streams;
+    std::vector<std::string> descriptors;
+    std::vector<Gap> gaps;          // corrupt byte ranges skipped, see Scanner
+    TimelineGapColumns timelineGaps;    // only filled by Stitcher
+
+    uint32_t chunkCount = 0;
+    uint64_t bytesScanned = 0;
+    bool truncated = false;
+
+    void clear()
+    {
+        arena.release();
+        recycle();
+    }
+
+    /** Like clear(), but the arena keeps its block for the next batch of a StreamDecoder. */
+    void recycle()
+    {
+        ecg = EcgColumns();
+        imu = ImuColumns();
+        other = OtherColumns();
+        timelineGaps = TimelineGapColumns();
+        streams.clear();
+        descriptors.clear();
+        gaps.clear();
+        chunkCount = 0;
+        bytesScanned = 0;
+        truncated = false;
+    }
+};
+
+/**
+*   Chunk where each row kind first appears, UINT32_MAX where it never does.
+*   The CSV columns follow from it, so a streamed conversion finds it before
+*   it writes the first batch.
+*/
+struct RecordingShape
+{
+    uint32_t firstEcg = UINT32_MAX;
+    uint32_t firstImu = UINT32_MAX;
+    uint32_t firstOther = UINT32_MAX;
+
+    bool complete() const { return firstEcg != UINT32_MAX && firstImu != UINT32_MAX && firstOther != UINT32_MAX; }
+
+    bool empty() const { return firstEcg == UINT32_MAX && firstImu == UINT32_MAX && firstOther == UINT32_MAX; }
+
+    static RecordingShape of(const Recording& rRecording)
+    {
+        RecordingShape shape;
+        if (rRecording.ecg.packets())
+            shape.firstEcg = rRecording.ecg.chunkIndex[0];
+        if (rRecording.imu.packets())
+            shape.firstImu = rRecording.imu.chunkIndex[0];
+        if (rRecording.other.size())
+            shape.firstOther = rRecording.other.chunkIndex[0];
+        return shape;
+    }
+};
+
+} // namespace sbem
@@ -0,0 +1,331 @@
+#include "Repacker.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "ChunkIndex.h"
+#include "FileIo.h"
+
+namespace sbem
+{
+
+namespace
+{
+
+constexpr size_t ID_COUNT = 1 << 16;
+
+// The output is assembled in blocks of about this size
+constexpr size_t WRITE_BLOCK = 1 << 20;
+
+void putChunk(std::vector<uint8_t>& rOut, uint16_t id, const uint8_t* pPayload, uint32_t length)
+{
+    uint8_t header[8];
+    size_t size = writeId(header, id);
+    size += writeLen(header + size, length);
+    rOut.insert(rOut.end(), header, header + size);
+    rOut.insert(rOut.end(), pPayload, pPayload + length);
+}
+
+} // namespace
+
+Repacker::Repacker():
+    mDescribed(ID_COUNT, -1),
+    mUndescribedUser(ID_COUNT, -1)
+{
+    memset(mHeader, 0, sizeof(mHeader));
+}
+
+Repacker::~Repacker() = default;
+
+bool Repacker::add(const char* path, bool useSidecar)
+{
+    std::unique_ptr<Input> pInput(new Input);
+    pInput->path = path;
+    if (!pInput->file.open(path) || pInput->file.size() < HEADER_SIZE)
+    {
+        mError = std::string(path) + ": not a readable SBEM file";
+        return false;
+    }
+
+    const uint8_t* pData = pInput->file.data();
+    const size_t size = pInput->file.size();
+    ChunkIndex index;
+    if (useSidecar)
+        index.useSidecar(path, pData, size);
+    else
+        index.build(pData, size);
+
+    // Check the descriptors and ids against the earlier inputs before taking anything over
+    const uint32_t input = static_cast<uint32_t>(mInputs.size());
+    std::vector<Descriptor> added;
+    std::vector<bool> describedHere(ID_COUNT, false);
+    for (const IndexEntry& rEntry : index)
+    {
+        if (rEntry.kind != ChunkKind::DESCRIPTOR)
+            continue;
+
+        const uint8_t* p = pData + rEntry.offset;
+        uint16_t id;
+        if (!readId(p, pData + rEntry.offset + rEntry.length, id))
+            continue;
+        const std::string payload(reinterpret_cast<const char*>(pData + rEntry.offset), rEntry.length);
+
+        const Descriptor* pKnown = mDescribed[id] >= 0 ? &mDescriptors[mDescribed[id]] : nullptr;
+        for (const Descriptor& rAdded : added)
+        {
+            if (rAdded.id == id)
+                pKnown = &rAdded;
+        }
+        if (pKnown && pKnown->payload != payload)
+        {
+            mError = std::string(path) + ": describes id " + std::to_string(id) +
+                     (pKnown->input == input ? " twice, differently" : " differently from " +
+                                                                           mInputs[pKnown->input]->path);
+            return false;
+        }
+        if (mUndescribedUser[id] >= 0)
+        {
+            mError = std::string(path) + ": describes id " + std::to_string(id) + ", which " +
+                     mInputs[mUndescribedUser[id]]->path + " logs without a descriptor";
+            return false;
+        }
+        if (!pKnown)
+            added.push_back({ id, input, payload });
+        describedHere[id] = true;
+    }
+
+    for (const IndexEntry& rEntry : index)
+    {
+        if (rEntry.kind != ChunkKind::DESCRIPTOR && !describedHere[rEntry.id] && mDescribed[rEntry.id] >= 0)
+        {
+            mError = std::string(path) + ": logs id " + std::to_string(rEntry.id) + " without a descriptor, " +
+                     mInputs[mDescriptors[mDescribed[rEntry.id]].input]->path + " describes it";
+            return false;
+        }
+    }
+
+    for (Descriptor& rAdded : added)
+    {
+        mDescribed[rAdded.id] = static_cast<int32_t>(mDescriptors.size());
+        mDescriptors.push_back(std::move(rAdded));
+    }
+
+    // Chunks other than packets sort with the packet before them, or the first one of the log
+    uint32_t timestamp = 0;
+    index.firstTimestamp(timestamp);
+    const size_t spansBegin = mSpans.size();
+    for (const IndexEntry& rEntry : index)
+    {
+        if (rEntry.kind == ChunkKind::DESCRIPTOR)
+            continue;
+
+        const bool packet = rEntry.kind == ChunkKind::ECG || rEntry.kind == ChunkKind::IMU;
+        if (packet)
+        {
+            timestamp = rEntry.firstTimestamp;
+            auto it = std::find_if(mSpans.begin() + spansBegin, mSpans.end(),
+                                   [&](const Span& rSpan) { return rSpan.id == rEntry.id; });
+            if (it == mSpans.end())
+            {
+                mSpans.push_back({ input, rEntry.id, timestamp, timestamp });
+            }
+            else
+            {
+                it->first = std::min(it->first, timestamp);
+                it->last = std::max(it->last, timestamp);
+            }
+        }
+        if (!describedHere[rEntry.id] && mUndescribedUser[rEntry.id] < 0)
+            mUndescribedUser[rEntry.id] = static_cast<int32_t>(input);
+        mEntries.push_back({ rEntry.offset, rEntry.length, timestamp, input, rEntry.id, packet });
+    }
+
+    if (mInputs.empty())
+        memcpy(mHeader, pData, HEADER_SIZE);
+    mGaps += index.gapCount();
+    mInputs.push_back(std::move(pInput));
+    return true;
+}
+
+bool Repacker::firstTimestamp(uint32_t& rTimestamp) const
+{
+    bool found = false;
+    for (const Entry& rEntry : mEntries)
+    {
+        if (rEntry.packet && (!found || rEntry.timestamp < rTimestamp))
+        {
+            rTimestamp = rEntry.timestamp;
+            found = true;
+        }
+    }
+    return found;
+}
+
+/**
+*   Two inputs with packets of one id over the same time must hold some of
+*   the same packets, as fetches of one log do; a restarted sensor's second
+*   session shares none with the first. Expects mEntries sorted by timestamp.
+*
+*   @return true with mError set if two inputs overlap without sharing
+*/
+bool Repacker::findOverlap()
+{
+    struct Overlap
+    {
+        const Span* pA;
+        const Span* pB;
+        bool shared;
+    };
+
+    std::vector<Overlap> overlaps;
+    for (size_t i = 0; i < mSpans.size(); i++)
+    {
+        for (size_t j = i + 1; j < mSpans.size(); j++)
+        {
+            const Span& rA = mSpans[i];
+            const Span& rB = mSpans[j];
+            if (rA.id == rB.id && rA.input != rB.input && rA.first <= rB.last && rB.first <= rA.last)
+                overlaps.push_back({ &rA, &rB, false });
+        }
+    }
+    if (overlaps.empty())
+        return false;
+
+    size_t runBegin = 0;    // first entry with the current timestamp
+    for (size_t i = 0; i < mEntries.size(); i++)
+    {
+        const Entry& rEntry = mEntries[i];
+        if (rEntry.timestamp != mEntries[runBegin].timestamp)
+            runBegin = i;
+        if (!rEntry.packet)
+            continue;
+
+        const uint8_t* pPayload = mInputs[rEntry.input]->file.data() + rEntry.offset;
+        for (size_t j = runBegin; j < i; j++)
+        {
+            const Entry& rOther = mEntries[j];
+            if (rOther.input == rEntry.input || rOther.id != rEntry.id || rOther.length != rEntry.length ||
+                memcmp(mInputs[rOther.input]->file.data() + rOther.offset, pPayload, rEntry.length) != 0)
+            {
+                continue;
+            }
+            for (Overlap& rOverlap : overlaps)
+            {
+                if (rOverlap.pA->id == rEntry.id &&
+                    ((rOverlap.pA->input == rOther.input && rOverlap.pB->input == rEntry.input) ||
+                     (rOverlap.pA->input == rEntry.input && rOverlap.pB->input == rOther.input)))
+                {
+                    rOverlap.shared = true;
+                }
+            }
+        }
+    }
+
+    for (const Overlap& rOverlap : overlaps)
+    {
+        if (!rOverlap.shared)
+        {
+            const Span& rA = *rOverlap.pA;
+            const Span& rB = *rOverlap.pB;
+            mError = mInputs[rA.input]->path + " and " + mInputs[rB.input]->path + " log different packets of id " +
+                     std::to_string(rA.id) + " from " + std::to_string(std::max(rA.first, rB.first)) + " to " +
+                     std::to_string(std::min(rA.last, rB.last)) +
+                     " ms; the sensor restarted between them, stitch them instead";
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Repacker::write(const char* path, uint32_t begin, uint32_t end, RepackStats& rStats)
+{
+    rStats = RepackStats();
+    rStats.inputs = mInputs.size();
+    rStats.descriptors = mDescriptors.size();
+    rStats.gaps = mGaps;
+    for (const std::unique_ptr<Input>& rpInput : mInputs)
+        rStats.bytesIn += rpInput->file.size();
+
+    if (mEntries.empty())
+    {
+        mError = "no data chunks to write";
+        return false;
+    }
+
+    // Stable: ties stay in input order, and in file order within an input
+    std::stable_sort(mEntries.begin(), mEntries.end(),
+                     [](const Entry& a, const Entry& b) { return a.timestamp < b.timestamp; });
+    if (findOverlap())
+        return false;
+
+    const std::string tmpPath = std::string(path) + ".tmp" + std::to_string(getpid());
+    const int fd = ::open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        mError = std::string(path) + ": can't write";
+        return false;
+    }
+
+    std::vector<uint8_t> out;
+    out.reserve(2 * WRITE_BLOCK);
+    out.insert(out.end(), mHeader, mHeader + HEADER_SIZE);
+    for (const Descriptor& rDescriptor : mDescriptors)
+    {
+        putChunk(out, DESCRIPTOR_ID, reinterpret_cast<const uint8_t*>(rDescriptor.payload.data()),
+                 static_cast<uint32_t>(rDescriptor.payload.size()));
+    }
+
+    bool ok = true;
+    size_t runBegin = 0;    // first entry with the current timestamp
+    for (size_t i = 0; i < mEntries.size() && ok; i++)
+    {
+        const Entry& rEntry = mEntries[i];
+        if (rEntry.timestamp != mEntries[runBegin].timestamp)
+            runBegin = i;
+        if (rEntry.timestamp < begin || rEntry.timestamp >= end)
+        {
+            rStats.trimmed++;
+            continue;
+        }
+
+        // A packet of another input at the same time with the same bytes: the same log fetched twice
+        const uint8_t* pPayload = mInputs[rEntry.input]->file.data() + rEntry.offset;
+        bool duplicate = false;
+        for (size_t j = runBegin; j < i && rEntry.packet && !duplicate; j++)
+        {
+            const Entry& rOther = mEntries[j];
+            duplicate = rOther.input != rEntry.input && rOther.id == rEntry.id && rOther.length == rEntry.length &&
+                        memcmp(mInputs[rOther.input]->file.data() + rOther.offset, pPayload, rEntry.length) == 0;
+        }
+        if (duplicate)
+        {
+            rStats.duplicates++;
+            continue;
+        }
+
+        putChunk(out, rEntry.id, pPayload, rEntry.length);
+        rStats.chunks++;
+        if (out.size() >= WRITE_BLOCK)
+        {
+            ok = writeAll(fd, out.data(), out.size());
+            rStats.bytesOut += out.size();
+            out.clear();
+        }
+    }
+    ok = ok && writeAll(fd, out.data(), out.size());
+    rStats.bytesOut += out.size();
+
+    if (::close(fd) != 0)
+        ok = false;
+    mError = ok ? "no data chunks in the time window" : std::string(path) + ": can't write";
+    if (ok && rStats.chunks && rename(tmpPath.c_str(), path) == 0)
+        return true;
+    unlink(tmpPath.c_str());
+    return false;
+}
+
+} // namespace sbem
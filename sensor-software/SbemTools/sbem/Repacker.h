@@ -0,0 +1,137 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "MappedFile.h"
+#include "SbemFormat.h"
+
+namespace sbem
+{
+
+/** What a repack read and wrote. */
+struct RepackStats
+{
+    size_t inputs = 0;
+    size_t descriptors = 0;     // distinct descriptors written
+    size_t chunks = 0;          // data chunks written
+    size_t duplicates = 0;      // packets dropped because another input holds the same packet
+    size_t trimmed = 0;         // chunks dropped outside the time window
+    size_t gaps = 0;            // corrupt ranges skipped in the inputs
+    uint64_t bytesIn = 0;
+    uint64_t bytesOut = 0;
+};
+
+/**
+*   Merges SBEM logs of one sensor into a single canonical file.
+*
+*   The Winlogger starts a new log whenever a session starts, so an archive
+*   fills up with fragments that each repeat the same descriptors. A repacked
+*   file holds the header of the first input, every distinct descriptor once
+*   in front, then the data chunks of all inputs in packet timestamp order
+*   with the shortest id and length encodings. Corrupt bytes the scanner
+*   skips are left out, and a packet that another input already holds with
+*   the same id, timestamp and payload (a log fetched twice) is written once.
+*
+*   Chunks without a packet timestamp keep their place after the packet
+*   before them in their input. Decoding the output gives the rows of the
+*   inputs decoded one after the other, merged by time.
+*
+*   That only holds while the inputs share a clock. Two inputs logging one
+*   id over the same time without a single packet in common come from a
+*   sensor that restarted in between; merging them by time would interleave
+*   two sessions, so write() refuses them. Such logs are joined with the
+*   Stitcher instead, which moves the later ones behind.
+*/
+class Repacker
+{
+public:
+    Repacker();
+    ~Repacker();
+
+    Repacker(const Repacker&) = delete;
+    Repacker& operator=(const Repacker&) = delete;
+
+    /**
+    *   Map a log and index its chunks; it stays mapped until write().
+    *
+    *   @param path SBEM file
+    *   @param useSidecar Reuse or leave a <file>.sbidx index next to the log
+    *   @return false if the file isn't readable SBEM or describes an id
+    *           differently from an earlier input; error() says which
+    */
+    bool add(const char* path, bool useSidecar = true);
+
+    /**
+    *   @param rTimestamp Receives the earliest ECG or IMU packet timestamp of the inputs
+    *   @return false if no input has packets
+    */
+    bool firstTimestamp(uint32_t& rTimestamp) const;
+
+    /**
+    *   Write the merged log. It is written under a temporary name and renamed
+    *   into place, so the output may replace one of the inputs.
+    *
+    *   @param path Output file
+    *   @param begin Keep chunks timestamped from here on (ms)
+    *   @param end Keep chunks timestamped before this (ms)
+    *   @param rStats Receives what was read and written
+    *   @return false if there is nothing to write, two inputs overlap in time
+    *           or the file can't be written
+    */
+    bool write(const char* path, uint32_t begin, uint32_t end, RepackStats& rStats);
+
+    /** Why add() or write() failed. */
+    const std::string& error() const { return mError; }
+
+private:
+    struct Input
+    {
+        std::string path;
+        MappedFile file;
+    };
+
+    /** A data chunk of an input, sorted by timestamp for writing. */
+    struct Entry
+    {
+        uint64_t offset;        // payload offset in the input
+        uint32_t length;
+        uint32_t timestamp;     // of the packet, or carried over from the packet before
+        uint32_t input;
+        uint16_t id;
+        bool packet;
+    };
+
+    /** The packet timestamps of an id in an input. */
+    struct Span
+    {
+        uint32_t input;
+        uint16_t id;
+        uint32_t first;
+        uint32_t last;
+    };
+
+    struct Descriptor
+    {
+        uint16_t id;
+        uint32_t input;         // that described it first
+        std::string payload;
+    };
+
+    std::vector<std::unique_ptr<Input>> mInputs;
+    bool findOverlap();
+
+    std::vector<Entry> mEntries;
+    std::vector<Span> mSpans;
+    std::vector<Descriptor> mDescriptors;   // in first seen order
+    std::vector<int32_t> mDescribed;        // id -> mDescriptors slot, -1 if undescribed
+    std::vector<int32_t> mUndescribedUser;  // id -> first input with data of the id and no descriptor, -1 if none
+    uint8_t mHeader[HEADER_SIZE];
+    size_t mGaps = 0;
+    std::string mError;
+};
+
+} // namespace sbem
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SBEM_HAVE_SSE2 1
+#else
+#define SBEM_HAVE_SSE2 0
+#endif
+
+/**
+*   Wire format constants and primitive readers for Movesense SBEM logs.
+*
+*   An SBEM file is an 8 byte header followed by chunks of
+*   [id][length][payload]. Ids and lengths are a single byte unless that byte
+*   is ReservedSbemId_e_Escape (0xFF), in which case the real value follows as
+*   a little-endian uint16 (id) or uint32 (length).
+*/
+namespace sbem
+{
+
+constexpr uint8_t ESCAPE = 0xFF;          // ReservedSbemId_e_Escape
+constexpr uint16_t DESCRIPTOR_ID = 0;     // ReservedSbemId_e_Descriptor
+constexpr size_t HEADER_SIZE = 8;
+
+// Packet layouts logged by winlogger (see startLogging())
+constexpr size_t ECG_SAMPLES_PER_PACKET = 16;
+constexpr size_t IMU_SAMPLES_PER_PACKET = 2;
+constexpr size_t ECG_MV_PACKET_SIZE = 4 + ECG_SAMPLES_PER_PACKET * 4;      // 68
+constexpr size_t IMU6_PACKET_SIZE = 4 + 2 * IMU_SAMPLES_PER_PACKET * 3 * 4; // 52
+
+/** Bytes [begin, end) of a file skipped as corrupt. */
+struct Gap
+{
+    uint64_t begin;
+    uint64_t end;
+};
+
+inline uint16_t loadU16(const uint8_t* p)
+{
+    uint16_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint32_t loadU32(const uint8_t* p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline float loadF32(const uint8_t* p)
+{
+    float v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/**
+*   Read an escape-encoded chunk id.
+*
+*   @param rPos Read position, advanced past the id on success
+*   @param end One past the last readable byte
+*   @param rId Receives the id
+*   @return false if the id runs past end
+*/
+inline bool readId(const uint8_t*& rPos, const uint8_t* end, uint16_t& rId)
+{
+    if (rPos >= end)
+        return false;
+
+    if (*rPos < ESCAPE)
+    {
+        rId = *rPos++;
+        return true;
+    }
+
+    if (end - rPos < 3)
+        return false;
+    rId = loadU16(rPos + 1);
+    rPos += 3;
+    return true;
+}
+
+/**
+*   Read an escape-encoded chunk length.
+*
+*   @param rPos Read position, advanced past the length on success
+*   @param end One past the last readable byte
+*   @param rLength Receives the length
+*   @return false if the length runs past end
+*/
+inline bool readLen(const uint8_t*& rPos, const uint8_t* end, uint32_t& rLength)
+{
+    if (rPos >= end)
+        return false;
+
+    if (*rPos < ESCAPE)
+    {
+        rLength = *rPos++;
+        return true;
+    }
+
+    if (end - rPos < 5)
+        return false;
+    rLength = loadU32(rPos + 1);
+    rPos += 5;
+    return true;
+}
+
+/**
+*   Write a chunk id with the shortest escape encoding, the inverse of readId().
+*
+*   @param p Receives up to 3 bytes
+*   @param id Chunk id
+*   @return Bytes written
+*/
+inline size_t writeId(uint8_t* p, uint16_t id)
+{
+    if (id < ESCAPE)
+    {
+        *p = static_cast<uint8_t>(id);
+        return 1;
+    }
+
+    p[0] = ESCAPE;
+    memcpy(p + 1, &id, sizeof(id));
+    return 3;
+}
+
+/**
+*   Write a chunk length with the shortest escape encoding, the inverse of readLen().
+*
+*   @param p Receives up to 5 bytes
+*   @param length Payload length
+*   @return Bytes written
+*/
+inline size_t writeLen(uint8_t* p, uint32_t length)
+{
+    if (length < ESCAPE)
+    {
+        *p = static_cast<uint8_t>(length);
+        return 1;
+    }
+
+    p[0] = ESCAPE;
+    memcpy(p + 1, &length, sizeof(length));
+    return 5;
+}
+
+} // namespace sbem
@@ -0,0 +1,281 @@
+#include "Scanner.h"
+
+#include <algorithm>
+
+#include "DecodePlan.h"
+
+namespace sbem
+{
+
+namespace
+{
+
+/** Lengths of the packets with a timestamp in front, see SbemFormat.h. */
+bool isPacketLength(uint32_t length)
+{
+    return length == ECG_MV_PACKET_SIZE || length == IMU6_PACKET_SIZE;
+}
+
+/** Chunks looked past for the next chunk of the same id before giving up on a confirmation. */
+constexpr size_t MAX_CONFIRM_CHUNKS = 64;
+
+#if SBEM_HAVE_SSE2
+constexpr size_t MAX_SIMD_TARGETS = 8;
+#endif
+
+} // namespace
+
+Scanner::Scanner(const uint8_t* pData, size_t size):
+    mBegin(pData),
+    mPos(pData + (size < HEADER_SIZE ? size : HEADER_SIZE)),
+    mEnd(pData + size),
+    mIndex(0),
+    mTruncated(false),
+    mComplete(true),
+    mShort(false),
+    mIsTarget()
+{
+}
+
+void Scanner::extend(const uint8_t* pData, size_t size, size_t dropped, bool complete)
+{
+    const size_t position = static_cast<size_t>(mPos - mBegin) - dropped;
+    mBegin = pData;
+    mPos = pData + position;
+    mEnd = pData + size;
+    mComplete = complete;
+}
+
+bool Scanner::nextChecked(Chunk& rChunk)
+{
+    if (mPos >= mEnd)
+        return false;
+
+    // Any check that runs into the end of incomplete data waits for more
+    mShort = false;
+    Header header;
+    const bool sound = readHeader(mPos, header) && consistent(header, true) &&
+                       (header.id == DESCRIPTOR_ID || seen(header.id) || plausibleNext(header));
+    if (mShort)
+        return false;
+    if (sound)
+    {
+        accept(header, rChunk);
+        return true;
+    }
+
+    // The chunk at mPos is the corrupt one, so it can't be where decoding resumes
+    const uint8_t* pResume = resync(mPos + 1);
+    if (mShort)
+        return false;
+    if (pResume > mPos)
+        mGaps.push_back({ static_cast<uint64_t>(mPos - mBegin), static_cast<uint64_t>(pResume - mBegin) });
+    mPos = pResume;
+    if (mPos >= mEnd)
+    {
+        mTruncated = true;
+        return false;
+    }
+
+    // Resuming out of step with the last packet of its id: the clock went on elsewhere, for every id
+    readHeader(mPos, header);
+    if (!consistent(header, true))
+    {
+        for (IdState& rState : mIds)
+            rState.timed = false;
+    }
+    accept(header, rChunk);
+    return true;
+}
+
+bool Scanner::readHeader(const uint8_t* p, Header& rHeader) const
+{
+    if (!readId(p, mEnd, rHeader.id) || !readLen(p, mEnd, rHeader.length) ||
+        static_cast<size_t>(mEnd - p) < rHeader.length)
+    {
+        mShort = mShort || !mComplete;
+        return false;
+    }
+    rHeader.pPayload = p;
+    rHeader.pNext = p + rHeader.length;
+    return true;
+}
+
+/**
+*   What the log so far says about a chunk. checkStep also compares its
+*   timestamp with the last packet of its id, which must not be later or
+*   more than MAX_TIMESTAMP_STEP_MS earlier; a confirmed resync point may
+*   step either way, as the log's clock may have restarted in the gap.
+*/
+bool Scanner::consistent(const Header& rHeader, bool checkStep) const
+{
+    // Zero filled holes read as empty descriptors, random bytes as descriptors that don't parse
+    if (rHeader.id == DESCRIPTOR_ID)
+        return PlanTable::validDescriptor(rHeader.pPayload, rHeader.length);
+
+    if (rHeader.id >= mIds.size())
+        return true;
+
+    const IdState& rState = mIds[rHeader.id];
+    if (rState.seen && isPacketLength(rState.length) && rHeader.length != rState.length)
+        return false;
+    if (checkStep && rState.timed && isPacketLength(rHeader.length))
+    {
+        const uint32_t timestamp = loadU32(rHeader.pPayload);
+        if (timestamp < rState.timestamp || timestamp - rState.timestamp > MAX_TIMESTAMP_STEP_MS)
+            return false;
+    }
+    return true;
+}
+
+/**
+*   Look past a chunk for the next chunk of its id, which must have the same
+*   length and, for packets, a timestamp step forward of at most
+*   MAX_TIMESTAMP_STEP_MS. The chunks in between must be consistent, and of
+*   known ids unless anyId is set.
+*
+*   @param acceptEnd Result if the data ends before the id comes again
+*/
+bool Scanner::sameIdFollows(const Header& rHeader, bool anyId, bool acceptEnd) const
+{
+    const uint8_t* p = rHeader.pNext;
+    for (size_t n = 0; n < MAX_CONFIRM_CHUNKS; n++)
+    {
+        if (p == mEnd)
+        {
+            mShort = !mComplete;
+            return acceptEnd;
+        }
+
+        Header next;
+        if (!readHeader(p, next))
+            return false;
+        if (next.id == rHeader.id)
+        {
+            if (next.length != rHeader.length)
+                return false;
+            if (!isPacketLength(rHeader.length))
+                return true;
+            const uint32_t first = loadU32(rHeader.pPayload);
+            const uint32_t second = loadU32(next.pPayload);
+            return second >= first && second - first <= MAX_TIMESTAMP_STEP_MS;
+        }
+        if ((next.id != DESCRIPTOR_ID && !anyId && !known(next.id)) || !consistent(next, false))
+            return false;
+        p = next.pNext;
+    }
+    return false;
+}
+
+/** The first chunk of an id, described or not, must be confirmed by the next chunk of that id, or end the data. */
+bool Scanner::plausibleNext(const Header& rHeader) const
+{
+    return sameIdFollows(rHeader, true, true);
+}
+
+/**
+*   A resync point: a consistent chunk of a known id confirmed by the next
+*   chunk of the same id, whatever its step from the last packet of its id.
+*   Running into the end of data instead only confirms a chunk that steps
+*   forward from that packet by at most MAX_TIMESTAMP_STEP_MS.
+*/
+bool Scanner::confirmed(const uint8_t* p) const
+{
+    Header header;
+    if (!readHeader(p, header) || header.id == DESCRIPTOR_ID || !known(header.id) || !consistent(header, false))
+        return false;
+    return sameIdFollows(header, false, consistent(header, true));
+}
+
+/** Next byte at or after p that could start a known data id, mEnd if none. */
+const uint8_t* Scanner::findCandidate(const uint8_t* p) const
+{
+#if SBEM_HAVE_SSE2
+    if (!mTargets.empty() && mTargets.size() <= MAX_SIMD_TARGETS)
+    {
+        __m128i needles[MAX_SIMD_TARGETS];
+        for (size_t t = 0; t < mTargets.size(); t++)
+            needles[t] = _mm_set1_epi8(static_cast<char>(mTargets[t]));
+
+        for (; mEnd - p >= 16; p += 16)
+        {
+            const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+            __m128i hits = _mm_cmpeq_epi8(block, needles[0]);
+            for (size_t t = 1; t < mTargets.size(); t++)
+                hits = _mm_or_si128(hits, _mm_cmpeq_epi8(block, needles[t]));
+
+            const int mask = _mm_movemask_epi8(hits);
+            if (mask)
+                return p + __builtin_ctz(static_cast<unsigned>(mask));
+        }
+    }
+#endif
+    while (p < mEnd && !mIsTarget[*p])
+        p++;
+    return p;
+}
+
+const uint8_t* Scanner::resync(const uint8_t* p) const
+{
+    for (p = findCandidate(p); p < mEnd; p = findCandidate(p + 1))
+    {
+        if (confirmed(p) || mShort)
+            return p;
+    }
+    mShort = !mComplete;
+    return mEnd;
+}
+
+void Scanner::accept(const Header& rHeader, Chunk& rChunk)
+{
+    if (rHeader.id == DESCRIPTOR_ID)
+    {
+        const uint8_t* p = rHeader.pPayload;
+        uint16_t described;
+        if (readId(p, rHeader.pNext, described))
+        {
+            // A new session describes its ids again, and its clock starts over
+            markKnown(described);
+            mIds[described].described = true;
+            mIds[described].timed = false;
+        }
+    }
+    else
+    {
+        markKnown(rHeader.id);
+        IdState& rState = mIds[rHeader.id];
+        if (!rState.seen)
+        {
+            rState.seen = true;
+            rState.length = rHeader.length;
+        }
+        if (isPacketLength(rHeader.length))
+        {
+            rState.timestamp = loadU32(rHeader.pPayload);
+            rState.timed = true;
+        }
+    }
+
+    rChunk.index = mIndex++;
+    rChunk.id = rHeader.id;
+    rChunk.length = rHeader.length;
+    rChunk.offset = static_cast<uint64_t>(rHeader.pPayload - mBegin);
+    mPos = rHeader.pNext;
+}
+
+void Scanner::markKnown(uint16_t id)
+{
+    if (mIds.size() <= id)
+        mIds.resize(id + 1);
+    if (id == DESCRIPTOR_ID)
+        return;
+
+    const uint8_t first = id < ESCAPE ? static_cast<uint8_t>(id) : ESCAPE;
+    if (!mIsTarget[first])
+    {
+        mIsTarget[first] = true;
+        mTargets.push_back(first);
+    }
+}
+
+} // namespace sbem
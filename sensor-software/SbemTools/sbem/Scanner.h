@@ -0,0 +1,170 @@
+#pragma once
+
+#include <vector>
+
+#include "SbemFormat.h"
+
+namespace sbem
+{
+
+/** One chunk as located in the file. offset points at the payload. */
+struct Chunk
+{
+    uint32_t index;     // running chunk number, descriptors included
+    uint16_t id;
+    uint32_t length;
+    uint64_t offset;
+};
+
+/**
+*   Sequential chunk boundary walker over an in-memory SBEM image that
+*   survives corruption.
+*
+*   Logs fetched over BLE have zero filled holes where notifications were
+*   lost, and parsing straight through one derails every chunk after it. The
+*   scanner therefore learns what the log looks like as it goes (the data ids
+*   in use, the length of every packet id, the last timestamp of each) and
+*   treats a chunk as corrupt when it runs past the end of the data, is a
+*   descriptor that doesn't parse, has a packet id with another length, steps
+*   its id's timestamp backwards or more than MAX_TIMESTAMP_STEP_MS forwards,
+*   or has a never seen id that the next chunk of the same id doesn't
+*   confirm (a descriptor alone doesn't vouch for a chunk). A descriptor
+*   forgets the last timestamp of the id it describes, so the restarted
+*   clock of a second session logged after it is taken as it is.
+*
+*   From a corrupt chunk it resynchronises: a vectorised byte scan from the
+*   byte after it finds the next occurrence of a known id, and the first one
+*   that starts a consistent chunk confirmed by the next chunk of the same id
+*   (same length, timestamp stepping forward by at most MAX_TIMESTAMP_STEP_MS)
+*   is where decoding resumes. Its own timestamp isn't compared with what
+*   came before the gap; if it steps back or too far, the log's clock was
+*   restarted and every id's last timestamp is forgotten. The skipped bytes
+*   are recorded as a Gap.
+*
+*   Only reads ids, lengths and packet timestamps; payloads are left to the caller.
+*
+*   A scanner can also follow data that is still arriving (see extend()):
+*   it then stops in front of any chunk whose verdict depends on bytes it
+*   doesn't have yet, so it walks the same chunks and gaps as a scanner
+*   over the finished image.
+*/
+class Scanner
+{
+public:
+    /** Largest forward step of a packet timestamp accepted without confirmation. */
+    static constexpr uint32_t MAX_TIMESTAMP_STEP_MS = 3600 * 1000;
+
+    Scanner(const uint8_t* pData, size_t size);
+
+    /**
+    *   Advance to the next chunk, skipping corrupt bytes.
+    *
+    *   @param rChunk Receives the chunk location
+    *   @return false at end of data
+    */
+    bool next(Chunk& rChunk)
+    {
+        // Fast path: another chunk of a seen id with its usual length and a sane timestamp step
+        const uint8_t* p = mPos;
+        uint16_t id;
+        uint32_t length;
+        if (readId(p, mEnd, id) && readLen(p, mEnd, length) && static_cast<size_t>(mEnd - p) >= length &&
+            id < mIds.size() && mIds[id].seen && mIds[id].length == length)
+        {
+            IdState& rState = mIds[id];
+            const uint32_t timestamp = rState.timed ? loadU32(p) : 0;
+            if (!rState.timed ||
+                (timestamp >= rState.timestamp && timestamp - rState.timestamp <= MAX_TIMESTAMP_STEP_MS))
+            {
+                rState.timestamp = timestamp;
+                rChunk.index = mIndex++;
+                rChunk.id = id;
+                rChunk.length = length;
+                rChunk.offset = static_cast<uint64_t>(p - mBegin);
+                mPos = p + length;
+                return true;
+            }
+        }
+        return nextChecked(rChunk);
+    }
+
+    /**
+    *   Continue over a longer copy of the data, for data that arrives while
+    *   it is scanned. Until complete is set the end of the data isn't final:
+    *   next() returns false instead of deciding on a chunk that needs more
+    *   bytes, and is called again after the next extend(). Offsets of the
+    *   chunks and gaps found from here on count from pData.
+    *
+    *   @param pData The data from dropped bytes of the old data on; the
+    *          bytes from position() on must be the same
+    *   @param size Bytes at pData
+    *   @param dropped Bytes in front of the old data's pData that aren't in pData
+    *   @param complete True when no more data will follow
+    */
+    void extend(const uint8_t* pData, size_t size, size_t dropped, bool complete);
+
+    /** Offset of the next chunk header; everything before it has been walked. */
+    size_t position() const { return static_cast<size_t>(mPos - mBegin); }
+
+    /** True if the data ends in a gap, e.g. a chunk running past the end. */
+    bool truncated() const { return mTruncated; }
+    uint32_t chunkCount() const { return mIndex; }
+
+    /** Corrupt byte ranges skipped so far, in file order. */
+    const std::vector<Gap>& gaps() const { return mGaps; }
+
+private:
+    struct Header
+    {
+        uint16_t id;
+        uint32_t length;
+        const uint8_t* pPayload;
+        const uint8_t* pNext;
+    };
+
+    struct IdState
+    {
+        uint32_t length = 0;        // of the first chunk
+        uint32_t timestamp = 0;     // of the last packet
+        bool seen = false;
+        bool described = false;
+        bool timed = false;
+    };
+
+    bool nextChecked(Chunk& rChunk);
+    bool readHeader(const uint8_t* p, Header& rHeader) const;
+    bool consistent(const Header& rHeader, bool checkStep) const;
+    bool sameIdFollows(const Header& rHeader, bool anyId, bool acceptEnd) const;
+    bool plausibleNext(const Header& rHeader) const;
+    bool confirmed(const uint8_t* p) const;
+    const uint8_t* findCandidate(const uint8_t* p) const;
+    const uint8_t* resync(const uint8_t* p) const;
+    void accept(const Header& rHeader, Chunk& rChunk);
+    void markKnown(uint16_t id);
+
+    bool seen(uint16_t id) const
+    {
+        return id < mIds.size() && mIds[id].seen;
+    }
+
+    bool known(uint16_t id) const
+    {
+        return id < mIds.size() && (mIds[id].seen || mIds[id].described);
+    }
+
+    const uint8_t* mBegin;
+    const uint8_t* mPos;
+    const uint8_t* mEnd;
+    uint32_t mIndex;
+    bool mTruncated;
+    bool mComplete;
+    mutable bool mShort;    // a check ran into the end of incomplete data
+    std::vector<IdState> mIds;
+    std::vector<Gap> mGaps;
+
+    // First bytes of the known data ids, what the resync scan looks for
+    bool mIsTarget[256];
+    std::vector<uint8_t> mTargets;
+};
+
+} // namespace sbem
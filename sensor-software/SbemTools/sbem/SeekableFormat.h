@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "seek tables are written and read as little-endian"
+#endif
+
+/**
+*   Layout of compressed output: the zstd seekable format (zstd's
+*   contrib/seekable_format), so any reader of that format can use the files.
+*
+*     zstd frame 0                    independent frames of frameSize bytes
+*     zstd frame 1 ...                of output each, the last one shorter
+*     skippable frame:
+*       SKIPPABLE_MAGIC, u32 size     of the rest of the frame
+*       Entry[frameCount]             (+ u32 checksum each if CHECKSUM_FLAG)
+*       u32 frameCount, u8 descriptor, SEEKABLE_MAGIC
+*
+*   Decompressors skip skippable frames, so `zstd -d` restores the plain file.
+*   A seekable reader sums the sizes in the table to find the frames holding
+*   the bytes it wants and decompresses only those.
+*/
+namespace sbem
+{
+namespace seekable
+{
+
+constexpr uint32_t FRAME_MAGIC = 0xFD2FB528;        // start of every zstd frame
+constexpr uint32_t SKIPPABLE_MAGIC = 0x184D2A5E;
+constexpr uint32_t SEEKABLE_MAGIC = 0x8F92EAB1;
+constexpr uint8_t CHECKSUM_FLAG = 0x80;             // in the descriptor
+constexpr size_t FOOTER_SIZE = 9;
+constexpr size_t SKIPPABLE_HEADER_SIZE = 8;
+constexpr uint32_t MAX_FRAMES = 0x8000000;
+
+struct Entry
+{
+    uint32_t compressedSize;
+    uint32_t decompressedSize;
+};
+
+static_assert(sizeof(Entry) == 8, "Entry is part of the file format");
+
+} // namespace seekable
+} // namespace sbem
@@ -0,0 +1,161 @@
+#include "SeekableReader.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if SBEM_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "SbemFormat.h"
+
+namespace sbem
+{
+
+SeekableReader::SeekableReader() = default;
+
+SeekableReader::~SeekableReader()
+{
+    close();
+}
+
+bool SeekableReader::isCompressed(const uint8_t* pData, size_t size)
+{
+    return size >= 4 && loadU32(pData) == seekable::FRAME_MAGIC;
+}
+
+bool SeekableReader::open(const char* path)
+{
+    close();
+#if SBEM_HAVE_ZSTD
+    if (!mFile.open(path, MappedFile::Access::RANDOM))
+        return false;
+
+    // Footer, then the skippable frame in front of it that holds the entries
+    const uint8_t* pData = mFile.data();
+    const uint64_t size = mFile.size();
+    if (size < seekable::SKIPPABLE_HEADER_SIZE + seekable::FOOTER_SIZE ||
+        loadU32(pData + size - 4) != seekable::SEEKABLE_MAGIC)
+    {
+        close();
+        return false;
+    }
+    const uint8_t* pFooter = pData + size - seekable::FOOTER_SIZE;
+    const uint64_t frames = loadU32(pFooter);
+    const uint64_t entrySize = (pFooter[4] & seekable::CHECKSUM_FLAG) ? 12 : 8;
+    const uint64_t tableSize = seekable::SKIPPABLE_HEADER_SIZE + frames * entrySize + seekable::FOOTER_SIZE;
+    if (frames > seekable::MAX_FRAMES || tableSize > size)
+    {
+        close();
+        return false;
+    }
+    const uint8_t* pTable = pData + size - tableSize;
+    if (loadU32(pTable) != seekable::SKIPPABLE_MAGIC ||
+        loadU32(pTable + 4) != tableSize - seekable::SKIPPABLE_HEADER_SIZE)
+    {
+        close();
+        return false;
+    }
+
+    mFileOffsets.resize(frames + 1);
+    mPlainOffsets.resize(frames + 1);
+    mFileOffsets[0] = 0;
+    mPlainOffsets[0] = 0;
+    for (uint64_t i = 0; i < frames; i++)
+    {
+        const uint8_t* pEntry = pTable + seekable::SKIPPABLE_HEADER_SIZE + i * entrySize;
+        mFileOffsets[i + 1] = mFileOffsets[i] + loadU32(pEntry);
+        mPlainOffsets[i + 1] = mPlainOffsets[i] + loadU32(pEntry + 4);
+    }
+    if (mFileOffsets.back() != size - tableSize)
+    {
+        close();
+        return false;
+    }
+
+    mpContext = ZSTD_createDCtx();
+    if (!mpContext)
+    {
+        close();
+        return false;
+    }
+    return true;
+#else
+    (void)path;
+    return false;
+#endif
+}
+
+void SeekableReader::close()
+{
+#if SBEM_HAVE_ZSTD
+    ZSTD_freeDCtx(static_cast<ZSTD_DCtx*>(mpContext));
+#endif
+    mpContext = nullptr;
+    mFile.close();
+    mFileOffsets.clear();
+    mPlainOffsets.clear();
+    mCachedFrame = SIZE_MAX;
+}
+
+bool SeekableReader::decompress(size_t frame, uint8_t* pOut)
+{
+#if SBEM_HAVE_ZSTD
+    const size_t plainSize = mPlainOffsets[frame + 1] - mPlainOffsets[frame];
+    const size_t result =
+        ZSTD_decompressDCtx(static_cast<ZSTD_DCtx*>(mpContext), pOut, plainSize, mFile.data() + mFileOffsets[frame],
+                            mFileOffsets[frame + 1] - mFileOffsets[frame]);
+    return !ZSTD_isError(result) && result == plainSize;
+#else
+    (void)frame;
+    (void)pOut;
+    return false;
+#endif
+}
+
+bool SeekableReader::read(uint64_t offset, size_t length, void* pOut)
+{
+    if (!isOpen() || offset > size() || length > size() - offset)
+        return false;
+
+    uint8_t* pDest = static_cast<uint8_t*>(pOut);
+    size_t frame = std::upper_bound(mPlainOffsets.begin(), mPlainOffsets.end(), offset) - mPlainOffsets.begin() - 1;
+    while (length)
+    {
+        const uint64_t frameBegin = mPlainOffsets[frame];
+        const size_t frameSize = mPlainOffsets[frame + 1] - frameBegin;
+        const size_t skip = offset - frameBegin;
+        const size_t n = std::min(length, frameSize - skip);
+
+        // Whole frames go straight to the caller, partial ones through the cache
+        if (n == frameSize)
+        {
+            if (!decompress(frame, pDest))
+                return false;
+        }
+        else
+        {
+            if (frame != mCachedFrame)
+            {
+                if (mCachedCapacity < frameSize)
+                {
+                    mpCached.reset(new uint8_t[frameSize]);
+                    mCachedCapacity = frameSize;
+                }
+                mCachedFrame = SIZE_MAX;
+                if (!decompress(frame, mpCached.get()))
+                    return false;
+                mCachedFrame = frame;
+            }
+            memcpy(pDest, mpCached.get() + skip, n);
+        }
+
+        pDest += n;
+        offset += n;
+        length -= n;
+        frame++;
+    }
+    return true;
+}
+
+} // namespace sbem
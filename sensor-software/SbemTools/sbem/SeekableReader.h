@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "MappedFile.h"
+#include "OutputFile.h"
+
+namespace sbem
+{
+
+/**
+*   Random access to a seekable zstd file (see SeekableFormat.h), as written
+*   by OutputFile. Only the frames overlapping a read are decompressed; the
+*   last frame read partially is kept, so walking a file in small reads
+*   decompresses every frame once.
+*/
+class SeekableReader
+{
+public:
+    SeekableReader();
+    ~SeekableReader();
+
+    SeekableReader(const SeekableReader&) = delete;
+    SeekableReader& operator=(const SeekableReader&) = delete;
+
+    /**
+    *   Map a file and load its seek table.
+    *
+    *   @param path File to read
+    *   @return false if it can't be mapped, doesn't end in a seek table or
+    *           the build has no zstd
+    */
+    bool open(const char* path);
+    void close();
+
+    bool isOpen() const { return mFile.isOpen(); }
+
+    /** Size of the decompressed data. */
+    uint64_t size() const { return mPlainOffsets.empty() ? 0 : mPlainOffsets.back(); }
+    size_t frameCount() const { return mPlainOffsets.empty() ? 0 : mPlainOffsets.size() - 1; }
+
+    /**
+    *   @param offset Position in the decompressed data
+    *   @param length Bytes to read
+    *   @param pOut Receives length bytes
+    *   @return false if the range runs past size() or a frame is corrupt
+    */
+    bool read(uint64_t offset, size_t length, void* pOut);
+
+    /** True if the data starts like a zstd frame, the way to tell compressed input from plain. */
+    static bool isCompressed(const uint8_t* pData, size_t size);
+
+private:
+    bool decompress(size_t frame, uint8_t* pOut);
+
+    MappedFile mFile;
+    std::vector<uint64_t> mFileOffsets;     // frame starts in the file, then the end of the last frame
+    std::vector<uint64_t> mPlainOffsets;    // frame starts in the decompressed data, then size()
+    void* mpContext = nullptr;              // ZSTD_DCtx
+    std::unique_ptr<uint8_t[]> mpCached;
+    size_t mCachedCapacity = 0;
+    size_t mCachedFrame = SIZE_MAX;
+};
+
+} // namespace sbem
@@ -0,0 +1,373 @@
+#include "Stitcher.h"
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+
+#include "DecodePlan.h"
+
+namespace sbem
+{
+
+namespace
+{
+
+// Packet periods of the resources winlogger subscribes to, for logs too short to measure them
+constexpr uint32_t ECG_PERIOD_MS = 1000 * ECG_SAMPLES_PER_PACKET / 200;   // /Meas/ECG/200/mV
+constexpr uint32_t IMU_PERIOD_MS = 1000 * IMU_SAMPLES_PER_PACKET / 26;    // /Meas/IMU6/26
+
+struct GapRow
+{
+    GapKind kind;
+    PacketKind channel;
+    uint32_t begin;
+    uint32_t end;
+};
+
+/** Where each log of a channel starts on the timeline, for finding its gaps. */
+struct Segment
+{
+    const Column<uint32_t>* pTimestamps;
+    uint32_t offset;
+    bool reset;
+};
+
+/** Median step between consecutive timestamps of the segments, or fallback if none has two. */
+uint32_t measurePeriod(const std::vector<Segment>& rSegments, uint32_t fallback)
+{
+    std::vector<uint32_t> steps;
+    for (const Segment& rSegment : rSegments)
+    {
+        const Column<uint32_t>& rTs = *rSegment.pTimestamps;
+        for (size_t i = 1; i < rTs.size; i++)
+        {
+            if (rTs[i] > rTs[i - 1])
+                steps.push_back(rTs[i] - rTs[i - 1]);
+        }
+    }
+    if (steps.empty())
+        return fallback;
+    std::nth_element(steps.begin(), steps.begin() + steps.size() / 2, steps.end());
+    return steps[steps.size() / 2];
+}
+
+/**
+*   Gaps of one channel: steps longer than period + minGap, and every log
+*   boundary where the clock was reset.
+*/
+void findGaps(const std::vector<Segment>& rSegments, PacketKind channel, uint32_t period, uint32_t minGap,
+              std::vector<GapRow>& rGaps)
+{
+    bool started = false;
+    uint32_t prev = 0;
+    for (const Segment& rSegment : rSegments)
+    {
+        const Column<uint32_t>& rTs = *rSegment.pTimestamps;
+        for (size_t i = 0; i < rTs.size; i++)
+        {
+            const uint32_t t = rTs[i] + rSegment.offset;
+            if (started)
+            {
+                const bool boundary = i == 0;
+                if (boundary && rSegment.reset)
+                    rGaps.push_back({ GapKind::RESET, channel, prev + period, t });
+                else if (t > prev && t - prev > period + minGap)
+                    rGaps.push_back({ boundary ? GapKind::LEAD_OFF : GapKind::DROPOUT, channel, prev + period, t });
+            }
+            prev = started ? std::max(prev, t) : t;
+            started = true;
+        }
+    }
+}
+
+template <typename T>
+void place(Arena& rArena, Column<T>& rColumn, size_t count)
+{
+    rColumn.data = rArena.alloc<T>(count);
+    rColumn.size = count;
+}
+
+template <typename T>
+void copyAt(const Column<T>& rFrom, Column<T>& rTo, size_t pos)
+{
+    if (rFrom.size)
+        memcpy(rTo.data + pos, rFrom.data, rFrom.size * sizeof(T));
+}
+
+/** Copy rFrom to rTo[pos..], adding delta to every value. */
+void copyShifted(const Column<uint32_t>& rFrom, Column<uint32_t>& rTo, size_t pos, uint32_t delta)
+{
+    for (size_t i = 0; i < rFrom.size; i++)
+        rTo[pos + i] = rFrom[i] + delta;
+}
+
+} // namespace
+
+Stitcher::Stitcher() = default;
+
+Stitcher::~Stitcher() = default;
+
+bool Stitcher::add(const char* path, uint32_t logId, const DecodeOptions& rOptions)
+{
+    std::unique_ptr<Log> pLog(new Log);
+    pLog->path = path;
+    pLog->logId = logId;
+    if (!Decoder::decodeFile(path, pLog->recording, rOptions))
+    {
+        mError = std::string(path) + ": not a readable SBEM file";
+        return false;
+    }
+
+    const Recording& rRec = pLog->recording;
+    for (const Column<uint32_t>* pTimestamps : { &rRec.ecg.timestamp, &rRec.imu.timestamp })
+    {
+        for (uint32_t t : *pTimestamps)
+        {
+            pLog->first = std::min(pLog->first, t);
+            pLog->last = std::max(pLog->last, t);
+        }
+    }
+    mLogs.push_back(std::move(pLog));
+    return true;
+}
+
+/** Drop logs fetched twice and sort the rest into recording order. */
+void Stitcher::order(StitchStats& rStats)
+{
+    const bool byId = std::all_of(mLogs.begin(), mLogs.end(),
+                                  [](const std::unique_ptr<Log>& rLog) { return rLog->logId != NO_LOG_ID; });
+    if (byId)
+    {
+        std::map<uint32_t, size_t> largest;
+        for (size_t i = 0; i < mLogs.size(); i++)
+        {
+            auto it = largest.emplace(mLogs[i]->logId, i).first;
+            if (mLogs[i]->recording.bytesScanned > mLogs[it->second]->recording.bytesScanned)
+                it->second = i;
+        }
+
+        std::vector<std::unique_ptr<Log>> kept;
+        for (auto& rEntry : largest)
+            kept.push_back(std::move(mLogs[rEntry.second]));
+        rStats.duplicates = mLogs.size() - kept.size();
+        mLogs.swap(kept);
+    }
+    else
+    {
+        std::stable_sort(mLogs.begin(), mLogs.end(), [](const std::unique_ptr<Log>& rA, const std::unique_ptr<Log>& rB)
+        {
+            return rA->first < rB->first;
+        });
+    }
+}
+
+/** Give each log its offset on the timeline, moving logs after a restart behind the ones before. */
+bool Stitcher::assignOffsets(uint32_t period)
+{
+    uint64_t offset = 0;
+    uint64_t end = 0;
+    bool started = false;
+    for (const std::unique_ptr<Log>& rLog : mLogs)
+    {
+        if (rLog->first == UINT32_MAX)
+            continue;
+        if (started && rLog->first + offset < end)
+        {
+            offset = end + period - rLog->first;
+            rLog->reset = true;
+        }
+        if (rLog->last + offset > UINT32_MAX)
+        {
+            mError = rLog->path + ": the stitched timeline runs past the 32 bit ms clock";
+            return false;
+        }
+        rLog->offset = static_cast<uint32_t>(offset);
+        end = std::max<uint64_t>(end, rLog->last + offset);
+        started = true;
+    }
+    return true;
+}
+
+bool Stitcher::stitch(Recording& rOut, uint32_t minGap, StitchStats& rStats)
+{
+    rOut.clear();
+    rStats = StitchStats();
+    order(rStats);
+    rStats.logs = mLogs.size();
+
+    std::vector<Segment> ecg;
+    std::vector<Segment> imu;
+    for (const std::unique_ptr<Log>& rLog : mLogs)
+    {
+        ecg.push_back({ &rLog->recording.ecg.timestamp, 0, false });
+        imu.push_back({ &rLog->recording.imu.timestamp, 0, false });
+    }
+    rStats.ecgPeriod = measurePeriod(ecg, ECG_PERIOD_MS);
+    rStats.imuPeriod = measurePeriod(imu, IMU_PERIOD_MS);
+    if (!assignOffsets(std::max(rStats.ecgPeriod, rStats.imuPeriod)))
+        return false;
+
+    for (size_t i = 0; i < mLogs.size(); i++)
+    {
+        ecg[i].offset = imu[i].offset = mLogs[i]->offset;
+        ecg[i].reset = imu[i].reset = mLogs[i]->reset;
+        rStats.resets += mLogs[i]->reset ? 1 : 0;
+    }
+    std::vector<GapRow> gaps;
+    findGaps(ecg, PacketKind::ECG_MV, rStats.ecgPeriod, minGap ? minGap : rStats.ecgPeriod / 2, gaps);
+    findGaps(imu, PacketKind::IMU6, rStats.imuPeriod, minGap ? minGap : rStats.imuPeriod / 2, gaps);
+    std::stable_sort(gaps.begin(), gaps.end(), [](const GapRow& rA, const GapRow& rB) { return rA.begin < rB.begin; });
+
+    // Sizes of the merged columns; generic streams are merged by chunk id
+    size_t ecgPackets = 0;
+    size_t imuPackets = 0;
+    size_t others = 0;
+    std::map<uint16_t, size_t> streamSlot;
+    std::vector<size_t> streamChunks;
+    std::vector<size_t> streamValues;
+    for (const std::unique_ptr<Log>& rLog : mLogs)
+    {
+        const Recording& rRec = rLog->recording;
+        ecgPackets += rRec.ecg.packets();
+        imuPackets += rRec.imu.packets();
+        others += rRec.other.size();
+        for (const GenericStream& rStream : rRec.streams)
+        {
+            auto it = streamSlot.emplace(rStream.id, rOut.streams.size()).first;
+            if (it->second == rOut.streams.size())
+            {
+                rOut.streams.emplace_back();
+                rOut.streams.back().id = rStream.id;
+                rOut.streams.back().path = rStream.path;
+                streamChunks.push_back(0);
+                streamValues.push_back(0);
+            }
+            streamChunks[it->second] += rStream.chunkIndex.size;
+            streamValues[it->second] += rStream.values.size;
+        }
+        for (const std::string& rDescriptor : rRec.descriptors)
+        {
+            if (std::find(rOut.descriptors.begin(), rOut.descriptors.end(), rDescriptor) == rOut.descriptors.end())
+                rOut.descriptors.push_back(rDescriptor);
+        }
+        rStats.corrupt += rRec.gaps.size();
+    }
+    if (!ecgPackets && !imuPackets)
+    {
+        mError = "No ECG or IMU packets in the logs";
+        return false;
+    }
+
+    const size_t ecgSamples = ecgPackets * ECG_SAMPLES_PER_PACKET;
+    const size_t imuSamples = imuPackets * IMU_SAMPLES_PER_PACKET;
+    size_t bytes = 2 * Arena::footprint<uint32_t>(ecgPackets) + Arena::footprint<float>(ecgSamples) +
+                   2 * Arena::footprint<uint32_t>(imuPackets) + 6 * Arena::footprint<float>(imuSamples) +
+                   2 * Arena::footprint<uint32_t>(others) + Arena::footprint<uint16_t>(others) +
+                   2 * Arena::footprint<uint8_t>(gaps.size()) + 2 * Arena::footprint<uint32_t>(gaps.size());
+    for (size_t s = 0; s < rOut.streams.size(); s++)
+    {
+        bytes += Arena::footprint<uint32_t>(streamChunks[s]) + Arena::footprint<uint32_t>(streamChunks[s] + 1) +
+                 Arena::footprint<double>(streamValues[s]);
+    }
+
+    Arena& rArena = rOut.arena;
+    if (!rArena.reset(bytes))
+    {
+        mError = "Out of memory for the stitched recording";
+        return false;
+    }
+    place(rArena, rOut.ecg.chunkIndex, ecgPackets);
+    place(rArena, rOut.ecg.timestamp, ecgPackets);
+    place(rArena, rOut.ecg.samples, ecgSamples);
+    place(rArena, rOut.imu.chunkIndex, imuPackets);
+    place(rArena, rOut.imu.timestamp, imuPackets);
+    place(rArena, rOut.imu.accelX, imuSamples);
+    place(rArena, rOut.imu.accelY, imuSamples);
+    place(rArena, rOut.imu.accelZ, imuSamples);
+    place(rArena, rOut.imu.gyroX, imuSamples);
+    place(rArena, rOut.imu.gyroY, imuSamples);
+    place(rArena, rOut.imu.gyroZ, imuSamples);
+    place(rArena, rOut.other.chunkIndex, others);
+    place(rArena, rOut.other.id, others);
+    place(rArena, rOut.other.value, others);
+    for (size_t s = 0; s < rOut.streams.size(); s++)
+    {
+        GenericStream& rStream = rOut.streams[s];
+        place(rArena, rStream.chunkIndex, streamChunks[s]);
+        place(rArena, rStream.valueOffsets, streamChunks[s] + 1);
+        place(rArena, rStream.values, streamValues[s]);
+        rStream.valueOffsets[0] = 0;
+    }
+
+    TimelineGapColumns& rGaps = rOut.timelineGaps;
+    place(rArena, rGaps.kind, gaps.size());
+    place(rArena, rGaps.channel, gaps.size());
+    place(rArena, rGaps.begin, gaps.size());
+    place(rArena, rGaps.end, gaps.size());
+    for (size_t i = 0; i < gaps.size(); i++)
+    {
+        rGaps.kind[i] = static_cast<uint8_t>(gaps[i].kind);
+        rGaps.channel[i] = static_cast<uint8_t>(gaps[i].channel);
+        rGaps.begin[i] = gaps[i].begin;
+        rGaps.end[i] = gaps[i].end;
+        rStats.dropouts += gaps[i].kind == GapKind::DROPOUT ? 1 : 0;
+        rStats.leadOffs += gaps[i].kind == GapKind::LEAD_OFF ? 1 : 0;
+    }
+
+    // Copy log by log, releasing each one as soon as it is in the output
+    size_t ecgPos = 0;
+    size_t imuPos = 0;
+    size_t otherPos = 0;
+    std::vector<size_t> chunkPos(rOut.streams.size(), 0);
+    std::vector<size_t> valuePos(rOut.streams.size(), 0);
+    uint32_t chunkBase = 0;
+    for (const std::unique_ptr<Log>& rLog : mLogs)
+    {
+        Recording& rRec = rLog->recording;
+        copyShifted(rRec.ecg.chunkIndex, rOut.ecg.chunkIndex, ecgPos, chunkBase);
+        copyShifted(rRec.ecg.timestamp, rOut.ecg.timestamp, ecgPos, rLog->offset);
+        copyAt(rRec.ecg.samples, rOut.ecg.samples, ecgPos * ECG_SAMPLES_PER_PACKET);
+        ecgPos += rRec.ecg.packets();
+
+        const size_t imuSample = imuPos * IMU_SAMPLES_PER_PACKET;
+        copyShifted(rRec.imu.chunkIndex, rOut.imu.chunkIndex, imuPos, chunkBase);
+        copyShifted(rRec.imu.timestamp, rOut.imu.timestamp, imuPos, rLog->offset);
+        copyAt(rRec.imu.accelX, rOut.imu.accelX, imuSample);
+        copyAt(rRec.imu.accelY, rOut.imu.accelY, imuSample);
+        copyAt(rRec.imu.accelZ, rOut.imu.accelZ, imuSample);
+        copyAt(rRec.imu.gyroX, rOut.imu.gyroX, imuSample);
+        copyAt(rRec.imu.gyroY, rOut.imu.gyroY, imuSample);
+        copyAt(rRec.imu.gyroZ, rOut.imu.gyroZ, imuSample);
+        imuPos += rRec.imu.packets();
+
+        copyShifted(rRec.other.chunkIndex, rOut.other.chunkIndex, otherPos, chunkBase);
+        copyAt(rRec.other.id, rOut.other.id, otherPos);
+        copyAt(rRec.other.value, rOut.other.value, otherPos);
+        otherPos += rRec.other.size();
+
+        for (const GenericStream& rStream : rRec.streams)
+        {
+            const size_t s = streamSlot[rStream.id];
+            GenericStream& rMerged = rOut.streams[s];
+            copyShifted(rStream.chunkIndex, rMerged.chunkIndex, chunkPos[s], chunkBase);
+            for (size_t c = 0; c < rStream.chunkIndex.size; c++)
+            {
+                rMerged.valueOffsets[chunkPos[s] + c + 1] =
+                    static_cast<uint32_t>(valuePos[s]) + rStream.valueOffsets[c + 1];
+            }
+            copyAt(rStream.values, rMerged.values, valuePos[s]);
+            chunkPos[s] += rStream.chunkIndex.size;
+            valuePos[s] += rStream.values.size;
+        }
+
+        chunkBase += rRec.chunkCount;
+        rOut.chunkCount += rRec.chunkCount;
+        rOut.bytesScanned += rRec.bytesScanned;
+        rOut.truncated = rOut.truncated || rRec.truncated;
+        rRec.clear();
+    }
+    mLogs.clear();
+    return true;
+}
+
+} // namespace sbem
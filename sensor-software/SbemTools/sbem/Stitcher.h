@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Decoder.h"
+#include "Recording.h"
+
+namespace sbem
+{
+
+/** What a stitch read and found. */
+struct StitchStats
+{
+    size_t logs = 0;            // logs stitched
+    size_t duplicates = 0;      // logs dropped because another input is the same log id
+    size_t dropouts = 0;        // GapKind::DROPOUT rows
+    size_t leadOffs = 0;        // GapKind::LEAD_OFF rows
+    size_t resets = 0;          // sensor restarts spliced over
+    size_t corrupt = 0;         // corrupt byte ranges skipped in the inputs
+    uint32_t ecgPeriod = 0;     // ms between consecutive packets the gaps were measured against
+    uint32_t imuPeriod = 0;
+};
+
+/**
+*   Joins the logs of one sensor into one recording on a single timeline.
+*
+*   The Winlogger starts a new log for every lead-on session, and packet
+*   timestamps count ms since the sensor started, so the logs of one power
+*   cycle already share a clock. The stitched recording holds the packets of
+*   every log in log order with their own timestamps, chunk indices counting
+*   on from log to log, and a gap table (Recording::timelineGaps) listing
+*   per channel every stretch without packets:
+*
+*     LEAD_OFF   from the end of one log to the start of the next
+*     DROPOUT    packets missing inside a log
+*     RESET      the sensor restarted between two logs, so its clock went
+*                back; the later logs are moved to start one packet after the
+*                end of the earlier one, as the real length isn't known
+*
+*   Logs are put in log id order when every input has one (the Logbook
+*   numbers logs in the order they were started, across restarts), otherwise
+*   in order of their first packet timestamp. A log id given twice, a log
+*   fetched twice, is stitched once from the larger file.
+*/
+class Stitcher
+{
+public:
+    static constexpr uint32_t NO_LOG_ID = UINT32_MAX;
+
+    Stitcher();
+    ~Stitcher();
+
+    Stitcher(const Stitcher&) = delete;
+    Stitcher& operator=(const Stitcher&) = delete;
+
+    /**
+    *   Decode a log; the decoded data is kept until stitch().
+    *
+    *   @param path SBEM file
+    *   @param logId Logbook id of the log, NO_LOG_ID if unknown
+    *   @param rOptions Decode options
+    *   @return false if the file can't be decoded; error() says which
+    */
+    bool add(const char* path, uint32_t logId, const DecodeOptions& rOptions = DecodeOptions());
+
+    /**
+    *   Merge the added logs. Each log's data is released once it is copied.
+    *
+    *   @param rOut Receives the stitched recording (cleared first)
+    *   @param minGap Shortest gap reported [ms], counted from when the next
+    *          packet was due; 0 for half a packet period
+    *   @param rStats Receives what was stitched
+    *   @return false if no log has packets or the timeline runs past the
+    *           32 bit ms clock (49 days)
+    */
+    bool stitch(Recording& rOut, uint32_t minGap, StitchStats& rStats);
+
+    /** Why add() or stitch() failed. */
+    const std::string& error() const { return mError; }
+
+private:
+    struct Log
+    {
+        std::string path;
+        uint32_t logId;
+        Recording recording;
+        uint32_t first = UINT32_MAX;    // earliest ECG or IMU timestamp, UINT32_MAX without packets
+        uint32_t last = 0;
+        uint32_t offset = 0;            // added to the log's timestamps on the timeline
+        bool reset = false;             // the clock went back since the log before
+    };
+
+    void order(StitchStats& rStats);
+    bool assignOffsets(uint32_t period);
+
+    std::vector<std::unique_ptr<Log>> mLogs;
+    std::string mError;
+};
+
+} // namespace sbem
@@ -0,0 +1,169 @@
+#include "StreamConverter.h"
+
+#include <algorithm>
+#include <memory>
+
+#include "MappedFile.h"
+#include "ThreadPool.h"
+
+namespace sbem
+{
+
+namespace
+{
+
+/** Decoding and formatting take turns, let them share one pool; rpPool keeps it when one is made here. */
+DecodeOptions sharePool(const DecodeOptions& rOptions, CsvOptions& rCsvOptions, std::unique_ptr<ThreadPool>& rpPool)
+{
+    DecodeOptions options = rOptions;
+    if (!options.pPool && !rCsvOptions.pPool)
+    {
+        const unsigned threads = std::max(options.threads ? options.threads : defaultThreadCount(),
+                                          rCsvOptions.threads ? rCsvOptions.threads : defaultThreadCount());
+        if (threads > 1)
+        {
+            rpPool.reset(new ThreadPool(threads - 1));
+            options.pPool = rpPool.get();
+            rCsvOptions.pPool = rpPool.get();
+        }
+    }
+    return options;
+}
+
+void addBatch(StreamStats& rStats, const Recording& rBatch)
+{
+    rStats.chunkCount = rBatch.chunkCount;
+    rStats.ecgPackets += rBatch.ecg.packets();
+    rStats.imuPackets += rBatch.imu.packets();
+    rStats.otherChunks += rBatch.other.size();
+    rStats.batches++;
+    rStats.gaps.insert(rStats.gaps.end(), rBatch.gaps.begin(), rBatch.gaps.end());
+    rStats.truncated = rBatch.truncated;
+}
+
+} // namespace
+
+bool StreamConverter::toCsv(MappedFile& rFile, const char* csvPath, size_t memoryLimit,
+                            const DecodeOptions& rOptions, const CsvOptions& rCsvOptions, StreamStats& rStats,
+                            LodPyramid* pLod)
+{
+    rStats = StreamStats();
+    const size_t batchBytes = std::max(memoryLimit, MIN_MEMORY_LIMIT) / BYTES_PER_LOG_BYTE;
+
+    CsvOptions csvOptions = rCsvOptions;
+    std::unique_ptr<ThreadPool> pPool;
+    const DecodeOptions options = sharePool(rOptions, csvOptions, pPool);
+
+    RecordingShape shape;
+    uint64_t released = 0;
+    {
+        StreamDecoder surveyor(rFile.data(), rFile.size(), options);
+        bool more;
+        do
+        {
+            more = surveyor.survey(shape, batchBytes);
+            rFile.release(released, surveyor.position() - released);
+            released = surveyor.position();
+        }
+        while (more);
+    }
+    rStats.shape = shape;
+
+    CsvStream csv;
+    if (!csv.open(csvPath, shape, csvOptions))
+        return false;
+
+    StreamDecoder decoder(rFile.data(), rFile.size(), options);
+    Recording batch;
+    released = 0;
+    bool ok = true;
+    while (ok && decoder.next(batch, batchBytes))
+    {
+        ok = csv.append(batch);
+        if (pLod)
+            pLod->add(batch);
+        rFile.release(released, decoder.position() - released);
+        released = decoder.position();
+        addBatch(rStats, batch);
+    }
+    return csv.close() && ok;
+}
+
+PushConverter::PushConverter(const char* csvPath, const DecodeOptions& rOptions, const CsvOptions& rCsvOptions,
+                             size_t lossWindow):
+    mPath(csvPath),
+    mCsvOptions(rCsvOptions),
+    mDecoder(sharePool(rOptions, mCsvOptions, mpPool), lossWindow)
+{
+}
+
+PushConverter::~PushConverter()
+{
+}
+
+bool PushConverter::push(uint64_t offset, const uint8_t* pData, size_t size)
+{
+    if (mFinished || !mOk)
+        return false;
+    mDecoder.push(offset, pData, size);
+    if (mDecoder.contiguous() >= mNextBatch)
+    {
+        mNextBatch = mDecoder.contiguous() + BATCH_BYTES;
+        mOk = convert();
+    }
+    return mOk;
+}
+
+bool PushConverter::finish(StreamStats& rStats)
+{
+    bool ok = !mFinished && mOk;
+    mFinished = true;
+    mDecoder.finish();
+    ok = ok && convert();
+
+    // A log that never had every row kind gets the columns of those it had
+    ok = ok && (mOpen || open());
+    ok = mOpen && mCsv.close() && ok;
+    mHeld.clear();
+    rStats = mStats;
+    return ok;
+}
+
+bool PushConverter::convert()
+{
+    std::unique_ptr<Recording> pBatch(mOpen ? nullptr : new Recording());
+    while (mDecoder.next(mOpen ? mBatch : *pBatch))
+    {
+        if (mOpen)
+        {
+            addBatch(mStats, mBatch);
+            if (!mCsv.append(mBatch))
+                return false;
+            continue;
+        }
+
+        const RecordingShape shape = RecordingShape::of(*pBatch);
+        mShape.firstEcg = std::min(mShape.firstEcg, shape.firstEcg);
+        mShape.firstImu = std::min(mShape.firstImu, shape.firstImu);
+        mShape.firstOther = std::min(mShape.firstOther, shape.firstOther);
+        addBatch(mStats, *pBatch);
+        mHeld.push_back(std::move(pBatch));
+        if (mShape.complete() && !open())
+            return false;
+        if (!mOpen)
+            pBatch.reset(new Recording());
+    }
+    return true;
+}
+
+bool PushConverter::open()
+{
+    mOpen = mCsv.open(mPath.c_str(), mShape, mCsvOptions);
+    bool ok = mOpen;
+    for (const std::unique_ptr<Recording>& rpBatch : mHeld)
+        ok = ok && mCsv.append(*rpBatch);
+    mHeld.clear();
+    return ok;
+}
+
+} // namespace sbem
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "CsvWriter.h"
+#include "Decoder.h"
+#include "LodPyramid.h"
+
+namespace sbem
+{
+
+class MappedFile;
+class ThreadPool;
+
+/** What a streamed conversion decoded. */
+struct StreamStats
+{
+    uint32_t chunkCount = 0;
+    size_t ecgPackets = 0;
+    size_t imuPackets = 0;
+    size_t otherChunks = 0;
+    size_t batches = 0;
+    std::vector<Gap> gaps;
+    bool truncated = false;
+    RecordingShape shape;       // row kinds the survey found; empty: nothing to write
+};
+
+/**
+*   SBEM to CSV with memory bounded by a limit instead of by the log.
+*
+*   A survey pass finds the CSV columns, usually within the first chunks
+*   (it walks the whole log only if a row kind never appears). Then a
+*   StreamDecoder decodes batches of chunks that a CsvStream writes out, and
+*   the mapped pages of the log are dropped behind both passes. The output is
+*   byte identical to decoding the whole log and CsvWriter::write.
+*/
+class StreamConverter
+{
+public:
+    /**
+    *   Memory a batch takes per byte of log it covers, at most: the mapped
+    *   log, decoded columns and chunk table, and the CSV text of the samples
+    *   layout. Batches are memoryLimit / BYTES_PER_LOG_BYTE bytes of log.
+    */
+    static constexpr size_t BYTES_PER_LOG_BYTE = 24;
+
+    /** Smallest limit honoured; below it the fixed buffers of the writer dominate. */
+    static constexpr size_t MIN_MEMORY_LIMIT = 4 << 20;
+
+    /**
+    *   @param rFile Mapped SBEM file; its pages are released as batches complete
+    *   @param csvPath Output CSV path
+    *   @param memoryLimit Bytes of memory the conversion may use
+    *   @param rOptions Decode options; pIndex is ignored
+    *   @param rCsvOptions Layout, float format and threading
+    *   @param rStats Receives what was decoded
+    *   @param pLod If set, every batch is added to it as well
+    *   @return false if the log has no rows to write or the CSV can't be written
+    */
+    static bool toCsv(MappedFile& rFile, const char* csvPath, size_t memoryLimit, const DecodeOptions& rOptions,
+                      const CsvOptions& rCsvOptions, StreamStats& rStats, LodPyramid* pLod = nullptr);
+};
+
+/**
+*   SBEM to CSV while the log downloads. Notification fragments go to a
+*   PushDecoder and the chunks it decodes are written by a CsvStream every
+*   BATCH_BYTES of contiguous log, so the CSV is complete moments after the
+*   last fragment instead of a conversion's time after it.
+*
+*   The CSV columns follow from the shape of the whole log, so batches are
+*   held in memory until every row kind has appeared or the log is
+*   complete; logs without some row kind are held whole, which for a
+*   Movesense log is a few MB. The output is byte identical to converting
+*   the file the fragments make.
+*/
+class PushConverter
+{
+public:
+    /** Contiguous log decoded and written at a time. */
+    static constexpr size_t BATCH_BYTES = 64 << 10;
+
+    /**
+    *   @param csvPath Output CSV path
+    *   @param rOptions Decode options; pIndex is ignored
+    *   @param rCsvOptions Layout, float format and threading
+    *   @param lossWindow See PushDecoder
+    */
+    PushConverter(const char* csvPath, const DecodeOptions& rOptions = DecodeOptions(),
+                  const CsvOptions& rCsvOptions = CsvOptions(), size_t lossWindow = PushDecoder::LOSS_WINDOW);
+    ~PushConverter();
+
+    PushConverter(const PushConverter&) = delete;
+    PushConverter& operator=(const PushConverter&) = delete;
+
+    /**
+    *   Add a fragment of the log, see PushDecoder::push().
+    *
+    *   @return false after finish() or once the CSV can't be written
+    */
+    bool push(uint64_t offset, const uint8_t* pData, size_t size);
+
+    /**
+    *   The log is complete: decode and write the rest and close the CSV.
+    *
+    *   @param rStats Receives what was decoded
+    *   @return false if the log has no rows to write or the CSV can't be written
+    */
+    bool finish(StreamStats& rStats);
+
+    /** The decoder, for its progress. */
+    const PushDecoder& decoder() const { return mDecoder; }
+
+private:
+    bool convert();
+    bool open();
+
+    std::string mPath;
+    CsvOptions mCsvOptions;
+    std::unique_ptr<ThreadPool> mpPool;
+    PushDecoder mDecoder;
+    CsvStream mCsv;
+    RecordingShape mShape;
+    std::vector<std::unique_ptr<Recording>> mHeld;  // decoded before the shape was known
+    Recording mBatch;
+    StreamStats mStats;
+    uint64_t mNextBatch = BATCH_BYTES;
+    bool mOpen = false;
+    bool mOk = true;
+    bool mFinished = false;
+};
+
+} // namespace sbem
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+namespace sbem
+{
+
+/** Growable character buffer that formatters write into directly. */
+class TextBuffer
+{
+public:
+    TextBuffer():
+        mSize(0),
+        mCapacity(0)
+    {
+    }
+
+    /**
+    *   @param bytes Characters about to be written
+    *   @return Write position with room for bytes characters; finish with commit()
+    */
+    char* room(size_t bytes)
+    {
+        if (mSize + bytes > mCapacity)
+            grow(mSize + bytes);
+        return mData.get() + mSize;
+    }
+
+    void commit(const char* pEnd) { mSize = pEnd - mData.get(); }
+
+    void put(char c)
+    {
+        *room(1) = c;
+        mSize++;
+    }
+
+    void put(const char* s, size_t length)
+    {
+        memcpy(room(length), s, length);
+        mSize += length;
+    }
+
+    template <size_t N>
+    void put(const char (&s)[N])
+    {
+        put(s, N - 1);
+    }
+
+    void putUInt(uint64_t v)
+    {
+        char* p = room(24);
+        commit(std::to_chars(p, p + 24, v).ptr);
+    }
+
+    /** Integer cell of a column pandas holds as float64 because some rows lack it. */
+    void putUIntAsFloat(uint64_t v)
+    {
+        putUInt(v);
+        put(".0");
+    }
+
+    const char* data() const { return mData.get(); }
+    size_t size() const { return mSize; }
+    void clear() { mSize = 0; }
+
+private:
+    void grow(size_t needed)
+    {
+        const size_t capacity = std::max(needed, std::max<size_t>(mCapacity * 2, 64 * 1024));
+        std::unique_ptr<char[]> data(new char[capacity]);
+        if (mSize)
+            memcpy(data.get(), mData.get(), mSize);
+        mData = std::move(data);
+        mCapacity = capacity;
+    }
+
+    std::unique_ptr<char[]> mData;
+    size_t mSize;
+    size_t mCapacity;
+};
+
+} // namespace sbem
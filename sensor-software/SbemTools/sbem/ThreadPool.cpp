@@ -0,0 +1,146 @@
+#include "ThreadPool.h"
+
+namespace sbem
+{
+
+namespace
+{
+thread_local const ThreadPool* tlsPool = nullptr;
+thread_local int tlsWorker = -1;
+}
+
+ThreadPool::ThreadPool(unsigned workers):
+    mQueues(workers ? workers : 1),
+    mQueued(0),
+    mNextQueue(0),
+    mStop(false)
+{
+    mWorkers.reserve(workers);
+    for (unsigned i = 0; i < workers; i++)
+        mWorkers.emplace_back(&ThreadPool::workerLoop, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mSleepMutex);
+        mStop = true;
+    }
+    mWake.notify_all();
+    for (std::thread& t : mWorkers)
+        t.join();
+}
+
+int ThreadPool::currentWorker() const
+{
+    return tlsPool == this ? tlsWorker : -1;
+}
+
+void ThreadPool::submit(TaskGroup& rGroup, std::function<void()> task)
+{
+    rGroup.mPending.fetch_add(1);
+
+    // Count before publishing so a thief never decrements below zero
+    mQueued.fetch_add(1);
+    const int self = currentWorker();
+    const unsigned q = self >= 0 ? static_cast<unsigned>(self) : mNextQueue.fetch_add(1) % mQueues.size();
+    {
+        std::lock_guard<std::mutex> lock(mQueues[q].mutex);
+        mQueues[q].tasks.push_back({ std::move(task), &rGroup });
+    }
+
+    // Taking the lock orders this against a sleeper checking mQueued
+    {
+        std::lock_guard<std::mutex> lock(mSleepMutex);
+    }
+    mWake.notify_one();
+}
+
+bool ThreadPool::take(int self, Task& rTask)
+{
+    if (mQueued.load() == 0)
+        return false;
+
+    // Own deque first, newest task (its data is still in cache)
+    if (self >= 0)
+    {
+        Queue& own = mQueues[self];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty())
+        {
+            rTask = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            mQueued.fetch_sub(1);
+            return true;
+        }
+    }
+
+    // Steal the oldest task of someone else, it is usually the biggest
+    const size_t n = mQueues.size();
+    const size_t start = self >= 0 ? static_cast<size_t>(self) + 1 : 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        const size_t victim = (start + i) % n;
+        if (static_cast<int>(victim) == self)
+            continue;
+
+        Queue& q = mQueues[victim];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        if (!q.tasks.empty())
+        {
+            rTask = std::move(q.tasks.front());
+            q.tasks.pop_front();
+            mQueued.fetch_sub(1);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ThreadPool::runOne(int self)
+{
+    Task task;
+    if (!take(self, task))
+        return false;
+
+    task.fn();
+
+    if (task.pGroup->mPending.fetch_sub(1) == 1)
+    {
+        std::lock_guard<std::mutex> lock(mSleepMutex);
+        mWake.notify_all();
+    }
+    return true;
+}
+
+void ThreadPool::workerLoop(unsigned index)
+{
+    tlsPool = this;
+    tlsWorker = static_cast<int>(index);
+
+    for (;;)
+    {
+        if (runOne(tlsWorker))
+            continue;
+
+        std::unique_lock<std::mutex> lock(mSleepMutex);
+        mWake.wait(lock, [this]() { return mStop || mQueued.load() > 0; });
+        if (mStop && mQueued.load() == 0)
+            return;
+    }
+}
+
+void ThreadPool::wait(TaskGroup& rGroup)
+{
+    const int self = currentWorker();
+    while (rGroup.mPending.load() > 0)
+    {
+        if (runOne(self))
+            continue;
+
+        std::unique_lock<std::mutex> lock(mSleepMutex);
+        mWake.wait(lock, [&]() { return rGroup.mPending.load() == 0 || mQueued.load() > 0; });
+    }
+}
+
+} // namespace sbem
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace sbem
+{
+
+/** Worker count to use when the caller passes 0. */
+inline unsigned defaultThreadCount()
+{
+    const unsigned n = std::thread::hardware_concurrency();
+    return n ? n : 1;
+}
+
+/** Set of tasks a caller can wait for. */
+class TaskGroup
+{
+public:
+    TaskGroup(): mPending(0) {}
+
+private:
+    friend class ThreadPool;
+    std::atomic<size_t> mPending;
+};
+
+/**
+*   Work-stealing thread pool.
+*
+*   Every worker owns a deque: it pushes and pops its own tasks at the back and
+*   idle workers steal from the front of the others. Tasks may submit more
+*   tasks and wait for them; a waiting thread keeps running queued tasks
+*   instead of blocking, so nested waits never deadlock. Threads that are not
+*   pool workers help too while they wait.
+*/
+class ThreadPool
+{
+public:
+    /**
+    *   @param workers Background threads. 0 is valid: wait() then runs every
+    *                  task on the waiting thread.
+    */
+    explicit ThreadPool(unsigned workers);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /** Threads that run tasks while someone waits: the workers plus the waiter. */
+    unsigned concurrency() const { return static_cast<unsigned>(mWorkers.size()) + 1; }
+
+    /**
+    *   Queue a task. From a worker it goes to that worker's own deque,
+    *   otherwise round robin.
+    */
+    void submit(TaskGroup& rGroup, std::function<void()> task);
+
+    /** Run queued tasks until every task of the group has finished. */
+    void wait(TaskGroup& rGroup);
+
+private:
+    struct Task
+    {
+        std::function<void()> fn;
+        TaskGroup* pGroup;
+    };
+
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void workerLoop(unsigned index);
+    bool runOne(int self);
+    bool take(int self, Task& rTask);
+    int currentWorker() const;
+
+    std::vector<std::thread> mWorkers;
+    std::vector<Queue> mQueues;
+    std::atomic<size_t> mQueued;
+    std::atomic<unsigned> mNextQueue;
+    std::mutex mSleepMutex;
+    std::condition_variable mWake;
+    bool mStop;
+};
+
+/**
+*   Run fn(begin, end) over [0, count) as stealable blocks on the pool and
+*   wait for them. The calling thread takes part.
+*
+*   @param rPool Pool to run on
+*   @param count Number of items
+*   @param fn Callable taking (size_t begin, size_t end)
+*/
+template <typename Fn>
+void parallelFor(ThreadPool& rPool, size_t count, Fn fn)
+{
+    if (count == 0)
+        return;
+    if (rPool.concurrency() <= 1 || count < 2)
+    {
+        fn(size_t(0), count);
+        return;
+    }
+
+    // Several blocks per thread so a thread that finishes early can steal
+    const size_t blockSize = std::max<size_t>(1, count / (rPool.concurrency() * 8));
+    TaskGroup group;
+    for (size_t begin = 0; begin < count; begin += blockSize)
+    {
+        const size_t end = std::min(count, begin + blockSize);
+        rPool.submit(group, [&fn, begin, end]() { fn(begin, end); });
+    }
+    rPool.wait(group);
+}
+
+} // namespace sbem
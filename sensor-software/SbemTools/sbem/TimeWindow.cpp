@@ -0,0 +1,113 @@
+#include "TimeWindow.h"
+
+#include <algorithm>
+
+namespace sbem
+{
+
+namespace
+{
+
+/** Packets [rFirst, rEnd) of a channel that overlap [begin, end). */
+void packetRange(const Column<uint32_t>& rTimestamps, uint32_t begin, uint32_t end, size_t& rFirst, size_t& rEnd)
+{
+    const uint32_t* ts = rTimestamps.begin();
+    const size_t n = rTimestamps.size;
+
+    // The packet before the first one after begin is still running at begin, unless it is the last one
+    const size_t after = std::upper_bound(ts, ts + n, begin) - ts;
+    rFirst = after > 0 && (after < n || ts[after - 1] == begin) ? after - 1 : after;
+    rEnd = std::max(rFirst, static_cast<size_t>(std::lower_bound(ts, ts + n, end) - ts));
+}
+
+template <typename T>
+void narrow(Column<T>& rColumn, size_t first, size_t end, size_t perPacket)
+{
+    if (!rColumn.data)
+        return;
+    rColumn.data += first * perPacket;
+    rColumn.size = (end - first) * perPacket;
+}
+
+/** Entries [rFirst, rEnd) of an ascending chunk index column inside [chunkBegin, chunkEnd). */
+void chunkSpan(const Column<uint32_t>& rChunks, uint32_t chunkBegin, uint32_t chunkEnd, size_t& rFirst, size_t& rEnd)
+{
+    rFirst = std::lower_bound(rChunks.begin(), rChunks.end(), chunkBegin) - rChunks.begin();
+    rEnd = std::max(rFirst, static_cast<size_t>(std::lower_bound(rChunks.begin(), rChunks.end(), chunkEnd) -
+                                                rChunks.begin()));
+}
+
+uint32_t saturatingAdd(uint32_t a, uint32_t b)
+{
+    return a > UINT32_MAX - b ? UINT32_MAX : a + b;
+}
+
+} // namespace
+
+void TimeWindow::chunkRange(const ChunkIndex& rIndex, size_t& rFirst, size_t& rEnd) const
+{
+    rFirst = rIndex.lowerBound(begin > CHANNEL_SLACK_MS ? begin - CHANNEL_SLACK_MS : 0);
+    rEnd = std::max(rFirst, rIndex.lowerBound(saturatingAdd(end, CHANNEL_SLACK_MS)));
+}
+
+void TimeWindow::trim(Recording& rRecording) const
+{
+    EcgColumns& rEcg = rRecording.ecg;
+    ImuColumns& rImu = rRecording.imu;
+
+    size_t ecgFirst;
+    size_t ecgEnd;
+    packetRange(rEcg.timestamp, begin, end, ecgFirst, ecgEnd);
+    size_t imuFirst;
+    size_t imuEnd;
+    packetRange(rImu.timestamp, begin, end, imuFirst, imuEnd);
+
+    // Other chunks carry no time of their own, keep those logged among the kept packets
+    uint32_t chunkBegin = UINT32_MAX;
+    uint32_t chunkEnd = 0;
+    if (ecgFirst < ecgEnd)
+    {
+        chunkBegin = std::min(chunkBegin, rEcg.chunkIndex[ecgFirst]);
+        chunkEnd = std::max(chunkEnd, rEcg.chunkIndex[ecgEnd - 1] + 1);
+    }
+    if (imuFirst < imuEnd)
+    {
+        chunkBegin = std::min(chunkBegin, rImu.chunkIndex[imuFirst]);
+        chunkEnd = std::max(chunkEnd, rImu.chunkIndex[imuEnd - 1] + 1);
+    }
+
+    narrow(rEcg.chunkIndex, ecgFirst, ecgEnd, 1);
+    narrow(rEcg.timestamp, ecgFirst, ecgEnd, 1);
+    narrow(rEcg.samples, ecgFirst, ecgEnd, ECG_SAMPLES_PER_PACKET);
+
+    narrow(rImu.chunkIndex, imuFirst, imuEnd, 1);
+    narrow(rImu.timestamp, imuFirst, imuEnd, 1);
+    narrow(rImu.accelX, imuFirst, imuEnd, IMU_SAMPLES_PER_PACKET);
+    narrow(rImu.accelY, imuFirst, imuEnd, IMU_SAMPLES_PER_PACKET);
+    narrow(rImu.accelZ, imuFirst, imuEnd, IMU_SAMPLES_PER_PACKET);
+    narrow(rImu.gyroX, imuFirst, imuEnd, IMU_SAMPLES_PER_PACKET);
+    narrow(rImu.gyroY, imuFirst, imuEnd, IMU_SAMPLES_PER_PACKET);
+    narrow(rImu.gyroZ, imuFirst, imuEnd, IMU_SAMPLES_PER_PACKET);
+
+    size_t first;
+    size_t last;
+    OtherColumns& rOther = rRecording.other;
+    chunkSpan(rOther.chunkIndex, chunkBegin, chunkEnd, first, last);
+    narrow(rOther.chunkIndex, first, last, 1);
+    narrow(rOther.id, first, last, 1);
+    narrow(rOther.value, first, last, 1);
+
+    // Value offsets stay absolute into the untouched values column
+    for (GenericStream& rStream : rRecording.streams)
+    {
+        chunkSpan(rStream.chunkIndex, chunkBegin, chunkEnd, first, last);
+        narrow(rStream.chunkIndex, first, last, 1);
+        if (rStream.valueOffsets.data)
+        {
+            rStream.valueOffsets.data += first;
+            rStream.valueOffsets.size = last - first + 1;
+        }
+    }
+}
+
+} // namespace sbem
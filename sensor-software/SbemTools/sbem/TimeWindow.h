@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "ChunkIndex.h"
+#include "Recording.h"
+
+namespace sbem
+{
+
+/**
+*   Half-open range of sensor time, in the ms of the packet timestamps.
+*
+*   A packet covers the time from its timestamp up to the next packet of its
+*   channel, so a window keeps every packet that overlaps it, including the
+*   one already running when the window begins.
+*/
+struct TimeWindow
+{
+    uint32_t begin;
+    uint32_t end;
+
+    /**
+    *   ECG and IMU packets are logged interleaved and each channel stamps its
+    *   own packets, so neighbouring chunks can be this far out of time order.
+    */
+    static constexpr uint32_t CHANNEL_SLACK_MS = 1000;
+
+    /**
+    *   Chunks to decode for the window: found by binary search on the packet
+    *   timestamps of the index, widened by the packet running at begin and
+    *   by CHANNEL_SLACK_MS. trim() cuts the decoded recording back exactly.
+    *
+    *   @param rIndex Index of the file
+    *   @param rFirst Receives the first chunk
+    *   @param rEnd Receives one past the last chunk
+    */
+    void chunkRange(const ChunkIndex& rIndex, size_t& rFirst, size_t& rEnd) const;
+
+    /**
+    *   Narrow the columns of a decoded recording to the packets overlapping
+    *   the window, and the other chunks and streams to the chunks between
+    *   them. Only the column views change, no data moves.
+    *
+    *   @param rRecording Recording decoded from (at least) chunkRange()
+    */
+    void trim(Recording& rRecording) const;
+};
+
+} // namespace sbem
@@ -0,0 +1,198 @@
+#include "WfdbWriter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "ColumnarWriter.h"
+#include "OutputFile.h"
+#include "PacketSlots.h"
+
+namespace sbem
+{
+
+namespace
+{
+
+constexpr size_t FLUSH_BYTES = 1 << 20;
+
+/** Packs samples into a signal file in format 16 or 212. */
+class SignalFile
+{
+public:
+    SignalFile(OutputFile& rFile, int format): mFile(rFile), mFormat(format)
+    {
+        mBuffer.reserve(FLUSH_BYTES + 4);
+    }
+
+    void put(int sample)
+    {
+        mChecksum += sample;
+        if (mFormat == 16)
+        {
+            mBuffer.push_back(static_cast<uint8_t>(sample & 0xFF));
+            mBuffer.push_back(static_cast<uint8_t>((sample >> 8) & 0xFF));
+        }
+        else if (!mHalf)
+        {
+            mPending = sample;
+            mHalf = true;
+        }
+        else
+        {
+            // Low byte of the first, the high nibbles of both, low byte of the second
+            mBuffer.push_back(static_cast<uint8_t>(mPending & 0xFF));
+            mBuffer.push_back(static_cast<uint8_t>(((mPending >> 8) & 0x0F) | ((sample >> 4) & 0xF0)));
+            mBuffer.push_back(static_cast<uint8_t>(sample & 0xFF));
+            mHalf = false;
+        }
+        if (mBuffer.size() >= FLUSH_BYTES)
+            flush();
+    }
+
+    /** Write what is buffered; a last odd 212 sample takes two bytes. */
+    bool finish()
+    {
+        if (mHalf)
+        {
+            mBuffer.push_back(static_cast<uint8_t>(mPending & 0xFF));
+            mBuffer.push_back(static_cast<uint8_t>((mPending >> 8) & 0x0F));
+            mHalf = false;
+        }
+        flush();
+        return mOk;
+    }
+
+    /** The header's checksum: the sum of the samples as a signed 16 bit number. */
+    int checksum() const { return static_cast<int16_t>(static_cast<uint16_t>(mChecksum & 0xFFFF)); }
+
+private:
+    void flush()
+    {
+        mOk = mOk && mFile.write(mBuffer.data(), mBuffer.size());
+        mBuffer.clear();
+    }
+
+    OutputFile& mFile;
+    int mFormat;
+    std::vector<uint8_t> mBuffer;
+    int64_t mChecksum = 0;
+    int mPending = 0;
+    bool mHalf = false;
+    bool mOk = true;
+};
+
+} // namespace
+
+bool WfdbWriter::write(const Recording& rRecording, const char* basePath, const WfdbOptions& rOptions,
+                       WfdbStats& rStats)
+{
+    rStats = WfdbStats();
+    const EcgColumns& rEcg = rRecording.ecg;
+    if (!rEcg.packets() || (rOptions.format != 16 && rOptions.format != 212))
+        return false;
+
+    const double rate =
+        ColumnarWriter::rateFromPath(ColumnarWriter::channelPath(rRecording.descriptors, PacketKind::ECG_MV));
+    if (rate <= 0.0)
+        return false;
+
+    // The lowest value of each format marks a missing sample
+    const int invalid = rOptions.format == 16 ? -32768 : -2048;
+    const int top = rOptions.format == 16 ? 32767 : 2047;
+
+    // Gain and baseline that spread the mV range over the valid adu range
+    double lo = INFINITY;
+    double hi = -INFINITY;
+    for (float v : rEcg.samples)
+    {
+        if (std::isfinite(v))
+        {
+            lo = std::min<double>(lo, v);
+            hi = std::max<double>(hi, v);
+        }
+    }
+    if (lo > hi)
+    {
+        lo = 0.0;
+        hi = 0.0;
+    }
+    const double span = std::max(hi - lo, 1e-3);
+    char text[64];
+    snprintf(text, sizeof(text), "%.6g", 2.0 * (top - 1) / span);
+    const double gain = atof(text);
+    const int baseline = static_cast<int>(std::lround(-(lo + hi) / 2.0 * gain));
+    rStats.gain = gain;
+    rStats.baseline = baseline;
+
+    const std::string base = basePath;
+    const size_t slash = base.find_last_of('/');
+    const std::string record = slash == std::string::npos ? base : base.substr(slash + 1);
+    const std::string datName = record + ".dat";
+
+    OutputFile dat;
+    if (!dat.open((base + ".dat").c_str()))
+        return false;
+    SignalFile signal(dat, rOptions.format);
+
+    // One pass over the packets, filling the slots between them with the invalid value
+    const size_t perPacket = ECG_SAMPLES_PER_PACKET;
+    uint64_t next = 0;
+    int first = invalid;
+    for (PacketSlots slots(rEcg.timestamp, perPacket, rate, rEcg.timestamp[0]); slots.valid(); slots.advance())
+    {
+        const size_t p = slots.packet();
+        const uint64_t slot = static_cast<uint64_t>(slots.slot());
+        for (; next < slot; next++)
+        {
+            signal.put(invalid);
+            rStats.missing++;
+        }
+        for (size_t k = 0; k < perPacket; k++)
+        {
+            const float v = rEcg.samples[p * perPacket + k];
+            int adu = invalid;
+            if (std::isfinite(v))
+                adu = static_cast<int>(std::min<double>(std::max<double>(std::round(v * gain) + baseline, -top),
+                                                        top));
+            else
+                rStats.missing++;
+            if (next == 0)
+                first = adu;
+            signal.put(adu);
+            next++;
+        }
+    }
+    rStats.samples = next;
+    bool ok = signal.finish();
+    ok = dat.close() && ok;
+    if (!ok)
+        return false;
+
+    // Record line, then the signal line: file format gain(baseline)/units resolution zero first checksum block
+    snprintf(text, sizeof(text), " 1 %g ", rate);
+    std::string header = record + text + std::to_string(next);
+    if (rOptions.haveStart)
+    {
+        const uint64_t s = rOptions.clockMs / 1000;
+        snprintf(text, sizeof(text), " %02u:%02u:%02u.%03u %02d/%02d/%04d", static_cast<unsigned>(s / 3600 % 24),
+                 static_cast<unsigned>(s / 60 % 60), static_cast<unsigned>(s % 60),
+                 static_cast<unsigned>(rOptions.clockMs % 1000), rOptions.day, rOptions.month, rOptions.year);
+        header += text;
+    }
+    header += "\n";
+    snprintf(text, sizeof(text), " %d %.6g(%d)/mV %d 0 ", rOptions.format, gain, baseline,
+             rOptions.format == 16 ? 16 : 12);
+    header += datName + text + std::to_string(first) + " " + std::to_string(signal.checksum()) + " 0 ECG\n";
+
+    FILE* pFile = fopen((base + ".hea").c_str(), "w");
+    if (!pFile)
+        return false;
+    ok = fwrite(header.data(), 1, header.size(), pFile) == header.size();
+    return fclose(pFile) == 0 && ok;
+}
+
+} // namespace sbem
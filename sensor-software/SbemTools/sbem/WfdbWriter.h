@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "Recording.h"
+
+namespace sbem
+{
+
+struct WfdbOptions
+{
+    /** Signal file format: 16 (16 bit samples) or 212 (two 12 bit samples in 3 bytes). */
+    int format = 16;
+
+    /** Wall clock of the first sample for the header, as in EdfOptions; left out when unknown. */
+    bool haveStart = false;
+    int year = 1985;
+    int month = 1;
+    int day = 1;
+    uint64_t clockMs = 0;       // ms after midnight
+};
+
+struct WfdbStats
+{
+    uint64_t samples = 0;       // per signal, missing ones included
+    uint64_t missing = 0;       // written as the invalid sample value
+    double gain = 0.0;          // adu per mV
+    int baseline = 0;
+};
+
+/**
+*   Writes the ECG of a Recording as a WFDB (PhysioNet) record: <base>.hea
+*   and the signal file <base>.dat, for the WFDB toolbox and wfdb-python.
+*
+*   The gain and baseline map the recording's mV range onto the sample
+*   range of the format, so the samples keep the most precision they can:
+*   mV = (adu - baseline) / gain. Samples are placed from the first packet
+*   on, each packet right after the one before unless the timestamps show a
+*   gap (see PacketSlots); slots no packet fills (dropouts,
+*   the lead-off between stitched logs) hold the format's invalid sample
+*   value, which the toolbox reads as NaN. Packets that go back in time
+*   are dropped, as in EdfWriter.
+*
+*   The signal file is written in one pass over the samples through a
+*   fixed buffer, so a day long record costs no memory and writes at disk
+*   speed.
+*/
+class WfdbWriter
+{
+public:
+    /**
+    *   @param rRecording Decoded data, possibly stitched
+    *   @param basePath Output path without extension; its file name is the record name
+    *   @param rOptions Format and start time
+    *   @param rStats Receives the samples and scaling written
+    *   @return false if there is no ECG, the format isn't 16 or 212 or the files can't be written
+    */
+    static bool write(const Recording& rRecording, const char* basePath, const WfdbOptions& rOptions,
+                      WfdbStats& rStats);
+};
+
+} // namespace sbem
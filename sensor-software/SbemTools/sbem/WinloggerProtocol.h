@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace sbem
+{
+
+/**
+*   The Winlogger's GATT command protocol (sensor-software/Winlogger).
+*
+*   The client writes [command][reference][data] to the write characteristic.
+*   The sensor answers on the notify characteristic with [response][reference]
+*   and a payload; log data comes as [DATA or DATA_PART2][reference][u32 offset]
+*   [bytes], at most DATA_PART_SIZE bytes a notification. A DATA notification
+*   without bytes, at offset = log size, ends a FETCH_LOG.
+*/
+namespace winlogger
+{
+
+enum Command : uint8_t
+{
+    HELLO = 0,              // clear the logbook and power off; answered COMMAND_RESULT "POWER"
+    SUBSCRIBE = 1,          // data: resource path; streams its values as DATA notifications
+    UNSUBSCRIBE = 2,
+    FETCH_LOG = 3,          // data: u32 log id; an unknown id gets no answer at all
+    INIT_OFFLINE = 4,
+    GET_LOG_COUNT = 5,
+    STOP_LOGGING = 6        // answered COMMAND_RESULT 0
+};
+
+enum Response : uint8_t
+{
+    COMMAND_RESULT = 1,
+    DATA = 2,
+    DATA_PART2 = 3,         // the rest of a logbook read that didn't fit one notification
+    DATA_PART3 = 4
+};
+
+/** [response][reference][u32 offset] */
+constexpr size_t FRAME_HEADER = 6;
+
+/** Log bytes per notification; a logbook read is split into a DATA and a DATA_PART2 notification. */
+constexpr size_t DATA_PART_SIZE = 150;
+
+/** Reference byte the extractor sends its commands with. */
+constexpr uint8_t CLIENT_REFERENCE = 101;
+
+/**
+*   Simulated GATT link (tools/sbemsim): a SOCK_SEQPACKET Unix socket per
+*   sensor, one message per ATT packet, the first byte saying which.
+*/
+enum LinkOp : uint8_t
+{
+    LINK_WRITE = 1,             // client: a write to the write characteristic, the command follows
+    LINK_WRITE_RESPONSE = 2,    // sensor: the write is acknowledged
+    LINK_NOTIFY = 3             // sensor: a notification, its value follows
+};
+
+/** Socket file of a simulated sensor in the simulator's folder: <serial>.sock */
+constexpr const char* LINK_SUFFIX = ".sock";
+
+} // namespace winlogger
+
+} // namespace sbem
@@ -0,0 +1,119 @@
+#!/usr/bin/env python3
+"""
+sbemcol_test.py
+
+Checks sbemcol.py against converter.py: the log converted with
+`sbem2csv --columnar` reads back with the values of converter.py's CSV.
+With --zstd, so does the compressed .sbcol.zst, read through sbem_native.
+lod_window() of the `--lod` pyramid gives the bins of the ECG samples.
+Run by ctest with sbemcol.py and sbem_native on PYTHONPATH:
+
+    sbemcol_test.py <sbem2csv> <log.sbem> <converter.csv> [--zstd]
+"""
+
+import ast
+import csv
+import os
+import subprocess
+import sys
+import tempfile
+
+import numpy as np
+
+from sbemcol import load_sbcol, lod_window
+
+AXES = ("x", "y", "z")
+
+
+def read_converter_csv(csv_path):
+    """Timestamps and samples of converter.py's ECG and IMU rows, as the float32 the sensor logged."""
+    ecg_ts, ecg, imu_ts = [], [], []
+    imu = {f"{kind}_{axis}": [] for kind in ("acc", "gyro") for axis in AXES}
+    with open(csv_path, newline="") as f:
+        for row in csv.DictReader(f):
+            if row["group"] == "ECGmV":
+                ecg_ts.append(int(row["TIMESTAMP"]))
+                ecg.extend(ast.literal_eval(row["SAMPLES"]))
+            elif row["group"] == "IMU":
+                imu_ts.append(int(row["TIMESTAMP"]))
+                for kind, column in (("acc", "ACCEL"), ("gyro", "GYRO")):
+                    for sample in ast.literal_eval(row[column]):
+                        for axis in AXES:
+                            imu[f"{kind}_{axis}"].append(sample[axis])
+    expected = {"ecg.timestamp": np.array(ecg_ts, dtype=np.uint32),
+                "ecg.samples": np.array(ecg, dtype=np.float32),
+                "imu.timestamp": np.array(imu_ts, dtype=np.uint32)}
+    for name, values in imu.items():
+        expected["imu." + name] = np.array(values, dtype=np.float32)
+    return expected
+
+
+def check_columns(rec, expected):
+    """Names of the columns that differ from the expected arrays."""
+    return [name for name, values in expected.items()
+            if name not in rec or not np.array_equal(np.asarray(rec[name]), values)]
+
+
+def pyramid_level(timestamps, samples, per_packet, bin_samples):
+    """Time, min, max and mean of every bin_samples samples, the last bin partial."""
+    starts = np.arange(0, len(samples), bin_samples)
+    return (timestamps[starts // per_packet], np.minimum.reduceat(samples, starts),
+            np.maximum.reduceat(samples, starts), np.add.reduceat(samples.astype(np.float64), starts) /
+            np.diff(np.append(starts, len(samples))))
+
+
+def check_lod(lod, expected):
+    """What is wrong with the ECG windows of the pyramid, at the level each range and width call for."""
+    failures = []
+    timestamps, samples = expected["ecg.timestamp"], expected["ecg.samples"]
+    # 125 packets: the whole log at 100 pixels takes the 16 sample bins, packets 40 to 80 at 8 pixels the 64
+    for t0, t1, pixels, bin_samples in ((timestamps[0], timestamps[-1], 100, 16),
+                                        (timestamps[40], timestamps[80], 8, 64)):
+        time, low, high, mean = lod_window(lod, "ecg.samples", t0, t1, pixels)
+        level = pyramid_level(timestamps, samples, 16, bin_samples)
+        begin = int(np.searchsorted(level[0], t0, side="right")) - 1
+        end = int(np.searchsorted(level[0], t1, side="right"))
+        if (not np.array_equal(time, level[0][begin:end]) or not np.array_equal(low, level[1][begin:end]) or
+                not np.array_equal(high, level[2][begin:end]) or not np.allclose(mean, level[3][begin:end], atol=1e-5)):
+            failures.append(f"lod_window {t0}..{t1} at {pixels} pixels")
+    try:
+        lod_window(lod, "ecg.missing", timestamps[0], timestamps[-1], 100)
+        failures.append("lod_window of a missing channel")
+    except KeyError:
+        pass
+    return failures
+
+
+def main():
+    if len(sys.argv) not in (4, 5) or sys.argv[4:] not in ([], ["--zstd"]):
+        print(__doc__)
+        return 1
+    sbem2csv, log_path, csv_path = sys.argv[1:4]
+    expected = read_converter_csv(csv_path)
+    name = os.path.splitext(os.path.basename(log_path))[0]
+    variants = [(["--lod"], ".sbcol")] + ([(["--zstd"], ".sbcol.zst")] if sys.argv[4:] else [])
+
+    failures = []
+    with tempfile.TemporaryDirectory() as out_dir:
+        for flags, extension in variants:
+            subprocess.run([sbem2csv, "--columnar", "--no-index"] + flags + [log_path, out_dir], check=True,
+                           stdout=subprocess.DEVNULL)
+            out_name = name + extension
+            rec = load_sbcol(os.path.join(out_dir, out_name))
+            failures += [f"{out_name}: {column}" for column in check_columns(rec, expected)]
+            if rec.info("ecg.samples").sample_rate != 200 or rec.info("imu.acc_x").values_per_packet != 2:
+                failures.append(f"{out_name}: rates")
+            times = rec.sample_times("ecg")
+            if len(times) != len(expected["ecg.samples"]) or times[1] - times[0] != 5.0:
+                failures.append(f"{out_name}: ecg sample times")
+            if "--lod" in flags:
+                failures += check_lod(load_sbcol(os.path.join(out_dir, name + ".lod.sbcol")), expected)
+
+    for failure in failures:
+        print(failure, file=sys.stderr)
+    print(f"sbemcol: {'FAILED' if failures else 'ok'}")
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
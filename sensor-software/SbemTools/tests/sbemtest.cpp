@@ -0,0 +1,1511 @@
+// sbemtest: checks of the decoders, the reassembler and the writers on synthetic logs, run by ctest
+//
+//   sbemtest <case>    runs one case and exits 1 if any of its checks fails
+//
+// tests/data/synthetic_10s.sbem is `sbemgen --duration 10s --seed 1`, and synthetic_10s.csv is what
+// converter.py writes for it on its pure Python path (sbem_native blocked, as sbembench --baseline does).
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "sbem/ChunkIndex.h"
+#include "sbem/ClockAligner.h"
+#include "sbem/ColumnarReader.h"
+#include "sbem/ColumnarWriter.h"
+#include "sbem/CsvWriter.h"
+#include "sbem/Decoder.h"
+#include "sbem/EdfWriter.h"
+#include "sbem/FileIo.h"
+#include "sbem/Joiner.h"
+#include "sbem/LodPyramid.h"
+#include "sbem/MappedFile.h"
+#include "sbem/OutputFile.h"
+#include "sbem/Reassembler.h"
+#include "sbem/Repacker.h"
+#include "sbem/Scanner.h"
+#include "sbem/SeekableReader.h"
+#include "sbem/TimeWindow.h"
+#include "sbem/Stitcher.h"
+#include "sbem/StreamConverter.h"
+#include "sbem/WfdbWriter.h"
+#include "sbem/WinloggerProtocol.h"
+
+#include "SyntheticLog.h"
+#include "TimeSpec.h"
+
+#ifndef SBEM_TEST_DATA
+#define SBEM_TEST_DATA "tests/data"
+#endif
+#ifndef SBEMBATCH
+#define SBEMBATCH "sbembatch"
+#endif
+
+static int gFailures = 0;
+
+static void check(bool ok, const char* what, int line)
+{
+    if (!ok)
+    {
+        fprintf(stderr, "sbemtest.cpp:%d: %s\n", line, what);
+        gFailures++;
+    }
+}
+
+#define CHECK(condition) check((condition), #condition, __LINE__)
+
+/** A folder in /tmp for the files of one case, removed with them. */
+class TempDir
+{
+public:
+    TempDir(): mPath("/tmp/sbemtest.XXXXXX")
+    {
+        if (!mkdtemp(&mPath[0]))
+            mPath.clear();
+    }
+
+    ~TempDir()
+    {
+        for (const std::string& rFile : mFiles)
+            unlink(rFile.c_str());
+        if (!mPath.empty())
+            rmdir(mPath.c_str());
+    }
+
+    bool ok() const { return !mPath.empty(); }
+
+    const std::string& path() const { return mPath; }
+
+    std::string file(const std::string& name)
+    {
+        mFiles.push_back(mPath + "/" + name);
+        return mFiles.back();
+    }
+
+private:
+    std::string mPath;
+    std::vector<std::string> mFiles;
+};
+
+static bool readFile(const std::string& path, std::vector<uint8_t>& rOut)
+{
+    rOut.clear();
+    FILE* pFile = fopen(path.c_str(), "rb");
+    if (!pFile)
+        return false;
+    uint8_t buffer[1 << 16];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), pFile)) > 0)
+        rOut.insert(rOut.end(), buffer, buffer + n);
+    fclose(pFile);
+    return true;
+}
+
+static bool writeFile(const std::string& path, const std::vector<uint8_t>& rData)
+{
+    FILE* pFile = fopen(path.c_str(), "wb");
+    if (!pFile)
+        return false;
+    const bool ok = fwrite(rData.data(), 1, rData.size(), pFile) == rData.size();
+    return fclose(pFile) == 0 && ok;
+}
+
+/**
+*   The columns of a recording as raw bytes, appended batch after batch, so
+*   a whole decode and a batched one compare bit for bit, NaNs included.
+*/
+struct Columns
+{
+    std::vector<std::vector<uint8_t>> fixed = std::vector<std::vector<uint8_t>>(15);
+    std::vector<std::vector<uint8_t>> streams;      // chunk indices then values, per stream number
+
+    template <typename T>
+    static void append(std::vector<uint8_t>& rOut, const T* pData, size_t count)
+    {
+        const uint8_t* p = reinterpret_cast<const uint8_t*>(pData);
+        rOut.insert(rOut.end(), p, p + count * sizeof(T));
+    }
+
+    template <typename T>
+    static void append(std::vector<uint8_t>& rOut, const sbem::Column<T>& rColumn)
+    {
+        append(rOut, rColumn.data, rColumn.size);
+    }
+
+    void add(const sbem::Recording& rRecording)
+    {
+        const sbem::EcgColumns& rEcg = rRecording.ecg;
+        const sbem::ImuColumns& rImu = rRecording.imu;
+        append(fixed[0], rEcg.chunkIndex);
+        append(fixed[1], rEcg.timestamp);
+        append(fixed[2], rEcg.samples);
+        append(fixed[3], rImu.chunkIndex);
+        append(fixed[4], rImu.timestamp);
+        append(fixed[5], rImu.accelX);
+        append(fixed[6], rImu.accelY);
+        append(fixed[7], rImu.accelZ);
+        append(fixed[8], rImu.gyroX);
+        append(fixed[9], rImu.gyroY);
+        append(fixed[10], rImu.gyroZ);
+        append(fixed[11], rRecording.other.chunkIndex);
+        append(fixed[12], rRecording.other.id);
+        append(fixed[13], rRecording.other.value);
+        append(fixed[14], rRecording.gaps.data(), rRecording.gaps.size());
+
+        if (streams.size() < rRecording.streams.size())
+            streams.resize(rRecording.streams.size());
+        for (size_t s = 0; s < rRecording.streams.size(); s++)
+        {
+            append(streams[s], rRecording.streams[s].chunkIndex);
+            append(streams[s], rRecording.streams[s].values);
+        }
+    }
+
+    bool operator==(const Columns& rOther) const { return fixed == rOther.fixed && streams == rOther.streams; }
+};
+
+/** The log's bytes as the sensor sends them: DATA_PART_SIZE byte notifications with their headers. */
+static std::vector<std::vector<uint8_t>> notifications(const std::vector<uint8_t>& rLog, uint8_t reference)
+{
+    using namespace sbem::winlogger;
+    std::vector<std::vector<uint8_t>> frames;
+    for (size_t offset = 0; offset < rLog.size(); offset += DATA_PART_SIZE)
+    {
+        const size_t n = std::min(DATA_PART_SIZE, rLog.size() - offset);
+        std::vector<uint8_t> frame(FRAME_HEADER + n);
+        frame[0] = frames.size() % 2 ? DATA_PART2 : DATA;
+        frame[1] = reference;
+        synthetic::putU32(&frame[2], static_cast<uint32_t>(offset));
+        memcpy(&frame[FRAME_HEADER], &rLog[offset], n);
+        frames.push_back(frame);
+    }
+    return frames;
+}
+
+/** Swap every frame with one up to window places later, as a link reorders them. */
+static void shuffle(std::vector<std::vector<uint8_t>>& rFrames, size_t window, SyntheticRandom& rRandom)
+{
+    for (size_t i = 0; i + 1 < rFrames.size(); i++)
+        std::swap(rFrames[i], rFrames[std::min(rFrames.size() - 1, i + rRandom.below(window + 1))]);
+}
+
+/**
+*   A synthetic log rewritten chunk by chunk: rEcg is called with every ECG
+*   packet's index and payload, and the packet is left out if it returns false.
+*/
+static std::vector<uint8_t> rewrite(const std::vector<uint8_t>& rLog,
+                                    const std::function<bool(size_t, uint8_t*)>& rEcg)
+{
+    std::vector<uint8_t> out(rLog.begin(), rLog.begin() + sbem::HEADER_SIZE);
+    sbem::Scanner scanner(rLog.data(), rLog.size());
+    sbem::Chunk chunk;
+    size_t packet = 0;
+    std::vector<uint8_t> payload;
+    while (scanner.next(chunk))
+    {
+        payload.assign(rLog.begin() + chunk.offset, rLog.begin() + chunk.offset + chunk.length);
+        if (chunk.id == synthetic::ECG_ID && !rEcg(packet++, payload.data()))
+            continue;
+        synthetic::putChunk(out, chunk.id, payload.data(), chunk.length);
+    }
+    return out;
+}
+
+/** An id described as one layout, then described again as another halfway through. */
+static std::vector<uint8_t> redescribedLog()
+{
+    std::vector<uint8_t> out(sbem::HEADER_SIZE, 0);
+    memcpy(out.data(), "SBEM", 4);
+    const uint8_t payload[8] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+    synthetic::putDescriptor(out, 20, "<FRM>uint32<NME>A<PTH>/X");
+    for (int i = 0; i < 50; i++)
+        synthetic::putChunk(out, 20, payload, sizeof(payload));
+    synthetic::putDescriptor(out, 20, "<FRM>uint16[]<NME>B<PTH>/X");
+    for (int i = 0; i < 50; i++)
+        synthetic::putChunk(out, 20, payload, sizeof(payload));
+    return out;
+}
+
+/** A synthetic log with every ECG and IMU packet timestamp moved by ms. */
+static std::vector<uint8_t> shifted(const std::vector<uint8_t>& rLog, uint32_t ms)
+{
+    std::vector<uint8_t> out(rLog.begin(), rLog.begin() + sbem::HEADER_SIZE);
+    sbem::Scanner scanner(rLog.data(), rLog.size());
+    sbem::Chunk chunk;
+    std::vector<uint8_t> payload;
+    while (scanner.next(chunk))
+    {
+        payload.assign(rLog.begin() + chunk.offset, rLog.begin() + chunk.offset + chunk.length);
+        if (chunk.id == synthetic::ECG_ID || chunk.id == synthetic::IMU_ID)
+            synthetic::putU32(payload.data(), sbem::loadU32(payload.data()) + ms);
+        synthetic::putChunk(out, chunk.id, payload.data(), chunk.length);
+    }
+    return out;
+}
+
+/** A 60 s log with ECG timestamps jittering by up to 3 ms and ECG packets 250-259 (800 ms) lost. */
+static const size_t LOST_BEGIN = 250;
+static const size_t LOST_END = 260;
+
+static std::vector<uint8_t> gappedLog(size_t& rEcgPackets)
+{
+    SyntheticOptions options;
+    options.seconds = 60;
+    const SyntheticLog log = synthesizeLog(options);
+    rEcgPackets = log.ecgPackets;
+    SyntheticRandom random(7);
+    return rewrite(log.bytes, [&](size_t p, uint8_t* pPayload)
+    {
+        if (p >= LOST_BEGIN && p < LOST_END)
+            return false;
+        // The first packet and those around the gap keep their time, so the expected slots are exact
+        if (p != 0 && p != LOST_BEGIN - 1 && p != LOST_END)
+        {
+            const int jitter = static_cast<int>(random.below(7)) - 3;
+            synthetic::putU32(pPayload, sbem::loadU32(pPayload) + jitter);
+        }
+        return true;
+    });
+}
+
+/** Every intact packet of a log with holes comes back, and nothing that wasn't logged. */
+static void testScannerHoles()
+{
+    for (uint64_t seed = 1; seed <= 8; seed++)
+    {
+        SyntheticOptions options;
+        options.seconds = 600;
+        options.seed = seed;
+        options.holesPerMb = seed == 1 ? 0 : 8;
+        const SyntheticLog log = synthesizeLog(options);
+        sbem::Recording recording;
+        CHECK(sbem::Decoder::decode(log.bytes.data(), log.bytes.size(), recording));
+
+        const size_t ecg = recording.ecg.packets();
+        const size_t imu = recording.imu.packets();
+        CHECK(ecg <= log.ecgPackets && ecg + log.ecgDamaged >= log.ecgPackets);
+        CHECK(imu <= log.imuPackets && imu + log.imuDamaged >= log.imuPackets);
+        CHECK(recording.other.size() == 0);
+        CHECK(log.corrupted.empty() == recording.gaps.empty());
+        if (gFailures)
+        {
+            fprintf(stderr, "seed %llu: %zu/%zu ECG, %zu/%zu IMU, %zu other\n", static_cast<unsigned long long>(seed),
+                    ecg, log.ecgPackets, imu, log.imuPackets, recording.other.size());
+            return;
+        }
+    }
+}
+
+/** A second session logged after the first: its clock starts over, and every packet of both comes back. */
+static void testScannerRestart()
+{
+    SyntheticOptions first;
+    first.seconds = 600;
+    SyntheticOptions second;
+    second.seconds = 300;
+    second.seed = 2;
+    const SyntheticLog a = synthesizeLog(first);
+    const SyntheticLog b = synthesizeLog(second);
+
+    // The second session with its descriptors, then again with the 8 byte header of a file of its own
+    for (size_t skip : { sbem::HEADER_SIZE, static_cast<size_t>(0) })
+    {
+        std::vector<uint8_t> log = a.bytes;
+        log.insert(log.end(), b.bytes.begin() + skip, b.bytes.end());
+
+        sbem::Recording recording;
+        CHECK(sbem::Decoder::decode(log.data(), log.size(), recording));
+        CHECK(recording.ecg.packets() == a.ecgPackets + b.ecgPackets);
+        CHECK(recording.imu.packets() == a.imuPackets + b.imuPackets);
+        CHECK(recording.other.size() == 0);
+        CHECK(!recording.truncated);
+        CHECK(recording.gaps.empty() == (skip != 0));
+        if (recording.ecg.packets() > a.ecgPackets)
+            CHECK(recording.ecg.timestamp[a.ecgPackets] == synthetic::START_MS);
+
+        sbem::DecodeOptions parallel;
+        parallel.threads = 4;
+        Columns whole;
+        whole.add(recording);
+        Columns threaded;
+        CHECK(sbem::Decoder::decode(log.data(), log.size(), recording, parallel));
+        threaded.add(recording);
+        CHECK(threaded == whole);
+    }
+}
+
+/** Decoder, StreamDecoder and PushDecoder give the same columns, on every thread count. */
+static void testDecoderPaths()
+{
+    SyntheticOptions clean;
+    clean.seconds = 600;
+    SyntheticOptions holes = clean;
+    holes.seed = 2;
+    holes.holesPerMb = 8;
+    const std::vector<std::vector<uint8_t>> logs =
+    {
+        synthesizeLog(clean).bytes, synthesizeLog(holes).bytes, redescribedLog()
+    };
+
+    SyntheticRandom random(3);
+    for (const std::vector<uint8_t>& rLog : logs)
+    {
+        sbem::Recording recording;
+        CHECK(sbem::Decoder::decode(rLog.data(), rLog.size(), recording));
+        Columns whole;
+        whole.add(recording);
+
+        sbem::DecodeOptions parallel;
+        parallel.threads = 4;
+        Columns threaded;
+        CHECK(sbem::Decoder::decode(rLog.data(), rLog.size(), recording, parallel));
+        threaded.add(recording);
+        CHECK(threaded == whole);
+
+        for (const sbem::DecodeOptions& rOptions : { sbem::DecodeOptions(), parallel })
+        {
+            sbem::StreamDecoder stream(rLog.data(), rLog.size(), rOptions);
+            Columns batches;
+            uint64_t bytes = 0;
+            while (stream.next(recording, 4096))
+            {
+                batches.add(recording);
+                bytes += recording.bytesScanned;
+            }
+            CHECK(batches == whole);
+            CHECK(bytes == rLog.size());
+        }
+
+        // Notifications reordered and some of them twice
+        std::vector<std::vector<uint8_t>> frames = notifications(rLog, sbem::winlogger::CLIENT_REFERENCE);
+        shuffle(frames, 8, random);
+        sbem::PushDecoder push;
+        Columns pushed;
+        for (size_t i = 0; i < frames.size(); i++)
+        {
+            const std::vector<uint8_t>& rFrame = frames[i];
+            const size_t repeats = i % 5 == 0 ? 2 : 1;
+            for (size_t r = 0; r < repeats; r++)
+            {
+                CHECK(push.push(sbem::loadU32(&rFrame[2]), &rFrame[sbem::winlogger::FRAME_HEADER],
+                                rFrame.size() - sbem::winlogger::FRAME_HEADER));
+            }
+            while (push.next(recording))
+                pushed.add(recording);
+        }
+        push.finish();
+        while (push.next(recording))
+            pushed.add(recording);
+        CHECK(push.done());
+        CHECK(push.lost() == 0);
+        CHECK(pushed == whole);
+    }
+
+    // The packet decoders agree with the descriptor interpreter on intact packets
+    sbem::Recording specialised;
+    sbem::Recording interpreted;
+    sbem::DecodeOptions options;
+    options.packets = sbem::PacketPath::INTERPRETED;
+    CHECK(sbem::Decoder::decode(logs[0].data(), logs[0].size(), specialised));
+    CHECK(sbem::Decoder::decode(logs[0].data(), logs[0].size(), interpreted, options));
+    Columns a;
+    Columns b;
+    a.add(specialised);
+    b.add(interpreted);
+    CHECK(a == b);
+}
+
+/** The entries and gaps of two indexes, bytewise. */
+static bool sameIndex(const sbem::ChunkIndex& rA, const sbem::ChunkIndex& rB)
+{
+    return rA.size() == rB.size() && rA.gapCount() == rB.gapCount() && rA.truncated() == rB.truncated() &&
+           rA.ecgSamples() == rB.ecgSamples() && rA.imuSamples() == rB.imuSamples() &&
+           memcmp(rA.begin(), rB.begin(), rA.size() * sizeof(sbem::IndexEntry)) == 0 &&
+           memcmp(rA.gapsBegin(), rB.gapsBegin(), rA.gapCount() * sizeof(sbem::Gap)) == 0;
+}
+
+/** The sidecar is written once, reused while the log is unchanged and rebuilt when it grows or is rewritten. */
+static void testChunkIndex()
+{
+    TempDir dir;
+    CHECK(dir.ok());
+    SyntheticOptions options;
+    options.seconds = 600;
+    options.seed = 3;
+    options.holesPerMb = 8;
+    std::vector<uint8_t> log = synthesizeLog(options).bytes;
+    const std::string path = dir.file("log.sbem");
+    const std::string sidecar = dir.file("log.sbem.sbidx");
+    CHECK(sidecar == sbem::ChunkIndex::sidecarPath(path.c_str()));
+    CHECK(writeFile(path, log));
+
+    sbem::ChunkIndex built;
+    built.build(log.data(), log.size());
+    sbem::Recording recording;
+    CHECK(sbem::Decoder::decode(log.data(), log.size(), recording));
+    CHECK(built.ecgSamples() == recording.ecg.samples.size && built.imuSamples() == recording.imu.accelX.size);
+    CHECK(built.gapCount() == recording.gaps.size());
+
+    // Decoding through the index gives the scanned decode's columns
+    Columns scanned;
+    scanned.add(recording);
+    sbem::DecodeOptions indexed;
+    indexed.pIndex = &built;
+    Columns viaIndex;
+    CHECK(sbem::Decoder::decode(log.data(), log.size(), recording, indexed));
+    viaIndex.add(recording);
+    CHECK(viaIndex == scanned);
+
+    // The first packet at or after a time
+    const uint32_t t = synthetic::START_MS + 300000;
+    const size_t at = built.lowerBound(t);
+    CHECK(at < built.size() && built[at].firstTimestamp >= t);
+    for (size_t i = 0; i < at; i++)
+        CHECK(built[i].kind != sbem::ChunkKind::ECG || built[i].firstTimestamp < t);
+
+    {
+        sbem::MappedFile file;
+        CHECK(file.open(path.c_str()));
+        sbem::ChunkIndex first;
+        sbem::ChunkIndex second;
+        CHECK(!first.useSidecar(path.c_str(), file.data(), file.size()));
+        CHECK(access(sidecar.c_str(), F_OK) == 0);
+        CHECK(second.useSidecar(path.c_str(), file.data(), file.size()));
+        CHECK(sameIndex(first, built) && sameIndex(second, built));
+    }
+
+    // The log grew by a packet: rebuilt, then reused again
+    uint8_t packet[sbem::ECG_MV_PACKET_SIZE] = {};
+    synthetic::putU32(packet, recording.ecg.timestamp[recording.ecg.packets() - 1] + 80);
+    synthetic::putChunk(log, synthetic::ECG_ID, packet, sizeof(packet));
+    CHECK(writeFile(path, log));
+    {
+        sbem::MappedFile file;
+        CHECK(file.open(path.c_str()));
+        sbem::ChunkIndex grown;
+        sbem::ChunkIndex again;
+        CHECK(!grown.useSidecar(path.c_str(), file.data(), file.size()));
+        CHECK(grown.size() == built.size() + 1);
+        CHECK(again.useSidecar(path.c_str(), file.data(), file.size()) && sameIndex(again, grown));
+    }
+
+    // Rewritten in place at the same size, and a sidecar cut short
+    log[log.size() / 2] ^= 0xFF;
+    CHECK(writeFile(path, log));
+    {
+        sbem::MappedFile file;
+        CHECK(file.open(path.c_str()));
+        sbem::SourceStamp stamp;
+        CHECK(sbem::SourceStamp::of(path.c_str(), file.data(), file.size(), stamp));
+        sbem::ChunkIndex stale;
+        CHECK(!stale.load(sidecar.c_str(), stamp));
+        CHECK(!stale.useSidecar(path.c_str(), file.data(), file.size()));
+
+        std::vector<uint8_t> bytes;
+        CHECK(readFile(sidecar, bytes) && bytes.size() > sizeof(sbem::IndexEntry));
+        bytes.resize(bytes.size() - sizeof(sbem::IndexEntry) / 2);
+        CHECK(writeFile(sidecar, bytes));
+        sbem::ChunkIndex cut;
+        CHECK(!cut.load(sidecar.c_str(), stamp));
+        CHECK(!cut.useSidecar(path.c_str(), file.data(), file.size()) && sameIndex(cut, stale));
+    }
+}
+
+/** Packets [rFirst, rEnd) that overlap [begin, end), each running until the next one, counted one by one. */
+static void overlapping(const sbem::Column<uint32_t>& rTs, uint32_t begin, uint32_t end, size_t& rFirst, size_t& rEnd)
+{
+    rFirst = rTs.size;
+    rEnd = 0;
+    for (size_t i = 0; i < rTs.size; i++)
+    {
+        const bool runs = i + 1 < rTs.size ? rTs[i + 1] > begin : rTs[i] >= begin;
+        if (rTs[i] < end && runs)
+        {
+            rFirst = std::min(rFirst, i);
+            rEnd = i + 1;
+        }
+    }
+    rFirst = std::min(rFirst, rEnd);
+}
+
+/** rColumn is [first, end) packets of rWhole, perPacket values each. */
+template <typename T>
+static bool isSlice(const sbem::Column<T>& rColumn, const sbem::Column<T>& rWhole, size_t first, size_t end,
+                    size_t perPacket)
+{
+    const size_t count = (end - first) * perPacket;
+    return rColumn.size == count &&
+           (count == 0 || memcmp(rColumn.data, rWhole.data + first * perPacket, count * sizeof(T)) == 0);
+}
+
+/** Windows decoded from their index range and trimmed keep exactly the packets overlapping them. */
+static void testTimeWindow()
+{
+    SyntheticOptions options;
+    options.seconds = 600;
+    const std::vector<uint8_t> log = synthesizeLog(options).bytes;
+    sbem::Recording whole;
+    CHECK(sbem::Decoder::decode(log.data(), log.size(), whole));
+    sbem::ChunkIndex index;
+    index.build(log.data(), log.size());
+    const uint32_t first = synthetic::START_MS;
+    const uint32_t last = whole.ecg.timestamp[whole.ecg.packets() - 1];
+
+    const sbem::TimeWindow windows[] =
+    {
+        { first + 100030, first + 160010 },     // inside packets at both ends
+        { first + 240000, first + 240080 },     // one ECG packet from its timestamp
+        { 0, UINT32_MAX },
+        { 0, first },                           // before the first packet
+        { last + 1000, last + 2000 },           // after the last one has run out
+        { first + 50000, first + 50001 },
+    };
+    for (const sbem::TimeWindow& rWindow : windows)
+    {
+        sbem::DecodeOptions ranged;
+        ranged.pIndex = &index;
+        rWindow.chunkRange(index, ranged.firstChunk, ranged.endChunk);
+        sbem::Recording recording;
+        CHECK(sbem::Decoder::decode(log.data(), log.size(), recording, ranged));
+        rWindow.trim(recording);
+
+        size_t ecgFirst;
+        size_t ecgEnd;
+        overlapping(whole.ecg.timestamp, rWindow.begin, rWindow.end, ecgFirst, ecgEnd);
+        size_t imuFirst;
+        size_t imuEnd;
+        overlapping(whole.imu.timestamp, rWindow.begin, rWindow.end, imuFirst, imuEnd);
+
+        const size_t ecgPerPacket = sbem::ECG_SAMPLES_PER_PACKET;
+        const size_t imuPerPacket = sbem::IMU_SAMPLES_PER_PACKET;
+        CHECK(isSlice(recording.ecg.timestamp, whole.ecg.timestamp, ecgFirst, ecgEnd, 1));
+        CHECK(isSlice(recording.ecg.samples, whole.ecg.samples, ecgFirst, ecgEnd, ecgPerPacket));
+        CHECK(isSlice(recording.imu.timestamp, whole.imu.timestamp, imuFirst, imuEnd, 1));
+        CHECK(isSlice(recording.imu.accelX, whole.imu.accelX, imuFirst, imuEnd, imuPerPacket));
+        CHECK(isSlice(recording.imu.gyroZ, whole.imu.gyroZ, imuFirst, imuEnd, imuPerPacket));
+        if (gFailures)
+        {
+            fprintf(stderr, "window %u-%u: %zu ECG packets for %zu, %zu IMU for %zu\n", rWindow.begin, rWindow.end,
+                    recording.ecg.packets(), ecgEnd - ecgFirst, recording.imu.packets(), imuEnd - imuFirst);
+            return;
+        }
+    }
+
+    // --from/--to values of the tools
+    TimeSpec spec;
+    CHECK(parseTime("52000", spec) && spec.kind == TimeSpec::SENSOR && resolve(spec, first, 0) == 52000);
+    CHECK(parseTime("+1:30:00", spec) && spec.kind == TimeSpec::OFFSET && resolve(spec, first, 0) == first + 5400000);
+    CHECK(parseTime("14:00", spec) && spec.kind == TimeSpec::CLOCK);
+    CHECK(resolve(spec, first, 13 * 3600000ull) == first + 3600000);
+    CHECK(resolve(spec, first, 23 * 3600000ull) == first + 15 * 3600000ull);
+    CHECK(!parseTime("1:75", spec) && !parseTime("abc", spec) && !parseTime("99999999999", spec));
+}
+
+/** The column called name holds exactly the array of rColumn. */
+template <typename T>
+static bool sameColumn(const sbem::ColumnarReader& rReader, const char* name, const sbem::Column<T>& rColumn)
+{
+    uint64_t count = 0;
+    const T* pData = rReader.array<T>(name, count);
+    return count == rColumn.size && (count == 0 || (pData && memcmp(pData, rColumn.data, count * sizeof(T)) == 0));
+}
+
+/** A recording written to .sbcol reads back bit for bit, with its rates, paths and generic streams. */
+static void testColumnar()
+{
+    TempDir dir;
+    CHECK(dir.ok());
+    SyntheticOptions options;
+    options.seconds = 600;
+    options.seed = 2;
+    options.holesPerMb = 8;
+    const std::vector<std::vector<uint8_t>> logs = { synthesizeLog(options).bytes, redescribedLog() };
+
+    for (size_t l = 0; l < logs.size(); l++)
+    {
+        sbem::Recording recording;
+        CHECK(sbem::Decoder::decode(logs[l].data(), logs[l].size(), recording));
+        const std::string path = dir.file("log" + std::to_string(l) + ".sbcol");
+        CHECK(sbem::ColumnarWriter::write(recording, path.c_str()));
+
+        sbem::ColumnarReader reader;
+        CHECK(reader.open(path.c_str()));
+        if (!reader.isOpen())
+            continue;
+        CHECK(reader.sourceSize() == logs[l].size() && reader.chunkCount() == recording.chunkCount);
+        CHECK(reader.truncated() == recording.truncated);
+
+        const sbem::EcgColumns& rEcg = recording.ecg;
+        const sbem::ImuColumns& rImu = recording.imu;
+        CHECK(sameColumn(reader, "ecg.chunk_index", rEcg.chunkIndex));
+        CHECK(sameColumn(reader, "ecg.timestamp", rEcg.timestamp));
+        CHECK(sameColumn(reader, "ecg.samples", rEcg.samples));
+        CHECK(sameColumn(reader, "imu.chunk_index", rImu.chunkIndex));
+        CHECK(sameColumn(reader, "imu.timestamp", rImu.timestamp));
+        CHECK(sameColumn(reader, "imu.acc_x", rImu.accelX) && sameColumn(reader, "imu.acc_y", rImu.accelY) &&
+              sameColumn(reader, "imu.acc_z", rImu.accelZ));
+        CHECK(sameColumn(reader, "imu.gyro_x", rImu.gyroX) && sameColumn(reader, "imu.gyro_y", rImu.gyroY) &&
+              sameColumn(reader, "imu.gyro_z", rImu.gyroZ));
+        CHECK(sameColumn(reader, "other.chunk_index", recording.other.chunkIndex) &&
+              sameColumn(reader, "other.id", recording.other.id) &&
+              sameColumn(reader, "other.value", recording.other.value));
+        for (const sbem::GenericStream& rStream : recording.streams)
+        {
+            const std::string prefix = "stream." + std::to_string(rStream.id) + ".";
+            CHECK(sameColumn(reader, (prefix + "chunk_index").c_str(), rStream.chunkIndex));
+            CHECK(sameColumn(reader, (prefix + "value_offsets").c_str(), rStream.valueOffsets));
+            CHECK(sameColumn(reader, (prefix + "values").c_str(), rStream.values));
+        }
+
+        const sbem::ColumnView* pEcg = reader.find("ecg.samples");
+        const sbem::ColumnView* pGyro = reader.find("imu.gyro_z");
+        CHECK(pEcg && pGyro && !reader.find("ecg.missing"));
+        if (l == 0 && pEcg && pGyro)
+        {
+            CHECK(pEcg->sampleRate == 200 && pEcg->path == "/Meas/ECG/200/mV");
+            CHECK(pEcg->valuesPerPacket == sbem::ECG_SAMPLES_PER_PACKET && pEcg->firstTimestamp == rEcg.timestamp[0]);
+            CHECK(pGyro->sampleRate == 26 && pGyro->valuesPerPacket == sbem::IMU_SAMPLES_PER_PACKET);
+        }
+        if (l == 1)
+            CHECK(!recording.streams.empty());
+    }
+
+    // Not a columnar file
+    sbem::ColumnarReader reader;
+    const std::string junk = dir.file("junk.sbcol");
+    CHECK(writeFile(junk, logs[1]));
+    CHECK(!reader.open(junk.c_str()));
+}
+
+#if SBEM_HAVE_ZSTD
+/** Seekable zstd output reads back at any offset, frame by frame, and a columnar file opens through it. */
+static void testSeekableZstd()
+{
+    TempDir dir;
+    CHECK(dir.ok());
+    SyntheticOptions logOptions;
+    logOptions.seconds = 1800;
+    const std::vector<uint8_t> data = synthesizeLog(logOptions).bytes;
+
+    sbem::OutputOptions options;
+    options.compression = sbem::Compression::ZSTD;
+    options.frameSize = 1 << 18;
+    options.threads = 4;
+    const std::string path = dir.file("log.sbem.zst");
+    sbem::OutputFile out;
+    CHECK(out.open(path.c_str(), options));
+    for (size_t offset = 0, step = 1; offset < data.size(); offset += step, step = step * 7 % 100003 + 1)
+        CHECK(out.write(&data[offset], std::min(step, data.size() - offset)));
+    CHECK(out.close());
+
+    std::vector<uint8_t> file;
+    CHECK(readFile(path, file) && file.size() < data.size());
+    CHECK(sbem::SeekableReader::isCompressed(file.data(), file.size()));
+    CHECK(!sbem::SeekableReader::isCompressed(data.data(), data.size()));
+
+    sbem::SeekableReader reader;
+    CHECK(reader.open(path.c_str()));
+    CHECK(reader.size() == data.size());
+    CHECK(reader.frameCount() == (data.size() + options.frameSize - 1) / options.frameSize);
+
+    // Reads inside a frame, across frame boundaries, backwards and the whole file
+    SyntheticRandom random(11);
+    std::vector<uint8_t> buffer(data.size());
+    for (int i = 0; i < 200; i++)
+    {
+        const uint64_t offset = random.below(data.size());
+        const size_t length = static_cast<size_t>(random.below(std::min<uint64_t>(data.size() - offset, 600000) + 1));
+        CHECK(reader.read(offset, length, buffer.data()) && memcmp(buffer.data(), &data[offset], length) == 0);
+    }
+    CHECK(reader.read(0, data.size(), buffer.data()) && buffer == data);
+    CHECK(!reader.read(data.size() - 10, 11, buffer.data()));
+
+    // A damaged frame fails its reads, the others still read
+    std::vector<uint8_t> damaged = file;
+    damaged[damaged.size() / 2] ^= 0x55;
+    const std::string damagedPath = dir.file("damaged.sbem.zst");
+    CHECK(writeFile(damagedPath, damaged));
+    sbem::SeekableReader damagedReader;
+    CHECK(damagedReader.open(damagedPath.c_str()));
+    size_t failed = 0;
+    for (uint64_t offset = 0; offset < data.size(); offset += options.frameSize)
+    {
+        const size_t length = static_cast<size_t>(std::min<uint64_t>(options.frameSize, data.size() - offset));
+        const bool ok = damagedReader.read(offset, length, buffer.data());
+        failed += !ok;
+        CHECK(!ok || memcmp(buffer.data(), &data[offset], length) == 0);
+    }
+    CHECK(failed == 1);
+
+    // A file that isn't seekable zstd
+    const std::string plainPath = dir.file("plain.sbem");
+    CHECK(writeFile(plainPath, data));
+    sbem::SeekableReader plain;
+    CHECK(!plain.open(plainPath.c_str()));
+
+    sbem::Recording recording;
+    CHECK(sbem::Decoder::decode(data.data(), data.size(), recording));
+    const std::string columnarPath = dir.file("log.sbcol.zst");
+    CHECK(sbem::ColumnarWriter::write(recording, columnarPath.c_str(), options));
+    sbem::ColumnarReader columns;
+    CHECK(columns.open(columnarPath.c_str()));
+    CHECK(sameColumn(columns, "ecg.samples", recording.ecg.samples));
+    CHECK(sameColumn(columns, "imu.gyro_x", recording.imu.gyroX));
+    CHECK(sameColumn(columns, "imu.timestamp", recording.imu.timestamp));
+}
+#endif
+
+/** Shuffled, repeated and lost notifications: the holes are listed, and filled by a second fetch. */
+static void testReassembler()
+{
+    using namespace sbem::winlogger;
+    TempDir dir;
+    CHECK(dir.ok());
+    SyntheticOptions options;
+    options.seconds = 600;
+    const std::vector<uint8_t> log = synthesizeLog(options).bytes;
+    const std::string path = dir.file("log.sbem");
+
+    std::vector<std::vector<uint8_t>> frames = notifications(log, CLIENT_REFERENCE);
+    std::vector<std::vector<uint8_t>> lost;
+    std::vector<sbem::ByteRange> holes;
+    std::vector<std::vector<uint8_t>> sent;
+    uint64_t duplicates = 0;
+    for (size_t i = 0; i < frames.size(); i++)
+    {
+        const uint64_t offset = sbem::loadU32(&frames[i][2]);
+        if (i % 97 == 50)
+        {
+            lost.push_back(frames[i]);
+            holes.push_back({ offset, offset + frames[i].size() - FRAME_HEADER });
+            continue;
+        }
+        sent.push_back(frames[i]);
+        if (i % 7 == 0)
+        {
+            sent.push_back(frames[i]);
+            duplicates += frames[i].size() - FRAME_HEADER;
+        }
+    }
+    SyntheticRandom random(5);
+    shuffle(sent, 16, random);
+
+    sbem::Reassembler reassembler;
+    CHECK(reassembler.open(path.c_str(), CLIENT_REFERENCE));
+    for (const std::vector<uint8_t>& rFrame : sent)
+        CHECK(reassembler.frame(rFrame.data(), rFrame.size()) == sbem::FrameKind::DATA);
+    std::vector<uint8_t> foreign = frames[0];
+    foreign[1] = CLIENT_REFERENCE + 1;
+    CHECK(reassembler.frame(foreign.data(), foreign.size()) == sbem::FrameKind::FOREIGN);
+    CHECK(reassembler.frame(frames[0].data(), 3) == sbem::FrameKind::MALFORMED);
+    uint8_t end[FRAME_HEADER] = { DATA, CLIENT_REFERENCE };
+    synthetic::putU32(end + 2, static_cast<uint32_t>(log.size()));
+    CHECK(reassembler.frame(end, sizeof(end)) == sbem::FrameKind::END);
+
+    std::vector<sbem::ByteRange> missing;
+    reassembler.missing(missing);
+    CHECK(missing.size() == holes.size());
+    for (size_t i = 0; i < std::min(missing.size(), holes.size()); i++)
+        CHECK(missing[i].begin == holes[i].begin && missing[i].end == holes[i].end);
+    CHECK(!reassembler.complete());
+    CHECK(reassembler.stats().duplicates == duplicates);
+    CHECK(reassembler.stats().foreign == 1 && reassembler.stats().malformed == 1);
+
+    // The refetch: everything again, only the lost notifications are new
+    for (const std::vector<uint8_t>& rFrame : frames)
+        reassembler.frame(rFrame.data(), rFrame.size());
+    reassembler.missing(missing);
+    CHECK(missing.empty());
+    CHECK(reassembler.complete());
+    CHECK(reassembler.received() == log.size());
+    CHECK(reassembler.close());
+    CHECK(reassembler.error() == 0);
+
+    std::vector<uint8_t> written;
+    CHECK(readFile(path, written));
+    CHECK(written == log);
+}
+
+/** Two sessions and a second fetch of one merge by time, once each; a restarted sensor's logs are refused. */
+static void testRepacker()
+{
+    TempDir dir;
+    CHECK(dir.ok());
+    SyntheticOptions options;
+    options.seconds = 300;
+    const std::vector<uint8_t> first = synthesizeLog(options).bytes;
+    options.seed = 2;
+    const std::vector<uint8_t> restarted = synthesizeLog(options).bytes;
+    const std::vector<uint8_t> later = shifted(restarted, 400000);
+
+    const std::string firstPath = dir.file("first.sbem");
+    const std::string againPath = dir.file("again.sbem");
+    const std::string laterPath = dir.file("later.sbem");
+    const std::string restartedPath = dir.file("restarted.sbem");
+    const std::string outPath = dir.file("out.sbem");
+    CHECK(writeFile(firstPath, first) && writeFile(againPath, first));
+    CHECK(writeFile(laterPath, later) && writeFile(restartedPath, restarted));
+
+    sbem::Recording a;
+    sbem::Recording b;
+    CHECK(sbem::Decoder::decode(first.data(), first.size(), a));
+    CHECK(sbem::Decoder::decode(later.data(), later.size(), b));
+
+    sbem::Repacker repacker;
+    for (const std::string& rPath : { laterPath, firstPath, againPath })
+        CHECK(repacker.add(rPath.c_str(), false));
+    sbem::RepackStats stats;
+    CHECK(repacker.write(outPath.c_str(), 0, UINT32_MAX, stats));
+    CHECK(stats.inputs == 3 && stats.descriptors == 6 && stats.trimmed == 0 && stats.gaps == 0);
+    CHECK(stats.duplicates == a.ecg.packets() + a.imu.packets());
+
+    std::vector<uint8_t> out;
+    sbem::Recording merged;
+    CHECK(readFile(outPath, out));
+    CHECK(sbem::Decoder::decode(out.data(), out.size(), merged));
+    CHECK(merged.ecg.packets() == a.ecg.packets() + b.ecg.packets());
+    CHECK(merged.imu.packets() == a.imu.packets() + b.imu.packets());
+    if (merged.ecg.packets() == a.ecg.packets() + b.ecg.packets())
+    {
+        size_t wrong = 0;
+        for (size_t p = 0; p < merged.ecg.packets(); p++)
+        {
+            const bool isFirst = p < a.ecg.packets();
+            const size_t q = isFirst ? p : p - a.ecg.packets();
+            wrong += merged.ecg.timestamp[p] != (isFirst ? a : b).ecg.timestamp[q];
+        }
+        CHECK(wrong == 0);
+        CHECK(memcmp(merged.ecg.samples.data, a.ecg.samples.data, a.ecg.samples.size * sizeof(float)) == 0);
+    }
+
+    // The sensor restarted: same time, none of the same packets
+    sbem::Repacker refused;
+    CHECK(refused.add(firstPath.c_str(), false) && refused.add(restartedPath.c_str(), false));
+    CHECK(!refused.write(outPath.c_str(), 0, UINT32_MAX, stats));
+    CHECK(refused.error().find("restarted") != std::string::npos);
+    CHECK(readFile(outPath, out) && out.size() == merged.bytesScanned);
+}
+
+/** Dropout, lead-off and restart gaps are mapped per channel; a log fetched twice is stitched once. */
+static void testStitcher()
+{
+    TempDir dir;
+    CHECK(dir.ok());
+    SyntheticOptions options;
+    options.seconds = 300;
+    const std::vector<uint8_t> first = rewrite(synthesizeLog(options).bytes, [](size_t p, uint8_t*)
+    {
+        return p < 1000 || p >= 1010;
+    });
+    options.seconds = 120;
+    options.seed = 2;
+    const std::vector<uint8_t> second = shifted(synthesizeLog(options).bytes, 360000);
+    options.seed = 3;
+    const std::vector<uint8_t> restarted = synthesizeLog(options).bytes;
+
+    // Log ids 1, 2 (twice, the second fetch cut short) and 3, added out of order
+    const std::string firstPath = dir.file("first.sbem");
+    const std::string secondPath = dir.file("second.sbem");
+    const std::string cutPath = dir.file("cut.sbem");
+    const std::string restartedPath = dir.file("restarted.sbem");
+    CHECK(writeFile(firstPath, first) && writeFile(secondPath, second) && writeFile(restartedPath, restarted));
+    CHECK(writeFile(cutPath, std::vector<uint8_t>(second.begin(), second.begin() + second.size() / 2)));
+
+    sbem::Stitcher stitcher;
+    CHECK(stitcher.add(restartedPath.c_str(), 3) && stitcher.add(cutPath.c_str(), 2));
+    CHECK(stitcher.add(firstPath.c_str(), 1) && stitcher.add(secondPath.c_str(), 2));
+    sbem::Recording stitched;
+    sbem::StitchStats stats;
+    CHECK(stitcher.stitch(stitched, 0, stats));
+    CHECK(stats.logs == 3 && stats.duplicates == 1);
+    CHECK(stats.dropouts == 1 && stats.leadOffs == 2 && stats.resets == 1);
+    CHECK(stats.ecgPeriod == 80 && stats.corrupt == 0);
+
+    sbem::Recording a;
+    sbem::Recording b;
+    sbem::Recording c;
+    CHECK(sbem::Decoder::decode(first.data(), first.size(), a));
+    CHECK(sbem::Decoder::decode(second.data(), second.size(), b));
+    CHECK(sbem::Decoder::decode(restarted.data(), restarted.size(), c));
+    const sbem::EcgColumns& rEcg = stitched.ecg;
+    CHECK(rEcg.packets() == a.ecg.packets() + b.ecg.packets() + c.ecg.packets());
+    CHECK(stitched.imu.packets() == a.imu.packets() + b.imu.packets() + c.imu.packets());
+    if (rEcg.packets() != a.ecg.packets() + b.ecg.packets() + c.ecg.packets())
+        return;
+
+    // One timeline: ascending, the restarted log moved behind the others, chunk indices counting on
+    size_t backwards = 0;
+    for (size_t i = 1; i < rEcg.packets(); i++)
+        backwards += rEcg.timestamp[i] <= rEcg.timestamp[i - 1] || rEcg.chunkIndex[i] <= rEcg.chunkIndex[i - 1];
+    CHECK(backwards == 0);
+    const size_t restart = a.ecg.packets() + b.ecg.packets();
+    CHECK(rEcg.timestamp[restart] - c.ecg.timestamp[0] == rEcg.timestamp[restart + 1] - c.ecg.timestamp[1]);
+    CHECK(memcmp(rEcg.samples.data + restart * sbem::ECG_SAMPLES_PER_PACKET, c.ecg.samples.data,
+                 c.ecg.samples.size * sizeof(float)) == 0);
+
+    // The gap map, in time order
+    const sbem::TimelineGapColumns& rGaps = stitched.timelineGaps;
+    const uint32_t start = synthetic::START_MS;
+    const uint32_t ecgLast = a.ecg.timestamp[a.ecg.packets() - 1];
+    const uint32_t imuLast = a.imu.timestamp[a.imu.packets() - 1];
+    struct Expected
+    {
+        sbem::GapKind kind;
+        sbem::PacketKind channel;
+        uint32_t begin;
+        uint32_t end;
+    };
+    const Expected expected[] =
+    {
+        { sbem::GapKind::DROPOUT, sbem::PacketKind::ECG_MV, start + 1000 * 80, start + 1010 * 80 },
+        { sbem::GapKind::LEAD_OFF, sbem::PacketKind::ECG_MV, ecgLast + 80, b.ecg.timestamp[0] },
+        { sbem::GapKind::LEAD_OFF, sbem::PacketKind::IMU6, imuLast + stats.imuPeriod, b.imu.timestamp[0] },
+    };
+    CHECK(rGaps.size() == 5);
+    for (size_t i = 0; i < std::min<size_t>(rGaps.size(), 3); i++)
+    {
+        CHECK(rGaps.kind[i] == static_cast<uint8_t>(expected[i].kind));
+        CHECK(rGaps.channel[i] == static_cast<uint8_t>(expected[i].channel));
+        CHECK(rGaps.begin[i] == expected[i].begin && rGaps.end[i] == expected[i].end);
+    }
+    // Then the restart on both channels, ending at the first packet of the moved log
+    const uint32_t ecgRestart = rEcg.timestamp[restart];
+    const uint32_t imuRestart = stitched.imu.timestamp[a.imu.packets() + b.imu.packets()];
+    for (size_t i = 3; i < rGaps.size(); i++)
+    {
+        const bool isEcg = rGaps.channel[i] == static_cast<uint8_t>(sbem::PacketKind::ECG_MV);
+        CHECK(rGaps.kind[i] == static_cast<uint8_t>(sbem::GapKind::RESET));
+        CHECK(rGaps.end[i] == (isEcg ? ecgRestart : imuRestart) && rGaps.begin[i] <= rGaps.end[i]);
+    }
+}
+
+/** Vertical acceleration of a walk with bursts of random strength every 1.5 s, at ms of the reference clock. */
+static double movement(double ms)
+{
+    const double segment = ms / 1500.0;
+    const uint64_t k = static_cast<uint64_t>(segment);
+    const double strength = SyntheticRandom(k).uniform();
+    const double next = SyntheticRandom(k + 1).uniform();
+    const double blend = 0.5 - 0.5 * std::cos((segment - k) * M_PI);
+    return 3.0 * (strength + (next - strength) * blend) * std::sin(2 * M_PI * 1.7 * ms / 1000);
+}
+
+/**
+*   IMU packets of a sensor worn during movement(), its clock starting at
+*   start and running so that reference ms = t + offset + drift * (t - start).
+*/
+static std::vector<uint8_t> movementLog(uint32_t start, double seconds, double offset, double drift)
+{
+    std::vector<uint8_t> out(sbem::HEADER_SIZE, 0);
+    memcpy(out.data(), "SBEM", 4);
+    synthetic::putDescriptor(out, 10, "<FRM>uint32<NME>Timestamp");
+    synthetic::putDescriptor(out, 13, "<FRM>float32[3][2]<NME>ArrayAcc");
+    synthetic::putDescriptor(out, 14, "<FRM>float32[3][2]<NME>ArrayGyro");
+    synthetic::putDescriptor(out, synthetic::IMU_ID, "<GRP>10,13,14<PTH>/Meas/IMU6/26");
+
+    uint8_t imu[sbem::IMU6_PACKET_SIZE] = {};
+    const size_t packets = static_cast<size_t>(seconds * 1000 / synthetic::IMU_PACKET_MS);
+    for (size_t p = 0; p < packets; p++)
+    {
+        const double packetMs = start + p * synthetic::IMU_PACKET_MS;
+        synthetic::putU32(imu, static_cast<uint32_t>(packetMs));
+        for (size_t s = 0; s < sbem::IMU_SAMPLES_PER_PACKET; s++)
+        {
+            const double t = packetMs + s * 1000.0 / 26;
+            const double a = movement(t + offset + drift * (t - start));
+            synthetic::putF32(imu + 4 + (s * 3) * 4, static_cast<float>(0.3 * a));
+            synthetic::putF32(imu + 4 + (s * 3 + 2) * 4, static_cast<float>(9.81 + a));
+        }
+        synthetic::putChunk(out, synthetic::IMU_ID, imu, sizeof(imu));
+    }
+    return out;
+}
+
+/** A sensor 5 s behind and 50 ppm slow is found so, and joined onto the reference clock it lines up. */
+static void testClockAlign()
+{
+    TempDir dir;
+    CHECK(dir.ok());
+    const uint32_t start = synthetic::START_MS + 20000;
+    const std::vector<uint8_t> reference = movementLog(synthetic::START_MS, 2 * 3600, 0, 0);
+    const std::vector<uint8_t> sensor = movementLog(start, 2 * 3600, -5000, -50e-6);
+    sbem::Recording a;
+    sbem::Recording b;
+    CHECK(sbem::Decoder::decode(reference.data(), reference.size(), a));
+    CHECK(sbem::Decoder::decode(sensor.data(), sensor.size(), b));
+
+    sbem::ClockFit fit;
+    CHECK(sbem::ClockAligner::fit(a, b, sbem::AlignOptions(), fit));
+    CHECK(std::fabs(fit.offset + 5000) < 5 && std::fabs(fit.drift * 1e6 + 50) < 2);
+    CHECK(fit.anchor == start && fit.windows >= 8 && fit.score > 0.5);
+    if (gFailures)
+    {
+        fprintf(stderr, "offset %.2f ms, drift %.2f ppm, %zu windows, score %.2f\n", fit.offset, fit.drift * 1e6,
+                fit.windows, fit.score);
+        return;
+    }
+
+    // Where both sensors log, the joined vertical accelerations agree
+    std::vector<sbem::JoinSource> sources(2);
+    sources[0].pRecording = &a;
+    sources[0].label = "a";
+    sources[1].pRecording = &b;
+    sources[1].clock = fit;
+    sources[1].label = "b";
+    sbem::JoinOptions options;
+    options.rate = 50;
+    options.ecg = false;
+    options.overlap = true;
+    const std::string path = dir.file("joined.csv");
+    sbem::JoinStats stats;
+    CHECK(sbem::Joiner::write(sources, path.c_str(), options, stats));
+    CHECK(stats.rows > 50 * 7000 && stats.begin >= synthetic::START_MS);
+
+    FILE* pFile = fopen(path.c_str(), "r");
+    CHECK(pFile != nullptr);
+    if (!pFile)
+        return;
+    char line[1024];
+    CHECK(fgets(line, sizeof(line), pFile) && strncmp(line, "time_ms,a.acc_x,a.acc_y,a.acc_z,", 32) == 0);
+    double error = 0;
+    double signal = 0;
+    size_t rows = 0;
+    while (fgets(line, sizeof(line), pFile))
+    {
+        double v[13];
+        if (sscanf(line, "%lf,%lf,%lf,%lf,%lf,%lf,%lf,%lf,%lf,%lf,%lf,%lf,%lf", &v[0], &v[1], &v[2], &v[3], &v[4],
+                   &v[5], &v[6], &v[7], &v[8], &v[9], &v[10], &v[11], &v[12]) != 13)
+        {
+            continue;
+        }
+        error += (v[3] - v[9]) * (v[3] - v[9]);
+        signal += (v[3] - 9.81) * (v[3] - 9.81);
+        rows++;
+    }
+    fclose(pFile);
+    CHECK(rows + 10 >= stats.rows);
+    CHECK(error < 0.01 * signal);
+}
+
+/**
+*   Every level of the pyramid of a channel holds the min, max and mean of
+*   its samples binSamples at a time, the last bin partial, up to one bin.
+*/
+static bool samePyramid(const sbem::ColumnarReader& rReader, const char* channel,
+                        const sbem::Column<uint32_t>& rTimestamps, const sbem::Column<float>& rSamples,
+                        size_t perPacket)
+{
+    size_t levels = 0;
+    uint64_t bins = 0;
+    for (uint64_t binSamples = sbem::LodPyramid::BASE_BIN; bins != 1; binSamples *= sbem::LodPyramid::FACTOR)
+    {
+        const std::string prefix = std::string(channel) + "." + std::to_string(binSamples) + ".";
+        uint64_t counts[4] = {};
+        const float* pMin = rReader.array<float>((prefix + "min").c_str(), counts[0]);
+        const float* pMax = rReader.array<float>((prefix + "max").c_str(), counts[1]);
+        const float* pMean = rReader.array<float>((prefix + "mean").c_str(), counts[2]);
+        const uint32_t* pTime = rReader.array<uint32_t>((prefix + "time").c_str(), counts[3]);
+        bins = (rSamples.size + binSamples - 1) / binSamples;
+        if (!pMin || !pMax || !pMean || !pTime || counts[0] != bins || counts[1] != bins || counts[2] != bins ||
+            counts[3] != bins)
+        {
+            return false;
+        }
+        for (uint64_t b = 0; b < bins; b++)
+        {
+            const size_t first = b * binSamples;
+            const size_t end = std::min<size_t>(first + binSamples, rSamples.size);
+            float min = rSamples[first];
+            float max = rSamples[first];
+            double sum = 0;
+            for (size_t i = first; i < end; i++)
+            {
+                min = std::min(min, rSamples[i]);
+                max = std::max(max, rSamples[i]);
+                sum += rSamples[i];
+            }
+            const double mean = sum / (end - first);
+            if (pMin[b] != min || pMax[b] != max || std::fabs(pMean[b] - mean) > 1e-4 * (1 + std::fabs(mean)) ||
+                pTime[b] != rTimestamps[first / perPacket])
+            {
+                return false;
+            }
+        }
+        levels++;
+    }
+    uint64_t count = 0;
+    const std::string above = std::string(channel) + "." +
+                              std::to_string(sbem::LodPyramid::BASE_BIN << (2 * levels)) + ".time";
+    return levels > 1 && !rReader.array<uint32_t>(above.c_str(), count);
+}
+
+/** The pyramid of a log holds the bins its samples make, whether added whole or batch by batch. */
+static void testLodPyramid()
+{
+    TempDir dir;
+    CHECK(dir.ok());
+    SyntheticOptions options;
+    options.seconds = 613;
+    options.seed = 4;
+    options.holesPerMb = 8;
+    const std::vector<uint8_t> log = synthesizeLog(options).bytes;
+    sbem::Recording recording;
+    CHECK(sbem::Decoder::decode(log.data(), log.size(), recording));
+
+    sbem::LodPyramid whole;
+    whole.add(recording);
+    const std::string wholePath = dir.file("whole.lod.sbcol");
+    CHECK(whole.write(wholePath.c_str()));
+
+    sbem::LodPyramid batched;
+    sbem::StreamDecoder stream(log.data(), log.size());
+    sbem::Recording batch;
+    while (stream.next(batch, 4096))
+        batched.add(batch);
+    const std::string batchedPath = dir.file("batched.lod.sbcol");
+    CHECK(batched.write(batchedPath.c_str()));
+    std::vector<uint8_t> wholeBytes;
+    std::vector<uint8_t> batchedBytes;
+    CHECK(readFile(wholePath, wholeBytes) && readFile(batchedPath, batchedBytes) && batchedBytes == wholeBytes);
+
+    sbem::ColumnarReader reader;
+    CHECK(reader.open(wholePath.c_str()));
+    if (!reader.isOpen())
+        return;
+    CHECK(reader.sourceSize() == log.size() && reader.chunkCount() == recording.chunkCount);
+    const sbem::ImuColumns& rImu = recording.imu;
+    CHECK(rImu.accelX.size % sbem::LodPyramid::BASE_BIN != 0);
+    CHECK(samePyramid(reader, "ecg.samples", recording.ecg.timestamp, recording.ecg.samples,
+                      sbem::ECG_SAMPLES_PER_PACKET));
+    CHECK(samePyramid(reader, "imu.acc_x", rImu.timestamp, rImu.accelX, sbem::IMU_SAMPLES_PER_PACKET) &&
+          samePyramid(reader, "imu.acc_y", rImu.timestamp, rImu.accelY, sbem::IMU_SAMPLES_PER_PACKET) &&
+          samePyramid(reader, "imu.acc_z", rImu.timestamp, rImu.accelZ, sbem::IMU_SAMPLES_PER_PACKET));
+    CHECK(samePyramid(reader, "imu.gyro_x", rImu.timestamp, rImu.gyroX, sbem::IMU_SAMPLES_PER_PACKET) &&
+          samePyramid(reader, "imu.gyro_y", rImu.timestamp, rImu.gyroY, sbem::IMU_SAMPLES_PER_PACKET) &&
+          samePyramid(reader, "imu.gyro_z", rImu.timestamp, rImu.gyroZ, sbem::IMU_SAMPLES_PER_PACKET));
+
+    const sbem::ColumnView* pLevel = reader.find("ecg.samples.64.mean");
+    CHECK(pLevel && pLevel->sampleRate == 200.0f / 64 && pLevel->path == "/Meas/ECG/200/mV");
+}
+
+/** 16 and 212 records: every ECG sample back within half a step, the lost packets invalid, in place. */
+static void testWfdb()
+{
+    TempDir dir;
+    CHECK(dir.ok());
+    size_t ecgPackets = 0;
+    const std::vector<uint8_t> log = gappedLog(ecgPackets);
+    sbem::Recording recording;
+    CHECK(sbem::Decoder::decode(log.data(), log.size(), recording));
+    CHECK(recording.ecg.packets() == ecgPackets - (LOST_END - LOST_BEGIN));
+    const size_t perPacket = sbem::ECG_SAMPLES_PER_PACKET;
+
+    for (int format : { 16, 212 })
+    {
+        const std::string base = dir.file(format == 16 ? "rec16" : "rec212");
+        dir.file(format == 16 ? "rec16.dat" : "rec212.dat");
+        dir.file(format == 16 ? "rec16.hea" : "rec212.hea");
+        sbem::WfdbOptions options;
+        options.format = format;
+        sbem::WfdbStats stats;
+        CHECK(sbem::WfdbWriter::write(recording, base.c_str(), options, stats));
+        CHECK(stats.samples == ecgPackets * perPacket);
+        CHECK(stats.missing == (LOST_END - LOST_BEGIN) * perPacket);
+
+        // Record line, then: <file> <format> <gain>(<baseline>)/mV ...
+        std::vector<uint8_t> header;
+        CHECK(readFile(base + ".hea", header));
+        header.push_back(0);
+        const char* pSignal = strchr(reinterpret_cast<const char*>(header.data()), '\n');
+        int fileFormat = 0;
+        double gain = 0;
+        int baseline = 0;
+        CHECK(pSignal && sscanf(pSignal + 1, "%*s %d %lf(%d)", &fileFormat, &gain, &baseline) == 3);
+        CHECK(fileFormat == format && gain > 0);
+
+        std::vector<uint8_t> dat;
+        CHECK(readFile(base + ".dat", dat));
+        std::vector<int> adu;
+        if (format == 16)
+        {
+            for (size_t i = 0; i + 1 < dat.size(); i += 2)
+                adu.push_back(static_cast<int16_t>(dat[i] | dat[i + 1] << 8));
+        }
+        else
+        {
+            for (size_t i = 0; i + 2 < dat.size(); i += 3)
+            {
+                const int first = dat[i] | (dat[i + 1] & 0x0F) << 8;
+                const int second = dat[i + 2] | (dat[i + 1] & 0xF0) << 4;
+                adu.push_back(first >= 2048 ? first - 4096 : first);
+                adu.push_back(second >= 2048 ? second - 4096 : second);
+            }
+        }
+        CHECK(adu.size() == stats.samples);
+        if (adu.size() != stats.samples)
+            continue;
+
+        const int invalid = format == 16 ? -32768 : -2048;
+        const double tolerance = 0.5 / gain + 1e-6;
+        size_t worse = 0;
+        for (size_t p = 0; p < ecgPackets; p++)
+        {
+            const bool isLost = p >= LOST_BEGIN && p < LOST_END;
+            const size_t decoded = p < LOST_BEGIN ? p : p - (LOST_END - LOST_BEGIN);
+            for (size_t k = 0; k < perPacket; k++)
+            {
+                const int value = adu[p * perPacket + k];
+                if (isLost)
+                    worse += value != invalid;
+                else
+                    worse += std::fabs((value - baseline) / gain -
+                                       recording.ecg.samples[decoded * perPacket + k]) > tolerance;
+            }
+        }
+        CHECK(worse == 0);
+    }
+}
+
+/** The EDF+ file holds every ECG and IMU sample within a step of its range, in its slot. */
+static void testEdf()
+{
+    TempDir dir;
+    CHECK(dir.ok());
+    size_t ecgPackets = 0;
+    const std::vector<uint8_t> log = gappedLog(ecgPackets);
+    sbem::Recording recording;
+    CHECK(sbem::Decoder::decode(log.data(), log.size(), recording));
+
+    const std::string path = dir.file("rec.edf");
+    sbem::EdfStats stats;
+    CHECK(sbem::EdfWriter::write(recording, path.c_str(), sbem::EdfOptions(), stats));
+    CHECK(stats.signals == 7 && stats.records == 60 && stats.skipped == 0);
+
+    std::vector<uint8_t> file;
+    CHECK(readFile(path, file));
+    CHECK(file.size() > 256);
+    if (file.size() <= 256)
+        return;
+    const auto field = [&](size_t offset, size_t width)
+    {
+        return std::string(reinterpret_cast<const char*>(&file[offset]), width);
+    };
+    const size_t headerBytes = static_cast<size_t>(atol(field(184, 8).c_str()));
+    const size_t records = static_cast<size_t>(atol(field(236, 8).c_str()));
+    const size_t signals = static_cast<size_t>(atol(field(252, 4).c_str()));
+    CHECK(field(192, 5) == "EDF+C");
+    CHECK(records == 60 && signals == 8 && headerBytes == 256 * (signals + 1));
+    if (signals != 8 || file.size() < headerBytes)
+        return;
+
+    // Per signal: physical and digital range, samples per record
+    std::vector<double> physicalMin(signals);
+    std::vector<double> physicalMax(signals);
+    std::vector<double> digitalMin(signals);
+    std::vector<double> digitalMax(signals);
+    std::vector<size_t> perRecord(signals);
+    size_t recordBytes = 0;
+    for (size_t s = 0; s < signals; s++)
+    {
+        physicalMin[s] = atof(field(256 + signals * 104 + s * 8, 8).c_str());
+        physicalMax[s] = atof(field(256 + signals * 112 + s * 8, 8).c_str());
+        digitalMin[s] = atof(field(256 + signals * 120 + s * 8, 8).c_str());
+        digitalMax[s] = atof(field(256 + signals * 128 + s * 8, 8).c_str());
+        perRecord[s] = static_cast<size_t>(atol(field(256 + signals * 216 + s * 8, 8).c_str()));
+        recordBytes += perRecord[s] * 2;
+    }
+    CHECK(field(256, 16).compare(0, 3, "ECG") == 0 && field(256 + 16, 16).compare(0, 7, "Accel X") == 0);
+    CHECK(perRecord[0] == 200 && perRecord[1] == 26);
+    CHECK(file.size() == headerBytes + records * recordBytes);
+    if (file.size() != headerBytes + records * recordBytes)
+        return;
+
+    // Signal s, sample i of the whole file, in physical units
+    const auto physical = [&](size_t s, size_t i)
+    {
+        size_t offset = headerBytes + i / perRecord[s] * recordBytes;
+        for (size_t before = 0; before < s; before++)
+            offset += perRecord[before] * 2;
+        offset += i % perRecord[s] * 2;
+        const int16_t digital = static_cast<int16_t>(file[offset] | file[offset + 1] << 8);
+        return (digital - digitalMin[s]) * (physicalMax[s] - physicalMin[s]) / (digitalMax[s] - digitalMin[s]) +
+               physicalMin[s];
+    };
+
+    const size_t ecgPerPacket = sbem::ECG_SAMPLES_PER_PACKET;
+    const double ecgStep = (physicalMax[0] - physicalMin[0]) / (digitalMax[0] - digitalMin[0]);
+    size_t worse = 0;
+    for (size_t p = 0; p < ecgPackets; p++)
+    {
+        const bool isLost = p >= LOST_BEGIN && p < LOST_END;
+        const size_t decoded = p < LOST_BEGIN ? p : p - (LOST_END - LOST_BEGIN);
+        for (size_t k = 0; k < ecgPerPacket; k++)
+        {
+            // A lost packet's slots hold the value nearest to 0 mV
+            const double expected = isLost ? 0.0 : recording.ecg.samples[decoded * ecgPerPacket + k];
+            worse += std::fabs(physical(0, p * ecgPerPacket + k) - expected) > ecgStep;
+        }
+    }
+    CHECK(worse == 0);
+
+    const double accStep = (physicalMax[1] - physicalMin[1]) / (digitalMax[1] - digitalMin[1]);
+    worse = 0;
+    for (size_t i = 0; i < recording.imu.accelX.size; i++)
+        worse += std::fabs(physical(1, i) - recording.imu.accelX[i]) > accStep;
+    CHECK(worse == 0);
+}
+
+/** Peak resident size of a tool run in kB, its output discarded; -1 if it fails. */
+static long peakKb(const char* tool, const std::vector<std::string>& rArgs)
+{
+    std::vector<char*> argv = { const_cast<char*>(tool) };
+    for (const std::string& rArg : rArgs)
+        argv.push_back(const_cast<char*>(rArg.c_str()));
+    argv.push_back(nullptr);
+
+    const pid_t pid = fork();
+    if (pid == 0)
+    {
+        const int null = open("/dev/null", O_WRONLY);
+        dup2(null, STDOUT_FILENO);
+        execv(tool, argv.data());
+        _exit(127);
+    }
+    int status = 0;
+    struct rusage usage;
+    if (pid < 0 || wait4(pid, &status, 0, &usage) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        return -1;
+    return usage.ru_maxrss;
+}
+
+/** sbembatch keeps a recording per thread, not per file: 16 files peak where 4 do. */
+static void testBatchMemory()
+{
+    TempDir few;
+    TempDir many;
+    TempDir out;
+    CHECK(few.ok() && many.ok() && out.ok());
+    SyntheticOptions options;
+    options.seconds = 1800;
+    const std::vector<uint8_t> log = synthesizeLog(options).bytes;
+    for (int i = 0; i < 16; i++)
+    {
+        const std::string name = "log" + std::to_string(i);
+        if (i < 4)
+            CHECK(writeFile(few.file(name + ".sbem"), log));
+        CHECK(writeFile(many.file(name + ".sbem"), log));
+        out.file(name + ".sbcol");
+    }
+
+    const std::vector<std::string> options4 = { "-j", "2", "--columnar", "--no-index" };
+    std::vector<std::string> fewArgs = options4;
+    fewArgs.push_back(few.path());
+    fewArgs.push_back(out.path());
+    std::vector<std::string> manyArgs = options4;
+    manyArgs.push_back(many.path());
+    manyArgs.push_back(out.path());
+    const long fewKb = peakKb(SBEMBATCH, fewArgs);
+    const long manyKb = peakKb(SBEMBATCH, manyArgs);
+    CHECK(fewKb > 0 && manyKb > 0);
+
+    // A recording is about the size of its file: two more of them, where 12 more would pile up per file
+    const long marginKb = static_cast<long>(2 * log.size() / 1024);
+    CHECK(manyKb < fewKb + marginKb);
+    if (manyKb >= fewKb + marginKb)
+        fprintf(stderr, "peak %ld kB with 4 files, %ld kB with 16\n", fewKb, manyKb);
+}
+
+/** The CSV is byte identical to converter.py's, written whole or while the notifications arrive. */
+static void testCsvConverter()
+{
+    TempDir dir;
+    CHECK(dir.ok());
+    std::vector<uint8_t> log;
+    std::vector<uint8_t> expected;
+    CHECK(readFile(SBEM_TEST_DATA "/synthetic_10s.sbem", log));
+    CHECK(readFile(SBEM_TEST_DATA "/synthetic_10s.csv", expected));
+    CHECK(!log.empty() && !expected.empty());
+
+    sbem::Recording recording;
+    CHECK(sbem::Decoder::decode(log.data(), log.size(), recording));
+    const std::string wholePath = dir.file("whole.csv");
+    CHECK(sbem::CsvWriter::write(recording, wholePath.c_str()));
+    std::vector<uint8_t> whole;
+    CHECK(readFile(wholePath, whole));
+    CHECK(whole == expected);
+
+    const std::string pushedPath = dir.file("pushed.csv");
+    std::vector<std::vector<uint8_t>> frames = notifications(log, sbem::winlogger::CLIENT_REFERENCE);
+    SyntheticRandom random(9);
+    shuffle(frames, 8, random);
+    sbem::PushConverter converter(pushedPath.c_str());
+    for (const std::vector<uint8_t>& rFrame : frames)
+    {
+        CHECK(converter.push(sbem::loadU32(&rFrame[2]), &rFrame[sbem::winlogger::FRAME_HEADER],
+                             rFrame.size() - sbem::winlogger::FRAME_HEADER));
+    }
+    sbem::StreamStats stats;
+    CHECK(converter.finish(stats));
+    std::vector<uint8_t> pushed;
+    CHECK(readFile(pushedPath, pushed));
+    CHECK(pushed == expected);
+}
+
+struct Case
+{
+    const char* name;
+    void (*run)();
+};
+
+static const Case CASES[] =
+{
+    { "scanner-holes", testScannerHoles },
+    { "scanner-restart", testScannerRestart },
+    { "decoder-paths", testDecoderPaths },
+    { "chunk-index", testChunkIndex },
+    { "columnar", testColumnar },
+    { "time-window", testTimeWindow },
+#if SBEM_HAVE_ZSTD
+    { "seekable-zstd", testSeekableZstd },
+#endif
+    { "reassembler", testReassembler },
+    { "repacker", testRepacker },
+    { "stitcher", testStitcher },
+    { "clock-align", testClockAlign },
+    { "lod-pyramid", testLodPyramid },
+    { "wfdb", testWfdb },
+    { "edf", testEdf },
+    { "csv-converter", testCsvConverter },
+    { "batch-memory", testBatchMemory },
+};
+
+int main(int argc, char** argv)
+{
+    if (argc != 2)
+    {
+        fprintf(stderr, "Usage: sbemtest <case>\n  cases:");
+        for (const Case& rCase : CASES)
+            fprintf(stderr, " %s", rCase.name);
+        fprintf(stderr, "\n");
+        return 1;
+    }
+    for (const Case& rCase : CASES)
+    {
+        if (strcmp(argv[1], rCase.name) == 0)
+        {
+            rCase.run();
+            printf("%s: %s\n", rCase.name, gFailures ? "FAILED" : "ok");
+            return gFailures ? 1 : 0;
+        }
+    }
+    fprintf(stderr, "Unknown case %s\n", argv[1]);
+    return 1;
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+// Output naming of the GUI (gui/main_window.py): ParticipantID_DDMMYY_day.csv
+// and the raw log naming of the extractor (extraction/extractor.py)
+
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <map>
+#include <set>
+#include <string>
+
+#include "ToolUtil.h"
+
+class ParticipantMap
+{
+public:
+    /**
+    *   Load "sensor,participantID" rows the way MainWindow.load_mapping_csv()
+    *   does: the key is the last 6 digits of the sensor column.
+    *
+    *   @return false if the file can't be read or has no valid rows
+    */
+    bool load(const std::string& path)
+    {
+        FILE* pFile = fopen(path.c_str(), "r");
+        if (!pFile)
+            return false;
+
+        char line[512];
+        while (fgets(line, sizeof(line), pFile))
+        {
+            const std::string row(line);
+            const size_t comma = row.find(',');
+            if (comma == std::string::npos)
+                continue;
+
+            std::string digits;
+            for (size_t i = 0; i < comma; i++)
+            {
+                if (row[i] >= '0' && row[i] <= '9')
+                    digits.push_back(row[i]);
+            }
+            const size_t end = row.find(',', comma + 1);
+            const std::string participant = trim(row.substr(comma + 1, end == std::string::npos ? std::string::npos : end - comma - 1));
+            if (digits.size() >= 6 && !participant.empty())
+                mParticipants[digits.substr(digits.size() - 6)] = participant;
+        }
+        fclose(pFile);
+        return !mParticipants.empty();
+    }
+
+    bool empty() const { return mParticipants.empty(); }
+
+    /**
+    *   Same rule as MainWindow.guess_sensor_from_filename(): the last 6 digits
+    *   of the first run of 6 or more digits that is in the map.
+    */
+    std::string participantForFile(const std::string& fileName) const
+    {
+        size_t i = 0;
+        while (i < fileName.size())
+        {
+            if (!isdigit(static_cast<unsigned char>(fileName[i])))
+            {
+                i++;
+                continue;
+            }
+            size_t j = i;
+            while (j < fileName.size() && isdigit(static_cast<unsigned char>(fileName[j])))
+                j++;
+            if (j - i >= 6)
+            {
+                auto it = mParticipants.find(fileName.substr(j - 6, 6));
+                if (it != mParticipants.end())
+                    return it->second;
+            }
+            i = j;
+        }
+        return std::string();
+    }
+
+    /** Today as DDMMYY, like datetime.now().strftime("%d%m%y"). */
+    static std::string today()
+    {
+        char buf[8];
+        const time_t now = time(nullptr);
+        strftime(buf, sizeof(buf), "%d%m%y", localtime(&now));
+        return buf;
+    }
+
+private:
+    static std::string trim(const std::string& s)
+    {
+        const size_t b = s.find_first_not_of(" \t\r\n");
+        const size_t e = s.find_last_not_of(" \t\r\n");
+        return b == std::string::npos ? std::string() : s.substr(b, e - b + 1);
+    }
+
+    std::map<std::string, std::string> mParticipants;
+};
+
+/**
+*   Pick an output path that exists neither on disk nor in rTaken, appending
+*   _1, _2, ... like MainWindow.safe_rename(), and claim it. A compression
+*   suffix (".zst") goes after the extension: PID_DDMMYY_day_1.csv.zst.
+*/
+inline std::string claimOutputPath(const std::string& wanted, std::set<std::string>& rTaken,
+                                   const char* suffix = "")
+{
+    const size_t dot = wanted.find_last_of('.');
+    const std::string base = dot == std::string::npos ? wanted : wanted.substr(0, dot);
+    const std::string ext = (dot == std::string::npos ? std::string() : wanted.substr(dot)) + suffix;
+
+    std::string candidate = base + ext;
+    for (int i = 1; fileExists(candidate) || rTaken.count(candidate); i++)
+        candidate = base + "_" + std::to_string(i) + ext;
+    rTaken.insert(candidate);
+    return candidate;
+}
+
+/**
+*   Split a raw log name of fetch_log(), HHMMSSDDMMYYYY_<sensor>_<logid>.sbem,
+*   into its sensor and Logbook id.
+*
+*   @return false if the name doesn't end in _<sensor>_<digits>.sbem
+*/
+inline bool parseLogName(const std::string& path, std::string& rSensor, uint32_t& rLogId)
+{
+    const std::string name = baseName(path);
+    const size_t idAt = name.find_last_of('_');
+    if (idAt == std::string::npos || idAt == 0 || idAt + 1 == name.size() ||
+        name.find_first_not_of("0123456789", idAt + 1) != std::string::npos || name.size() - idAt > 10)
+    {
+        return false;
+    }
+    const size_t sensorAt = name.find_last_of('_', idAt - 1);
+    if (sensorAt == std::string::npos || sensorAt + 1 == idAt)
+        return false;
+    rSensor = name.substr(sensorAt + 1, idAt - sensorAt - 1);
+    rLogId = static_cast<uint32_t>(strtoul(name.c_str() + idAt + 1, nullptr, 10));
+    return true;
+}
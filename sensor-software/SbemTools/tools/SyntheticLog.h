@@ -0,0 +1,268 @@
+#pragma once
+
+// Deterministic synthetic SBEM logs for benchmarks and round-trip checks
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "sbem/SbemFormat.h"
+
+struct SyntheticOptions
+{
+    double seconds = 3600;      // logged time
+    uint64_t seed = 1;
+    double holesPerMb = 0;      // corrupt stretches per MB of log, half zero filled, half random bytes
+};
+
+/** A generated log and what a decoder should find in it. */
+struct SyntheticLog
+{
+    std::vector<uint8_t> bytes;
+    size_t ecgPackets = 0;
+    size_t imuPackets = 0;
+    std::vector<sbem::Gap> corrupted;   // byte ranges overwritten, in file order
+    size_t ecgDamaged = 0;              // packets overlapping a corrupted range, the most a decoder may lose
+    size_t imuDamaged = 0;
+};
+
+/** splitmix64: the same numbers on every platform and standard library. */
+class SyntheticRandom
+{
+public:
+    explicit SyntheticRandom(uint64_t seed): mState(seed) {}
+
+    uint64_t next()
+    {
+        uint64_t z = (mState += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    /** Uniform in [0, 1). */
+    double uniform() { return (next() >> 11) * (1.0 / 9007199254740992.0); }
+
+    /** Roughly normal, mean 0 and deviation 1 (Irwin-Hall of 4). */
+    double noise() { return (uniform() + uniform() + uniform() + uniform() - 2.0) * 1.7320508075688772; }
+
+    uint64_t below(uint64_t n) { return n ? next() % n : 0; }
+
+private:
+    uint64_t mState;
+};
+
+namespace synthetic
+{
+
+// Chunk ids of the Winlogger's DataLogger config: ECG and IMU6 groups, plus their items
+constexpr uint16_t ECG_ID = 5;
+constexpr uint16_t IMU_ID = 6;
+constexpr double ECG_PACKET_MS = 1000.0 * sbem::ECG_SAMPLES_PER_PACKET / 200;
+constexpr double IMU_PACKET_MS = 1000.0 * sbem::IMU_SAMPLES_PER_PACKET / 26;
+constexpr uint32_t START_MS = 12345;
+
+inline void putId(std::vector<uint8_t>& rOut, uint16_t id)
+{
+    uint8_t bytes[3];
+    rOut.insert(rOut.end(), bytes, bytes + sbem::writeId(bytes, id));
+}
+
+inline void putLength(std::vector<uint8_t>& rOut, uint32_t length)
+{
+    uint8_t bytes[5];
+    rOut.insert(rOut.end(), bytes, bytes + sbem::writeLen(bytes, length));
+}
+
+inline void putChunk(std::vector<uint8_t>& rOut, uint16_t id, const void* pPayload, uint32_t length)
+{
+    putId(rOut, id);
+    putLength(rOut, length);
+    const uint8_t* p = static_cast<const uint8_t*>(pPayload);
+    rOut.insert(rOut.end(), p, p + length);
+}
+
+/** Chunks starting at the sorted offsets, each size bytes long, that overlap one of the ranges. */
+inline size_t countDamaged(const std::vector<uint64_t>& rStarts, uint64_t size, const std::vector<sbem::Gap>& rRanges)
+{
+    std::vector<bool> damaged(rStarts.size());
+    for (const sbem::Gap& rRange : rRanges)
+    {
+        const uint64_t first = rRange.begin >= size ? rRange.begin - size + 1 : 0;
+        for (auto it = std::lower_bound(rStarts.begin(), rStarts.end(), first);
+             it != rStarts.end() && *it < rRange.end; ++it)
+        {
+            damaged[it - rStarts.begin()] = true;
+        }
+    }
+    return static_cast<size_t>(std::count(damaged.begin(), damaged.end(), true));
+}
+
+inline void putDescriptor(std::vector<uint8_t>& rOut, uint16_t id, const char* text)
+{
+    std::vector<uint8_t> payload;
+    putId(payload, id);
+    payload.insert(payload.end(), text, text + strlen(text));
+    putChunk(rOut, sbem::DESCRIPTOR_ID, payload.data(), static_cast<uint32_t>(payload.size()));
+}
+
+inline void putU32(uint8_t* p, uint32_t v)
+{
+    memcpy(p, &v, 4);
+}
+
+inline void putF32(uint8_t* p, float v)
+{
+    memcpy(p, &v, 4);
+}
+
+/** Bump of height a centred at c (fraction of a beat) with width w. */
+inline double wave(double phase, double a, double c, double w)
+{
+    const double d = (phase - c) / w;
+    return a * std::exp(-0.5 * d * d);
+}
+
+/** Lead voltage in mV at t seconds: P, QRS and T waves at about 70 bpm, baseline wander and noise. */
+inline double ecgMv(double t, SyntheticRandom& rRandom)
+{
+    const double beat = 60.0 / (70.0 + 4.0 * std::sin(t * 0.05));
+    const double phase = std::fmod(t, beat) / beat;
+    return wave(phase, 0.15, 0.18, 0.025) - wave(phase, 0.12, 0.285, 0.008) + wave(phase, 1.2, 0.3, 0.011) -
+           wave(phase, 0.25, 0.318, 0.009) + wave(phase, 0.3, 0.55, 0.05) + 0.1 * std::sin(t * 1.57) +
+           0.02 * rRandom.noise();
+}
+
+} // namespace synthetic
+
+/**
+*   Generate a log the way the Winlogger records it: the 8 byte header, the
+*   descriptors of the ECG (200 Hz, 16 samples a packet) and IMU6 (26 Hz, 2
+*   samples a packet) groups, then both packet streams interleaved in
+*   timestamp order with a plausible ECG waveform and accelerometer/gyro
+*   readings. The same options always give the same bytes.
+*/
+inline SyntheticLog synthesizeLog(const SyntheticOptions& rOptions)
+{
+    using namespace synthetic;
+
+    SyntheticLog log;
+    SyntheticRandom random(rOptions.seed);
+    std::vector<uint8_t>& out = log.bytes;
+
+    const size_t ecgPackets = static_cast<size_t>(rOptions.seconds * 1000 / ECG_PACKET_MS);
+    const size_t imuPackets = static_cast<size_t>(rOptions.seconds * 1000 / IMU_PACKET_MS);
+    out.reserve(sbem::HEADER_SIZE + 512 + ecgPackets * (sbem::ECG_MV_PACKET_SIZE + 2) +
+                imuPackets * (sbem::IMU6_PACKET_SIZE + 2));
+
+    static const char HEADER[sbem::HEADER_SIZE] = { 'S', 'B', 'E', 'M', 0, 0, 0, 0 };
+    out.resize(sbem::HEADER_SIZE);
+    memcpy(out.data(), HEADER, sbem::HEADER_SIZE);
+    putDescriptor(out, 10, "<FRM>uint32<NME>Timestamp");
+    putDescriptor(out, 11, "<FRM>float32[]<NME>Samples");
+    putDescriptor(out, ECG_ID, "<GRP>10,11<PTH>/Meas/ECG/200/mV");
+    putDescriptor(out, 13, "<FRM>float32[3][2]<NME>ArrayAcc");
+    putDescriptor(out, 14, "<FRM>float32[3][2]<NME>ArrayGyro");
+    putDescriptor(out, IMU_ID, "<GRP>10,13,14<PTH>/Meas/IMU6/26");
+    const size_t dataBegin = out.size();
+
+    uint8_t ecg[sbem::ECG_MV_PACKET_SIZE];
+    uint8_t imu[sbem::IMU6_PACKET_SIZE];
+    std::vector<uint64_t> ecgStarts;
+    std::vector<uint64_t> imuStarts;
+    size_t e = 0;
+    size_t i = 0;
+    while (e < ecgPackets || i < imuPackets)
+    {
+        const double ecgMs = e * ECG_PACKET_MS;
+        const double imuMs = i * IMU_PACKET_MS;
+        if (e < ecgPackets && (i >= imuPackets || ecgMs <= imuMs))
+        {
+            putU32(ecg, START_MS + static_cast<uint32_t>(ecgMs));
+            for (size_t s = 0; s < sbem::ECG_SAMPLES_PER_PACKET; s++)
+                putF32(ecg + 4 + s * 4, static_cast<float>(ecgMv((ecgMs + s * 5.0) / 1000, random)));
+            ecgStarts.push_back(out.size());
+            putChunk(out, ECG_ID, ecg, sizeof(ecg));
+            e++;
+        }
+        else
+        {
+            // Walking: gravity on z with a sway, a slow turn on the gyro z axis
+            putU32(imu, START_MS + static_cast<uint32_t>(imuMs));
+            for (size_t s = 0; s < sbem::IMU_SAMPLES_PER_PACKET; s++)
+            {
+                const double t = (imuMs + s * 1000.0 / 26) / 1000;
+                const float acc[3] =
+                {
+                    static_cast<float>(0.6 * std::sin(t * 11.0) + 0.05 * random.noise()),
+                    static_cast<float>(0.3 * std::cos(t * 5.5) + 0.05 * random.noise()),
+                    static_cast<float>(9.81 + 0.8 * std::sin(t * 11.0 + 0.4) + 0.05 * random.noise()),
+                };
+                const float gyro[3] =
+                {
+                    static_cast<float>(4.0 * std::sin(t * 5.5) + 0.5 * random.noise()),
+                    static_cast<float>(2.0 * std::cos(t * 11.0) + 0.5 * random.noise()),
+                    static_cast<float>(6.0 * std::sin(t * 0.2) + 0.5 * random.noise()),
+                };
+                for (size_t axis = 0; axis < 3; axis++)
+                {
+                    putF32(imu + 4 + (s * 3 + axis) * 4, acc[axis]);
+                    putF32(imu + 4 + 24 + (s * 3 + axis) * 4, gyro[axis]);
+                }
+            }
+            imuStarts.push_back(out.size());
+            putChunk(out, IMU_ID, imu, sizeof(imu));
+            i++;
+        }
+    }
+    log.ecgPackets = ecgPackets;
+    log.imuPackets = imuPackets;
+
+    // Holes where BLE notifications were lost, and stretches of noise; never in the descriptors
+    const size_t dataSize = out.size() - dataBegin;
+    const size_t holes = static_cast<size_t>(rOptions.holesPerMb * out.size() / 1e6 + 0.5);
+    for (size_t h = 0; h < holes && dataSize > 4096; h++)
+    {
+        const uint64_t begin = dataBegin + random.below(dataSize - 2048);
+        const uint64_t length = 16 + random.below(2032);
+        const bool zeros = h % 2 == 0;
+        for (uint64_t b = begin; b < begin + length; b++)
+            out[b] = zeros ? 0 : static_cast<uint8_t>(random.next());
+        log.corrupted.push_back({ begin, begin + length });
+    }
+    std::sort(log.corrupted.begin(), log.corrupted.end(),
+              [](const sbem::Gap& a, const sbem::Gap& b) { return a.begin < b.begin; });
+    if (!log.corrupted.empty())
+    {
+        // Id and length bytes in front of the payload
+        log.ecgDamaged = countDamaged(ecgStarts, 2 + sbem::ECG_MV_PACKET_SIZE, log.corrupted);
+        log.imuDamaged = countDamaged(imuStarts, 2 + sbem::IMU6_PACKET_SIZE, log.corrupted);
+    }
+    return log;
+}
+
+/** "90s", "10m", "8h", "2d" or plain seconds; false if unreadable. */
+inline bool parseDuration(const char* text, double& rSeconds)
+{
+    char* pEnd;
+    const double value = strtod(text, &pEnd);
+    if (pEnd == text || value <= 0)
+        return false;
+    double unit = 1;
+    if (*pEnd == 'm')
+        unit = 60;
+    else if (*pEnd == 'h')
+        unit = 3600;
+    else if (*pEnd == 'd')
+        unit = 86400;
+    else if (*pEnd != 's' && *pEnd)
+        return false;
+    if (*pEnd && pEnd[1])
+        return false;
+    rSeconds = value * unit;
+    return true;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+// --from/--to times of the tools that cut logs by time
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+constexpr uint64_t DAY_MS = 24 * 3600 * 1000ull;
+
+/** A --from/--to value before it is resolved against a file's first packet. */
+struct TimeSpec
+{
+    enum Kind
+    {
+        SENSOR,     // 52000: packet timestamp in ms
+        OFFSET,     // +0:30: after the first packet
+        CLOCK       // 14:00: wall clock, needs --start
+    };
+
+    Kind kind;
+    uint64_t ms;
+};
+
+/** H:MM[:SS[.fff]] to ms. */
+inline bool parseClock(const char* text, uint64_t& rMs)
+{
+    char* pEnd;
+    const long hours = strtol(text, &pEnd, 10);
+    if (pEnd == text || *pEnd != ':' || hours < 0)
+        return false;
+    const char* pMinutes = pEnd + 1;
+    const long minutes = strtol(pMinutes, &pEnd, 10);
+    if (pEnd == pMinutes || minutes < 0 || minutes > 59)
+        return false;
+    double seconds = 0;
+    if (*pEnd == ':')
+    {
+        const char* pSeconds = pEnd + 1;
+        seconds = strtod(pSeconds, &pEnd);
+        if (pEnd == pSeconds || seconds < 0 || seconds >= 60)
+            return false;
+    }
+    if (*pEnd)
+        return false;
+
+    rMs = (static_cast<uint64_t>(hours) * 60 + static_cast<uint64_t>(minutes)) * 60000 +
+          static_cast<uint64_t>(seconds * 1000 + 0.5);
+    return true;
+}
+
+inline bool parseTime(const char* text, TimeSpec& rSpec)
+{
+    if (text[0] == '+')
+    {
+        rSpec.kind = TimeSpec::OFFSET;
+        return parseClock(text + 1, rSpec.ms);
+    }
+    if (strchr(text, ':'))
+    {
+        rSpec.kind = TimeSpec::CLOCK;
+        return parseClock(text, rSpec.ms);
+    }
+
+    char* pEnd;
+    rSpec.kind = TimeSpec::SENSOR;
+    rSpec.ms = strtoull(text, &pEnd, 10);
+    return pEnd != text && !*pEnd && rSpec.ms <= UINT32_MAX;
+}
+
+/** Sensor time of a spec in a file whose first packet is at firstTimestamp, logged from startClock on. */
+inline uint64_t resolve(const TimeSpec& rSpec, uint32_t firstTimestamp, uint64_t startClock)
+{
+    switch (rSpec.kind)
+    {
+    case TimeSpec::OFFSET:
+        return firstTimestamp + rSpec.ms;
+    case TimeSpec::CLOCK:
+        return firstTimestamp + (rSpec.ms + DAY_MS - startClock) % DAY_MS;
+    default:
+        return rSpec.ms;
+    }
+}
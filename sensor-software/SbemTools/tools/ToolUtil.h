@@ -0,0 +1,83 @@
+#pragma once
+
+// Small file helpers shared by the command line tools
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+inline bool isDirectory(const std::string& path)
+{
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+inline bool fileExists(const std::string& path)
+{
+    struct stat st;
+    return stat(path.c_str(), &st) == 0;
+}
+
+inline uint64_t fileSize(const std::string& path)
+{
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 ? static_cast<uint64_t>(st.st_size) : 0;
+}
+
+/** An argument starting with '-' is an option, never a path; "-" alone is left to the tool. */
+inline bool isOption(const char* arg)
+{
+    return arg[0] == '-' && arg[1] != '\0';
+}
+
+inline bool hasSuffix(const std::string& s, const char* suffix)
+{
+    const size_t n = strlen(suffix);
+    return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+/** File name without folder and extension. */
+inline std::string baseName(const std::string& path)
+{
+    size_t slash = path.find_last_of('/');
+    std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+    size_t dot = name.find_last_of('.');
+    return dot == std::string::npos ? name : name.substr(0, dot);
+}
+
+inline std::string dirName(const std::string& path)
+{
+    size_t slash = path.find_last_of('/');
+    return slash == std::string::npos ? std::string(".") : path.substr(0, slash);
+}
+
+/**
+*   The .sbem files of a folder sorted by name, or the target itself if it is a file.
+*/
+inline std::vector<std::string> listSbemFiles(const std::string& target)
+{
+    std::vector<std::string> files;
+    if (!isDirectory(target))
+    {
+        files.push_back(target);
+        return files;
+    }
+
+    if (DIR* pDir = opendir(target.c_str()))
+    {
+        while (dirent* pEntry = readdir(pDir))
+        {
+            std::string name = pEntry->d_name;
+            if (hasSuffix(name, ".sbem"))
+                files.push_back(target + "/" + name);
+        }
+        closedir(pDir);
+    }
+    std::sort(files.begin(), files.end());
+    return files;
+}
@@ -0,0 +1,322 @@
+// sbem2csv: native replacement for `python conversion/converter.py <folder>`
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "sbem/ColumnarWriter.h"
+#include "sbem/CsvWriter.h"
+#include "sbem/Decoder.h"
+#include "sbem/EdfWriter.h"
+#include "sbem/LodPyramid.h"
+#include "sbem/MappedFile.h"
+#include "sbem/StreamConverter.h"
+#include "sbem/WfdbWriter.h"
+
+#include "ParticipantMap.h"
+#include "ToolUtil.h"
+
+enum class Format
+{
+    CSV,
+    COLUMNAR,
+    EDF,
+    WFDB
+};
+
+static void reportGaps(const std::string& path, const std::vector<sbem::Gap>& rGaps, bool truncated)
+{
+    for (const sbem::Gap& rGap : rGaps)
+    {
+        fprintf(stderr, "%s: skipped corrupt bytes %llu-%llu%s\n", path.c_str(),
+                static_cast<unsigned long long>(rGap.begin), static_cast<unsigned long long>(rGap.end),
+                truncated && &rGap == &rGaps.back() ? " (truncated at end)" : "");
+    }
+}
+
+/** Write the pyramid next to the output, uncompressed so a viewer can map it. */
+static bool writeLod(sbem::LodPyramid& rLod, const std::string& path, const std::string& outputDir)
+{
+    const std::string lodPath = outputDir + "/" + baseName(path) + ".lod.sbcol";
+    if (!rLod.write(lodPath.c_str()))
+    {
+        fprintf(stderr, "%s: can't write %s\n", path.c_str(), lodPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+/** Convert in batches within memoryLimit bytes, whatever the length of the log. */
+static bool streamFile(const std::string& path, const std::string& outputDir, size_t memoryLimit,
+                       const sbem::DecodeOptions& rOptions, const sbem::CsvOptions& rCsvOptions, bool lod)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    sbem::MappedFile file;
+    if (!file.open(path.c_str()) || file.size() < sbem::HEADER_SIZE)
+    {
+        fprintf(stderr, "%s: not a readable SBEM file\n", path.c_str());
+        return false;
+    }
+
+    const std::string outPath =
+        outputDir + "/" + baseName(path) + ".csv" + sbem::OutputFile::suffix(rCsvOptions.output.compression);
+    sbem::StreamStats stats;
+    sbem::LodPyramid pyramid;
+    const bool ok = sbem::StreamConverter::toCsv(file, outPath.c_str(), memoryLimit, rOptions, rCsvOptions, stats,
+                                                 lod ? &pyramid : nullptr);
+    reportGaps(path, stats.gaps, stats.truncated);
+    if (!ok)
+    {
+        fprintf(stderr, "%s: no data rows written\n", path.c_str());
+        return false;
+    }
+    if (lod && !writeLod(pyramid, path, outputDir))
+        return false;
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("%s -> %s: %zu ECG, %zu IMU, %zu other chunks in %zu batches, %.1f MB/s\n",
+           path.c_str(), outPath.c_str(), stats.ecgPackets, stats.imuPackets, stats.otherChunks, stats.batches,
+           file.size() / 1e6 / (seconds > 0 ? seconds : 1e-9));
+    return true;
+}
+
+static bool convertFile(const std::string& path, const std::string& outputDir, const sbem::DecodeOptions& rOptions,
+                        const sbem::CsvOptions& rCsvOptions, Format format, int wfdbFormat, bool lod)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    sbem::Recording recording;
+    if (!sbem::Decoder::decodeFile(path.c_str(), recording, rOptions))
+    {
+        fprintf(stderr, "%s: not a readable SBEM file\n", path.c_str());
+        return false;
+    }
+    reportGaps(path, recording.gaps, recording.truncated);
+
+    const char* extension = format == Format::COLUMNAR ? ".sbcol" : format == Format::EDF ? ".edf"
+                            : format == Format::WFDB   ? ".hea" : ".csv";
+    const std::string outPath =
+        outputDir + "/" + baseName(path) + extension + sbem::OutputFile::suffix(rCsvOptions.output.compression);
+    if (format == Format::COLUMNAR && !sbem::ColumnarWriter::write(recording, outPath.c_str(), rCsvOptions.output))
+    {
+        fprintf(stderr, "%s: can't write %s\n", path.c_str(), outPath.c_str());
+        return false;
+    }
+    if (format == Format::EDF)
+    {
+        sbem::EdfOptions edfOptions;
+        edfOptions.ecg = rCsvOptions.ecg;
+        edfOptions.imu = rCsvOptions.imu;
+        std::string sensor;
+        uint32_t logId;
+        if (parseLogName(path, sensor, logId))
+            edfOptions.equipment = "Movesense_" + sensor;
+        sbem::EdfStats stats;
+        if (!sbem::EdfWriter::write(recording, outPath.c_str(), edfOptions, stats))
+        {
+            fprintf(stderr, "%s: no samples written to %s\n", path.c_str(), outPath.c_str());
+            return false;
+        }
+    }
+    if (format == Format::WFDB)
+    {
+        sbem::WfdbOptions wfdbOptions;
+        wfdbOptions.format = wfdbFormat;
+        sbem::WfdbStats stats;
+        if (!sbem::WfdbWriter::write(recording, (outputDir + "/" + baseName(path)).c_str(), wfdbOptions, stats))
+        {
+            fprintf(stderr, "%s: no ECG written to %s\n", path.c_str(), outPath.c_str());
+            return false;
+        }
+    }
+    if (format == Format::CSV && !sbem::CsvWriter::write(recording, outPath.c_str(), rCsvOptions))
+    {
+        fprintf(stderr, "%s: no data rows written\n", path.c_str());
+        return false;
+    }
+    if (lod)
+    {
+        sbem::LodPyramid pyramid;
+        pyramid.add(recording);
+        if (!writeLod(pyramid, path, outputDir))
+            return false;
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("%s -> %s: %zu ECG, %zu IMU, %zu other chunks, %.1f MB/s\n",
+           path.c_str(), outPath.c_str(), recording.ecg.packets(), recording.imu.packets(),
+           recording.other.size(), recording.bytesScanned / 1e6 / (seconds > 0 ? seconds : 1e-9));
+    return true;
+}
+
+static void usage()
+{
+    fprintf(stderr,
+            "Usage: sbem2csv [options] <folder|file.sbem> [output_dir]\n"
+            "  -j <threads>        decode and format threads, 0 = all cores (default 1)\n"
+            "  --layout <l>        converter (default, same as converter.py) or samples (one row per sample)\n"
+            "  --floats <f>        repr (default), shortest (float32 round-trip) or fixed\n"
+            "  --decimals <n>      digits after the point for --floats fixed (default 6)\n"
+            "  --rows <kinds>      comma separated ecg,imu,other (default all)\n"
+            "  --columnar          write memory-mappable .sbcol files instead of CSV\n"
+            "  --edf               write EDF+ files of the ECG and IMU signals instead of CSV\n"
+            "  --wfdb              write WFDB records of the ECG (.hea and .dat) instead of CSV\n"
+            "  --wfdb-format <f>   WFDB signal format, 16 (default) or 212\n"
+            "  --lod               also write a min/max/mean pyramid for plotting, <name>.lod.sbcol\n"
+            "  --zstd              compress the outputs to seekable .csv.zst/.sbcol.zst files\n"
+            "  --zstd-level <n>    zstd level, 1 (fastest) to 19 (default 3)\n"
+            "  --no-index          don't write or use <file>.sbem.sbidx chunk index sidecars\n"
+            "  --memory-limit <MB> convert in batches using at most this much memory, for logs\n"
+            "                      too long to decode whole (CSV only, no index)\n");
+}
+
+static bool parseRows(const char* text, sbem::CsvOptions& rOptions)
+{
+    rOptions.ecg = strstr(text, "ecg") != nullptr;
+    rOptions.imu = strstr(text, "imu") != nullptr;
+    rOptions.other = strstr(text, "other") != nullptr;
+    return rOptions.ecg || rOptions.imu || rOptions.other;
+}
+
+int main(int argc, char** argv)
+{
+    sbem::DecodeOptions options;
+    options.sidecarIndex = true;
+    sbem::CsvOptions csvOptions;
+    Format format = Format::CSV;
+    int wfdbFormat = 16;
+    bool lod = false;
+    size_t memoryLimit = 0;
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; i++)
+    {
+        const bool hasValue = i + 1 < argc;
+        bool valid = true;
+        if (strcmp(argv[i], "-j") == 0 && hasValue)
+        {
+            options.threads = static_cast<unsigned>(atoi(argv[++i]));
+            csvOptions.threads = options.threads;
+            csvOptions.output.threads = options.threads;
+        }
+        else if (strcmp(argv[i], "--layout") == 0 && hasValue)
+        {
+            const std::string layout = argv[++i];
+            valid = layout == "converter" || layout == "samples";
+            csvOptions.layout = layout == "samples" ? sbem::CsvLayout::SAMPLES : sbem::CsvLayout::CONVERTER;
+        }
+        else if (strcmp(argv[i], "--floats") == 0 && hasValue)
+        {
+            const std::string floats = argv[++i];
+            valid = floats == "repr" || floats == "shortest" || floats == "fixed";
+            csvOptions.floats = floats == "shortest" ? sbem::CsvFloats::SHORTEST :
+                                floats == "fixed" ? sbem::CsvFloats::FIXED : sbem::CsvFloats::PYTHON_REPR;
+        }
+        else if (strcmp(argv[i], "--decimals") == 0 && hasValue)
+        {
+            csvOptions.decimals = atoi(argv[++i]);
+            valid = csvOptions.decimals >= 0 && csvOptions.decimals <= 17;
+        }
+        else if (strcmp(argv[i], "--rows") == 0 && hasValue)
+        {
+            valid = parseRows(argv[++i], csvOptions);
+        }
+        else if (strcmp(argv[i], "--columnar") == 0)
+        {
+            format = Format::COLUMNAR;
+        }
+        else if (strcmp(argv[i], "--edf") == 0)
+        {
+            format = Format::EDF;
+        }
+        else if (strcmp(argv[i], "--wfdb") == 0)
+        {
+            format = Format::WFDB;
+        }
+        else if (strcmp(argv[i], "--wfdb-format") == 0 && hasValue)
+        {
+            wfdbFormat = atoi(argv[++i]);
+            valid = wfdbFormat == 16 || wfdbFormat == 212;
+        }
+        else if (strcmp(argv[i], "--lod") == 0)
+        {
+            lod = true;
+        }
+        else if (strcmp(argv[i], "--zstd") == 0)
+        {
+            csvOptions.output.compression = sbem::Compression::ZSTD;
+        }
+        else if (strcmp(argv[i], "--zstd-level") == 0 && hasValue)
+        {
+            csvOptions.output.level = atoi(argv[++i]);
+            valid = csvOptions.output.level >= 1 && csvOptions.output.level <= 19;
+        }
+        else if (strcmp(argv[i], "--no-index") == 0)
+        {
+            options.sidecarIndex = false;
+        }
+        else if (strcmp(argv[i], "--memory-limit") == 0 && hasValue)
+        {
+            const long megabytes = atol(argv[++i]);
+            valid = megabytes > 0;
+            memoryLimit = static_cast<size_t>(megabytes) << 20;
+        }
+        else if (isOption(argv[i]))
+        {
+            usage();
+            return 1;
+        }
+        else
+        {
+            args.push_back(argv[i]);
+        }
+
+        if (!valid)
+        {
+            fprintf(stderr, "Invalid value for %s\n", argv[i - 1]);
+            return 1;
+        }
+    }
+
+    if (args.empty())
+    {
+        usage();
+        return 1;
+    }
+    if (!sbem::OutputFile::supports(csvOptions.output.compression))
+    {
+        fprintf(stderr, "This build has no zstd support, rebuild with libzstd installed\n");
+        return 1;
+    }
+    if (memoryLimit && format != Format::CSV)
+    {
+        fprintf(stderr, "--memory-limit writes CSV, other formats are written from a whole recording\n");
+        return 1;
+    }
+    if ((format == Format::EDF || format == Format::WFDB) && csvOptions.output.compression != sbem::Compression::NONE)
+    {
+        fprintf(stderr, "EDF and WFDB files are written uncompressed, their readers don't take .zst\n");
+        return 1;
+    }
+
+    const std::string target = args[0];
+    const std::vector<std::string> files = listSbemFiles(target);
+    if (files.empty())
+    {
+        printf("No SBEM files found in folder: %s\n", target.c_str());
+        return 0;
+    }
+
+    int failures = 0;
+    for (const std::string& file : files)
+    {
+        const std::string outputDir = args.size() > 1 ? args[1] : (isDirectory(target) ? target : dirName(file));
+        const bool ok = memoryLimit ? streamFile(file, outputDir, memoryLimit, options, csvOptions, lod)
+                                    : convertFile(file, outputDir, options, csvOptions, format, wfdbFormat, lod);
+        if (!ok)
+            failures++;
+    }
+    return failures ? 2 : 0;
+}
@@ -0,0 +1,200 @@
+// sbemalign: put the recordings of several sensors on one clock and join them into one resampled CSV
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "sbem/ClockAligner.h"
+#include "sbem/Joiner.h"
+#include "sbem/OutputFile.h"
+#include "sbem/Stitcher.h"
+
+#include "ParticipantMap.h"
+#include "ToolUtil.h"
+
+static void usage()
+{
+    fprintf(stderr,
+            "Usage: sbemalign [options] <out.csv> <sensor> <sensor>...\n"
+            "  A <sensor> is a log or a folder with the logs of one sensor, stitched like\n"
+            "  sbemstitch does. The first sensor's clock is the time base; the others are\n"
+            "  mapped onto it from the movement their IMUs share.\n"
+            "  --rate <Hz>         rows per second (default 200, the ECG rate)\n"
+            "  --rows <kinds>      comma separated ecg,imu (default both)\n"
+            "  --overlap           only the time every sensor covers\n"
+            "  --window <s>        window of the drift fit (default 600)\n"
+            "  --no-drift          fit a constant offset only\n"
+            "  --fit-only          print the clock fits and write nothing\n"
+            "  -j <threads>        decode threads, 0 = all cores (default 1)\n"
+            "  --zstd              compress the output to a seekable .zst file\n"
+            "  --zstd-level <n>    zstd level, 1 (fastest) to 19 (default 3)\n"
+            "  --no-index          don't write or use <file>.sbem.sbidx chunk index sidecars\n");
+}
+
+/** Decode and stitch the logs of one sensor; the label is its sensor id or the input's name. */
+static bool loadSensor(const std::string& input, const sbem::DecodeOptions& rOptions, sbem::Recording& rRecording,
+                       std::string& rLabel)
+{
+    sbem::Stitcher stitcher;
+    rLabel = baseName(input);
+    for (const std::string& file : listSbemFiles(input))
+    {
+        std::string sensor;
+        uint32_t logId = sbem::Stitcher::NO_LOG_ID;
+        if (parseLogName(file, sensor, logId))
+            rLabel = sensor;
+        if (!stitcher.add(file.c_str(), logId, rOptions))
+        {
+            fprintf(stderr, "%s\n", stitcher.error().c_str());
+            return false;
+        }
+    }
+    sbem::StitchStats stats;
+    if (!stitcher.stitch(rRecording, 0, stats))
+    {
+        fprintf(stderr, "%s: %s\n", input.c_str(), stitcher.error().c_str());
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    sbem::DecodeOptions options;
+    options.sidecarIndex = true;
+    sbem::AlignOptions alignOptions;
+    sbem::JoinOptions joinOptions;
+    bool fitOnly = false;
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; i++)
+    {
+        const bool hasValue = i + 1 < argc;
+        bool valid = true;
+        if (strcmp(argv[i], "--rate") == 0 && hasValue)
+        {
+            joinOptions.rate = atof(argv[++i]);
+            valid = joinOptions.rate > 0 && joinOptions.rate <= 10000;
+        }
+        else if (strcmp(argv[i], "--rows") == 0 && hasValue)
+        {
+            const char* text = argv[++i];
+            joinOptions.ecg = strstr(text, "ecg") != nullptr;
+            joinOptions.imu = strstr(text, "imu") != nullptr;
+            valid = joinOptions.ecg || joinOptions.imu;
+        }
+        else if (strcmp(argv[i], "--overlap") == 0)
+        {
+            joinOptions.overlap = true;
+        }
+        else if (strcmp(argv[i], "--window") == 0 && hasValue)
+        {
+            const double seconds = atof(argv[++i]);
+            valid = seconds >= 30 && seconds <= 86400;
+            alignOptions.windowMs = static_cast<uint32_t>(seconds * 1000);
+        }
+        else if (strcmp(argv[i], "--no-drift") == 0)
+        {
+            alignOptions.drift = false;
+        }
+        else if (strcmp(argv[i], "--fit-only") == 0)
+        {
+            fitOnly = true;
+        }
+        else if (strcmp(argv[i], "-j") == 0 && hasValue)
+        {
+            options.threads = static_cast<unsigned>(atoi(argv[++i]));
+            joinOptions.output.threads = options.threads;
+        }
+        else if (strcmp(argv[i], "--zstd") == 0)
+        {
+            joinOptions.output.compression = sbem::Compression::ZSTD;
+        }
+        else if (strcmp(argv[i], "--zstd-level") == 0 && hasValue)
+        {
+            joinOptions.output.level = atoi(argv[++i]);
+            valid = joinOptions.output.level >= 1 && joinOptions.output.level <= 19;
+        }
+        else if (strcmp(argv[i], "--no-index") == 0)
+        {
+            options.sidecarIndex = false;
+        }
+        else if (isOption(argv[i]))
+        {
+            usage();
+            return 1;
+        }
+        else
+        {
+            args.push_back(argv[i]);
+        }
+
+        if (!valid)
+        {
+            fprintf(stderr, "Invalid value for %s\n", argv[i - 1]);
+            return 1;
+        }
+    }
+
+    if (args.size() < 3)
+    {
+        usage();
+        return 1;
+    }
+    if (!sbem::OutputFile::supports(joinOptions.output.compression))
+    {
+        fprintf(stderr, "This build has no zstd support, rebuild with libzstd installed\n");
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::unique_ptr<sbem::Recording>> recordings;
+    std::vector<sbem::JoinSource> sources;
+    for (size_t i = 1; i < args.size(); i++)
+    {
+        recordings.emplace_back(new sbem::Recording);
+        sbem::JoinSource source;
+        source.pRecording = recordings.back().get();
+        if (!loadSensor(args[i], options, *recordings.back(), source.label))
+            return 2;
+        for (const sbem::JoinSource& rOther : sources)
+        {
+            if (rOther.label == source.label)
+                source.label += "_" + std::to_string(i);
+        }
+        sources.push_back(source);
+    }
+
+    printf("%s: reference clock\n", sources[0].label.c_str());
+    for (size_t i = 1; i < sources.size(); i++)
+    {
+        sbem::JoinSource& rSource = sources[i];
+        if (!sbem::ClockAligner::fit(*sources[0].pRecording, *rSource.pRecording, alignOptions, rSource.clock))
+        {
+            fprintf(stderr, "%s: no movement in common with %s to align on\n", rSource.label.c_str(),
+                    sources[0].label.c_str());
+            return 2;
+        }
+        printf("%s: offset %+.1f ms at %.0f ms, drift %+.2f ppm, %zu windows, correlation %.2f\n",
+               rSource.label.c_str(), rSource.clock.offset, rSource.clock.anchor, rSource.clock.drift * 1e6,
+               rSource.clock.windows, rSource.clock.score);
+    }
+    if (fitOnly)
+        return 0;
+
+    const std::string outPath = args[0] + sbem::OutputFile::suffix(joinOptions.output.compression);
+    sbem::JoinStats stats;
+    if (!sbem::Joiner::write(sources, outPath.c_str(), joinOptions, stats))
+    {
+        fprintf(stderr, "Can't write %s\n", outPath.c_str());
+        return 2;
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("%s: %zu sensors, %llu rows at %g Hz from %.0f to %.0f ms, %.1f s\n", outPath.c_str(), sources.size(),
+           static_cast<unsigned long long>(stats.rows), joinOptions.rate, stats.begin, stats.end, seconds);
+    return 0;
+}
@@ -0,0 +1,228 @@
+// sbembatch: convert a whole raw folder on one work-stealing pool
+//
+// Every thread takes the next file until none are left; inside a file the
+// decode splits into chunk-range tasks on the same pool, so threads that run
+// out of files steal ranges of the big ones instead of idling at the end of a
+// clinic day.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "sbem/ColumnarWriter.h"
+#include "sbem/CsvWriter.h"
+#include "sbem/Decoder.h"
+#include "sbem/EdfWriter.h"
+#include "sbem/LodPyramid.h"
+#include "sbem/ThreadPool.h"
+
+#include "ParticipantMap.h"
+#include "ToolUtil.h"
+
+struct Job
+{
+    std::string input;
+    std::string output;
+    std::string lod;        // pyramid path, empty without --lod
+    sbem::EdfOptions edf;
+    uint64_t size;
+    bool ok;
+};
+
+static void usage()
+{
+    fprintf(stderr,
+            "Usage: sbembatch [options] <raw_folder> <output_folder>\n"
+            "  -j <threads>   threads, 0 = all cores (default 0)\n"
+            "  --map <csv>    sensor_last6,participantID mapping; names outputs PID_DDMMYY_day.csv\n"
+            "  --day <n>      recording day for the output name (default 1)\n"
+            "  --date <ddmmyy> date for the output name (default today)\n"
+            "  --columnar     write memory-mappable .sbcol files instead of CSV\n"
+            "  --edf          write EDF+ files instead of CSV, the participant as patient code\n"
+            "  --lod          also write a min/max/mean pyramid for plotting next to each output\n"
+            "  --zstd         compress the outputs to seekable .zst files\n"
+            "  --zstd-level <n> zstd level, 1 (fastest) to 19 (default 3)\n"
+            "  --no-index     don't write or use <file>.sbem.sbidx chunk index sidecars\n");
+}
+
+int main(int argc, char** argv)
+{
+    unsigned threads = 0;
+    std::string mapPath;
+    std::string day = "1";
+    std::string date = ParticipantMap::today();
+    bool columnar = false;
+    bool edf = false;
+    bool lod = false;
+    bool sidecarIndex = true;
+    sbem::OutputOptions output;
+    std::vector<std::string> args;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "-j") == 0 && hasValue)
+            threads = static_cast<unsigned>(atoi(argv[++i]));
+        else if (strcmp(argv[i], "--map") == 0 && hasValue)
+            mapPath = argv[++i];
+        else if (strcmp(argv[i], "--day") == 0 && hasValue)
+            day = argv[++i];
+        else if (strcmp(argv[i], "--date") == 0 && hasValue)
+            date = argv[++i];
+        else if (strcmp(argv[i], "--columnar") == 0)
+            columnar = true;
+        else if (strcmp(argv[i], "--edf") == 0)
+            edf = true;
+        else if (strcmp(argv[i], "--lod") == 0)
+            lod = true;
+        else if (strcmp(argv[i], "--zstd") == 0)
+            output.compression = sbem::Compression::ZSTD;
+        else if (strcmp(argv[i], "--zstd-level") == 0 && hasValue)
+            output.level = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--no-index") == 0)
+            sidecarIndex = false;
+        else if (isOption(argv[i]))
+        {
+            usage();
+            return 1;
+        }
+        else
+            args.push_back(argv[i]);
+    }
+    if (args.size() != 2)
+    {
+        usage();
+        return 1;
+    }
+    if (edf && (columnar || output.compression != sbem::Compression::NONE))
+    {
+        fprintf(stderr, "--edf writes uncompressed EDF+ files, without --columnar or --zstd\n");
+        return 1;
+    }
+    if (!sbem::OutputFile::supports(output.compression))
+    {
+        fprintf(stderr, "This build has no zstd support, rebuild with libzstd installed\n");
+        return 1;
+    }
+
+    const std::string rawFolder = args[0];
+    const std::string outputFolder = args[1];
+    if (!isDirectory(rawFolder) || !isDirectory(outputFolder))
+    {
+        fprintf(stderr, "Both %s and %s must be folders\n", rawFolder.c_str(), outputFolder.c_str());
+        return 1;
+    }
+
+    ParticipantMap participants;
+    if (!mapPath.empty() && !participants.load(mapPath))
+    {
+        fprintf(stderr, "No valid 'sensor_last6,participantID' rows in %s\n", mapPath.c_str());
+        return 1;
+    }
+
+    const std::vector<std::string> files = listSbemFiles(rawFolder);
+    if (files.empty())
+    {
+        printf("No SBEM files found in folder: %s\n", rawFolder.c_str());
+        return 0;
+    }
+
+    // Names are claimed in file name order so collisions get the same _n suffix every run
+    const char* extension = columnar ? ".sbcol" : edf ? ".edf" : ".csv";
+    const char* suffix = sbem::OutputFile::suffix(output.compression);
+    std::vector<Job> jobs;
+    std::set<std::string> taken;
+    for (const std::string& file : files)
+    {
+        const std::string pid = participants.participantForFile(baseName(file));
+        std::string path;
+        if (pid.empty())
+            path = outputFolder + "/" + baseName(file) + extension + suffix;
+        else
+            path = claimOutputPath(outputFolder + "/" + pid + "_" + date + "_" + day + extension, taken, suffix);
+        const std::string stem = path.substr(0, path.size() - strlen(extension) - strlen(suffix));
+        sbem::EdfOptions edfOptions;
+        if (!pid.empty())
+            edfOptions.patient = pid + " X X X";
+        std::string sensor;
+        uint32_t logId;
+        if (parseLogName(file, sensor, logId))
+            edfOptions.equipment = "Movesense_" + sensor;
+        jobs.push_back({ file, path, lod ? stem + ".lod.sbcol" : "", edfOptions, fileSize(file), false });
+    }
+
+    // Largest first, the small ones fill the gaps at the end
+    std::vector<size_t> order(jobs.size());
+    for (size_t i = 0; i < order.size(); i++)
+        order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return jobs[a].size > jobs[b].size; });
+
+    const unsigned concurrency = threads ? threads : sbem::defaultThreadCount();
+    sbem::ThreadPool pool(concurrency - 1);
+    sbem::DecodeOptions options;
+    options.pPool = &pool;
+    options.sidecarIndex = sidecarIndex;
+    output.pPool = &pool;
+    sbem::CsvOptions csvOptions;
+    csvOptions.pPool = &pool;
+    csvOptions.output = output;
+
+    const auto convert = [&options, &csvOptions, &output, columnar, edf](Job& rJob)
+    {
+        sbem::Recording recording;
+        sbem::EdfStats edfStats;
+        rJob.ok = sbem::Decoder::decodeFile(rJob.input.c_str(), recording, options) &&
+                  (columnar ? sbem::ColumnarWriter::write(recording, rJob.output.c_str(), output)
+                   : edf    ? sbem::EdfWriter::write(recording, rJob.output.c_str(), rJob.edf, edfStats)
+                            : sbem::CsvWriter::write(recording, rJob.output.c_str(), csvOptions));
+        if (rJob.ok && !rJob.lod.empty())
+        {
+            sbem::LodPyramid pyramid;
+            pyramid.add(recording);
+            rJob.ok = pyramid.write(rJob.lod.c_str());
+        }
+    };
+
+    // One task per thread rather than per file: a decode waiting for its ranges runs any queued task, and
+    // with a task per file it would start file after file, each recording kept alive under the one before.
+    // A waiting decode can still pick up a task that hasn't started, but there are only so many of them,
+    // so at most one recording per thread is alive.
+    const auto start = std::chrono::steady_clock::now();
+    std::atomic<size_t> next(0);
+    sbem::TaskGroup group;
+    for (unsigned t = 0; t < concurrency; t++)
+    {
+        pool.submit(group, [&]()
+        {
+            for (size_t n = next++; n < order.size(); n = next++)
+                convert(jobs[order[n]]);
+        });
+    }
+    pool.wait(group);
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    uint64_t bytes = 0;
+    int failures = 0;
+    for (const Job& job : jobs)
+    {
+        bytes += job.size;
+        if (job.ok)
+        {
+            printf("%s -> %s\n", job.input.c_str(), job.output.c_str());
+        }
+        else
+        {
+            fprintf(stderr, "%s: conversion failed\n", job.input.c_str());
+            failures++;
+        }
+    }
+    printf("Converted %zu of %zu file(s), %.1f MB in %.2f s (%.1f MB/s, %u threads)\n",
+           jobs.size() - failures, jobs.size(), bytes / 1e6, seconds,
+           bytes / 1e6 / (seconds > 0 ? seconds : 1e-9), concurrency);
+    return failures ? 2 : 0;
+}
@@ -0,0 +1,509 @@
+// sbembench: decode throughput of the packet decoder paths, and a benchmark suite
+//
+// Given a file, decodes it with every PacketPath, reports the best of several
+// runs and checks that all paths produced bit-identical columns.
+//
+// With --suite, generates synthetic logs of several durations and times every
+// stage of a conversion on them: the chunk scan, the index build, the decode
+// and each output format, optionally against the pure Python converter.py.
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "sbem/ChunkIndex.h"
+#include "sbem/ColumnarWriter.h"
+#include "sbem/CsvWriter.h"
+#include "sbem/Decoder.h"
+#include "sbem/FileIo.h"
+#include "sbem/MappedFile.h"
+#include "sbem/Scanner.h"
+#include "sbem/StreamConverter.h"
+
+#include "SyntheticLog.h"
+#include "ToolUtil.h"
+
+#ifndef SBEM_CONVERTER_PY
+#define SBEM_CONVERTER_PY "converter.py"
+#endif
+
+struct PathInfo
+{
+    sbem::PacketPath path;
+    const char* name;
+};
+
+static const PathInfo PATHS[] =
+{
+    { sbem::PacketPath::INTERPRETED, "interpreted" },
+    { sbem::PacketPath::UNROLLED, "unrolled" },
+    { sbem::PacketPath::SIMD, SBEM_HAVE_SSE2 ? "simd (sse2)" : "simd (scalar fallback)" },
+};
+
+template <typename T>
+static bool sameColumn(const sbem::Column<T>& rA, const sbem::Column<T>& rB)
+{
+    return rA.size == rB.size && (rA.size == 0 || memcmp(rA.data, rB.data, rA.size * sizeof(T)) == 0);
+}
+
+static bool sameRecording(const sbem::Recording& rA, const sbem::Recording& rB)
+{
+    return sameColumn(rA.ecg.chunkIndex, rB.ecg.chunkIndex) && sameColumn(rA.ecg.timestamp, rB.ecg.timestamp) &&
+           sameColumn(rA.ecg.samples, rB.ecg.samples) && sameColumn(rA.imu.chunkIndex, rB.imu.chunkIndex) &&
+           sameColumn(rA.imu.timestamp, rB.imu.timestamp) && sameColumn(rA.imu.accelX, rB.imu.accelX) &&
+           sameColumn(rA.imu.accelY, rB.imu.accelY) && sameColumn(rA.imu.accelZ, rB.imu.accelZ) &&
+           sameColumn(rA.imu.gyroX, rB.imu.gyroX) && sameColumn(rA.imu.gyroY, rB.imu.gyroY) &&
+           sameColumn(rA.imu.gyroZ, rB.imu.gyroZ);
+}
+
+/** Decode one file with every PacketPath; 2 if they disagree. */
+static int benchFile(const char* path, unsigned threads, int runs)
+{
+    sbem::MappedFile file;
+    if (!file.open(path))
+    {
+        fprintf(stderr, "%s: can't open\n", path);
+        return 1;
+    }
+
+    sbem::Recording reference;
+    bool identical = true;
+    for (const PathInfo& info : PATHS)
+    {
+        sbem::DecodeOptions options;
+        options.threads = threads;
+        options.packets = info.path;
+
+        sbem::Recording recording;
+        double best = 1e30;
+        for (int r = 0; r < runs; r++)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            if (!sbem::Decoder::decode(file.data(), file.size(), recording, options))
+            {
+                fprintf(stderr, "%s: not a readable SBEM file\n", path);
+                return 1;
+            }
+            const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            if (seconds < best)
+                best = seconds;
+        }
+
+        const double samples = static_cast<double>(recording.ecg.samples.size + recording.imu.accelX.size);
+        printf("%-24s %8.2f ms %9.1f MB/s %8.1f Msamples/s\n", info.name, best * 1e3,
+               file.size() / 1e6 / best, samples / 1e6 / best);
+
+        if (info.path == PATHS[0].path)
+            reference = std::move(recording);
+        else if (!sameRecording(reference, recording))
+            identical = false;
+    }
+
+    if (!identical)
+    {
+        fprintf(stderr, "decoder paths disagree\n");
+        return 2;
+    }
+    return 0;
+}
+
+struct SuiteOptions
+{
+    std::vector<std::string> durations = { "10m", "1h", "8h" };
+    double holesPerMb = 0;
+    unsigned threads = 1;
+    int runs = 5;
+    std::string jsonPath;
+    bool baseline = false;
+    std::string converter = SBEM_CONVERTER_PY;
+};
+
+/** One stage timed on one log, a record of the --json output. */
+struct StageResult
+{
+    std::string duration;
+    std::string stage;
+    size_t bytes;
+    size_t samples;
+    double seconds;
+};
+
+/** Best wall time of runs calls of rRun, negative if a call fails. */
+template <typename Run>
+static double bestOf(int runs, Run&& rRun)
+{
+    double best = 1e30;
+    for (int r = 0; r < runs; r++)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        if (!rRun())
+            return -1;
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (seconds < best)
+            best = seconds;
+    }
+    return best;
+}
+
+static void report(const StageResult& rResult)
+{
+    printf("%-6s %-14s %10.2f ms %9.1f MB/s %8.1f Msamples/s\n", rResult.duration.c_str(), rResult.stage.c_str(),
+           rResult.seconds * 1e3, rResult.bytes / 1e6 / rResult.seconds, rResult.samples / 1e6 / rResult.seconds);
+}
+
+static bool sameFile(const std::string& a, const std::string& b)
+{
+    sbem::MappedFile fileA;
+    sbem::MappedFile fileB;
+    return fileA.open(a.c_str()) && fileB.open(b.c_str()) && fileA.size() == fileB.size() &&
+           (fileA.size() == 0 || memcmp(fileA.data(), fileB.data(), fileA.size()) == 0);
+}
+
+/**
+*   Time converter.convert_sbem on its pure Python path in a python3 process.
+*   Interpreter start up and imports are left out, as the native stages leave
+*   out generating the log.
+*
+*   @param converter Path of converter.py
+*   @param log SBEM file
+*   @param outDir Folder the CSV is written to
+*   @return Seconds, negative if Python or the conversion failed
+*/
+static double timeConverterPy(const std::string& converter, const std::string& log, const std::string& outDir)
+{
+    // With sbem_native blocked convert_sbem can't hand the file to the native decoder; its
+    // progress prints go to /dev/null and only the time comes back
+    const std::string command =
+        "python3 -c 'import os, sys, time\n"
+        "sys.modules[\"sbem_native\"] = None\n"
+        "sys.path.insert(0, os.path.dirname(os.path.abspath(sys.argv[1])))\n"
+        "import converter\n"
+        "out, sys.stdout = sys.stdout, open(os.devnull, \"w\")\n"
+        "start = time.perf_counter()\n"
+        "ok = converter.convert_sbem(sys.argv[2], sys.argv[3])\n"
+        "print(time.perf_counter() - start if ok else -1, file=out)' '" +
+        converter + "' '" + log + "' '" + outDir + "'";
+
+    FILE* pPipe = popen(command.c_str(), "r");
+    if (!pPipe)
+        return -1;
+    char line[64] = {};
+    const bool read = fgets(line, sizeof(line), pPipe) != nullptr;
+    const int status = pclose(pPipe);
+    return read && status == 0 ? atof(line) : -1;
+}
+
+static bool writeJson(const std::string& path, const SuiteOptions& rOptions, const std::vector<StageResult>& rResults)
+{
+    FILE* pFile = fopen(path.c_str(), "w");
+    if (!pFile)
+        return false;
+
+    fprintf(pFile, "{\n  \"threads\": %u,\n  \"runs\": %d,\n  \"holes_per_mb\": %g,\n  \"results\": [\n",
+            rOptions.threads, rOptions.runs, rOptions.holesPerMb);
+    for (size_t i = 0; i < rResults.size(); i++)
+    {
+        const StageResult& rResult = rResults[i];
+        fprintf(pFile,
+                "    {\"duration\": \"%s\", \"stage\": \"%s\", \"bytes\": %zu, \"samples\": %zu, "
+                "\"seconds\": %.6f, \"mb_per_s\": %.3f, \"msamples_per_s\": %.3f}%s\n",
+                rResult.duration.c_str(), rResult.stage.c_str(), rResult.bytes, rResult.samples, rResult.seconds,
+                rResult.bytes / 1e6 / rResult.seconds, rResult.samples / 1e6 / rResult.seconds,
+                i + 1 < rResults.size() ? "," : "");
+    }
+    fprintf(pFile, "  ]\n}\n");
+    return fclose(pFile) == 0;
+}
+
+static bool writeLog(const std::string& path, const std::vector<uint8_t>& rBytes)
+{
+    const int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return false;
+    const bool written = sbem::writeAll(fd, rBytes.data(), rBytes.size());
+    return ::close(fd) == 0 && written;
+}
+
+/**
+*   Time every stage on one synthetic log per duration. The output formats
+*   are timed end to end, from the mapped log to the closed file.
+*
+*   @return 0, 1 if a stage failed or 2 if outputs disagree
+*/
+static int runSuite(const SuiteOptions& rOptions)
+{
+    std::string dir = "/tmp/sbembench.XXXXXX";
+    if (!mkdtemp(&dir[0]))
+    {
+        fprintf(stderr, "can't create a folder in /tmp\n");
+        return 1;
+    }
+
+    // converter.py only on the shortest log, it is far slower
+    size_t baselineLog = 0;
+    double shortest = 1e30;
+    for (size_t i = 0; i < rOptions.durations.size(); i++)
+    {
+        double seconds = 0;
+        parseDuration(rOptions.durations[i].c_str(), seconds);
+        if (seconds < shortest)
+        {
+            shortest = seconds;
+            baselineLog = i;
+        }
+    }
+
+    std::vector<StageResult> results;
+    int status = 0;
+    for (size_t i = 0; i < rOptions.durations.size() && status == 0; i++)
+    {
+        const std::string& duration = rOptions.durations[i];
+        SyntheticOptions synthetic;
+        parseDuration(duration.c_str(), synthetic.seconds);
+        synthetic.holesPerMb = rOptions.holesPerMb;
+        const SyntheticLog log = synthesizeLog(synthetic);
+
+        const std::string logPath = dir + "/" + duration + ".sbem";
+        const std::string csvPath = dir + "/" + duration + ".csv";
+        const std::string samplesPath = dir + "/" + duration + ".samples.csv";
+        const std::string sbcolPath = dir + "/" + duration + ".sbcol";
+        const std::string streamPath = dir + "/" + duration + ".stream.csv";
+        sbem::MappedFile file;
+        if (!writeLog(logPath, log.bytes) || !file.open(logPath.c_str()))
+        {
+            fprintf(stderr, "%s: can't write\n", logPath.c_str());
+            unlink(logPath.c_str());
+            status = 1;
+            break;
+        }
+
+        sbem::DecodeOptions decodeOptions;
+        decodeOptions.threads = rOptions.threads;
+        sbem::Recording recording;
+        sbem::Decoder::decode(file.data(), file.size(), recording, decodeOptions);
+        const size_t samples = recording.ecg.samples.size + recording.imu.accelX.size;
+        printf("%s: %.1f MB, %zu ECG and %zu IMU packets", duration.c_str(), file.size() / 1e6,
+               log.ecgPackets, log.imuPackets);
+        if (log.corrupted.empty())
+        {
+            printf("\n");
+        }
+        else
+        {
+            printf(", %zu corrupt stretches, %zu skipped by the decoder\n", log.corrupted.size(),
+                   recording.gaps.size());
+        }
+        // Every intact packet must come back, and no more than were logged; a damaged one whose
+        // header and timestamp survived may still decode
+        const size_t ecgDecoded = recording.ecg.timestamp.size;
+        const size_t imuDecoded = recording.imu.timestamp.size;
+        if (ecgDecoded > log.ecgPackets || ecgDecoded + log.ecgDamaged < log.ecgPackets ||
+            imuDecoded > log.imuPackets || imuDecoded + log.imuDamaged < log.imuPackets ||
+            recording.other.size() != 0)
+        {
+            fprintf(stderr, "%s: decoded %zu ECG, %zu IMU and %zu other chunks, expected %zu-%zu ECG and "
+                    "%zu-%zu IMU\n", duration.c_str(), ecgDecoded, imuDecoded, recording.other.size(),
+                    log.ecgPackets - log.ecgDamaged, log.ecgPackets, log.imuPackets - log.imuDamaged,
+                    log.imuPackets);
+            status = 2;
+        }
+
+        sbem::CsvOptions csvOptions;
+        csvOptions.threads = rOptions.threads;
+        sbem::CsvOptions samplesOptions = csvOptions;
+        samplesOptions.layout = sbem::CsvLayout::SAMPLES;
+        sbem::Recording decoded;
+        const uint8_t* pData = file.data();
+        const size_t size = file.size();
+
+        const auto stage = [&](const char* name, auto&& rRun)
+        {
+            if (status != 0)
+                return;
+            const double seconds = bestOf(rOptions.runs, rRun);
+            if (seconds < 0)
+            {
+                fprintf(stderr, "%s: %s failed\n", duration.c_str(), name);
+                status = 1;
+                return;
+            }
+            results.push_back({ duration, name, size, samples, seconds });
+            report(results.back());
+        };
+
+        stage("scan", [&]
+        {
+            sbem::Scanner scanner(pData, size);
+            sbem::Chunk chunk;
+            uint32_t chunks = 0;
+            while (scanner.next(chunk))
+                chunks++;
+            return chunks > 0;
+        });
+        stage("index", [&]
+        {
+            sbem::ChunkIndex index;
+            index.build(pData, size);
+            return !index.empty();
+        });
+        stage("decode", [&] { return sbem::Decoder::decode(pData, size, decoded, decodeOptions); });
+        stage("csv", [&]
+        {
+            return sbem::Decoder::decode(pData, size, decoded, decodeOptions) &&
+                   sbem::CsvWriter::write(decoded, csvPath.c_str(), csvOptions);
+        });
+        stage("csv-samples", [&]
+        {
+            return sbem::Decoder::decode(pData, size, decoded, decodeOptions) &&
+                   sbem::CsvWriter::write(decoded, samplesPath.c_str(), samplesOptions);
+        });
+        stage("sbcol", [&]
+        {
+            return sbem::Decoder::decode(pData, size, decoded, decodeOptions) &&
+                   sbem::ColumnarWriter::write(decoded, sbcolPath.c_str());
+        });
+        stage("stream-csv", [&]
+        {
+            sbem::MappedFile streamed;
+            sbem::StreamStats stats;
+            return streamed.open(logPath.c_str()) &&
+                   sbem::StreamConverter::toCsv(streamed, streamPath.c_str(), 64 << 20, decodeOptions, csvOptions,
+                                                stats);
+        });
+        if (status == 0 && !sameFile(csvPath, streamPath))
+        {
+            fprintf(stderr, "%s: the streamed CSV differs from the whole log CSV\n", duration.c_str());
+            status = 2;
+        }
+
+        if (status == 0 && rOptions.baseline && i == baselineLog)
+        {
+            const std::string pyDir = dir + "/py";
+            const std::string pyCsvPath = pyDir + "/" + duration + ".csv";
+            const double seconds = timeConverterPy(rOptions.converter, logPath, pyDir);
+            if (seconds < 0)
+            {
+                fprintf(stderr, "%s: converter.py failed, no baseline\n", rOptions.converter.c_str());
+            }
+            else
+            {
+                results.push_back({ duration, "converter.py", size, samples, seconds });
+                report(results.back());
+                double native = seconds;
+                for (const StageResult& rResult : results)
+                {
+                    if (rResult.duration == duration && rResult.stage == "csv")
+                        native = rResult.seconds;
+                }
+                const bool identical = sameFile(pyCsvPath, csvPath);
+                printf("%-6s csv is %.0fx faster than converter.py, output %s\n", duration.c_str(), seconds / native,
+                       identical ? "identical" : "DIFFERS");
+                if (!identical)
+                    status = 2;
+            }
+            unlink(pyCsvPath.c_str());
+            rmdir(pyDir.c_str());
+        }
+
+        for (const std::string* pPath : { &logPath, &csvPath, &samplesPath, &sbcolPath, &streamPath })
+            unlink(pPath->c_str());
+    }
+    rmdir(dir.c_str());
+
+    if (!rOptions.jsonPath.empty() && !writeJson(rOptions.jsonPath, rOptions, results))
+    {
+        fprintf(stderr, "%s: can't write\n", rOptions.jsonPath.c_str());
+        return 1;
+    }
+    return status;
+}
+
+static std::vector<std::string> splitList(const char* text)
+{
+    std::vector<std::string> items;
+    std::string item;
+    for (const char* p = text;; p++)
+    {
+        if (*p == ',' || !*p)
+        {
+            if (!item.empty())
+                items.push_back(item);
+            item.clear();
+            if (!*p)
+                break;
+        }
+        else
+        {
+            item += *p;
+        }
+    }
+    return items;
+}
+
+static void usage()
+{
+    fprintf(stderr, "Usage: sbembench [-j threads] [-r runs] <file.sbem>\n"
+                    "       sbembench --suite [-j threads] [-r runs] [options]\n"
+                    "  -j  decode threads, 0 = all cores (default 1)\n"
+                    "  -r  runs per path or stage, the best is reported (default 5)\n"
+                    "Suite options:\n"
+                    "  --durations <list>  synthetic logs to time, e.g. 10m,1h,8h (the default)\n"
+                    "  --holes <n>         corrupt stretches per MB of synthetic log (default 0)\n"
+                    "  --json <path>       also write the results as JSON\n"
+                    "  --baseline          time converter.py's pure Python path on the shortest log\n"
+                    "  --converter <path>  converter.py to time (default the one in this repository)\n");
+}
+
+int main(int argc, char** argv)
+{
+    SuiteOptions suite;
+    bool suiteMode = false;
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; i++)
+    {
+        const bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "-j") == 0 && hasValue)
+            suite.threads = static_cast<unsigned>(atoi(argv[++i]));
+        else if (strcmp(argv[i], "-r") == 0 && hasValue)
+            suite.runs = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--suite") == 0)
+            suiteMode = true;
+        else if (strcmp(argv[i], "--durations") == 0 && hasValue)
+            suite.durations = splitList(argv[++i]);
+        else if (strcmp(argv[i], "--holes") == 0 && hasValue)
+            suite.holesPerMb = atof(argv[++i]);
+        else if (strcmp(argv[i], "--json") == 0 && hasValue)
+            suite.jsonPath = argv[++i];
+        else if (strcmp(argv[i], "--baseline") == 0)
+            suite.baseline = true;
+        else if (strcmp(argv[i], "--converter") == 0 && hasValue)
+            suite.converter = argv[++i];
+        else if (isOption(argv[i]))
+        {
+            usage();
+            return 1;
+        }
+        else
+            args.push_back(argv[i]);
+    }
+
+    bool valid = suite.runs >= 1 && suite.holesPerMb >= 0 && args.size() == (suiteMode ? 0u : 1u);
+    for (const std::string& duration : suite.durations)
+    {
+        double seconds;
+        if (!parseDuration(duration.c_str(), seconds))
+            valid = false;
+    }
+    if (!valid || (suiteMode && suite.durations.empty()))
+    {
+        usage();
+        return 1;
+    }
+
+    return suiteMode ? runSuite(suite) : benchFile(args[0].c_str(), suite.threads, suite.runs);
+}
@@ -0,0 +1,85 @@
+// sbemgen: write deterministic synthetic SBEM logs, e.g. to benchmark or test converters
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "sbem/FileIo.h"
+
+#include "SyntheticLog.h"
+#include "ToolUtil.h"
+
+static void usage()
+{
+    fprintf(stderr,
+            "Usage: sbemgen [options] <out.sbem>\n"
+            "  --duration <d>   logged time: 90s, 10m, 8h, 2d (default 1h)\n"
+            "  --seed <n>       random seed, the same seed gives the same file (default 1)\n"
+            "  --holes <n>      corrupt stretches per MB: zero filled holes and random bytes (default 0)\n");
+}
+
+int main(int argc, char** argv)
+{
+    SyntheticOptions options;
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; i++)
+    {
+        const bool hasValue = i + 1 < argc;
+        bool valid = true;
+        if (strcmp(argv[i], "--duration") == 0 && hasValue)
+        {
+            valid = parseDuration(argv[++i], options.seconds);
+        }
+        else if (strcmp(argv[i], "--seed") == 0 && hasValue)
+        {
+            options.seed = strtoull(argv[++i], nullptr, 10);
+        }
+        else if (strcmp(argv[i], "--holes") == 0 && hasValue)
+        {
+            options.holesPerMb = atof(argv[++i]);
+            valid = options.holesPerMb >= 0;
+        }
+        else if (isOption(argv[i]))
+        {
+            usage();
+            return 1;
+        }
+        else
+        {
+            args.push_back(argv[i]);
+        }
+
+        if (!valid)
+        {
+            fprintf(stderr, "Invalid value for %s\n", argv[i - 1]);
+            return 1;
+        }
+    }
+
+    if (args.size() != 1)
+    {
+        usage();
+        return 1;
+    }
+
+    const SyntheticLog log = synthesizeLog(options);
+    const int fd = ::open(args[0].c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0 || !sbem::writeAll(fd, log.bytes.data(), log.bytes.size()) || ::close(fd) != 0)
+    {
+        fprintf(stderr, "%s: can't write\n", args[0].c_str());
+        return 1;
+    }
+
+    printf("%s: %.1f MB, %zu ECG and %zu IMU packets, %zu corrupt stretches\n", args[0].c_str(),
+           log.bytes.size() / 1e6, log.ecgPackets, log.imuPackets, log.corrupted.size());
+    for (const sbem::Gap& rGap : log.corrupted)
+    {
+        printf("  corrupt %llu-%llu\n", static_cast<unsigned long long>(rGap.begin),
+               static_cast<unsigned long long>(rGap.end));
+    }
+    return 0;
+}
@@ -0,0 +1,139 @@
+// sbemrepack: merge the logs of a sensor into one canonical SBEM file, optionally cut to a time window
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "sbem/Repacker.h"
+
+#include "TimeSpec.h"
+#include "ToolUtil.h"
+
+static void usage()
+{
+    fprintf(stderr,
+            "Usage: sbemrepack [options] <out.sbem> <folder|file.sbem>...\n"
+            "  Writes the chunks of every input in timestamp order, the descriptors once\n"
+            "  and the same packet fetched twice once.\n"
+            "  --from <time>       keep chunks from this time on\n"
+            "  --to <time>         keep chunks before this time\n"
+            "  <time> is a packet timestamp in ms (52000), a time after the first packet (+1:30:00)\n"
+            "         or a clock time (14:00, 14:30:15) when --start is given\n"
+            "  --start <hh:mm[:ss]> clock time of the first packet of the inputs\n"
+            "  --no-index          don't reuse or leave .sbidx chunk indexes next to the inputs\n");
+}
+
+int main(int argc, char** argv)
+{
+    TimeSpec from = { TimeSpec::SENSOR, 0 };
+    TimeSpec to = { TimeSpec::SENSOR, UINT32_MAX };
+    uint64_t startClock = 0;
+    bool haveStart = false;
+    bool useSidecar = true;
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; i++)
+    {
+        const bool hasValue = i + 1 < argc;
+        bool valid = true;
+        if (strcmp(argv[i], "--from") == 0 && hasValue)
+        {
+            valid = parseTime(argv[++i], from);
+        }
+        else if (strcmp(argv[i], "--to") == 0 && hasValue)
+        {
+            valid = parseTime(argv[++i], to);
+        }
+        else if (strcmp(argv[i], "--start") == 0 && hasValue)
+        {
+            valid = haveStart = parseClock(argv[++i], startClock);
+            startClock %= DAY_MS;
+        }
+        else if (strcmp(argv[i], "--no-index") == 0)
+        {
+            useSidecar = false;
+        }
+        else if (isOption(argv[i]))
+        {
+            usage();
+            return 1;
+        }
+        else
+        {
+            args.push_back(argv[i]);
+        }
+
+        if (!valid)
+        {
+            fprintf(stderr, "Invalid value for %s\n", argv[i - 1]);
+            return 1;
+        }
+    }
+
+    if (args.size() < 2)
+    {
+        usage();
+        return 1;
+    }
+    if ((from.kind == TimeSpec::CLOCK || to.kind == TimeSpec::CLOCK) && !haveStart)
+    {
+        fprintf(stderr, "Clock times need --start, the clock time of the first packet\n");
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    // A folder is repacked in place: the output may sit in it without being an input
+    const std::string outPath = args[0];
+    std::vector<std::string> files;
+    for (size_t i = 1; i < args.size(); i++)
+    {
+        for (const std::string& file : listSbemFiles(args[i]))
+        {
+            if (file != outPath || !isDirectory(args[i]))
+                files.push_back(file);
+        }
+    }
+    if (files.empty())
+    {
+        printf("No SBEM files found\n");
+        return 0;
+    }
+
+    sbem::Repacker repacker;
+    for (const std::string& file : files)
+    {
+        if (!repacker.add(file.c_str(), useSidecar))
+        {
+            fprintf(stderr, "%s\n", repacker.error().c_str());
+            return 2;
+        }
+    }
+
+    uint32_t firstTimestamp = 0;
+    repacker.firstTimestamp(firstTimestamp);
+    const uint64_t begin = resolve(from, firstTimestamp, startClock);
+    const uint64_t end = resolve(to, firstTimestamp, startClock);
+    if (begin >= end || begin > UINT32_MAX)
+    {
+        fprintf(stderr, "Empty window %llu-%llu ms\n", static_cast<unsigned long long>(begin),
+                static_cast<unsigned long long>(end));
+        return 1;
+    }
+
+    sbem::RepackStats stats;
+    if (!repacker.write(outPath.c_str(), static_cast<uint32_t>(begin),
+                        static_cast<uint32_t>(end > UINT32_MAX ? UINT32_MAX : end), stats))
+    {
+        fprintf(stderr, "%s\n", repacker.error().c_str());
+        return 2;
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("%s: %zu logs, %.1f MB -> %.1f MB, %zu chunks, %zu descriptors, %zu duplicates and %zu chunks outside "
+           "the window dropped, %zu corrupt ranges skipped, %.1f ms\n",
+           outPath.c_str(), stats.inputs, stats.bytesIn / 1e6, stats.bytesOut / 1e6, stats.chunks, stats.descriptors,
+           stats.duplicates, stats.trimmed, stats.gaps, seconds * 1e3);
+    return 0;
+}
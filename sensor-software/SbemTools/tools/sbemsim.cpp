@@ -0,0 +1,559 @@
+// sbemsim: simulated Movesense sensors running the Winlogger protocol on Unix sockets, to test extraction without BLE
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "sbem/FileIo.h"
+#include "sbem/MappedFile.h"
+#include "sbem/WinloggerProtocol.h"
+
+#include "SyntheticLog.h"
+#include "ToolUtil.h"
+
+using namespace sbem::winlogger;
+using Clock = std::chrono::steady_clock;
+
+static void usage()
+{
+    fprintf(stderr,
+            "Usage: sbemsim [options] <folder>\n"
+            "  Serves simulated sensors on <folder>/<serial>.sock (SOCK_SEQPACKET, one message per\n"
+            "  ATT packet: [1][command] writes, [2] write responses, [3][value] notifications) and\n"
+            "  lists their logbooks in <folder>/logbook.csv. A sensor powers off (its socket goes\n"
+            "  away) on HELLO; sbemsim exits when every sensor is off.\n"
+            "  --sensors <n>       synthetic sensors, serials 990000000001 up (default 1)\n"
+            "  --logs <n>          logs per synthetic sensor (default 2)\n"
+            "  --duration <d>      mean logged time of a synthetic log: 90s, 10m, 8h (default 10m);\n"
+            "                      each log gets between half and 1.5 times that\n"
+            "  --log <serial>=<f>  serve a recorded .sbem log, the next log id of that sensor\n"
+            "  --mtu <n>           ATT MTU; notifications carry <n> - 9 log bytes (default 159: 150)\n"
+            "  --interval <ms>     connection interval (default 15)\n"
+            "  --per-event <n>     notifications per connection event (default 4)\n"
+            "  --loss <p>          probability that a notification is lost (default 0)\n"
+            "  --disconnect <p>    probability that a FETCH_LOG is cut off by a disconnect (default 0)\n"
+            "  --seed <n>          random seed for logs, loss and disconnects (default 1)\n"
+            "  --dump <folder>     also write the served logs as <serial>_<log id>.sbem\n");
+}
+
+namespace
+{
+
+struct LinkOptions
+{
+    size_t mtu = 159;
+    double intervalMs = 15;
+    unsigned perEvent = 4;
+    double loss = 0;
+    double disconnect = 0;
+};
+
+struct LinkStats
+{
+    uint64_t connections = 0;
+    uint64_t notifications = 0;
+    uint64_t lost = 0;
+    uint64_t logBytes = 0;
+    uint64_t disconnects = 0;   // injected
+};
+
+std::atomic<bool> gStop(false);
+
+void onSignal(int)
+{
+    gStop = true;
+}
+
+/** Live stream of a SUBSCRIBE: its packets are due every period from the subscription on. */
+struct Subscription
+{
+    uint8_t reference;
+    bool ecg;
+    Clock::time_point start;
+    uint64_t sent = 0;
+};
+
+/**
+*   One simulated sensor: the Winlogger's command handling over a socket,
+*   with notifications paced by connection events.
+*/
+class Sensor
+{
+public:
+    Sensor(const std::string& serial, std::vector<std::vector<uint8_t>> logs, const LinkOptions& rOptions,
+           uint64_t seed):
+        mSerial(serial), mLogs(std::move(logs)), mOptions(rOptions), mRandom(seed),
+        mPartSize(rOptions.mtu - 3 - FRAME_HEADER)
+    {
+    }
+
+    /** Advertise (listen) on folder/<serial>.sock. */
+    bool listen(const std::string& folder)
+    {
+        mPath = folder + "/" + mSerial + LINK_SUFFIX;
+        sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        if (mPath.size() >= sizeof(address.sun_path))
+            return false;
+        memcpy(address.sun_path, mPath.c_str(), mPath.size() + 1);
+        ::unlink(mPath.c_str());
+        mListen = ::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+        return mListen >= 0 && ::bind(mListen, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0 &&
+               ::listen(mListen, 1) == 0;
+    }
+
+    /** Accept one connection at a time until HELLO powers the sensor off or sbemsim is stopped. */
+    void run()
+    {
+        while (!gStop && !mPoweredOff)
+        {
+            pollfd p = { mListen, POLLIN, 0 };
+            if (::poll(&p, 1, 200) <= 0)
+                continue;
+            const int fd = ::accept4(mListen, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd < 0)
+                continue;
+            mStats.connections++;
+            serve(fd);
+            ::close(fd);
+        }
+        ::close(mListen);
+        ::unlink(mPath.c_str());
+    }
+
+    const std::string& serial() const { return mSerial; }
+    const std::vector<std::vector<uint8_t>>& logs() const { return mLogs; }
+    const LinkStats& stats() const { return mStats; }
+
+private:
+    void serve(int fd)
+    {
+        const auto interval = std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double, std::milli>(mOptions.intervalMs));
+        Clock::time_point next = Clock::now() + interval;
+        while (!gStop)
+        {
+            const auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(next - Clock::now()).count();
+            pollfd p = { fd, POLLIN, 0 };
+            if (::poll(&p, 1, wait > 0 ? static_cast<int>(wait) : 0) > 0)
+            {
+                uint8_t message[512];
+                const ssize_t n = ::recv(fd, message, sizeof(message), 0);
+                if (n <= 0)
+                    break;      // the client disconnected
+                if (message[0] == LINK_WRITE && n >= 3)
+                {
+                    mWriteResponses++;
+                    command(message + 1, static_cast<size_t>(n - 1));
+                }
+            }
+
+            const Clock::time_point now = Clock::now();
+            if (now < next)
+                continue;
+            if (!connectionEvent(fd, now))
+                break;
+            next += interval;
+            if (next < now)
+                next = now + interval;      // fell behind, as a radio that missed events
+        }
+
+        // The link is gone: what the firmware was sending goes with it
+        mFetchLog = 0;
+        mSubscriptions.clear();
+        mResults.clear();
+        mWriteResponses = 0;
+    }
+
+    /** Winlogger handleIncomingCommand(). */
+    void command(const uint8_t* pData, size_t size)
+    {
+        const uint8_t reference = pData[1];
+        switch (pData[0])
+        {
+        case HELLO:
+            mResults.push_back({ COMMAND_RESULT, reference, 'P', 'O', 'W', 'E', 'R' });
+            mLogs.clear();
+            mPoweredOff = true;
+            break;
+        case SUBSCRIBE:
+        {
+            const std::string path(reinterpret_cast<const char*>(pData + 2), size - 2);
+            if (mSubscriptions.size() >= MAX_SUBSCRIPTIONS)
+            {
+                mResults.push_back({ COMMAND_RESULT, reference, 0x01, 0xFB });     // 507
+                break;
+            }
+            // Other resources fail to subscribe, which the firmware doesn't answer either
+            if (path.compare(0, 9, "/Meas/ECG") == 0 || path.compare(0, 10, "/Meas/IMU6") == 0)
+                mSubscriptions.push_back({ reference, path[6] == 'E', Clock::now() });
+            break;
+        }
+        case UNSUBSCRIBE:
+            for (size_t i = 0; i < mSubscriptions.size(); i++)
+            {
+                if (mSubscriptions[i].reference == reference)
+                {
+                    mSubscriptions.erase(mSubscriptions.begin() + static_cast<long>(i));
+                    break;
+                }
+            }
+            break;
+        case FETCH_LOG:
+        {
+            if (size != 2 + sizeof(uint32_t))
+                break;
+            // A new fetch starts at offset 0; the firmware only resets its offset when a fetch completes
+            const uint32_t id = sbem::loadU32(pData + 2);
+            mFetchLog = id >= 1 && id <= mLogs.size() ? id : 0;
+            mFetchOffset = 0;
+            mFetchReference = reference;
+            mCutAt = UINT64_MAX;
+            if (mFetchLog && mRandom.uniform() < mOptions.disconnect)
+                mCutAt = mRandom.below(mLogs[mFetchLog - 1].size() + 1);
+            break;
+        }
+        case STOP_LOGGING:
+            mResults.push_back({ COMMAND_RESULT, reference, 0x00 });
+            break;
+        default:
+            break;      // INIT_OFFLINE and GET_LOG_COUNT have no handler in the firmware
+        }
+    }
+
+    /**
+    *   Send what one connection event carries: write responses, command
+    *   results, live data, then log data.
+    *
+    *   @return false to drop the link: a send failed, a disconnect was injected or the sensor powered off
+    */
+    bool connectionEvent(int fd, Clock::time_point now)
+    {
+        unsigned budget = mOptions.perEvent;
+        for (; budget && mWriteResponses; budget--, mWriteResponses--)
+        {
+            const uint8_t op = LINK_WRITE_RESPONSE;
+            if (::send(fd, &op, 1, MSG_NOSIGNAL) != 1)
+                return false;
+        }
+        for (; budget && !mResults.empty(); budget--)
+        {
+            if (!notify(fd, mResults.front().data(), mResults.front().size()))
+                return false;
+            mResults.pop_front();
+        }
+        if (mPoweredOff)
+            return !mResults.empty() || mWriteResponses;
+
+        for (Subscription& rSub : mSubscriptions)
+        {
+            const double periodMs = rSub.ecg ? synthetic::ECG_PACKET_MS : synthetic::IMU_PACKET_MS;
+            const double elapsedMs = std::chrono::duration<double, std::milli>(now - rSub.start).count();
+            for (; budget && rSub.sent < static_cast<uint64_t>(elapsedMs / periodMs); budget--)
+            {
+                if (!notify(fd, livePacket(rSub, periodMs)))
+                    return false;
+                rSub.sent++;
+            }
+        }
+
+        for (; budget && mFetchLog; budget--)
+        {
+            const std::vector<uint8_t>& rLog = mLogs[mFetchLog - 1];
+            if (mFetchOffset >= mCutAt)
+            {
+                mStats.disconnects++;
+                return false;
+            }
+            uint8_t frame[FRAME_HEADER + 512];
+            const size_t n = static_cast<size_t>(std::min<uint64_t>(mPartSize, rLog.size() - mFetchOffset));
+            // A logbook read is two parts, DATA and DATA_PART2; the end marker is a DATA without bytes
+            frame[0] = n && (mFetchOffset / mPartSize) % 2 ? DATA_PART2 : DATA;
+            frame[1] = mFetchReference;
+            synthetic::putU32(frame + 2, static_cast<uint32_t>(mFetchOffset));
+            memcpy(frame + FRAME_HEADER, rLog.data() + mFetchOffset, n);
+            if (!notify(fd, frame, FRAME_HEADER + n))
+                return false;
+            mFetchOffset += n;
+            mStats.logBytes += n;
+            if (!n)
+                mFetchLog = 0;
+        }
+        return true;
+    }
+
+    /** A live packet as the firmware serialises it: timestamp and samples. */
+    std::vector<uint8_t> livePacket(const Subscription& rSub, double periodMs)
+    {
+        const double ms = rSub.sent * periodMs;
+        std::vector<uint8_t> frame = { DATA, rSub.reference };
+        frame.resize(2 + (rSub.ecg ? sbem::ECG_MV_PACKET_SIZE : sbem::IMU6_PACKET_SIZE));
+        synthetic::putU32(frame.data() + 2, synthetic::START_MS + static_cast<uint32_t>(ms));
+        if (rSub.ecg)
+        {
+            for (size_t s = 0; s < sbem::ECG_SAMPLES_PER_PACKET; s++)
+                synthetic::putF32(frame.data() + 6 + s * 4,
+                                  static_cast<float>(synthetic::ecgMv((ms + s * 5.0) / 1000, mRandom)));
+        }
+        else
+        {
+            for (size_t s = 0; s < sbem::IMU_SAMPLES_PER_PACKET; s++)
+                synthetic::putF32(frame.data() + 6 + s * 12 + 8, static_cast<float>(9.81 + 0.05 * mRandom.noise()));
+        }
+        return frame;
+    }
+
+    bool notify(int fd, const std::vector<uint8_t>& rValue) { return notify(fd, rValue.data(), rValue.size()); }
+
+    bool notify(int fd, const uint8_t* pValue, size_t size)
+    {
+        mStats.notifications++;
+        if (mOptions.loss > 0 && mRandom.uniform() < mOptions.loss)
+        {
+            mStats.lost++;
+            return true;
+        }
+        uint8_t message[1 + FRAME_HEADER + 512];
+        message[0] = LINK_NOTIFY;
+        memcpy(message + 1, pValue, size);
+        return ::send(fd, message, size + 1, MSG_NOSIGNAL) == static_cast<ssize_t>(size + 1);
+    }
+
+    static constexpr size_t MAX_SUBSCRIPTIONS = 4;     // MAX_DATASUB_COUNT
+
+    std::string mSerial;
+    std::string mPath;
+    std::vector<std::vector<uint8_t>> mLogs;
+    LinkOptions mOptions;
+    SyntheticRandom mRandom;
+    size_t mPartSize;
+    int mListen = -1;
+    bool mPoweredOff = false;
+    unsigned mWriteResponses = 0;
+    std::deque<std::vector<uint8_t>> mResults;
+    std::vector<Subscription> mSubscriptions;
+    uint32_t mFetchLog = 0;         // log id being sent, 0 for none
+    uint64_t mFetchOffset = 0;
+    uint8_t mFetchReference = 0;
+    uint64_t mCutAt = UINT64_MAX;   // offset where an injected disconnect drops the link
+    LinkStats mStats;
+};
+
+bool writeFile(const std::string& path, const std::vector<uint8_t>& rBytes)
+{
+    const int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    const bool ok = fd >= 0 && sbem::writeAll(fd, rBytes.data(), rBytes.size());
+    return fd >= 0 && ::close(fd) == 0 && ok;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    LinkOptions link;
+    size_t sensorCount = 1;
+    size_t logCount = 2;
+    double seconds = 600;
+    uint64_t seed = 1;
+    std::string dumpFolder;
+    std::map<std::string, std::vector<std::string>> recorded;  // serial -> files in log id order
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; i++)
+    {
+        const bool hasValue = i + 1 < argc;
+        bool valid = true;
+        if (strcmp(argv[i], "--sensors") == 0 && hasValue)
+        {
+            const long value = atol(argv[++i]);
+            valid = value >= 0 && value <= 999;
+            sensorCount = static_cast<size_t>(value);
+        }
+        else if (strcmp(argv[i], "--logs") == 0 && hasValue)
+        {
+            const long value = atol(argv[++i]);
+            valid = value >= 0;
+            logCount = static_cast<size_t>(value);
+        }
+        else if (strcmp(argv[i], "--duration") == 0 && hasValue)
+        {
+            valid = parseDuration(argv[++i], seconds);
+        }
+        else if (strcmp(argv[i], "--log") == 0 && hasValue)
+        {
+            const std::string spec = argv[++i];
+            const size_t eq = spec.find('=');
+            valid = eq != std::string::npos && eq > 0 && eq + 1 < spec.size();
+            if (valid)
+                recorded[spec.substr(0, eq)].push_back(spec.substr(eq + 1));
+        }
+        else if (strcmp(argv[i], "--mtu") == 0 && hasValue)
+        {
+            const long value = atol(argv[++i]);
+            valid = value >= 23 && value <= 512;
+            link.mtu = static_cast<size_t>(value);
+        }
+        else if (strcmp(argv[i], "--interval") == 0 && hasValue)
+        {
+            link.intervalMs = atof(argv[++i]);
+            valid = link.intervalMs >= 1;
+        }
+        else if (strcmp(argv[i], "--per-event") == 0 && hasValue)
+        {
+            const long value = atol(argv[++i]);
+            valid = value >= 1;
+            link.perEvent = static_cast<unsigned>(value);
+        }
+        else if (strcmp(argv[i], "--loss") == 0 && hasValue)
+        {
+            link.loss = atof(argv[++i]);
+            valid = link.loss >= 0 && link.loss < 1;
+        }
+        else if (strcmp(argv[i], "--disconnect") == 0 && hasValue)
+        {
+            link.disconnect = atof(argv[++i]);
+            valid = link.disconnect >= 0 && link.disconnect <= 1;
+        }
+        else if (strcmp(argv[i], "--seed") == 0 && hasValue)
+        {
+            seed = strtoull(argv[++i], nullptr, 10);
+        }
+        else if (strcmp(argv[i], "--dump") == 0 && hasValue)
+        {
+            dumpFolder = argv[++i];
+        }
+        else if (isOption(argv[i]))
+        {
+            usage();
+            return 1;
+        }
+        else
+        {
+            args.push_back(argv[i]);
+        }
+
+        if (!valid)
+        {
+            fprintf(stderr, "Invalid value for %s\n", argv[i - 1]);
+            return 1;
+        }
+    }
+
+    if (args.size() != 1 || (!sensorCount && recorded.empty()))
+    {
+        usage();
+        return 1;
+    }
+    for (const std::string* pFolder : { &args[0], &dumpFolder })
+    {
+        if (!pFolder->empty() && !isDirectory(*pFolder))
+        {
+            fprintf(stderr, "%s is not a folder\n", pFolder->c_str());
+            return 1;
+        }
+    }
+
+    // Logs: synthetic ones of varying length, then the recorded ones
+    std::vector<std::unique_ptr<Sensor>> sensors;
+    SyntheticRandom random(seed);
+    for (size_t s = 0; s < sensorCount; s++)
+    {
+        char serial[32];
+        snprintf(serial, sizeof(serial), "990000000%03zu", s + 1);
+        std::vector<std::vector<uint8_t>> logs;
+        for (size_t l = 0; l < logCount; l++)
+        {
+            SyntheticOptions options;
+            options.seconds = seconds * (0.5 + random.uniform());
+            options.seed = seed * 1000003 + s * 1000 + l;
+            logs.push_back(synthesizeLog(options).bytes);
+        }
+        sensors.emplace_back(new Sensor(serial, std::move(logs), link, random.next()));
+    }
+    for (const auto& rEntry : recorded)
+    {
+        std::vector<std::vector<uint8_t>> logs;
+        for (const std::string& file : rEntry.second)
+        {
+            sbem::MappedFile mapped;
+            if (!mapped.open(file.c_str()))
+            {
+                fprintf(stderr, "Can't read %s\n", file.c_str());
+                return 2;
+            }
+            logs.emplace_back(mapped.data(), mapped.data() + mapped.size());
+        }
+        sensors.emplace_back(new Sensor(rEntry.first, std::move(logs), link, random.next()));
+    }
+
+    // The logbooks, to check what an extraction got against
+    FILE* pBook = fopen((args[0] + "/logbook.csv").c_str(), "w");
+    if (!pBook)
+    {
+        fprintf(stderr, "Can't write %s/logbook.csv\n", args[0].c_str());
+        return 2;
+    }
+    fprintf(pBook, "serial,log_id,bytes\n");
+    uint64_t total = 0;
+    for (const auto& rpSensor : sensors)
+    {
+        for (size_t l = 0; l < rpSensor->logs().size(); l++)
+        {
+            fprintf(pBook, "%s,%zu,%zu\n", rpSensor->serial().c_str(), l + 1, rpSensor->logs()[l].size());
+            total += rpSensor->logs()[l].size();
+            const std::string dumpPath = dumpFolder + "/" + rpSensor->serial() + "_" + std::to_string(l + 1) + ".sbem";
+            if (!dumpFolder.empty() && !writeFile(dumpPath, rpSensor->logs()[l]))
+            {
+                fprintf(stderr, "Can't write %s\n", dumpPath.c_str());
+                return 2;
+            }
+        }
+    }
+    fclose(pBook);
+
+    for (const auto& rpSensor : sensors)
+    {
+        if (!rpSensor->listen(args[0]))
+        {
+            fprintf(stderr, "Can't listen on %s/%s%s\n", args[0].c_str(), rpSensor->serial().c_str(), LINK_SUFFIX);
+            return 2;
+        }
+    }
+
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+    const double rate = (link.mtu - 3 - FRAME_HEADER) * link.perEvent / link.intervalMs;
+    printf("%zu sensors, %.1f MB of logs in %s; at most %.1f kB/s a link\n", sensors.size(), total / 1e6,
+           args[0].c_str(), rate);
+    fflush(stdout);
+
+    std::vector<std::thread> threads;
+    for (const auto& rpSensor : sensors)
+        threads.emplace_back([&rpSensor]() { rpSensor->run(); });
+    for (std::thread& rThread : threads)
+        rThread.join();
+
+    for (const auto& rpSensor : sensors)
+    {
+        const LinkStats& rStats = rpSensor->stats();
+        printf("%s: %llu connections, %.1f MB of log sent in %llu notifications, %llu lost, %llu disconnects\n",
+               rpSensor->serial().c_str(), static_cast<unsigned long long>(rStats.connections),
+               rStats.logBytes / 1e6, static_cast<unsigned long long>(rStats.notifications),
+               static_cast<unsigned long long>(rStats.lost), static_cast<unsigned long long>(rStats.disconnects));
+    }
+    return 0;
+}
@@ -0,0 +1,272 @@
+// sbemstitch: join the logs of one sensor into one timeline with a table of the gaps between and inside them
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "sbem/ColumnarWriter.h"
+#include "sbem/CsvWriter.h"
+#include "sbem/DecodePlan.h"
+#include "sbem/EdfWriter.h"
+#include "sbem/OutputFile.h"
+#include "sbem/Stitcher.h"
+#include "sbem/WfdbWriter.h"
+
+#include "ParticipantMap.h"
+#include "TimeSpec.h"
+#include "ToolUtil.h"
+
+static void usage()
+{
+    fprintf(stderr,
+            "Usage: sbemstitch [options] <out.csv|out.sbcol|out.edf|out.hea> <folder|file.sbem>...\n"
+            "  Writes the logs of one sensor as one recording, in log id order (from the\n"
+            "  extractor's <time>_<sensor>_<logid>.sbem names) or else in time order, and\n"
+            "  the gaps between and inside them to <out>.gaps.csv.\n"
+            "  -j <threads>        decode and format threads, 0 = all cores (default 1)\n"
+            "  --layout <l>        converter (default) or samples, as for sbem2csv\n"
+            "  --min-gap <ms>      shortest gap listed, from when the next packet was due\n"
+            "                      (default half a packet period)\n"
+            "  --start <H:MM:SS>   wall clock of the first packet, for EDF+ and WFDB headers\n"
+            "  --date <ddmmyy>     date of the first packet, for EDF+ and WFDB headers\n"
+            "  --wfdb-format <f>   signal format of a .hea output, 16 (default) or 212\n"
+            "  --zstd              compress the output to a seekable .zst file (CSV and .sbcol)\n"
+            "  --zstd-level <n>    zstd level, 1 (fastest) to 19 (default 3)\n"
+            "  --no-index          don't write or use <file>.sbem.sbidx chunk index sidecars\n");
+}
+
+static const char* kindName(uint8_t kind)
+{
+    switch (static_cast<sbem::GapKind>(kind))
+    {
+    case sbem::GapKind::DROPOUT:
+        return "dropout";
+    case sbem::GapKind::LEAD_OFF:
+        return "lead-off";
+    case sbem::GapKind::RESET:
+        return "reset";
+    }
+    return "?";
+}
+
+/** channel,kind,start_ms,end_ms,duration_ms rows of the gap table; resets have no duration. */
+static bool writeGaps(const sbem::TimelineGapColumns& rGaps, const std::string& path)
+{
+    FILE* pFile = fopen(path.c_str(), "w");
+    if (!pFile)
+        return false;
+    fprintf(pFile, "channel,kind,start_ms,end_ms,duration_ms\n");
+    for (size_t i = 0; i < rGaps.size(); i++)
+    {
+        const bool ecg = static_cast<sbem::PacketKind>(rGaps.channel[i]) == sbem::PacketKind::ECG_MV;
+        fprintf(pFile, "%s,%s,%u,%u,", ecg ? "ecg" : "imu", kindName(rGaps.kind[i]), rGaps.begin[i], rGaps.end[i]);
+        if (static_cast<sbem::GapKind>(rGaps.kind[i]) == sbem::GapKind::RESET)
+            fprintf(pFile, "\n");      // spliced, the real length isn't known
+        else
+            fprintf(pFile, "%u\n", rGaps.end[i] - rGaps.begin[i]);
+    }
+    return fclose(pFile) == 0;
+}
+
+int main(int argc, char** argv)
+{
+    sbem::DecodeOptions options;
+    options.sidecarIndex = true;
+    sbem::CsvOptions csvOptions;
+    uint32_t minGap = 0;
+    sbem::EdfOptions edfOptions;
+    bool haveClock = false;
+    bool haveDate = false;
+    sbem::WfdbOptions wfdbOptions;
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; i++)
+    {
+        const bool hasValue = i + 1 < argc;
+        bool valid = true;
+        if (strcmp(argv[i], "-j") == 0 && hasValue)
+        {
+            options.threads = static_cast<unsigned>(atoi(argv[++i]));
+            csvOptions.threads = options.threads;
+            csvOptions.output.threads = options.threads;
+        }
+        else if (strcmp(argv[i], "--layout") == 0 && hasValue)
+        {
+            const std::string layout = argv[++i];
+            valid = layout == "converter" || layout == "samples";
+            csvOptions.layout = layout == "samples" ? sbem::CsvLayout::SAMPLES : sbem::CsvLayout::CONVERTER;
+        }
+        else if (strcmp(argv[i], "--min-gap") == 0 && hasValue)
+        {
+            const long value = atol(argv[++i]);
+            valid = value > 0;
+            minGap = static_cast<uint32_t>(value);
+        }
+        else if (strcmp(argv[i], "--start") == 0 && hasValue)
+        {
+            valid = haveClock = parseClock(argv[++i], edfOptions.clockMs);
+            edfOptions.clockMs %= DAY_MS;
+        }
+        else if (strcmp(argv[i], "--date") == 0 && hasValue)
+        {
+            const char* text = argv[++i];
+            valid = haveDate = strlen(text) == 6 && strspn(text, "0123456789") == 6;
+            if (valid)
+            {
+                edfOptions.day = (text[0] - '0') * 10 + (text[1] - '0');
+                edfOptions.month = (text[2] - '0') * 10 + (text[3] - '0');
+                edfOptions.year = 2000 + (text[4] - '0') * 10 + (text[5] - '0');
+                valid = edfOptions.day >= 1 && edfOptions.day <= 31 && edfOptions.month >= 1 && edfOptions.month <= 12;
+            }
+        }
+        else if (strcmp(argv[i], "--wfdb-format") == 0 && hasValue)
+        {
+            wfdbOptions.format = atoi(argv[++i]);
+            valid = wfdbOptions.format == 16 || wfdbOptions.format == 212;
+        }
+        else if (strcmp(argv[i], "--zstd") == 0)
+        {
+            csvOptions.output.compression = sbem::Compression::ZSTD;
+        }
+        else if (strcmp(argv[i], "--zstd-level") == 0 && hasValue)
+        {
+            csvOptions.output.level = atoi(argv[++i]);
+            valid = csvOptions.output.level >= 1 && csvOptions.output.level <= 19;
+        }
+        else if (strcmp(argv[i], "--no-index") == 0)
+        {
+            options.sidecarIndex = false;
+        }
+        else if (isOption(argv[i]))
+        {
+            usage();
+            return 1;
+        }
+        else
+        {
+            args.push_back(argv[i]);
+        }
+
+        if (!valid)
+        {
+            fprintf(stderr, "Invalid value for %s\n", argv[i - 1]);
+            return 1;
+        }
+    }
+
+    if (args.size() < 2)
+    {
+        usage();
+        return 1;
+    }
+    const bool columnar = hasSuffix(args[0], ".sbcol");
+    const bool edf = hasSuffix(args[0], ".edf");
+    const bool wfdb = hasSuffix(args[0], ".hea");
+    if (!columnar && !edf && !wfdb && !hasSuffix(args[0], ".csv"))
+    {
+        fprintf(stderr, "The output must be a .csv, .sbcol, .edf or .hea file\n");
+        return 1;
+    }
+    if ((edf || wfdb) && csvOptions.output.compression != sbem::Compression::NONE)
+    {
+        fprintf(stderr, "EDF and WFDB files are written uncompressed, their readers don't take .zst\n");
+        return 1;
+    }
+    if (haveClock != haveDate)
+    {
+        fprintf(stderr, "--start and --date go together\n");
+        return 1;
+    }
+    edfOptions.haveStart = haveClock;
+    wfdbOptions.haveStart = haveClock;
+    wfdbOptions.clockMs = edfOptions.clockMs;
+    wfdbOptions.day = edfOptions.day;
+    wfdbOptions.month = edfOptions.month;
+    wfdbOptions.year = edfOptions.year;
+    if (!sbem::OutputFile::supports(csvOptions.output.compression))
+    {
+        fprintf(stderr, "This build has no zstd support, rebuild with libzstd installed\n");
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::string> files;
+    for (size_t i = 1; i < args.size(); i++)
+    {
+        for (const std::string& file : listSbemFiles(args[i]))
+            files.push_back(file);
+    }
+    if (files.empty())
+    {
+        printf("No SBEM files found\n");
+        return 0;
+    }
+
+    sbem::Stitcher stitcher;
+    std::string sensor;
+    for (const std::string& file : files)
+    {
+        std::string fileSensor;
+        uint32_t logId = sbem::Stitcher::NO_LOG_ID;
+        if (parseLogName(file, fileSensor, logId))
+        {
+            if (!sensor.empty() && fileSensor != sensor)
+            {
+                fprintf(stderr, "Logs of sensors %s and %s; stitch one sensor at a time\n", sensor.c_str(),
+                        fileSensor.c_str());
+                return 1;
+            }
+            sensor = fileSensor;
+            edfOptions.equipment = "Movesense_" + sensor;
+        }
+        if (!stitcher.add(file.c_str(), logId, options))
+        {
+            fprintf(stderr, "%s\n", stitcher.error().c_str());
+            return 2;
+        }
+    }
+
+    sbem::Recording recording;
+    sbem::StitchStats stats;
+    if (!stitcher.stitch(recording, minGap, stats))
+    {
+        fprintf(stderr, "%s\n", stitcher.error().c_str());
+        return 2;
+    }
+
+    const std::string outPath = args[0] + sbem::OutputFile::suffix(csvOptions.output.compression);
+    const std::string base = args[0].substr(0, args[0].find_last_of('.'));
+    const std::string gapPath = base + ".gaps.csv";
+    sbem::EdfStats edfStats;
+    sbem::WfdbStats wfdbStats;
+    const bool written = columnar ? sbem::ColumnarWriter::write(recording, outPath.c_str(), csvOptions.output)
+                         : edf    ? sbem::EdfWriter::write(recording, outPath.c_str(), edfOptions, edfStats)
+                         : wfdb   ? sbem::WfdbWriter::write(recording, base.c_str(), wfdbOptions, wfdbStats)
+                                  : sbem::CsvWriter::write(recording, outPath.c_str(), csvOptions);
+    if (!written || !writeGaps(recording.timelineGaps, gapPath))
+    {
+        fprintf(stderr, "Can't write %s\n", written ? gapPath.c_str() : outPath.c_str());
+        return 2;
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("%s: %zu logs (%zu fetched twice), %zu ECG, %zu IMU packets; %zu lead-off, %zu dropout gaps and %zu "
+           "restarts in %s (packets every %u/%u ms), %zu corrupt ranges skipped, %.1f ms\n",
+           outPath.c_str(), stats.logs, stats.duplicates, recording.ecg.packets(), recording.imu.packets(),
+           stats.leadOffs, stats.dropouts, stats.resets, gapPath.c_str(), stats.ecgPeriod, stats.imuPeriod,
+           stats.corrupt, seconds * 1e3);
+    if (edf)
+    {
+        printf("%s: %zu signals, %zu one second records (%zu without samples left out), %zu annotations\n",
+               outPath.c_str(), edfStats.signals, edfStats.records, edfStats.skipped, edfStats.annotations);
+    }
+    if (wfdb)
+    {
+        printf("%s: %llu samples (%llu missing), gain %g adu/mV, baseline %d\n", outPath.c_str(),
+               static_cast<unsigned long long>(wfdbStats.samples), static_cast<unsigned long long>(wfdbStats.missing),
+               wfdbStats.gain, wfdbStats.baseline);
+    }
+    return 0;
+}
@@ -0,0 +1,184 @@
+// sbemwindow: convert only a time window of SBEM logs, e.g. 14:00-14:30 of day 3
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "sbem/ChunkIndex.h"
+#include "sbem/ColumnarWriter.h"
+#include "sbem/CsvWriter.h"
+#include "sbem/Decoder.h"
+#include "sbem/MappedFile.h"
+#include "sbem/TimeWindow.h"
+
+#include "TimeSpec.h"
+#include "ToolUtil.h"
+
+static bool extractFile(const std::string& path, const std::string& outputDir, const TimeSpec& rFrom,
+                        const TimeSpec& rTo, uint64_t startClock, const sbem::DecodeOptions& rOptions,
+                        const sbem::CsvOptions& rCsvOptions, bool columnar)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    sbem::MappedFile file;
+    if (!file.open(path.c_str(), sbem::MappedFile::Access::RANDOM) || file.size() < sbem::HEADER_SIZE)
+    {
+        fprintf(stderr, "%s: not a readable SBEM file\n", path.c_str());
+        return false;
+    }
+
+    sbem::ChunkIndex index;
+    const bool reused = index.useSidecar(path.c_str(), file.data(), file.size());
+    uint32_t firstTimestamp;
+    if (!index.firstTimestamp(firstTimestamp))
+    {
+        fprintf(stderr, "%s: no ECG or IMU packets\n", path.c_str());
+        return false;
+    }
+
+    const uint64_t begin = resolve(rFrom, firstTimestamp, startClock);
+    const uint64_t end = resolve(rTo, firstTimestamp, startClock);
+    if (begin >= end || begin > UINT32_MAX)
+    {
+        fprintf(stderr, "%s: empty window %llu-%llu ms\n", path.c_str(), static_cast<unsigned long long>(begin),
+                static_cast<unsigned long long>(end));
+        return false;
+    }
+    const sbem::TimeWindow window = { static_cast<uint32_t>(begin),
+                                      static_cast<uint32_t>(end > UINT32_MAX ? UINT32_MAX : end) };
+
+    sbem::DecodeOptions options = rOptions;
+    options.pIndex = &index;
+    window.chunkRange(index, options.firstChunk, options.endChunk);
+
+    sbem::Recording recording;
+    if (!sbem::Decoder::decode(file.data(), file.size(), recording, options))
+    {
+        fprintf(stderr, "%s: not a readable SBEM file\n", path.c_str());
+        return false;
+    }
+    window.trim(recording);
+
+    const std::string outPath = outputDir + "/" + baseName(path) + "_" + std::to_string(window.begin) + "-" +
+                                std::to_string(window.end) + (columnar ? ".sbcol" : ".csv");
+    if (columnar && !sbem::ColumnarWriter::write(recording, outPath.c_str()))
+    {
+        fprintf(stderr, "%s: can't write %s\n", path.c_str(), outPath.c_str());
+        return false;
+    }
+    if (!columnar && !sbem::CsvWriter::write(recording, outPath.c_str(), rCsvOptions))
+    {
+        fprintf(stderr, "%s: nothing logged in %u-%u ms\n", path.c_str(), window.begin, window.end);
+        return false;
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("%s -> %s: %zu ECG, %zu IMU packets from chunks %zu-%zu of %zu (%s index), %.1f ms\n",
+           path.c_str(), outPath.c_str(), recording.ecg.packets(), recording.imu.packets(), options.firstChunk,
+           options.endChunk, index.size(), reused ? "cached" : "new", seconds * 1e3);
+    return true;
+}
+
+static void usage()
+{
+    fprintf(stderr,
+            "Usage: sbemwindow [options] --from <time> --to <time> <folder|file.sbem> [output_dir]\n"
+            "  <time> is a packet timestamp in ms (52000), a time after the first packet (+1:30:00)\n"
+            "         or a clock time (14:00, 14:30:15) when --start is given\n"
+            "  --start <hh:mm[:ss]> clock time of the first packet of each file\n"
+            "  -j <threads>        decode and format threads, 0 = all cores (default 1)\n"
+            "  --layout <l>        converter (default, same as converter.py) or samples (one row per sample)\n"
+            "  --columnar          write a memory-mappable .sbcol file instead of CSV\n");
+}
+
+int main(int argc, char** argv)
+{
+    sbem::DecodeOptions options;
+    sbem::CsvOptions csvOptions;
+    bool columnar = false;
+    TimeSpec from = { TimeSpec::SENSOR, 0 };
+    TimeSpec to = { TimeSpec::SENSOR, 0 };
+    bool haveFrom = false;
+    bool haveTo = false;
+    uint64_t startClock = 0;
+    bool haveStart = false;
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; i++)
+    {
+        const bool hasValue = i + 1 < argc;
+        bool valid = true;
+        if (strcmp(argv[i], "--from") == 0 && hasValue)
+        {
+            valid = haveFrom = parseTime(argv[++i], from);
+        }
+        else if (strcmp(argv[i], "--to") == 0 && hasValue)
+        {
+            valid = haveTo = parseTime(argv[++i], to);
+        }
+        else if (strcmp(argv[i], "--start") == 0 && hasValue)
+        {
+            valid = haveStart = parseClock(argv[++i], startClock);
+            startClock %= DAY_MS;
+        }
+        else if (strcmp(argv[i], "-j") == 0 && hasValue)
+        {
+            options.threads = static_cast<unsigned>(atoi(argv[++i]));
+            csvOptions.threads = options.threads;
+        }
+        else if (strcmp(argv[i], "--layout") == 0 && hasValue)
+        {
+            const std::string layout = argv[++i];
+            valid = layout == "converter" || layout == "samples";
+            csvOptions.layout = layout == "samples" ? sbem::CsvLayout::SAMPLES : sbem::CsvLayout::CONVERTER;
+        }
+        else if (strcmp(argv[i], "--columnar") == 0)
+        {
+            columnar = true;
+        }
+        else if (isOption(argv[i]))
+        {
+            usage();
+            return 1;
+        }
+        else
+        {
+            args.push_back(argv[i]);
+        }
+
+        if (!valid)
+        {
+            fprintf(stderr, "Invalid value for %s\n", argv[i - 1]);
+            return 1;
+        }
+    }
+
+    if (args.empty() || !haveFrom || !haveTo)
+    {
+        usage();
+        return 1;
+    }
+    if ((from.kind == TimeSpec::CLOCK || to.kind == TimeSpec::CLOCK) && !haveStart)
+    {
+        fprintf(stderr, "Clock times need --start, the clock time of the first packet\n");
+        return 1;
+    }
+
+    const std::string target = args[0];
+    const std::vector<std::string> files = listSbemFiles(target);
+    if (files.empty())
+    {
+        printf("No SBEM files found in folder: %s\n", target.c_str());
+        return 0;
+    }
+
+    int failures = 0;
+    for (const std::string& file : files)
+    {
+        const std::string outputDir = args.size() > 1 ? args[1] : (isDirectory(target) ? target : dirName(file));
+        if (!extractFile(file, outputDir, from, to, startClock, options, csvOptions, columnar))
+            failures++;
+    }
+    return failures ? 2 : 0;
+}